@@ -0,0 +1,81 @@
+#include "metric_record.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_SAMPLES 200000 // Muestras por medicion
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_sample(metrics_sample_t *sample, int i) {
+  size_t count;
+  const metric_field_t *fields = metric_fields(&count);
+  for (size_t f = 0; f < count; f++) {
+    double value = i * 1.5 + f;
+    memcpy((char *)sample + fields[f].offset, &value, sizeof(value));
+  }
+}
+
+static void report(const char *label, double elapsed, size_t bytes) {
+  printf("%-14s %8.1f ns/sample %6zu bytes/sample\n", label,
+         elapsed * 1e9 / BENCH_SAMPLES, bytes);
+}
+
+int main(void) {
+  metrics_sample_t sample;
+  metrics_sample_t decoded;
+  volatile double sink = 0;
+
+  // Binario: el registro de tamanio fijo que viaja por el ring
+  static metric_record_t records[BENCH_SAMPLES];
+  double start = now_seconds();
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    fill_sample(&sample, i);
+    metric_record_encode(&records[i], &sample, (uint64_t)i + 1);
+  }
+  report("binary encode", now_seconds() - start, sizeof(metric_record_t));
+
+  start = now_seconds();
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    if (metric_record_decode(&records[i], &decoded) == 0) {
+      sink += decoded.cpu_usage_percentage;
+    }
+  }
+  report("binary decode", now_seconds() - start, sizeof(metric_record_t));
+
+  // JSON: el formato anterior, ahora solo para depuracion
+  char **texts = malloc(BENCH_SAMPLES * sizeof(char *));
+  if (!texts) {
+    return EXIT_FAILURE;
+  }
+  size_t json_bytes = 0;
+  start = now_seconds();
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    fill_sample(&sample, i);
+    texts[i] = metric_sample_to_json(&sample);
+  }
+  double elapsed = now_seconds() - start;
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    json_bytes += texts[i] ? strlen(texts[i]) : 0;
+  }
+  report("json encode", elapsed, json_bytes / BENCH_SAMPLES);
+
+  start = now_seconds();
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    if (texts[i] && metric_sample_from_json(texts[i], &decoded) == 0) {
+      sink += decoded.cpu_usage_percentage;
+    }
+  }
+  report("json decode", now_seconds() - start, json_bytes / BENCH_SAMPLES);
+
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    free(texts[i]);
+  }
+  free(texts);
+  return sink < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,93 @@
+#include "metrics_archive.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SAMPLES 86400 // Un dia a una muestra por segundo
+#define BENCH_PATH "/tmp/bench_metrics_archive.bin"
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Valores parecidos a los del monitor: porcentajes con dos decimales,
+ * contadores que crecen y un timestamp con algo de jitter */
+static void fill_sample(metrics_sample_t *sample, int i) {
+  memset(sample, 0, sizeof(*sample));
+  sample->timestamp = 1700000000 + i + (rand() % 5) / 1000.0;
+  sample->cpu_usage_percentage = round((20 + 15 * sin(i / 600.0)) * 100) / 100;
+  sample->memory_usage_percentage = round((55 + (i % 300) / 100.0) * 100) / 100;
+  sample->disk_reads = 100000 + i * 12 + rand() % 4;
+  sample->disk_writes = 50000 + i * 7;
+  sample->disk_read_time_seconds = 10 + i * 0.002;
+  sample->disk_write_time_seconds = 5 + i * 0.001;
+  sample->network_bandwidth_rx = 1e9 + i * 15000.0 + rand() % 1000;
+  sample->network_bandwidth_tx = 2e8 + i * 3000.0;
+  sample->network_packet_ratio = 1.25;
+  sample->running_processes_count = 2 + rand() % 3;
+  sample->context_switches_total = 1e7 + i * 2500.0;
+}
+
+int main(void) {
+  unlink(BENCH_PATH);
+  metrics_archive_writer_t *writer = metrics_archive_create(BENCH_PATH);
+  if (!writer) {
+    perror(BENCH_PATH);
+    return EXIT_FAILURE;
+  }
+
+  metrics_sample_t sample;
+  double start = now_seconds();
+  for (int i = 0; i < BENCH_SAMPLES; i++) {
+    fill_sample(&sample, i);
+    metrics_archive_append(writer, &sample);
+  }
+  metrics_archive_close(writer);
+  double elapsed = now_seconds() - start;
+
+  metrics_archive_t archive;
+  if (metrics_archive_open(BENCH_PATH, &archive) == -1) {
+    perror(BENCH_PATH);
+    return EXIT_FAILURE;
+  }
+  printf("write          %8.1f ns/sample %6.1f bytes/sample (raw %zu)\n",
+         elapsed * 1e9 / BENCH_SAMPLES, (double)archive.size / BENCH_SAMPLES,
+         sizeof(metrics_sample_t));
+
+  // Todos los campos del dia: sale de los resumenes de los bloques
+  size_t count;
+  const metric_field_t *fields = metric_fields(&count);
+  metrics_aggregate_t aggregate;
+  start = now_seconds();
+  for (size_t f = 0; f < count; f++) {
+    metrics_archive_aggregate(&archive, &fields[f], -INFINITY, INFINITY,
+                              &aggregate);
+  }
+  printf("day aggregate  %8.3f ms for %zu fields\n",
+         (now_seconds() - start) * 1e3, count);
+
+  // Rango con bordes a mitad de bloque
+  const metric_field_t *cpu = metric_field_find("cpu_usage_percentage");
+  start = now_seconds();
+  metrics_archive_aggregate(&archive, cpu, 1700000000 + 3600.5,
+                            1700000000 + 7200.5, &aggregate);
+  printf("hour aggregate %8.3f ms, %zu blocks, %zu decompressed\n",
+         (now_seconds() - start) * 1e3, aggregate.blocks_scanned,
+         aggregate.blocks_decoded);
+
+  // Descompresion completa del dia
+  start = now_seconds();
+  long scanned =
+      metrics_archive_scan(&archive, -INFINITY, INFINITY, NULL, NULL);
+  printf("day full scan  %8.3f ms, %ld samples\n",
+         (now_seconds() - start) * 1e3, scanned);
+
+  metrics_archive_unmap(&archive);
+  unlink(BENCH_PATH);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include "searchconfig.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEPTH 3       // Niveles de subdirectorios
+#define BENCH_FANOUT 8      // Subdirectorios por directorio
+#define BENCH_FILES 40      // Archivos por directorio
+#define BENCH_CONFIG_EVERY 5 // Uno de cada N archivos es .config
+#define BENCH_RUNS 3        // Se reporta la mejor de N corridas
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Crea un arbol de BENCH_FANOUT^BENCH_DEPTH directorios con archivos */
+static int generate_tree(const char *path, int depth) {
+  char child[PATH_MAX];
+  for (int i = 0; i < BENCH_FILES; i++) {
+    const char *ext = (i % BENCH_CONFIG_EVERY == 0) ? ".config" : ".txt";
+    snprintf(child, sizeof(child), "%s/file%d%s", path, i, ext);
+    int fd = open(child, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+      perror("open");
+      return -1;
+    }
+    close(fd);
+  }
+  if (depth == 0) {
+    return 0;
+  }
+  for (int i = 0; i < BENCH_FANOUT; i++) {
+    snprintf(child, sizeof(child), "%s/dir%d", path, i);
+    if (mkdir(child, 0755) == -1) {
+      perror("mkdir");
+      return -1;
+    }
+    if (generate_tree(child, depth - 1) == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* El recorrido anterior: un stat() por entrada y un solo hilo */
+static size_t legacy_walk(const char *directory, const char *extension) {
+  DIR *dir = opendir(directory);
+  if (!dir) {
+    return 0;
+  }
+  size_t found = 0;
+  struct dirent *entry;
+  char path[PATH_MAX];
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+    struct stat statbuf;
+    if (stat(path, &statbuf) == -1) {
+      continue;
+    }
+    if (S_ISDIR(statbuf.st_mode)) {
+      found += legacy_walk(path, extension);
+    } else if (S_ISREG(statbuf.st_mode) &&
+               has_extension(entry->d_name, extension)) {
+      found++;
+    }
+  }
+  closedir(dir);
+  return found;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftwbuf) {
+  (void)sb;
+  (void)flag;
+  (void)ftwbuf;
+  return remove(path);
+}
+
+int main(int argc, char *argv[]) {
+  char root[] = "/tmp/bench_searchconfig.XXXXXX";
+  const char *directory = argc > 1 ? argv[1] : NULL;
+
+  if (!directory) {
+    if (!mkdtemp(root)) {
+      perror("mkdtemp");
+      return EXIT_FAILURE;
+    }
+    if (generate_tree(root, BENCH_DEPTH) == -1) {
+      nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+      return EXIT_FAILURE;
+    }
+    directory = root;
+  }
+
+  double best = 0;
+  size_t found = 0;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    double start = now_seconds();
+    found = legacy_walk(directory, ".config");
+    double elapsed = now_seconds() - start;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  printf("%-12s %8zu matches %10.3f ms\n", "legacy", found, best * 1e3);
+
+  static const int thread_counts[] = {1, 2, 4, 8};
+  for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]);
+       t++) {
+    for (int run = 0; run < BENCH_RUNS; run++) {
+      config_matches_t matches;
+      double start = now_seconds();
+      if (search_directory_parallel(directory, ".config", thread_counts[t],
+                                    &matches) == -1) {
+        break;
+      }
+      double elapsed = now_seconds() - start;
+      found = matches.count;
+      config_matches_free(&matches);
+      if (run == 0 || elapsed < best) {
+        best = elapsed;
+      }
+    }
+    char label[16];
+    snprintf(label, sizeof(label), "parallel-%d", thread_counts[t]);
+    printf("%-12s %8zu matches %10.3f ms\n", label, found, best * 1e3);
+  }
+
+  if (directory == root) {
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  }
+  return EXIT_SUCCESS;
+}
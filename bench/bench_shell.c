@@ -0,0 +1,427 @@
+#define _GNU_SOURCE
+#include "commands.h"
+#include "completion.h"
+#include "metrics_shm.h"
+#include "monitor_supervisor.h"
+#include "parse.h"
+#include "pathexp.h"
+#include "redirect.h"
+#include "shell.h"
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_RUNS 3               // Se reporta la mejor de N corridas
+#define BENCH_PARSE_OPS 200000     // Lineas por medicion del parser
+#define BENCH_DISPATCH_OPS 200000  // Built-ins por medicion
+#define BENCH_SPAWN_OPS 300        // Comandos externos por medicion
+#define BENCH_PIPELINE_OPS 100     // Pipelines por medicion
+#define BENCH_BATCH_LINES 5000     // Lineas del archivo batch
+#define BENCH_SEARCH_OPS 5         // Recorridos del arbol por medicion
+#define BENCH_STATUS_OPS 2000      // Consultas a status_monitor
+#define BENCH_TREE_DEPTH 2         // Niveles de subdirectorios
+#define BENCH_TREE_FANOUT 8        // Subdirectorios por directorio
+#define BENCH_TREE_FILES 40        // Archivos por directorio
+#define BENCH_COMPLETION_OPS 20000 // TABs por medicion
+#define BENCH_EXECUTABLES 10000    // Ejecutables en el PATH de la medicion
+#define BENCH_GLOB_OPS 5           // Expansiones por medicion
+#define BENCH_GLOB_FILES 100000    // Archivos que coinciden con el patron
+#define BENCH_LINE_SIZE 256
+
+static const char *parse_line =
+    "grep -n \"needle in\" < input.txt 2>&1 >> output.txt";
+static const char *pipe_line =
+    "cat input.txt | grep -v '#' | sort | uniq -c | sort -rn | head";
+static const int pipeline_stages[] = {2, 4, 8};
+
+static FILE *out; // El JSON; stdout va a /dev/null durante las mediciones
+static int results = 0;
+static const char *filter = NULL;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_json_string(const char *text) {
+  fputc('"', out);
+  for (; *text; text++) {
+    if (*text == '"' || *text == '\\') {
+      fputc('\\', out);
+    }
+    fputc(*text, out);
+  }
+  fputc('"', out);
+}
+
+static int selected(const char *name) {
+  return !filter || strstr(name, filter) != NULL;
+}
+
+/* Corre body BENCH_RUNS veces y agrega la mejor como un resultado */
+static void measure(const char *name, long ops, void (*body)(long, void *),
+                    void *data, const char *detail) {
+  double best = 0;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    double start = now_seconds();
+    body(ops, data);
+    double elapsed = now_seconds() - start;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  fflush(stdout);
+
+  fprintf(out, "%s\n    {\"name\": ", results++ ? "," : "");
+  write_json_string(name);
+  fprintf(out,
+          ", \"ops\": %ld, \"seconds\": %.6f, \"ns_per_op\": %.1f, "
+          "\"ops_per_sec\": %.1f",
+          ops, best, best * 1e9 / ops, best > 0 ? ops / best : 0);
+  if (detail) {
+    fprintf(out, ", \"detail\": ");
+    write_json_string(detail);
+  }
+  fprintf(out, "}");
+  fflush(out);
+  fprintf(stderr, "%-24s %12.1f ns/op\n", name, best * 1e9 / ops);
+}
+
+static void parse_body(long ops, void *data) {
+  (void)data;
+  char line[BENCH_LINE_SIZE];
+  for (long i = 0; i < ops; i++) {
+    strcpy(line, parse_line);
+    redir_t *redirs = NULL;
+    char **args = parse_command(line, &redirs);
+    free(args);
+    redir_free(redirs);
+  }
+}
+
+static void split_body(long ops, void *data) {
+  (void)data;
+  char line[BENCH_LINE_SIZE];
+  for (long i = 0; i < ops; i++) {
+    strcpy(line, pipe_line);
+    int count = 0;
+    char **commands = split_by_pipes(line, &count);
+    for (int c = 0; c < count; c++) {
+      free(commands[c]);
+    }
+    free(commands);
+  }
+}
+
+/* El despacho solo: la cadena de built-ins con los argumentos ya separados */
+static void dispatch_body(long ops, void *data) {
+  (void)data;
+  char *args[] = {"echo", "bench", NULL};
+  for (long i = 0; i < ops; i++) {
+    execute_internal_command(args, NULL, 0);
+  }
+}
+
+/* Una linea completa de la shell: separar, despachar y ejecutar */
+static void command_body(long ops, void *data) {
+  const char *command = data;
+  char line[BENCH_LINE_SIZE];
+  for (long i = 0; i < ops; i++) {
+    strcpy(line, command);
+    execute_command(line);
+  }
+}
+
+static void batch_body(long ops, void *data) {
+  (void)ops;
+  FILE *batch = fopen(data, "r");
+  if (!batch) {
+    perror("bench_shell: batch file");
+    exit(EXIT_FAILURE);
+  }
+  execute_batch_file(batch);
+  fclose(batch);
+}
+
+static void search_body(long ops, void *data) {
+  char *args[] = {"searchconfig", data, ".config", NULL};
+  for (long i = 0; i < ops; i++) {
+    cmd_searchconfig(args);
+  }
+}
+
+static void status_body(long ops, void *data) {
+  (void)data;
+  char *args[] = {"status_monitor", NULL};
+  for (long i = 0; i < ops; i++) {
+    cmd_status_monitor(args);
+  }
+}
+
+static void completion_body(long ops, void *data) {
+  const char *line = data;
+  for (long i = 0; i < ops; i++) {
+    char **matches = completion_matches(line, 0, strlen(line));
+    for (size_t m = 0; matches && matches[m]; m++) {
+      free(matches[m]);
+    }
+    free(matches);
+  }
+}
+
+/* TAB en posicion de comando con BENCH_EXECUTABLES ejecutables en PATH; el
+ * indice ya esta armado, como despues del primer TAB */
+static void bench_completion(const char *root) {
+  if (!selected("completion")) {
+    return;
+  }
+  char bin[PATH_MAX];
+  char path[PATH_MAX];
+  snprintf(bin, sizeof(bin), "%s/bin", root);
+  if (mkdir(bin, 0755) == -1) {
+    perror("bench_shell: completion");
+    return;
+  }
+  for (int i = 0; i < BENCH_EXECUTABLES; i++) {
+    snprintf(path, sizeof(path), "%s/cmd%05d", bin, i);
+    int fd = open(path, O_WRONLY | O_CREAT, 0755);
+    if (fd == -1) {
+      perror("bench_shell: completion");
+      return;
+    }
+    close(fd);
+  }
+  char *old_path = getenv("PATH") ? strdup(getenv("PATH")) : NULL;
+  setenv("PATH", bin, 1);
+  completion_body(1, "cmd0042"); // El primer TAB arma el indice
+
+  char detail[64];
+  snprintf(detail, sizeof(detail), "%d executables, 10 matches",
+           BENCH_EXECUTABLES);
+  measure("completion", BENCH_COMPLETION_OPS, completion_body, "cmd0042",
+          detail);
+  if (old_path) {
+    setenv("PATH", old_path, 1);
+    free(old_path);
+  }
+  completion_clear();
+}
+
+static void glob_body(long ops, void *data) {
+  for (long i = 0; i < ops; i++) {
+    char **matches;
+    long count = pathexp_expand("logs/*.gz", data, &matches);
+    for (long m = 0; m < count; m++) {
+      free(matches[m]);
+    }
+    free(matches);
+  }
+}
+
+/* El patron de un rm sobre BENCH_GLOB_FILES logs comprimidos, con otros
+ * archivos que no coinciden mezclados */
+static void bench_glob(const char *root) {
+  if (!selected("pathexp")) {
+    return;
+  }
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/logs", root);
+  if (mkdir(path, 0755) == -1) {
+    perror("bench_shell: pathexp");
+    return;
+  }
+  for (int i = 0; i < BENCH_GLOB_FILES + BENCH_GLOB_FILES / 10; i++) {
+    snprintf(path, sizeof(path), "%s/logs/app-%06d.%s", root, i,
+             i < BENCH_GLOB_FILES ? "log.gz" : "txt");
+    int fd = open(path, O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) {
+      perror("bench_shell: pathexp");
+      return;
+    }
+    close(fd);
+  }
+  char detail[64];
+  snprintf(detail, sizeof(detail), "logs/*.gz, %d of %d files",
+           BENCH_GLOB_FILES, BENCH_GLOB_FILES + BENCH_GLOB_FILES / 10);
+  measure("pathexp", BENCH_GLOB_OPS, glob_body, (void *)root, detail);
+}
+
+/* Crea un arbol de BENCH_TREE_FANOUT^BENCH_TREE_DEPTH directorios, con un
+ * .config de cada cinco archivos */
+static int generate_tree(const char *path, int depth) {
+  char child[PATH_MAX];
+  for (int i = 0; i < BENCH_TREE_FILES; i++) {
+    snprintf(child, sizeof(child), "%s/file%d%s", path, i,
+             i % 5 == 0 ? ".config" : ".txt");
+    FILE *file = fopen(child, "w");
+    if (!file) {
+      perror("bench_shell: tree");
+      return -1;
+    }
+    fprintf(file, "key%d = value\n", i);
+    fclose(file);
+  }
+  for (int i = 0; depth > 0 && i < BENCH_TREE_FANOUT; i++) {
+    snprintf(child, sizeof(child), "%s/dir%d", path, i);
+    if (mkdir(child, 0755) == -1 || generate_tree(child, depth - 1) == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int write_batch(const char *path) {
+  FILE *file = fopen(path, "w");
+  if (!file) {
+    return -1;
+  }
+  for (int i = 0; i < BENCH_BATCH_LINES; i++) {
+    // Comentarios y built-ins, algunos con redirecciones
+    switch (i % 4) {
+    case 0:
+      fprintf(file, "# line %d\n", i);
+      break;
+    case 1:
+      fprintf(file, "echo line %d\n", i);
+      break;
+    case 2:
+      fprintf(file, "echo \"quoted %d\" 2>&1 > /dev/null\n", i);
+      break;
+    default:
+      fprintf(file, "cd .\n");
+    }
+  }
+  return fclose(file);
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag,
+                        struct FTW *ftwbuf) {
+  (void)sb;
+  (void)flag;
+  (void)ftwbuf;
+  return remove(path);
+}
+
+/* Ida y vuelta de status_monitor: contra el monitor si arranca, si no contra
+ * un ring con una muestra publicada aca */
+static void bench_status_monitor(void) {
+  if (!selected("status_monitor")) {
+    return;
+  }
+  metrics_shm_t *ring = NULL;
+  const char *source = monitor_program();
+  if (monitor_start() == -1) {
+    ring = metrics_shm_create(METRICS_SHM_NAME);
+    if (!ring) {
+      perror("bench_shell: metrics ring");
+      return;
+    }
+    metrics_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.timestamp = time(NULL);
+    sample.cpu_usage_percentage = 12.5;
+    metrics_shm_publish(ring, &sample);
+    source = "ring published by bench_shell (no monitor)";
+  }
+  status_body(1, NULL); // El primer acceso mapea el ring
+  measure("status_monitor", BENCH_STATUS_OPS, status_body, NULL, source);
+  if (ring) {
+    metrics_shm_close(ring);
+  } else {
+    monitor_stop();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
+    fprintf(stderr, "Usage: %s [name filter] > results.json\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  filter = argc == 2 ? argv[1] : NULL;
+
+  char root[] = "/tmp/bench_shell.XXXXXX";
+  if (!mkdtemp(root)) {
+    perror("bench_shell: mkdtemp");
+    return EXIT_FAILURE;
+  }
+  char tree[PATH_MAX];
+  char batch[PATH_MAX];
+  snprintf(tree, sizeof(tree), "%s/tree", root);
+  snprintf(batch, sizeof(batch), "%s/batch.sh", root);
+  if (mkdir(tree, 0755) == -1 ||
+      generate_tree(tree, BENCH_TREE_DEPTH) == -1 ||
+      write_batch(batch) == -1) {
+    nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    return EXIT_FAILURE;
+  }
+
+  // Lo que imprimen los comandos medidos no debe mezclarse con el JSON
+  int json_fd = dup(STDOUT_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (json_fd == -1 || null_fd == -1 || !(out = fdopen(json_fd, "w"))) {
+    perror("bench_shell");
+    return EXIT_FAILURE;
+  }
+  fflush(stdout);
+  dup2(null_fd, STDOUT_FILENO);
+  close(null_fd);
+
+  fprintf(out, "{\n  \"benchmark\": \"bench_shell\",\n  \"runs\": %d,\n"
+               "  \"results\": [",
+          BENCH_RUNS);
+
+  if (selected("parse_command")) {
+    measure("parse_command", BENCH_PARSE_OPS, parse_body, NULL, parse_line);
+  }
+  if (selected("split_by_pipes")) {
+    measure("split_by_pipes", BENCH_PARSE_OPS, split_body, NULL, pipe_line);
+  }
+  if (selected("builtin_dispatch")) {
+    measure("builtin_dispatch", BENCH_DISPATCH_OPS, dispatch_body, NULL,
+            "echo bench");
+  }
+  if (selected("builtin_line")) {
+    measure("builtin_line", BENCH_DISPATCH_OPS, command_body, "echo bench",
+            "echo bench");
+  }
+  if (selected("spawn")) {
+    measure("spawn", BENCH_SPAWN_OPS, command_body, "true", "true");
+  }
+  for (size_t p = 0;
+       p < sizeof(pipeline_stages) / sizeof(pipeline_stages[0]); p++) {
+    char name[32];
+    char line[BENCH_LINE_SIZE] = "true";
+    snprintf(name, sizeof(name), "pipeline_%d", pipeline_stages[p]);
+    for (int stage = 1; stage < pipeline_stages[p]; stage++) {
+      strcat(line, " | true");
+    }
+    if (selected(name)) {
+      measure(name, BENCH_PIPELINE_OPS, command_body, line, line);
+    }
+  }
+  if (selected("batch_lines")) {
+    measure("batch_lines", BENCH_BATCH_LINES, batch_body, batch,
+            "comments, echo with redirections and cd");
+  }
+  if (selected("searchconfig")) {
+    char detail[64];
+    snprintf(detail, sizeof(detail), "%d^%d directories, %d files each",
+             BENCH_TREE_FANOUT, BENCH_TREE_DEPTH, BENCH_TREE_FILES);
+    measure("searchconfig", BENCH_SEARCH_OPS, search_body, tree, detail);
+  }
+  bench_completion(root);
+  bench_glob(root);
+  bench_status_monitor();
+
+  fprintf(out, "\n  ]\n}\n");
+  fclose(out);
+  nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  return EXIT_SUCCESS;
+}
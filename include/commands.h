@@ -1,6 +1,9 @@
 #ifndef COMMANDS_H
 #define COMMANDS_H
 
+#include "configindex.h"
+#include "redirect.h"
+#include "searchconfig.h"
 #include "shell.h"
 #include <stdio.h>
 
@@ -50,17 +53,22 @@ int cmd_help();
  * lifecycle.
  *
  * This function checks if a monitoring process is already running and, if so,
- * stops it before starting a new one.
+ * stops it before starting a new one. It then waits, for a bounded time, until
+ * the monitor reports it is ready; the shell restarts it if it crashes (see
+ * monitor_supervisor.h). With `--record file` it also starts a
+ * recorder process that appends every sample of the metrics ring to a
+ * compressed archive (see metrics_archive.h) until stop_monitor.
  *
+ * @param args The command arguments (args[0] is "start_monitor").
  * @return 1 to continue shell execution.
  */
-int cmd_start_monitor();
+int cmd_start_monitor(char **args);
 
 /**
  * @brief Stops the active monitoring process.
  *
- * This function reads the process ID of the monitoring process from a PID file
- * and sends a termination signal.
+ * The monitor gets SIGTERM and, if it does not exit in time, SIGKILL. A
+ * monitor started by another shell is found through its PID file.
  *
  * @return 1 to continue shell execution.
  */
@@ -72,50 +80,177 @@ int cmd_stop_monitor();
  *
  * This command can display various system metrics, such as CPU usage, memory
  * usage, disk statistics, and network statistics. Optionally, the user can
- * specify an option to filter the displayed metrics.
+ * specify an option to filter the displayed metrics. With `--watch [interval]`
+ * it keeps redrawing the newest sample from a timerfd/signalfd event loop
+ * until Ctrl-C, or until `--count N` samples were shown.
  *
- * @param option A string indicating the specific metric to display.
+ * @param args The command arguments (args[0] is "status_monitor").
  * @return 1 to continue shell execution.
  */
-int cmd_status_monitor(const char *option);
+int cmd_status_monitor(char **args);
+
+/**
+ * @brief Reads back a recording made with `start_monitor --record`.
+ *
+ * Prints the average, minimum and maximum of every field (or only of
+ * `-f field`) between `--from` and `--to`, or over the `--last` window before
+ * the newest sample. With `--json` it prints the samples instead.
+ *
+ * @param args The command arguments (args[0] is "replay_monitor").
+ * @return 1 to continue shell execution.
+ */
+int cmd_replay_monitor(char **args);
+
+/**
+ * @brief Shows or changes the monitor's configuration.
+ *
+ * `monitor_config set interval=500ms metrics=cpu,mem` updates the
+ * configuration file atomically and sends the new configuration to the
+ * running monitor over its control socket, which applies it without
+ * restarting (see monitor_config.h). Without arguments it shows the
+ * configuration the monitor is running with.
+ *
+ * @param args The command arguments (args[0] is "monitor_config").
+ * @return 1 to continue shell execution.
+ */
+int cmd_monitor_config(char **args);
+
+/**
+ * @brief Manages the threshold triggers (see triggers.h).
+ *
+ * `trigger add mem>90 for 30s -> command` registers a rule, `trigger list`
+ * shows them, `trigger del <id>` and `trigger clear` remove them. The line is
+ * taken unsplit, so the rule and the command need no quoting.
+ *
+ * @param line The whole command line, starting at "trigger".
+ * @return 1 to continue shell execution.
+ */
+int cmd_trigger(const char *line);
+
+/**
+ * @brief Lists the background jobs.
+ *
+ * `jobs -l` adds the PID and the resources each job used: wall time, user
+ * and system CPU, peak RSS, page faults and context switches (see
+ * print_jobs()).
+ *
+ * @param args The command arguments (args[0] is "jobs").
+ * @return 1 to continue shell execution.
+ */
+int cmd_jobs(char **args);
+
+/**
+ * @brief Runs a command line and reports the resources it used.
+ *
+ * The line may be a pipeline or a builtin. The report goes to stderr and
+ * covers the wall time, plus the usage wait4() returns for every foreground
+ * child and the shell's own usage while the line ran.
+ *
+ * @param line The whole command line, starting at "time".
+ * @return What executing the command returned.
+ */
+int cmd_time(const char *line);
+
+/**
+ * @brief Shows the shell's own metrics (see shell_stats.h).
+ *
+ * Without arguments it prints the parse, fork and spawn latency histograms
+ * and the counters. `--prometheus` prints them in the Prometheus text
+ * format, and `--listen <socket>` serves that text on a Unix socket, as
+ * SHELL_METRICS_SOCKET does at startup. `--close` stops serving.
+ *
+ * @param args The command arguments (args[0] is "shell_stats").
+ * @return 1 to continue shell execution.
+ */
+int cmd_shell_stats(char **args);
+
+/**
+ * @brief Shows the persistent history (see history_log.h).
+ *
+ * `history [N]` lists the newest N runs (20 by default) of every shell that
+ * shares the history file, oldest first. `history search <text> [N]` lists
+ * the newest N distinct commands containing text. Each line has the start
+ * time, duration, exit status, command and directory.
+ *
+ * @param args The command arguments (args[0] is "history").
+ * @return 1 to continue shell execution.
+ */
+int cmd_history(char **args);
+
+/**
+ * @brief Runs a deterministic command through a cache (see memo.h).
+ *
+ * `memo [-e VAR] [-i file] [-t file] [--] <command> [args]` keys the result
+ * on the arguments, the variables named with -e, the contents of the -i
+ * files and the size and mtime of the -t files. A hit replays the stored
+ * stdout, stderr and exit status without starting anything. `--stats` shows
+ * the cache size and this shell's hits, misses and evictions; `--clear`
+ * empties the cache.
+ *
+ * @param args The command arguments (args[0] is "memo").
+ * @return 1 to continue shell execution.
+ */
+int cmd_memo(char **args);
 
 int cmd_searchconfig(char **args);
 
+/**
+ * @brief A built-in command and the options it takes.
+ */
+typedef struct builtin {
+  const char *name;
+  const char *const *options; /**< NULL-terminated; NULL if it takes none */
+  int whole_line; /**< Gets the unsplit line from execute_command() */
+} builtin_t;
+
+/**
+ * @brief Every built-in, ending with an entry whose name is NULL. The
+ * dispatcher and tab completion both read it.
+ */
+extern const builtin_t builtins[];
+
+/**
+ * @brief Looks up a built-in.
+ *
+ * @param name The command name.
+ * @return Its entry in builtins, or NULL if it is not a built-in.
+ */
+const builtin_t *builtin_find(const char *name);
+
 /**
  * @brief Checks if a command is an internal command and executes it if
  * applicable.
  *
  * This function verifies if a given command is an internal command (such as
- * 'cd', 'echo', 'quit') and, if so, executes it. It handles input and output
- * redirection as well as background execution for these commands.
+ * 'cd', 'echo', 'quit') and, if so, executes it. Redirections are applied to
+ * the shell's own descriptors while the command runs and restored afterwards.
+ * It also handles background execution for these commands.
  *
  * @param args Array of arguments. args[0] is the command.
- * @param input_file File for input redirection (can be NULL).
- * @param output_file File for output redirection (can be NULL).
+ * @param redirs Ordered list of redirections (can be NULL).
  * @param background Flag indicating if the command should run in the
  * background.
  * @return 1 to continue shell execution, 0 to exit if 'quit' is executed, -1 if
  * the command is not internal.
  */
-int execute_internal_command(char **args, char *input_file, char *output_file,
-                             int background);
+int execute_internal_command(char **args, redir_t *redirs, int background);
 
 /**
  * @brief Executes an external command by forking a new process.
  *
- * This function handles input/output redirection and background execution for
- * external commands.
+ * This function handles redirections and background execution for external
+ * commands. Redirection files are opened in the parent before forking and
+ * only duplicated onto place in the child.
  *
  * @param args Array of arguments for the command.
  * @param background Flag indicating if the command should run in the
  * background.
  * @param command_copy A copy of the original command string.
- * @param input_file File for input redirection (can be NULL).
- * @param output_file File for output redirection (can be NULL).
+ * @param redirs Ordered list of redirections (can be NULL).
  * @return 1 to continue shell execution.
  */
 int execute_external_command(char **args, int background, char *command_copy,
-                             char *input_file, char *output_file);
+                             redir_t *redirs);
 
 /**
  * @brief Executes a single command.
@@ -140,8 +275,28 @@ int execute_single_command(char *command);
  */
 int execute_piped_commands(char **commands, int num_commands);
 
-void search_directory_recursive(const char *directory, const char *extension);
-int has_extension(const char *filename, const char *extension);
-void print_file_content(const char *filepath);
+/**
+ * @brief Starts every stage of a pipeline without waiting for them.
+ *
+ * Each stage is parsed in the parent, its redirections are opened and it is
+ * forked with its stdin and stdout connected to its neighbours. This is also
+ * how process substitutions run concurrently with the command that uses them.
+ *
+ * @param commands Array of command strings, one per stage.
+ * @param num_commands The number of stages.
+ * @param in_fd Descriptor for the first stage's stdin (STDIN_FILENO to
+ * inherit it). Owned by the function, closed in the parent.
+ * @param out_fd Descriptor for the last stage's stdout (STDOUT_FILENO to
+ * inherit it). Owned by the function, closed in the parent.
+ * @param pids Receives the process ID of every stage.
+ * @param stage_redirs If not NULL, receives each stage's redirection list so
+ * the caller can wait for its process substitutions; otherwise they are freed.
+ * @return The number of stages started. If a stage cannot be parsed, piped or
+ * forked, the error is printed, the stages before it are left running with
+ * their output pipe closed, and fewer than num_commands are returned.
+ */
+int spawn_pipeline(char **commands, int num_commands, int in_fd, int out_fd,
+                   pid_t *pids, redir_t **stage_redirs);
+
 
 #endif // COMMANDS_H
@@ -0,0 +1,41 @@
+#ifndef COMPLETION_H
+#define COMPLETION_H
+
+/**
+ * @brief Directory listings kept for file name completion.
+ */
+#define COMPLETION_DIR_CACHE 16
+
+/**
+ * @brief Completes the word that spans [start, end) of line.
+ *
+ * In command position (the first word of the line or of a pipeline stage, or
+ * the word after `time`) the candidates are the built-ins and the
+ * executables in PATH. The executables come from an index of every PATH
+ * directory, built on the first completion; each later completion only
+ * stat()s the directories and lists again the ones whose mtime changed, so
+ * an answer costs a binary search over the sorted names. After a built-in,
+ * words starting with '-' complete from its options (see builtin_t), and the
+ * first argument also from its subcommands. Anything else completes as a
+ * file name, from cached listings of the directories that are also checked
+ * against their mtime. Directories end with '/'.
+ *
+ * @param line The line being edited.
+ * @param start Where the word starts.
+ * @param end Where it ends (the cursor).
+ * @return A sorted, NULL-terminated array of malloc()ed matches, or NULL if
+ * there are none. The caller frees the strings and the array.
+ */
+char **completion_matches(const char *line, int start, int end);
+
+/**
+ * @brief Makes readline's TAB use completion_matches().
+ */
+void completion_install(void);
+
+/**
+ * @brief Frees the executable index and the cached listings.
+ */
+void completion_clear(void);
+
+#endif // COMPLETION_H
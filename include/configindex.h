@@ -0,0 +1,50 @@
+#ifndef CONFIGINDEX_H
+#define CONFIGINDEX_H
+
+#include "searchconfig.h"
+
+/**
+ * @brief Maximum number of roots watched with inotify at the same time.
+ *
+ * Queries on further roots still use the index, validated with directory
+ * mtimes instead of events.
+ */
+#define CONFIG_INDEX_MAX_ROOTS 16
+
+/**
+ * @brief Maximum number of changed directories remembered between queries.
+ *
+ * Past this, the next query validates every directory by its mtime.
+ */
+#define CONFIG_INDEX_MAX_DIRTY 256
+
+/**
+ * @brief Answers a searchconfig query from the persistent index.
+ *
+ * The index records path, extension, size and mtime of every regular file
+ * under a root. It is stored in a memory-mapped file under
+ * `$XDG_CACHE_HOME/shell-searchconfig` (or `~/.cache`), one per canonical root
+ * directory. Before answering, the index is brought up to date:
+ * - while the shell runs, an inotify watch on every indexed directory tells
+ *   exactly which directories changed since the last query;
+ * - otherwise (first query in this shell, lost events, watch limit reached),
+ *   each directory's mtime is compared with the one recorded.
+ * Only the directories found changed are read again; if nothing changed the
+ * mapped file is queried as is. A changed index is rewritten atomically.
+ *
+ * Changing a file's content does not change its directory's mtime, so sizes
+ * and mtimes may be stale until the next event-driven refresh or rebuild; the
+ * list of files is always current.
+ *
+ * @param directory Root of the search, as typed by the user (used to build the
+ * reported paths).
+ * @param extension Extension to match, including the dot.
+ * @param rebuild Non-zero to discard the stored index and walk the tree again.
+ * @param matches Receives the results sorted by path; release with
+ * config_matches_free().
+ * @return 0 on success, -1 on error (already reported).
+ */
+int config_index_query(const char *directory, const char *extension,
+                       int rebuild, config_matches_t *matches);
+
+#endif // CONFIGINDEX_H
@@ -0,0 +1,57 @@
+#ifndef HEREDOC_H
+#define HEREDOC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Largest payload written straight into a pipe.
+ *
+ * Up to PIPE_BUF bytes always fit in a fresh pipe, so the parent can write the
+ * whole document before forking without blocking. Anything larger goes into
+ * an anonymous memfd.
+ */
+#define HEREDOC_PIPE_MAX 4096
+
+/**
+ * @brief Reads the bodies of every here-document opened on a command line.
+ *
+ * Scans @p line for `<<DELIM` and `<<-DELIM` operators (here-strings `<<<`
+ * are ignored) and, for each one in order, reads lines from @p input_stream
+ * until the delimiter. When reading from stdin a continuation prompt is shown
+ * through readline. The collected bodies are queued and handed out by
+ * heredoc_next_body() while the line is parsed. Like sh, a body cut short by
+ * EOF is kept with a warning.
+ *
+ * @param line The command line just read.
+ * @param input_stream The stream the line came from (stdin or a batch file).
+ * @return 0 on success, -1 if an operator has no delimiter.
+ */
+int heredoc_collect(const char *line, FILE *input_stream);
+
+/**
+ * @brief Pops the next queued here-document body.
+ *
+ * @return The body (caller frees), or NULL if no body is queued.
+ */
+char *heredoc_next_body(void);
+
+/**
+ * @brief Drops any here-document bodies that were not consumed.
+ */
+void heredoc_discard(void);
+
+/**
+ * @brief Materializes inline data as a readable file descriptor.
+ *
+ * Small payloads are written into a pipe, larger ones into a memfd that is
+ * rewound to the start. The descriptor is close-on-exec; dup2() onto stdin
+ * clears the flag for the child.
+ *
+ * @param data The content to expose.
+ * @param length Number of bytes in @p data.
+ * @return A readable descriptor, or -1 on error.
+ */
+int heredoc_open(const char *data, size_t length);
+
+#endif // HEREDOC_H
@@ -0,0 +1,116 @@
+#ifndef HISTORY_LOG_H
+#define HISTORY_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @brief Environment variable with the history file. Without it the history
+ * is kept in ~/.shell_history; set to an empty string, nothing is kept.
+ */
+#define HISTORY_FILE_ENV "SHELL_HISTORY"
+
+/**
+ * @brief Environment variable with the size the history file is compacted
+ * at, in bytes.
+ */
+#define HISTORY_MAX_BYTES_ENV "SHELL_HISTORY_MAX_BYTES"
+
+/**
+ * @brief Compaction size when HISTORY_MAX_BYTES_ENV is not set (64 MiB,
+ * about half a million commands). Compaction keeps the newest half.
+ */
+#define HISTORY_DEFAULT_MAX_BYTES (64ULL << 20)
+
+/**
+ * @brief One command of the history, with what is known about its run.
+ * The strings point into the mapped file and are valid until the next call
+ * to a history_log function.
+ */
+typedef struct history_entry {
+  const char *command;  /**< The line as typed */
+  const char *cwd;      /**< Directory it was typed in */
+  int status;           /**< Its exit status, like `$?` */
+  int64_t start_ns;     /**< When it started (CLOCK_REALTIME, ns) */
+  uint64_t duration_ns; /**< How long it ran */
+  pid_t pid;            /**< The shell that ran it */
+} history_entry_t;
+
+/**
+ * @brief Where the history is kept.
+ *
+ * @return The path from HISTORY_FILE_ENV or ~/.shell_history, or NULL if the
+ * history is off.
+ */
+const char *history_log_default_path(void);
+
+/**
+ * @brief Opens (creating it if needed) a history file and maps it.
+ *
+ * The file is an append-only log of records, shared by every shell that
+ * opens it. Writers serialize with flock(); readers need no lock, since a
+ * record is only read once its trailer is in place. A shell sees what other
+ * shells appended on its next call.
+ *
+ * @param path The file.
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int history_log_open(const char *path);
+
+/**
+ * @brief Unmaps and closes the history, and frees its index.
+ */
+void history_log_close(void);
+
+/**
+ * @brief Appends a finished command.
+ *
+ * When the file grows past its size limit, the writer that crossed it
+ * rewrites the newest half to a new file and renames it over the old one;
+ * other shells notice the new file and reopen it.
+ *
+ * @param command The line.
+ * @param cwd Where it was typed.
+ * @param status Its exit status.
+ * @param start_ns When it started (CLOCK_REALTIME, ns).
+ * @param duration_ns How long it ran.
+ * @return 0 on success, -1 on error.
+ */
+int history_log_append(const char *command, const char *cwd, int status,
+                       int64_t start_ns, uint64_t duration_ns);
+
+/**
+ * @brief Finds the commands containing text, newest first.
+ *
+ * Each distinct command is reported once, with its newest run. Queries of
+ * three or more bytes are answered from a trigram index over the distinct
+ * commands, which is built on the first search and extended with each new
+ * record, so the cost follows the number of candidates rather than the size
+ * of the history.
+ *
+ * @param text What to look for (case-sensitive); empty matches everything.
+ * @param matches Where to store the matches.
+ * @param max Room in matches.
+ * @return Number of matches stored.
+ */
+size_t history_log_search(const char *text, history_entry_t *matches,
+                          size_t max);
+
+/**
+ * @brief The newest runs, newest first, repeats included.
+ *
+ * @param entries Where to store them.
+ * @param max Room in entries.
+ * @return Number of entries stored.
+ */
+size_t history_log_recent(history_entry_t *entries, size_t max);
+
+/**
+ * @brief Number of records in the history.
+ *
+ * @return The count.
+ */
+size_t history_log_count(void);
+
+#endif // HISTORY_LOG_H
@@ -0,0 +1,86 @@
+#ifndef JOB_USAGE_H
+#define JOB_USAGE_H
+
+#include "proc_file.h"
+#include <stdio.h>
+#include <sys/resource.h>
+
+/**
+ * @brief Resources used by a job.
+ */
+typedef struct job_usage {
+  double wall;               /**< Elapsed time (s) */
+  double user;               /**< CPU time in user mode (s) */
+  double sys;                /**< CPU time in the kernel (s) */
+  long max_rss;              /**< Peak resident set (KiB), 0 if unknown */
+  long minor_faults;         /**< Page faults served without I/O */
+  long major_faults;         /**< Page faults that needed I/O */
+  long voluntary_switches;   /**< Context switches while waiting */
+  long involuntary_switches; /**< Context switches by preemption */
+} job_usage_t;
+
+/**
+ * @brief Adds what wait4() reported for a reaped child.
+ *
+ * Times, faults and switches are added up; the peak RSS is the largest one,
+ * since the children of a pipeline run at the same time.
+ *
+ * @param usage The totals.
+ * @param rusage The child's usage.
+ */
+void job_usage_add_rusage(job_usage_t *usage, const struct rusage *rusage);
+
+/**
+ * @brief Adds the difference between two getrusage() readings.
+ *
+ * Used for the work a builtin does inside the shell itself. The peak RSS is
+ * not touched: the shell's own peak says nothing about the command.
+ *
+ * @param usage The totals.
+ * @param before The earlier reading.
+ * @param after The later reading.
+ */
+void job_usage_add_delta(job_usage_t *usage, const struct rusage *before,
+                         const struct rusage *after);
+
+/**
+ * @brief Adds one set of totals to another.
+ *
+ * @param usage The totals.
+ * @param other The totals to add (its wall time is ignored).
+ */
+void job_usage_add(job_usage_t *usage, const job_usage_t *other);
+
+/**
+ * @brief Reads the usage of a live process from its /proc files.
+ *
+ * CPU time and faults come from /proc/<pid>/stat, peak RSS and context
+ * switches from /proc/<pid>/status. Both files are kept open by the caller
+ * and re-read with pread(); status is scanned only until the three fields
+ * are found. The wall time is left as it was.
+ *
+ * @param stat /proc/<pid>/stat, opened with proc_file_open().
+ * @param status /proc/<pid>/status, or a closed handle to skip it.
+ * @param usage Receives the figures.
+ * @return 0 on success, -1 if stat cannot be read (the process was reaped).
+ */
+int job_usage_sample(proc_file_t *stat, proc_file_t *status,
+                     job_usage_t *usage);
+
+/**
+ * @brief Prints the usage on a single line, as used by 'jobs -l'.
+ *
+ * @param stream Where to print.
+ * @param usage The usage.
+ */
+void job_usage_print_short(FILE *stream, const job_usage_t *usage);
+
+/**
+ * @brief Prints the usage as the report of the 'time' builtin.
+ *
+ * @param stream Where to print.
+ * @param usage The usage.
+ */
+void job_usage_print(FILE *stream, const job_usage_t *usage);
+
+#endif // JOB_USAGE_H
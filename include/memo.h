@@ -0,0 +1,75 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Environment variable with the cache directory. Without it the cache
+ * lives in $XDG_CACHE_HOME/shell/memo, or ~/.cache/shell/memo.
+ */
+#define MEMO_DIR_ENV "SHELL_MEMO_DIR"
+
+/**
+ * @brief Environment variable with the largest size of the cache in bytes.
+ */
+#define MEMO_MAX_BYTES_ENV "SHELL_MEMO_MAX_BYTES"
+
+/**
+ * @brief Size of the cache when MEMO_MAX_BYTES_ENV is not set (256 MiB).
+ */
+#define MEMO_DEFAULT_MAX_BYTES (256ULL << 20)
+
+/**
+ * @brief What a memoized command depends on. Every list is NULL-terminated
+ * and may be NULL.
+ */
+typedef struct memo_spec {
+  char **args;   /**< The command and its arguments */
+  char **env;    /**< Names of the environment variables it reads */
+  char **inputs; /**< Files it reads, keyed by their contents */
+  char **stamps; /**< Files it reads, keyed by size and mtime only */
+} memo_spec_t;
+
+/**
+ * @brief Runs a command through the cache.
+ *
+ * The key hashes the working directory, the arguments, the program found in
+ * PATH (with its size and mtime, so an upgrade is a miss), the named
+ * variables and the input files. On a hit the stored stdout, stderr and exit
+ * status are replayed and nothing is started. On a miss the command runs
+ * with its output passed through as it comes and, if it exited normally,
+ * the result is stored. Hits refresh the entry's mtime, and the least
+ * recently used entries are evicted once the cache grows past its limit.
+ *
+ * @param spec The command and its inputs.
+ * @param status The command's exit status, like `$?`.
+ * @return 1 on a hit, 0 on a miss, -1 on error (an input cannot be read or
+ * the command cannot be started).
+ */
+int memo_run(const memo_spec_t *spec, int *status);
+
+/**
+ * @brief The cache directory in use.
+ *
+ * @return The path, or NULL if none can be found.
+ */
+const char *memo_dir(void);
+
+/**
+ * @brief Adds up the cache on disk.
+ *
+ * @param entries Number of stored results.
+ * @param bytes Their total size.
+ * @return 0 on success, -1 if the cache cannot be read.
+ */
+int memo_usage(size_t *entries, uint64_t *bytes);
+
+/**
+ * @brief Deletes every stored result.
+ *
+ * @return Number of entries deleted, or -1 on error.
+ */
+int memo_clear(void);
+
+#endif // MEMO_H
@@ -0,0 +1,144 @@
+#ifndef METRIC_RECORD_H
+#define METRIC_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Version of the binary record layout.
+ */
+#define METRIC_RECORD_VERSION 1
+
+/**
+ * @brief Alignment (and size granularity) of a binary record.
+ */
+#define METRIC_RECORD_ALIGN 64
+
+/**
+ * @brief One sample of system metrics.
+ *
+ * Field names follow the keys of the monitor's JSON output. Every field is a
+ * double so the sample can be copied as 8-byte words.
+ */
+typedef struct metrics_sample {
+  double timestamp;               /**< CLOCK_REALTIME, in seconds */
+  double cpu_usage_percentage;    /**< CPU usage (%) */
+  double memory_usage_percentage; /**< Memory usage (%) */
+  double disk_reads;              /**< Completed disk reads */
+  double disk_writes;             /**< Completed disk writes */
+  double disk_read_time_seconds;  /**< Time spent reading (s) */
+  double disk_write_time_seconds; /**< Time spent writing (s) */
+  double network_bandwidth_rx;    /**< Received bytes */
+  double network_bandwidth_tx;    /**< Transmitted bytes */
+  double network_packet_ratio;    /**< Received/transmitted packets */
+  double running_processes_count; /**< Running processes */
+  double context_switches_total;  /**< Context switches since boot */
+} metrics_sample_t;
+
+/**
+ * @brief Fixed-layout binary form of a sample, the wire format between the
+ * monitor and the shell.
+ *
+ * The header identifies the layout: a reader rejects records whose version or
+ * schema hash (field names and offsets) differ from its own, instead of
+ * misreading them.
+ */
+typedef struct metric_record {
+  uint32_t version;        /**< METRIC_RECORD_VERSION */
+  uint32_t schema_hash;    /**< metric_schema_hash() of the writer */
+  uint64_t sequence;       /**< Sample number assigned by the writer */
+  metrics_sample_t sample; /**< The values */
+} __attribute__((aligned(METRIC_RECORD_ALIGN))) metric_record_t;
+
+/**
+ * @brief Describes one field of a sample.
+ */
+typedef struct metric_field {
+  const char *name; /**< JSON key */
+  size_t offset;    /**< Offset inside metrics_sample_t */
+} metric_field_t;
+
+/**
+ * @brief Lists the fields of a sample in layout order.
+ *
+ * @param count Receives the number of fields.
+ * @return The field table.
+ */
+const metric_field_t *metric_fields(size_t *count);
+
+/**
+ * @brief Looks up a field by its JSON key.
+ *
+ * @param name The key (e.g. "cpu_usage_percentage").
+ * @return The field, or NULL if there is none with that name.
+ */
+const metric_field_t *metric_field_find(const char *name);
+
+/**
+ * @brief Looks up a metric by its JSON key or a short alias.
+ *
+ * The aliases are `cpu`, `mem` (or `memory`) and `procs`. The timestamp is not
+ * a metric and is never returned.
+ *
+ * @param name The key or alias.
+ * @return The field, or NULL if there is no such metric.
+ */
+const metric_field_t *metric_field_resolve(const char *name);
+
+/**
+ * @brief Reads a field of a sample.
+ *
+ * @param sample The sample.
+ * @param field A field from metric_fields().
+ * @return The value.
+ */
+double metric_field_value(const metrics_sample_t *sample,
+                          const metric_field_t *field);
+
+/**
+ * @brief Hash of the field names and offsets of this build.
+ *
+ * @return The schema hash stored in every record.
+ */
+uint32_t metric_schema_hash(void);
+
+/**
+ * @brief Fills a binary record.
+ *
+ * @param record The record to fill.
+ * @param sample The values.
+ * @param sequence Sample number.
+ */
+void metric_record_encode(metric_record_t *record,
+                          const metrics_sample_t *sample, uint64_t sequence);
+
+/**
+ * @brief Extracts the sample of a binary record.
+ *
+ * @param record The record.
+ * @param sample Receives the values.
+ * @return 0 on success, -1 if the version or schema does not match.
+ */
+int metric_record_decode(const metric_record_t *record,
+                         metrics_sample_t *sample);
+
+/**
+ * @brief Formats a sample as JSON, for humans and debugging.
+ *
+ * @param sample The sample.
+ * @return A string the caller frees with free(), or NULL on error.
+ */
+char *metric_sample_to_json(const metrics_sample_t *sample);
+
+/**
+ * @brief Parses a JSON object with the monitor's keys.
+ *
+ * Missing keys are left at 0.
+ *
+ * @param json The text of one JSON object.
+ * @param sample Receives the values.
+ * @return 0 on success, -1 if the text is not a JSON object.
+ */
+int metric_sample_from_json(const char *json, metrics_sample_t *sample);
+
+#endif // METRIC_RECORD_H
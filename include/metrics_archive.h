@@ -0,0 +1,162 @@
+#ifndef METRICS_ARCHIVE_H
+#define METRICS_ARCHIVE_H
+
+#include "metric_record.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Most samples stored in one compressed block.
+ */
+#define METRICS_ARCHIVE_BLOCK_SAMPLES 1024
+
+/**
+ * @brief A block is written once its samples span this many seconds, so a
+ * crash loses at most this much data.
+ */
+#define METRICS_ARCHIVE_FLUSH_SECONDS 60
+
+/**
+ * @brief An archive opened for appending.
+ */
+typedef struct metrics_archive_writer metrics_archive_writer_t;
+
+/**
+ * @brief A read-only, memory-mapped archive.
+ */
+typedef struct metrics_archive {
+  const unsigned char *data; /**< The mapping */
+  size_t size;               /**< Bytes of valid blocks, header included */
+  size_t mapped;             /**< Bytes mapped */
+} metrics_archive_t;
+
+/**
+ * @brief Aggregates of one field over a time range.
+ */
+typedef struct metrics_aggregate {
+  size_t count;          /**< Samples in the range */
+  double min;            /**< Smallest value */
+  double max;            /**< Largest value */
+  double sum;            /**< Sum of the values */
+  double first;          /**< Timestamp of the oldest sample */
+  double last;           /**< Timestamp of the newest sample */
+  size_t blocks_scanned; /**< Blocks overlapping the range */
+  size_t blocks_decoded; /**< Of those, blocks that had to be decompressed */
+} metrics_aggregate_t;
+
+/**
+ * @brief Called for every sample of a scan.
+ *
+ * @param sample The sample.
+ * @param data The pointer given to metrics_archive_scan().
+ * @return 0 to go on, non-zero to stop the scan.
+ */
+typedef int (*metrics_archive_visit_t)(const metrics_sample_t *sample,
+                                       void *data);
+
+/**
+ * @brief Opens an archive for appending, creating it if needed.
+ *
+ * The file is columnar: samples are grouped in blocks, and inside a block each
+ * field is compressed on its own. Timestamps are kept to the millisecond and
+ * stored as delta-of-deltas; the other fields are stored as the XOR of each
+ * value with the previous one, which takes one bit for a repeated value. Each
+ * block header also carries the count, min, max and sum of every field.
+ *
+ * A block left half-written by a crash is cut off before appending.
+ *
+ * @param path The file.
+ * @return The writer, or NULL on error (errno is set; EPROTO if the file is
+ * not an archive of this sample layout).
+ */
+metrics_archive_writer_t *metrics_archive_create(const char *path);
+
+/**
+ * @brief Adds a sample.
+ *
+ * Samples are buffered and written as a block when the block is full or spans
+ * METRICS_ARCHIVE_FLUSH_SECONDS.
+ *
+ * @param writer The writer.
+ * @param sample The sample. Timestamps are expected in increasing order.
+ * @return 0 on success, -1 if writing a block failed.
+ */
+int metrics_archive_append(metrics_archive_writer_t *writer,
+                           const metrics_sample_t *sample);
+
+/**
+ * @brief Writes the buffered samples as a block.
+ *
+ * @param writer The writer.
+ * @return 0 on success, -1 on error.
+ */
+int metrics_archive_flush(metrics_archive_writer_t *writer);
+
+/**
+ * @brief Flushes and closes an archive.
+ *
+ * @param writer The writer (can be NULL).
+ * @return 0 on success, -1 if the last flush failed.
+ */
+int metrics_archive_close(metrics_archive_writer_t *writer);
+
+/**
+ * @brief Maps an archive for reading.
+ *
+ * @param path The file.
+ * @param archive Receives the mapping.
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int metrics_archive_open(const char *path, metrics_archive_t *archive);
+
+/**
+ * @brief Unmaps an archive.
+ *
+ * @param archive The archive.
+ */
+void metrics_archive_unmap(metrics_archive_t *archive);
+
+/**
+ * @brief Aggregates a field over a time range.
+ *
+ * Blocks entirely inside the range are answered from their header; only the
+ * blocks cut by the range edges are decompressed, and of those only the
+ * timestamp column and the requested one.
+ *
+ * @param archive The archive.
+ * @param field The field (from metric_field_find()).
+ * @param from Start of the range, inclusive (seconds since the epoch).
+ * @param to End of the range, inclusive.
+ * @param aggregate Receives the result.
+ * @return 0 on success, -1 if the archive is corrupt.
+ */
+int metrics_archive_aggregate(const metrics_archive_t *archive,
+                              const metric_field_t *field, double from,
+                              double to, metrics_aggregate_t *aggregate);
+
+/**
+ * @brief Visits the samples of a time range, oldest first.
+ *
+ * @param archive The archive.
+ * @param from Start of the range, inclusive.
+ * @param to End of the range, inclusive.
+ * @param visit Called for each sample (NULL to only count them).
+ * @param data Passed to visit.
+ * @return The number of samples visited, or -1 if the archive is corrupt.
+ */
+long metrics_archive_scan(const metrics_archive_t *archive, double from,
+                          double to, metrics_archive_visit_t visit,
+                          void *data);
+
+/**
+ * @brief Time span covered by an archive.
+ *
+ * @param archive The archive.
+ * @param first Receives the oldest timestamp.
+ * @param last Receives the newest timestamp.
+ * @return 0 on success, -1 if the archive has no samples.
+ */
+int metrics_archive_span(const metrics_archive_t *archive, double *first,
+                         double *last);
+
+#endif // METRICS_ARCHIVE_H
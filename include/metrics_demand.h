@@ -0,0 +1,74 @@
+#ifndef METRICS_DEMAND_H
+#define METRICS_DEMAND_H
+
+/**
+ * @brief Name of the shared-memory object where readers announce they want
+ * samples.
+ *
+ * It is created with mode 0600, and an object owned by another user is
+ * ignored, so readers must run as the same user as the monitor.
+ */
+#define METRICS_DEMAND_NAME "/shell_monitor_demand"
+
+/**
+ * @brief How long one announcement keeps the collector at full rate (s).
+ */
+#define METRICS_DEMAND_LEASE_SECONDS 5.0
+
+/**
+ * @brief Longest idle interval, as a multiple of the configured one.
+ */
+#define METRICS_IDLE_MAX_FACTOR 16
+
+/**
+ * @brief Decides when the collector samples.
+ */
+typedef struct metrics_pacer {
+  double last_sample;   /**< When the last sample was taken (s), 0 if none */
+  double idle_interval; /**< Current interval while nobody reads (s) */
+} metrics_pacer_t;
+
+/**
+ * @brief Announces that this process reads samples.
+ *
+ * Extends the lease shared with the collector to at least `seconds` from
+ * now. After the first call it is a single atomic update in shared memory,
+ * cheap enough for every tick of a watcher.
+ *
+ * @param seconds How long samples are wanted at full rate.
+ */
+void metrics_demand_touch(double seconds);
+
+/**
+ * @brief Tells whether some reader holds a lease.
+ *
+ * @return 1 if samples are wanted at full rate, 0 otherwise.
+ */
+int metrics_demand_active(void);
+
+/**
+ * @brief Initializes a pacer.
+ *
+ * @param pacer The pacer.
+ */
+void metrics_pacer_init(metrics_pacer_t *pacer);
+
+/**
+ * @brief Tells the collector whether to sample on this tick.
+ *
+ * The collector wakes up every base_interval; checking costs one load from
+ * shared memory, so a new reader gets full rate within one base interval.
+ * While a reader holds a lease every tick samples. Without one, the interval
+ * between samples doubles after each sample, up to
+ * METRICS_IDLE_MAX_FACTOR times base_interval.
+ *
+ * @param pacer The pacer.
+ * @param now Current time (s, CLOCK_MONOTONIC).
+ * @param base_interval The configured interval (s).
+ * @param demanded metrics_demand_active().
+ * @return 1 if the collector should read /proc and publish now, 0 to skip.
+ */
+int metrics_pacer_due(metrics_pacer_t *pacer, double now,
+                      double base_interval, int demanded);
+
+#endif // METRICS_DEMAND_H
@@ -0,0 +1,93 @@
+#ifndef METRICS_HISTORY_H
+#define METRICS_HISTORY_H
+
+#include "metric_record.h"
+#include <stddef.h>
+
+/**
+ * @brief Centroids kept by the quantile sketch of each bucket.
+ */
+#define METRICS_SKETCH_CENTROIDS 8
+
+/**
+ * @brief Most quantiles a single query can ask for.
+ */
+#define METRICS_HISTORY_MAX_QUANTILES 8
+
+/**
+ * @brief Aggregates of one metric over a time window.
+ */
+typedef struct metrics_summary {
+  size_t count;      /**< Samples in the window */
+  double min;        /**< Smallest value */
+  double max;        /**< Largest value */
+  double avg;        /**< Mean value */
+  double resolution; /**< Bucket width the answer was computed from (s) */
+} metrics_summary_t;
+
+/**
+ * @brief Adds one sample to the history.
+ *
+ * Every tracked metric goes into the current bucket of each resolution
+ * (1 s for the last 10 minutes, 10 s for the last hour, 1 min for the last
+ * day), so downsampling costs nothing at query time. Cumulative counters
+ * (disk operations, network bytes, context switches) are stored as rates per
+ * second. Memory is fixed and allocated on the first sample.
+ *
+ * @param sample The sample, with its own timestamp.
+ */
+void metrics_history_add(const metrics_sample_t *sample);
+
+/**
+ * @brief Called with every sample pulled from the ring.
+ */
+typedef void (*metrics_sample_hook_t)(const metrics_sample_t *sample);
+
+/**
+ * @brief Pulls the samples published in the shared-memory ring since the
+ * last call into the history.
+ *
+ * Meant to be called often and from the main thread: it only does plain
+ * loads while there is nothing new.
+ *
+ * @param hook Also receives each new sample, oldest first (can be NULL).
+ * @return The number of samples added.
+ */
+int metrics_history_poll(metrics_sample_hook_t hook);
+
+/**
+ * @brief Summarizes a metric over the last seconds.
+ *
+ * The finest resolution that covers the whole window is used. Quantiles are
+ * estimated by merging the sketches of the buckets in the window.
+ *
+ * @param metric Field name (e.g. "cpu_usage_percentage").
+ * @param window Length of the window, in seconds, ending now.
+ * @param quantiles Quantiles to estimate, between 0 and 1 (can be NULL).
+ * @param count Number of quantiles (at most METRICS_HISTORY_MAX_QUANTILES).
+ * @param values Receives the estimates, in the same order.
+ * @param summary Receives the other aggregates.
+ * @return 0 on success, -1 if the metric is not tracked or there are no
+ * samples in the window.
+ */
+int metrics_history_query(const char *metric, double window,
+                          const double *quantiles, size_t count,
+                          double *values, metrics_summary_t *summary);
+
+/**
+ * @brief Tells whether a metric is stored as a rate per second.
+ *
+ * @param metric Field name.
+ * @return Non-zero for cumulative counters.
+ */
+int metrics_history_is_rate(const char *metric);
+
+/**
+ * @brief Drops every stored sample.
+ *
+ * Samples still in the shared-memory ring that were already pulled are not
+ * pulled again.
+ */
+void metrics_history_reset(void);
+
+#endif // METRICS_HISTORY_H
@@ -0,0 +1,119 @@
+#ifndef METRICS_SHM_H
+#define METRICS_SHM_H
+
+#include "metric_record.h"
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @brief Name of the shared-memory object the monitor publishes into.
+ */
+#define METRICS_SHM_NAME "/shell_monitor_metrics"
+
+/**
+ * @brief Number of samples kept in the ring.
+ */
+#define METRICS_RING_SLOTS 64
+
+/**
+ * @brief Attempts a reader makes before giving up on a slot being rewritten.
+ */
+#define METRICS_READ_RETRIES 16
+
+/**
+ * @brief A mapped metrics ring, either as writer or as reader.
+ */
+typedef struct metrics_shm {
+  struct metrics_ring *ring; /**< The shared mapping */
+  int writable;              /**< Non-zero for the writer */
+} metrics_shm_t;
+
+/**
+ * @brief Creates (or reuses) the ring and maps it for writing.
+ *
+ * A ring left by a previous writer is kept, so readers that already mapped it
+ * see the new samples. There must be a single writer at a time.
+ *
+ * @param name Shared-memory object name (e.g. METRICS_SHM_NAME).
+ * @return The mapping, or NULL on error (errno is set).
+ */
+metrics_shm_t *metrics_shm_create(const char *name);
+
+/**
+ * @brief Maps an existing ring read-only.
+ *
+ * @param name Shared-memory object name.
+ * @return The mapping, or NULL if there is no ring (errno is set).
+ */
+metrics_shm_t *metrics_shm_open(const char *name);
+
+/**
+ * @brief Publishes a sample into the next slot.
+ *
+ * The sample is stored as a binary metric_record_t. The slot is guarded by a
+ * sequence lock: the writer never waits for readers, and readers retry if
+ * they catch the slot mid-update.
+ *
+ * @param shm A mapping from metrics_shm_create().
+ * @param sample The sample to publish.
+ */
+void metrics_shm_publish(metrics_shm_t *shm, const metrics_sample_t *sample);
+
+/**
+ * @brief Number of samples published so far.
+ *
+ * Samples are numbered from 1; the newest one has this number.
+ *
+ * @param shm A mapping.
+ * @return The number of the newest sample, 0 if none was published.
+ */
+uint64_t metrics_shm_head(const metrics_shm_t *shm);
+
+/**
+ * @brief Reads a consistent copy of a given sample.
+ *
+ * Only plain loads are used, no system calls.
+ *
+ * @param shm A mapping.
+ * @param number Sample number, between head - METRICS_RING_SLOTS + 1 and head.
+ * @param sample Receives the sample.
+ * @return 0 on success, -1 if the sample was overwritten, never published or
+ * written with a different record schema.
+ */
+int metrics_shm_read(const metrics_shm_t *shm, uint64_t number,
+                     metrics_sample_t *sample);
+
+/**
+ * @brief Reads a consistent copy of the newest sample.
+ *
+ * @param shm A mapping.
+ * @param sample Receives the sample.
+ * @param number Receives its number (can be NULL).
+ * @return 0 on success, -1 if nothing was published yet.
+ */
+int metrics_shm_read_latest(const metrics_shm_t *shm, metrics_sample_t *sample,
+                            uint64_t *number);
+
+/**
+ * @brief Reads the samples published after a given one, oldest first.
+ *
+ * Samples already overwritten are skipped. If the ring was recreated (its
+ * head went back), reading starts over from its oldest sample.
+ *
+ * @param shm A mapping.
+ * @param last_seen Number of the last sample the caller has; updated to the
+ * newest one read.
+ * @param samples Receives up to METRICS_RING_SLOTS samples.
+ * @return The number of samples stored in samples.
+ */
+size_t metrics_shm_read_new(const metrics_shm_t *shm, uint64_t *last_seen,
+                            metrics_sample_t *samples);
+
+/**
+ * @brief Unmaps a ring. The shared-memory object itself is kept.
+ *
+ * @param shm The mapping (can be NULL).
+ */
+void metrics_shm_close(metrics_shm_t *shm);
+
+#endif // METRICS_SHM_H
@@ -0,0 +1,166 @@
+#ifndef MONITOR_CONFIG_H
+#define MONITOR_CONFIG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief The monitor's configuration file, read when it starts.
+ */
+#define MONITOR_CONFIG_FILE "config.json"
+
+/**
+ * @brief Unix socket the monitor listens on for configuration changes.
+ */
+#define MONITOR_CONTROL_SOCKET "/tmp/monitor_control.sock"
+
+/**
+ * @brief Default time between samples (s).
+ */
+#define MONITOR_CONFIG_DEFAULT_INTERVAL 1.0
+
+/**
+ * @brief Shortest and longest time between samples (s).
+ */
+#define MONITOR_CONFIG_MIN_INTERVAL 0.01
+#define MONITOR_CONFIG_MAX_INTERVAL 3600.0
+
+/**
+ * @brief Longest wait for the monitor's reply (ms).
+ */
+#define MONITOR_CONTROL_TIMEOUT_MS 1000
+
+/**
+ * @brief Largest request or reply on the control socket.
+ */
+#define MONITOR_CONTROL_MESSAGE_SIZE 4096
+
+/**
+ * @brief What the monitor samples and how often.
+ */
+typedef struct monitor_config {
+  double interval;  /**< Time between samples (s) */
+  uint32_t metrics; /**< Bit i set: field i of metric_fields() is sampled */
+} monitor_config_t;
+
+/**
+ * @brief Fills a configuration with the defaults: every metric, once per
+ * MONITOR_CONFIG_DEFAULT_INTERVAL.
+ *
+ * @param config The configuration.
+ */
+void monitor_config_default(monitor_config_t *config);
+
+/**
+ * @brief Reads a configuration file.
+ *
+ * The file is a JSON object such as
+ * `{"interval_ms": 500, "metrics": ["cpu_usage_percentage"]}`. Keys that are
+ * missing keep their default value.
+ *
+ * @param path The file.
+ * @param config Receives the configuration; the defaults if the file does
+ * not exist.
+ * @return 0 on success, -1 if the file cannot be read or is not valid.
+ */
+int monitor_config_load(const char *path, monitor_config_t *config);
+
+/**
+ * @brief Writes a configuration file atomically.
+ *
+ * The JSON is written to a temporary file in the same directory, synced and
+ * renamed over the old one, so readers see either the old file or the new
+ * one, never a partial write.
+ *
+ * @param path The file.
+ * @param config The configuration.
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int monitor_config_save(const char *path, const monitor_config_t *config);
+
+/**
+ * @brief Applies one `key=value` assignment.
+ *
+ * Keys: `interval` (a duration such as `500ms` or `2s`) and `metrics` (a
+ * comma-separated list of metric names or aliases, or `all`).
+ *
+ * @param config The configuration to change.
+ * @param assignment The assignment.
+ * @param error Receives a message when the assignment is rejected.
+ * @param error_size Size of error.
+ * @return 0 on success, -1 if it was rejected (config is left unchanged).
+ */
+int monitor_config_assign(monitor_config_t *config, const char *assignment,
+                          char *error, size_t error_size);
+
+/**
+ * @brief Formats a configuration as the JSON of the configuration file.
+ *
+ * @param config The configuration.
+ * @return A string the caller frees with free(), or NULL on error.
+ */
+char *monitor_config_to_json(const monitor_config_t *config);
+
+/**
+ * @brief Prints a configuration for humans.
+ *
+ * @param config The configuration.
+ */
+void monitor_config_print(const monitor_config_t *config);
+
+/**
+ * @brief Creates the monitor's end of the control socket.
+ *
+ * The socket is a non-blocking SOCK_SEQPACKET socket, so every request and
+ * reply arrives as one message. A socket file left by a previous monitor is
+ * replaced.
+ *
+ * @param path The socket path (e.g. MONITOR_CONTROL_SOCKET).
+ * @return The listening descriptor, or -1 on error (errno is set).
+ */
+int monitor_control_listen(const char *path);
+
+/**
+ * @brief Answers the pending requests on the control socket.
+ *
+ * Meant for the monitor's sampling loop: poll the listening descriptor along
+ * with the sampling timer and call this when it is readable. Requests are
+ * JSON objects: `{"command": "get"}` returns the configuration, and
+ * `{"command": "set", "config": {...}}` replaces the keys given, with the
+ * format of the configuration file. Replies are
+ * `{"ok": true, "config": {...}}` or `{"ok": false, "error": "..."}`.
+ *
+ * @param listen_fd Descriptor from monitor_control_listen().
+ * @param config The live configuration, updated in place.
+ * @return 1 if the configuration changed, 0 if not.
+ */
+int monitor_control_serve(int listen_fd, monitor_config_t *config);
+
+/**
+ * @brief Asks the monitor for the configuration it is running with.
+ *
+ * @param path The socket path.
+ * @param config Receives the configuration.
+ * @param error Receives a message on failure.
+ * @param error_size Size of error.
+ * @return 0 on success, -1 if the monitor is not listening, -2 if it did not
+ * answer in time or the answer was not valid.
+ */
+int monitor_control_get(const char *path, monitor_config_t *config,
+                        char *error, size_t error_size);
+
+/**
+ * @brief Sends a configuration to the monitor, which applies it right away.
+ *
+ * @param path The socket path.
+ * @param config The configuration to apply; receives the one the monitor
+ * reports after applying it.
+ * @param error Receives a message on failure.
+ * @param error_size Size of error.
+ * @return 0 on success, -1 if the monitor is not listening, -2 if it
+ * rejected the configuration or did not answer in time.
+ */
+int monitor_control_set(const char *path, monitor_config_t *config,
+                        char *error, size_t error_size);
+
+#endif // MONITOR_CONFIG_H
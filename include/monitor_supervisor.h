@@ -0,0 +1,172 @@
+#ifndef MONITOR_SUPERVISOR_H
+#define MONITOR_SUPERVISOR_H
+
+#include <sys/types.h>
+
+/**
+ * @brief The monitoring program started by start_monitor, unless
+ * MONITOR_PROGRAM_ENV names another one.
+ */
+#define MONITOR_PROGRAM "./monitoring_project"
+
+/**
+ * @brief Environment variable with the path of the monitoring program.
+ */
+#define MONITOR_PROGRAM_ENV "MONITOR_BIN"
+
+/**
+ * @brief File holding the PID of the running monitor, so other shells can
+ * stop it.
+ */
+#define MONITOR_PID_FILE "/tmp/monitor_pid"
+
+/**
+ * @brief Environment variable that makes start_monitor wait for the monitor
+ * to report readiness.
+ *
+ * Set it (to anything but "0") when the monitoring program implements the
+ * MONITOR_READY_FD_ENV handshake. Without it, the monitor counts as started
+ * as soon as it was executed.
+ */
+#define MONITOR_READY_WAIT_ENV "MONITOR_READY_WAIT"
+
+/**
+ * @brief Environment variable with the descriptor the monitor writes to once
+ * it is ready; only passed when MONITOR_READY_WAIT_ENV is set.
+ *
+ * Any write counts as the readiness notification. Publishing the first sample
+ * into the shared-memory ring counts too.
+ */
+#define MONITOR_READY_FD_ENV "MONITOR_READY_FD"
+
+/**
+ * @brief Longest wait for readiness in start_monitor (ms), when the monitor
+ * implements the handshake.
+ */
+#define MONITOR_READY_TIMEOUT_MS 2000
+
+/**
+ * @brief Time a stopped monitor gets to exit after SIGTERM before SIGKILL
+ * (ms).
+ */
+#define MONITOR_STOP_TIMEOUT_MS 2000
+
+/**
+ * @brief First delay before restarting a crashed monitor (ms). It doubles
+ * after each crash, up to MONITOR_RESTART_MAX_MS.
+ */
+#define MONITOR_RESTART_MIN_MS 50
+
+/**
+ * @brief Longest delay before restarting a crashed monitor (ms).
+ */
+#define MONITOR_RESTART_MAX_MS 30000
+
+/**
+ * @brief A monitor that ran this long before crashing is restarted with the
+ * shortest delay again (s).
+ */
+#define MONITOR_STABLE_SECONDS 30
+
+/**
+ * @brief Shortest period the collector overhead is measured over (s).
+ */
+#define MONITOR_OVERHEAD_MIN_PERIOD 0.5
+
+/**
+ * @brief CPU cost of the monitor itself.
+ */
+typedef struct monitor_overhead {
+  pid_t pid;                /**< The monitor */
+  double period;            /**< Seconds the figures cover */
+  double cpu_percent;       /**< CPU time over wall time (%) */
+  double cpu_ms_per_sample; /**< CPU per sample (ms), 0 if unknown */
+  double sample_interval;   /**< Time between samples (s), 0 if unknown */
+} monitor_overhead_t;
+
+/**
+ * @brief The monitoring program to run.
+ *
+ * @return The value of MONITOR_PROGRAM_ENV if it is set and not empty,
+ * MONITOR_PROGRAM otherwise.
+ */
+const char *monitor_program(void);
+
+/**
+ * @brief Starts the monitor.
+ *
+ * A monitor already running (started by this shell or, through
+ * MONITOR_PID_FILE, by another one) is stopped first with monitor_stop().
+ * The new one runs in its own process group and is watched through a pidfd:
+ * if it dies, monitor_supervise() restarts it.
+ *
+ * The monitor is started once its exec() succeeded, which a close-on-exec
+ * pipe reports right away. With MONITOR_READY_WAIT_ENV set it also waits for
+ * the readiness handshake, at most MONITOR_READY_TIMEOUT_MS; a monitor that
+ * is still starting after that keeps running and being supervised.
+ *
+ * @return The PID of the monitor, or -1 if it could not be started or exited
+ * while starting.
+ */
+pid_t monitor_start(void);
+
+/**
+ * @brief Stops the monitor and its supervision.
+ *
+ * The monitor gets SIGTERM and MONITOR_STOP_TIMEOUT_MS to exit, then SIGKILL.
+ * A PID read from MONITOR_PID_FILE is only signalled if it still belongs to
+ * monitor_program(), so a stale file never hits an unrelated process. A restart
+ * waiting for its delay is cancelled.
+ *
+ * @return 0 on success, -1 if no monitor was running.
+ */
+int monitor_stop(void);
+
+/**
+ * @brief Tells whether monitor_supervise() has something to do.
+ *
+ * It is cheap enough to call on every tick, and lets the caller make room for
+ * the messages monitor_supervise() prints.
+ *
+ * @return 1 if the monitor exited or a restart is due, 0 otherwise.
+ */
+int monitor_supervise_pending(void);
+
+/**
+ * @brief Checks on the supervised monitor.
+ *
+ * Called from the shell's periodic work. It notices a monitor that exited,
+ * reaps it and schedules a restart with exponential backoff, and starts it
+ * again when the delay is over. A monitor that could not be executed at all
+ * is not restarted.
+ */
+void monitor_supervise(void);
+
+/**
+ * @brief Measures the CPU time the monitor spends collecting.
+ *
+ * The monitor's /proc/<pid>/stat is kept open and read with pread(). The
+ * figures cover the time since the previous measurement if it is at least
+ * MONITOR_OVERHEAD_MIN_PERIOD old (calls closer than that get the previous
+ * figures again), or the monitor's whole life on the first call. CPU per
+ * sample and the sampling interval come from the samples published in the
+ * ring over the same period, so they are only known from the second call.
+ *
+ * @param overhead Receives the figures.
+ * @return 0 on success, -1 if no monitor is running.
+ */
+int monitor_overhead(monitor_overhead_t *overhead);
+
+/**
+ * @brief Hands the status of a child reaped elsewhere to the supervisor.
+ *
+ * The shell's SIGCHLD handling reaps every child; the status of the monitor
+ * is kept for monitor_supervise().
+ *
+ * @param pid The reaped child.
+ * @param status Its wait status.
+ * @return 1 if pid was the monitor, 0 otherwise.
+ */
+int monitor_reaped(pid_t pid, int status);
+
+#endif // MONITOR_SUPERVISOR_H
@@ -1,12 +1,15 @@
 #ifndef PARSE_H
 #define PARSE_H
 
+#include "redirect.h"
+
 /**
  * @brief Splits a command into subcommands separated by pipes ('|').
  *
  * This function takes a string containing a command with one or more pipes ('|')
  * and splits it into individual subcommands. Each subcommand is trimmed of
- * leading and trailing whitespace.
+ * leading and trailing whitespace. Pipes inside quotes or inside a process
+ * substitution (`<( ... )`, `>( ... )`) do not split the command.
  *
  * @param command The string containing the full command, which may include
  *        one or more pipes.
@@ -19,22 +22,60 @@
 char** split_by_pipes(char* command, int* num_commands);
 
 /**
- * @brief Splits a command into tokens and handles input and output redirection.
+ * @brief Splits a command into tokens and collects its redirections.
  *
  * This function takes a command and splits it into individual arguments (tokens),
- * while also parsing input and output redirection if present, using the `<` and `>`
- * operators. The redirection files found are stored in the pointers `input_file_ptr`
- * and `output_file_ptr`.
+ * while also parsing every redirection operator into an ordered list of
+ * descriptor operations: `<`, `>`, `>>`, `<>`, `n<`, `n>`, `2>`, `2>&1`,
+ * `n>&-`, `&>`, `&>>`, here-strings (`<<< word`) and here-documents
+ * (`<<DELIM`, whose body is read beforehand by `heredoc_collect` and taken
+ * by `redir_open`). Process substitutions (`<(cmd)`, `>(cmd)`) are kept as
+ * a placeholder argument plus a list entry; the placeholder becomes
+ * `/dev/fd/N` once `redir_open` starts them. The operations are applied later,
+ * in order, by the redirection engine (see redirect.h). Unquoted words with
+ * `*`, `?`, `[...]` or `**` are replaced by the paths they match, sorted, and
+ * kept as they are when nothing matches (see pathexp.h).
  *
  * @param command The string containing the full command.
- * @param input_file_ptr A `char*` pointer where the input redirection filename
- *        will be stored if present; otherwise, it is left as `NULL`.
- * @param output_file_ptr A `char*` pointer where the output redirection filename
- *        will be stored if present; otherwise, it is left as `NULL`.
+ * @param redirs_ptr A `redir_t*` pointer where the list of redirections will be
+ *        stored; it is left as `NULL` when the command has none. The caller
+ *        releases it with `redir_free`.
  * @return An array of strings (`char**`) where each element is a token of the command.
- *         The last element of the array is `NULL` to indicate the end.
+ *         The last element of the array is `NULL` to indicate the end. On a
+ *         syntax error, which is printed to stderr, the array is empty.
  *         The function returns `NULL` if a memory allocation error occurs.
  */
-char** parse_command(char* command, char** input_file_ptr, char** output_file_ptr);
+char** parse_command(char* command, redir_t** redirs_ptr);
+
+/**
+ * @brief Same as `parse_command`, but returns syntax errors instead of
+ * printing them.
+ *
+ * It touches no state other than its arguments (here-document bodies are
+ * only taken later, by `redir_open`), so it can run on several threads at
+ * once.
+ *
+ * @param command The string containing the full command.
+ * @param redirs_ptr Receives the list of redirections, as in `parse_command`.
+ * @param directory Where patterns are expanded, or `NULL` for the working
+ *        directory.
+ * @param error Receives a description of the syntax error, or `NULL` if the
+ *        command is well formed. The string is static.
+ * @return The tokens, empty on a syntax error, or `NULL` if a memory
+ *         allocation error occurs.
+ */
+char** parse_command_quiet(char* command, redir_t** redirs_ptr, const char* directory, const char** error);
+
+/**
+ * @brief Converts a duration such as `500ms`, `30s`, `10m`, `2h` or `1d` to
+ * seconds.
+ *
+ * The unit is required, so a duration is never mistaken for a plain number.
+ *
+ * @param text The duration.
+ * @param seconds Receives the length in seconds.
+ * @return 0 on success, -1 if the text is not a positive duration.
+ */
+int parse_duration(const char* text, double* seconds);
 
 #endif // PARSE_H
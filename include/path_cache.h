@@ -0,0 +1,35 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+/**
+ * @brief Commands remembered before the cache starts over.
+ */
+#define PATH_CACHE_SIZE 256
+
+/**
+ * @brief Finds a command in PATH, remembering where it was.
+ *
+ * The first lookup of a name walks the PATH directories; later ones answer
+ * from a hash table without touching the filesystem. The cache is emptied
+ * when PATH changes. Names that are not found are not remembered, so a
+ * command installed later is found on the next lookup.
+ *
+ * @param name The command, without a '/'.
+ * @return The full path, valid until the next call, or NULL if it is not in
+ * PATH.
+ */
+const char *path_cache_lookup(const char *name);
+
+/**
+ * @brief Forgets where a command was, e.g. after it failed to execute.
+ *
+ * @param name The command.
+ */
+void path_cache_forget(const char *name);
+
+/**
+ * @brief Forgets every command.
+ */
+void path_cache_clear(void);
+
+#endif // PATH_CACHE_H
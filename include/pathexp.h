@@ -0,0 +1,43 @@
+#ifndef PATHEXP_H
+#define PATHEXP_H
+
+#include <stddef.h>
+
+/**
+ * @brief Whether a word is a pattern: it has a '*', a '?' or a '[' with its
+ * closing ']'.
+ *
+ * @param word The unquoted word.
+ * @return 1 if it must be expanded, 0 if it is taken literally.
+ */
+int pathexp_has_magic(const char *word);
+
+/**
+ * @brief Expands a pattern into the paths that match it (pathname
+ * expansion, "globbing").
+ *
+ * `*` matches any run of characters, `?` one character and `[...]` one of a
+ * set (`[a-z]`, `[!0-9]`); none of them matches a '/' or the '.' that starts
+ * a hidden name, unless the pattern has it explicitly. A `**` component
+ * matches any number of directories, hidden ones excepted, without following
+ * symbolic links.
+ *
+ * Each component of the pattern is compiled once into a matcher. Each
+ * directory the expansion needs is read once with getdents64(), even when
+ * `**` visits it again, and the matches are sorted byte by byte with a radix
+ * sort. Nothing is shared between calls, so several threads can expand at
+ * once.
+ *
+ * @param pattern The pattern, quotes already removed.
+ * @param directory Where relative patterns are resolved; NULL for the
+ * working directory. The matches keep the form of the pattern (relative
+ * stays relative).
+ * @param matches Receives a sorted, NULL-terminated array of malloc()ed
+ * paths, or NULL when nothing matches. The caller frees the strings and the
+ * array.
+ * @return The number of matches, or -1 if an allocation failed.
+ */
+long pathexp_expand(const char *pattern, const char *directory,
+                    char ***matches);
+
+#endif // PATHEXP_H
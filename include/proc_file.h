@@ -0,0 +1,44 @@
+#ifndef PROC_FILE_H
+#define PROC_FILE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief A /proc file kept open between reads.
+ *
+ * /proc files are regenerated on every read from offset 0, so one descriptor
+ * can be reused with pread() instead of an open/read/close per sample.
+ */
+typedef struct proc_file {
+  int fd; /**< Open descriptor, -1 if closed */
+} proc_file_t;
+
+/**
+ * @brief Opens a /proc file.
+ *
+ * @param file The handle to fill.
+ * @param path The file (e.g. "/proc/stat").
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int proc_file_open(proc_file_t *file, const char *path);
+
+/**
+ * @brief Reads the whole file again.
+ *
+ * @param file The handle.
+ * @param buffer Receives the contents, NUL-terminated.
+ * @param size Size of buffer.
+ * @return The number of bytes read, or -1 on error (ESRCH once the process of
+ * a /proc/<pid> file has exited).
+ */
+ssize_t proc_file_read(proc_file_t *file, char *buffer, size_t size);
+
+/**
+ * @brief Closes a /proc file.
+ *
+ * @param file The handle (closing twice is harmless).
+ */
+void proc_file_close(proc_file_t *file);
+
+#endif // PROC_FILE_H
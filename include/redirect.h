@@ -0,0 +1,131 @@
+#ifndef REDIRECT_H
+#define REDIRECT_H
+
+#include <sys/types.h>
+
+/**
+ * @brief Lowest descriptor used for files opened by the parent.
+ *
+ * Files are opened before forking and moved at or above this number so an
+ * earlier dup2() in the list can never clobber a descriptor still pending.
+ */
+#define REDIR_FD_BASE 10
+
+/**
+ * @brief Permissions for files created by '>' and '<>'.
+ */
+#define REDIR_FILE_MODE 0644
+
+/**
+ * @brief Maximum number of descriptors a built-in can have redirected.
+ */
+#define REDIR_MAX_SAVED 16
+
+/**
+ * @brief Kind of descriptor operation.
+ */
+typedef enum {
+  REDIR_OPEN,    /**< Open `path` with `flags` onto `fd` (<, >, >>, n<, <>) */
+  REDIR_DUP,     /**< Duplicate `target_fd` onto `fd` (2>&1, n<&m) */
+  REDIR_CLOSE,   /**< Close `fd` (n>&-) */
+  REDIR_DATA,    /**< Feed inline `data` as `fd` (here-strings) */
+  REDIR_HEREDOC, /**< Here-document (<<DELIM); redir_open() takes its body */
+  REDIR_PROCSUB  /**< Run `data` and pass its pipe as /dev/fd/N (<(cmd), >(cmd)) */
+} redir_kind_t;
+
+/**
+ * @brief One descriptor operation, applied in command-line order.
+ */
+typedef struct redir {
+  redir_kind_t kind;  /**< What to do */
+  int fd;             /**< Descriptor the command sees */
+  int flags;          /**< open() flags for REDIR_OPEN */
+  int target_fd;      /**< Source descriptor for REDIR_DUP */
+  char *path;         /**< File name for REDIR_OPEN */
+  char *data;         /**< Content for REDIR_DATA */
+  int opened_fd;      /**< Descriptor opened by redir_open(), or -1 */
+  int arg_index;      /**< Argument replaced by /dev/fd/N for REDIR_PROCSUB */
+  pid_t *pids;        /**< Processes started for REDIR_PROCSUB */
+  int num_pids;       /**< Number of entries in `pids` */
+  struct redir *next; /**< Next operation */
+} redir_t;
+
+/**
+ * @brief Original descriptors saved while a built-in runs redirected.
+ */
+typedef struct redir_saved {
+  int count;                  /**< Number of saved entries */
+  int fds[REDIR_MAX_SAVED];   /**< Redirected descriptor */
+  int saved[REDIR_MAX_SAVED]; /**< Copy of the original, or -1 if closed */
+} redir_saved_t;
+
+/**
+ * @brief Appends a new operation to a redirection list.
+ *
+ * @param list_ptr Pointer to the head of the list.
+ * @param kind Operation kind.
+ * @param fd Descriptor the operation targets.
+ * @return The new node, or NULL if memory allocation fails.
+ */
+redir_t *redir_append(redir_t **list_ptr, redir_kind_t kind, int fd);
+
+/**
+ * @brief Opens every file and inline document of a list in the parent.
+ *
+ * Descriptors are opened close-on-exec and kept above REDIR_FD_BASE. Process
+ * substitutions are started here, concurrently with the command, through the
+ * pipeline spawner; the matching argument in @p args is replaced with
+ * `/dev/fd/N`. Each here-document takes the next body queued by
+ * heredoc_collect() and becomes a REDIR_DATA entry, so the lists of a line
+ * must be opened in the order of the line. On failure the error is reported
+ * and everything opened so far is closed.
+ *
+ * @param list The redirection list.
+ * @param args The command arguments (can be NULL if the list has no process
+ * substitutions).
+ * @return 0 on success, -1 on error.
+ */
+int redir_open(redir_t *list, char **args);
+
+/**
+ * @brief Applies the operations of a list to the current process.
+ *
+ * Called in the child after fork() with @p saved NULL, or in the shell
+ * itself for built-ins with @p saved set so redir_restore() can undo it. In a
+ * child, process substitution pipes are made inheritable by the exec'd program.
+ *
+ * @param list A list already prepared with redir_open().
+ * @param saved Where to save the original descriptors, or NULL.
+ * @return 0 on success, -1 on error.
+ */
+int redir_apply(redir_t *list, redir_saved_t *saved);
+
+/**
+ * @brief Restores the descriptors saved by redir_apply().
+ *
+ * @param saved The saved state.
+ */
+void redir_restore(redir_saved_t *saved);
+
+/**
+ * @brief Closes the parent's copies of the descriptors opened by redir_open().
+ *
+ * @param list The redirection list.
+ */
+void redir_close(redir_t *list);
+
+/**
+ * @brief Waits for the processes started by process substitutions.
+ *
+ * @param list The redirection list.
+ */
+void redir_wait(redir_t *list);
+
+/**
+ * @brief Closes and frees a redirection list.
+ *
+ * @param list The redirection list (can be NULL).
+ */
+void redir_free(redir_t *list);
+
+#endif // REDIRECT_H
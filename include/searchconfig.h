@@ -0,0 +1,142 @@
+#ifndef SEARCHCONFIG_H
+#define SEARCHCONFIG_H
+
+#include <stddef.h>
+
+/**
+ * @brief Upper bound for the number of walker threads.
+ */
+#define SEARCHCONFIG_MAX_THREADS 64
+
+/**
+ * @brief Default cap on walker threads when none is requested.
+ */
+#define SEARCHCONFIG_DEFAULT_THREADS 8
+
+/**
+ * @brief One result of a directory walk.
+ */
+typedef struct config_match {
+  char *path; /**< Matching file, or the entry that could not be read */
+  int error;  /**< errno for an unreadable entry, 0 for a match */
+} config_match_t;
+
+/**
+ * @brief Growable list of walk results.
+ */
+typedef struct config_matches {
+  config_match_t *items; /**< Results */
+  size_t count;          /**< Number of results */
+  size_t capacity;       /**< Allocated entries */
+} config_matches_t;
+
+/**
+ * @brief Walks a directory tree in parallel looking for an extension.
+ *
+ * Directories are processed by a pool of threads, each with its own
+ * work-stealing deque. Entries are classified with the `d_type` returned by
+ * readdir; fstatat() relative to the directory descriptor is only used when
+ * the type is unknown or the entry is a symbolic link. Symbolic links to
+ * directories are not followed. Every thread buffers its own results, which
+ * are merged and sorted by path so the output is deterministic.
+ *
+ * @param directory Root of the walk.
+ * @param extension Extension to match, including the dot (e.g. ".config").
+ * @param num_threads Number of threads, or 0 to pick one per CPU.
+ * @param matches Receives the sorted results; release with
+ * config_matches_free().
+ * @return 0 on success, -1 if the walk could not start.
+ */
+int search_directory_parallel(const char *directory, const char *extension,
+                              int num_threads, config_matches_t *matches);
+
+/**
+ * @brief Classifies a directory entry the way the walker does.
+ *
+ * A known `d_type` is trusted as is. fstatat() relative to dir_fd is only
+ * called for DT_UNKNOWN and for symbolic links; a link counts as a file when
+ * it points to one, and links to directories are not followed.
+ *
+ * @param dir_fd Descriptor of the directory holding the entry.
+ * @param name Name of the entry.
+ * @param d_type The `d_type` reported by readdir, or DT_UNKNOWN.
+ * @return DT_DIR to descend into it, DT_REG for a file, DT_UNKNOWN for
+ * anything to skip, or -1 with errno set if fstatat() failed.
+ */
+int config_entry_type(int dir_fd, const char *name, unsigned char d_type);
+
+/**
+ * @brief Appends a result to a list.
+ *
+ * @param matches The list.
+ * @param path The path, owned by the list from now on (freed on failure).
+ * @param error errno for an unreadable entry, 0 for a match.
+ * @return 0 on success, -1 if memory allocation fails.
+ */
+int config_matches_add(config_matches_t *matches, char *path, int error);
+
+/**
+ * @brief Releases the results of search_directory_parallel().
+ *
+ * @param matches The results.
+ */
+void config_matches_free(config_matches_t *matches);
+
+/**
+ * @brief Prints every match followed by its content.
+ *
+ * Unreadable entries are reported on stderr in their sorted position. With a
+ * pattern, only the matching lines of each file are printed.
+ *
+ * @param matches Sorted results of a search.
+ * @param pattern Text to look for, or NULL to print whole files.
+ */
+void print_config_matches(const config_matches_t *matches,
+                          const char *pattern);
+
+/**
+ * @brief Searches a tree for configuration files and prints them.
+ *
+ * Runs search_directory_parallel() and, once the walk is done, prints the
+ * matches with print_config_matches().
+ *
+ * @param directory Root of the walk.
+ * @param extension Extension to match, including the dot.
+ * @param num_threads Number of threads, or 0 to pick one per CPU.
+ * @param pattern Text to look for, or NULL to print whole files.
+ */
+void search_directory_recursive(const char *directory, const char *extension,
+                                int num_threads, const char *pattern);
+
+/**
+ * @brief Checks if a filename ends with the given extension.
+ *
+ * @param filename The file name (without directories).
+ * @param extension The extension, including the dot.
+ * @return 1 if it matches, 0 otherwise.
+ */
+int has_extension(const char *filename, const char *extension);
+
+/**
+ * @brief Prints the content of a file to stdout.
+ *
+ * The content is copied with sendfile() straight to the stdout descriptor
+ * (stdio is flushed first), falling back to read/write when the destination
+ * does not support it.
+ *
+ * @param filepath The file to print.
+ */
+void print_file_content(const char *filepath);
+
+/**
+ * @brief Prints the lines of a file that contain a pattern.
+ *
+ * The file is memory-mapped and searched with memchr()/memmem(); each
+ * matching line is printed once as `path:line: text`.
+ *
+ * @param filepath The file to search.
+ * @param pattern The text to look for.
+ */
+void print_matching_lines(const char *filepath, const char *pattern);
+
+#endif // SEARCHCONFIG_H
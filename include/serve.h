@@ -0,0 +1,81 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+
+/**
+ * @brief Option that starts the shell as a command server:
+ * `shell --serve <socket>`.
+ */
+#define SERVE_OPTION "--serve"
+
+/**
+ * @brief First bytes of every request, with the protocol version.
+ */
+#define SERVE_MAGIC "SHS1"
+
+/**
+ * @brief Largest request: magic, directory, command line and environment.
+ */
+#define SERVE_REQUEST_MAX 65536
+
+/**
+ * @brief Descriptors sent with each request: the client's stdin, stdout and
+ * stderr, in that order.
+ */
+#define SERVE_FDS 3
+
+/**
+ * @brief Starts serving command lines on a Unix socket; returns only on
+ * SIGINT or SIGTERM, or if the socket cannot be set up.
+ *
+ * The socket is SOCK_SEQPACKET, so every message is one request or one
+ * reply. A request is SERVE_MAGIC followed by NUL-terminated strings: the
+ * working directory (empty for the server's), the command line (several
+ * lines run like a batch file), and then the environment changes, `NAME=VALUE`
+ * to set and `NAME` to unset. The client's descriptors come with it through
+ * SCM_RIGHTS. The reply is the line's exit status as an int, like `$?`.
+ *
+ * Each request runs in a fork of the server, so it pays neither exec,
+ * dynamic linking nor the shell's initialization, and a `cd` or an `export`
+ * in one request does not leak into the next. A connection can carry any
+ * number of requests, one after the other; closing it kills the request
+ * still running. Only clients of the server's user (or root) are served, and
+ * the socket is created with mode 0600.
+ *
+ * @param path The socket; a stale one is replaced, a live one is an error.
+ * @return EXIT_SUCCESS after a signal, EXIT_FAILURE on error.
+ */
+int serve_run(const char *path);
+
+/**
+ * @brief Connects to a command server.
+ *
+ * @param path The server's socket.
+ * @return The connected socket, or -1 on error (errno is set).
+ */
+int serve_connect(const char *path);
+
+/**
+ * @brief Sends one request.
+ *
+ * @param sock The connected socket.
+ * @param cwd Directory to run in, or NULL for the server's.
+ * @param line The command line.
+ * @param env Environment changes, NULL-terminated (can be NULL).
+ * @param fds The SERVE_FDS descriptors the line reads and writes.
+ * @return 0 on success, -1 on error (E2BIG if the request is too large).
+ */
+int serve_send_request(int sock, const char *cwd, const char *line,
+                       char *const env[], const int fds[SERVE_FDS]);
+
+/**
+ * @brief Waits for the reply to a request.
+ *
+ * @param sock The connected socket.
+ * @param status The exit status of the line.
+ * @return 0 on success, -1 on error or if the server went away.
+ */
+int serve_recv_status(int sock, int *status);
+
+#endif // SERVE_H
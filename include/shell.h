@@ -1,8 +1,11 @@
 #ifndef SHELL_H
 #define SHELL_H
 
+#include "job_usage.h"
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 
 /**
@@ -20,6 +23,13 @@ extern int sig_pipe_fds[MAX_FS];
  */
 extern pid_t foreground_pid;
 
+/**
+ * @brief Exit status of the last command line run in the foreground, like
+ * `$?` in sh: the exit code, or 128 plus the signal that ended or stopped it.
+ * Built-ins leave it at 0.
+ */
+extern int last_status;
+
 /**
  * @brief Flag indicating if a SIGCHLD signal was received.
  */
@@ -73,6 +83,39 @@ int execute_command(char* command);
  */
 int execute_batch_file(FILE* batch_file);
 
+/**
+ * @brief Runs the shell's periodic work.
+ *
+ * Called by readline while it waits for input and before each command of a
+ * batch file. It reaps finished background jobs, feeds the metric history
+ * and the trigger rules from the monitor's shared-memory ring, launches the
+ * actions of the triggers that fired, and restarts the monitor if it crashed.
+ *
+ * @return Always returns 0.
+ */
+int shell_tick(void);
+
+/**
+ * @brief Opens the persistent history for an interactive shell.
+ *
+ * The newest commands of the history file (see history_log.h) are loaded
+ * into readline, so the arrows reach commands typed in other shells, and
+ * Ctrl-R is bound to the indexed search: it replaces the line with the
+ * newest command containing what was typed, and each further Ctrl-R steps
+ * to an older one.
+ */
+void shell_history_start(void);
+
+/**
+ * @brief Adds a finished command line to the persistent history.
+ *
+ * @param line The line as typed.
+ * @param cwd The directory it was typed in.
+ * @param start_ns When it started (CLOCK_REALTIME, ns).
+ * @param duration_ns How long it ran.
+ */
+void shell_history_record(const char* line, const char* cwd, int64_t start_ns, uint64_t duration_ns);
+
 /**
  * @brief Cleans up resources used by the shell before exiting.
  *
@@ -81,15 +124,26 @@ int execute_batch_file(FILE* batch_file);
  */
 void cleanup_shell();
 
+/**
+ * @brief Finished jobs kept for 'jobs' before the oldest are dropped.
+ */
+#define MAX_DONE_JOBS 32
+
 /**
  * @brief Structure representing a background job.
  */
 typedef struct job
 {
-    int job_id;       /**< Unique ID assigned to the job */
-    pid_t pid;        /**< Process ID of the job */
-    char* command;    /**< Command associated with the job */
-    struct job* next; /**< Pointer to the next job in the list */
+    int job_id;              /**< Unique ID assigned to the job */
+    pid_t pid;               /**< Process ID of the job */
+    char* command;           /**< Command associated with the job */
+    double started;          /**< Start time (s, CLOCK_MONOTONIC) */
+    int done;                /**< 1 once the job has been reaped */
+    int status;              /**< Wait status, valid when done */
+    job_usage_t usage;       /**< Resources used, final when done */
+    proc_file_t stat;        /**< /proc/<pid>/stat while it runs */
+    proc_file_t status_file; /**< /proc/<pid>/status while it runs */
+    struct job* next;        /**< Pointer to the next job in the list */
 } job_t;
 
 /**
@@ -114,12 +168,39 @@ int add_job(pid_t pid, const char* command);
  */
 void remove_job(pid_t pid);
 
+/**
+ * @brief Records the end of a background job.
+ *
+ * The job stays in the list, marked as done with the status and the usage
+ * reported by wait4(), until 'jobs' shows it. Its wall time runs until it is
+ * reaped, which shell_tick() does between commands and while idle. Only the last MAX_DONE_JOBS
+ * finished jobs are kept.
+ *
+ * @param pid The process ID of the job.
+ * @param status Its wait status.
+ * @param usage Its resource usage.
+ * @return 1 if pid was a job, 0 otherwise.
+ */
+int finish_job(pid_t pid, int status, const struct rusage* usage);
+
+/**
+ * @brief Prints the background jobs, in the order they were started.
+ *
+ * Finished jobs are printed once, with their exit status, and removed. With
+ * details, each line also has the PID and the resources used: the final
+ * figures from wait4() for finished jobs, and a sample of /proc/<pid> for
+ * running ones.
+ *
+ * @param details 1 for 'jobs -l', 0 for 'jobs'.
+ */
+void print_jobs(int details);
+
 /**
  * @brief Handles the logic for the SIGCHLD signal.
  *
  * This function is called when a SIGCHLD signal is received, indicating that
- * a child process has terminated. It removes the corresponding job from the
- * job list and handles the child process's status.
+ * a child process has terminated. It reaps every finished child with wait4()
+ * and records its status and resource usage in the job list.
  */
 void sigchld_handler_logic();
 
@@ -0,0 +1,177 @@
+#ifndef SHELL_STATS_H
+#define SHELL_STATS_H
+
+#include <stdint.h>
+
+/**
+ * @brief Environment variable with the Unix socket to serve the shell's own
+ * metrics on, in the Prometheus text format.
+ */
+#define SHELL_STATS_SOCKET_ENV "SHELL_METRICS_SOCKET"
+
+/**
+ * @brief Bits of precision below the leading one of a recorded value: each
+ * power of two is split into 2^SHELL_STATS_SUB_BITS buckets, so a bucket is
+ * at most 1/16 (6.25 %) wider than the values it holds.
+ */
+#define SHELL_STATS_SUB_BITS 4
+
+/**
+ * @brief Values up to 2^SHELL_STATS_MAX_BITS - 1 are told apart (about 18
+ * minutes in nanoseconds); larger ones go to the last bucket.
+ */
+#define SHELL_STATS_MAX_BITS 40
+
+/**
+ * @brief Buckets of each histogram.
+ */
+#define SHELL_STATS_BUCKETS                                                    \
+  ((SHELL_STATS_MAX_BITS - SHELL_STATS_SUB_BITS + 1) << SHELL_STATS_SUB_BITS)
+
+/**
+ * @brief Histograms of the shell's hot paths.
+ */
+typedef enum shell_histogram {
+  SHELL_HIST_PARSE,           /**< Parsing one command (ns) */
+  SHELL_HIST_FORK,            /**< The fork() call itself (ns) */
+  SHELL_HIST_SPAWN,           /**< From fork() to a successful exec (ns) */
+  SHELL_HIST_PIPELINE_STAGES, /**< Stages of each pipeline */
+  SHELL_HIST_COUNT
+} shell_histogram_t;
+
+/**
+ * @brief Counters, only ever incremented.
+ */
+typedef enum shell_counter {
+  SHELL_COUNTER_EXEC_FAILURES,  /**< Commands that could not be executed */
+  SHELL_COUNTER_PATH_HITS,      /**< Commands found in the PATH cache */
+  SHELL_COUNTER_PATH_MISSES,    /**< Commands searched in PATH */
+  SHELL_COUNTER_JOBS_STARTED,   /**< Background jobs started */
+  SHELL_COUNTER_MEMO_HITS,      /**< memo results replayed from the cache */
+  SHELL_COUNTER_MEMO_MISSES,    /**< memo commands that had to run */
+  SHELL_COUNTER_MEMO_EVICTIONS, /**< memo entries evicted to stay in size */
+  SHELL_COUNTER_COUNT
+} shell_counter_t;
+
+/**
+ * @brief Gauges, which go up and down.
+ */
+typedef enum shell_gauge {
+  SHELL_GAUGE_JOBS_RUNNING, /**< Background jobs not reaped yet */
+  SHELL_GAUGE_COUNT
+} shell_gauge_t;
+
+/**
+ * @brief The merged counts of one histogram.
+ */
+typedef struct shell_histogram_snapshot {
+  uint64_t count;                        /**< Values recorded */
+  uint64_t sum;                          /**< Sum of the values */
+  uint64_t buckets[SHELL_STATS_BUCKETS]; /**< Values per bucket */
+} shell_histogram_snapshot_t;
+
+/**
+ * @brief Current time for the histograms (ns, CLOCK_MONOTONIC).
+ *
+ * @return The time.
+ */
+uint64_t shell_stats_now(void);
+
+/**
+ * @brief Records a value in a histogram.
+ *
+ * Every thread records into its own shard with plain atomic stores, so there
+ * are no locks and no shared cache lines on the hot path; readers add the
+ * shards up.
+ *
+ * @param histogram The histogram.
+ * @param value The value (ns for durations).
+ */
+void shell_stats_record(shell_histogram_t histogram, uint64_t value);
+
+/**
+ * @brief Records the time elapsed since start.
+ *
+ * @param histogram The histogram.
+ * @param start A time from shell_stats_now().
+ */
+void shell_stats_since(shell_histogram_t histogram, uint64_t start);
+
+/**
+ * @brief Adds one to a counter.
+ *
+ * @param counter The counter.
+ */
+void shell_stats_count(shell_counter_t counter);
+
+/**
+ * @brief Moves a gauge.
+ *
+ * @param gauge The gauge.
+ * @param delta What to add (negative to subtract).
+ */
+void shell_stats_gauge_add(shell_gauge_t gauge, int64_t delta);
+
+/**
+ * @brief Reads a counter, summed over every thread.
+ *
+ * @param counter The counter.
+ * @return Its value.
+ */
+uint64_t shell_stats_counter(shell_counter_t counter);
+
+/**
+ * @brief Reads a histogram, summed over every thread.
+ *
+ * @param histogram The histogram.
+ * @param snapshot Receives the counts.
+ */
+void shell_stats_snapshot(shell_histogram_t histogram,
+                          shell_histogram_snapshot_t *snapshot);
+
+/**
+ * @brief Estimates a quantile from a snapshot.
+ *
+ * @param snapshot The counts.
+ * @param quantile Between 0 and 1.
+ * @return The largest value of the bucket holding the quantile, or 0 if the
+ * histogram is empty.
+ */
+uint64_t shell_stats_quantile(const shell_histogram_snapshot_t *snapshot,
+                              double quantile);
+
+/**
+ * @brief Formats every metric in the Prometheus text format.
+ *
+ * Durations are exported in seconds. The `le` buckets are fixed boundaries;
+ * each counts the HDR buckets that end at or below it.
+ *
+ * @return A string the caller frees with free().
+ */
+char *shell_stats_render(void);
+
+/**
+ * @brief Prints count, median, p90, p99 and max of every histogram, and the
+ * counters.
+ */
+void shell_stats_print(void);
+
+/**
+ * @brief Serves the metrics on a Unix socket from a background thread.
+ *
+ * Each connection gets the output of shell_stats_render() and is closed. A
+ * client that sends an HTTP GET (e.g. `curl --unix-socket`) gets an HTTP
+ * response, anything else the bare text. A previous socket at the same path
+ * is replaced, and a socket already being served is closed first.
+ *
+ * @param path The socket path.
+ * @return 0 on success, -1 on error (errno is set).
+ */
+int shell_stats_listen(const char *path);
+
+/**
+ * @brief Stops serving and removes the socket.
+ */
+void shell_stats_close(void);
+
+#endif // SHELL_STATS_H
@@ -0,0 +1,154 @@
+#ifndef SHELLCORE_H
+#define SHELLCORE_H
+
+#include <stddef.h>
+
+/**
+ * @brief Longest error message kept by a context.
+ */
+#define SHELL_ERROR_SIZE 256
+
+/**
+ * @brief Bytes read from a command's output before handing them to
+ * on_output.
+ */
+#define SHELL_READ_SIZE 4096
+
+/**
+ * @brief Result codes. Every function that can fail returns one of these
+ * instead of exiting; shell_ctx_error() describes the last one.
+ */
+typedef enum shell_result {
+  SHELL_OK = 0,
+  SHELL_ERR_NO_MEMORY = -1,   /**< An allocation failed */
+  SHELL_ERR_SYNTAX = -2,      /**< The line could not be parsed */
+  SHELL_ERR_SYSTEM = -3,      /**< A system call failed (errno is set) */
+  SHELL_ERR_UNSUPPORTED = -4  /**< Valid for the shell, not for the library */
+} shell_result_t;
+
+/**
+ * @brief An independent shell: its own running pipelines, working directory
+ * and error message.
+ *
+ * A context holds no global state, so several of them can run on different
+ * threads at once. A single context must only be used by one thread at a
+ * time.
+ */
+typedef struct shell_ctx shell_ctx_t;
+
+/**
+ * @brief What a run reports back. Callbacks are only called from
+ * shell_ctx_poll(), on the thread that polls.
+ */
+typedef struct shell_callbacks {
+  /**
+   * @brief Output from the run; NULL lets the commands write to the
+   * process's own stdout and stderr.
+   *
+   * @param data The pointer given to shell_run().
+   * @param run The run, as returned by shell_run().
+   * @param fd 1 for the last stage's stdout, 2 for the stderr of any stage.
+   * @param bytes The output, not NUL-terminated.
+   * @param length Number of bytes.
+   */
+  void (*on_output)(void *data, int run, int fd, const char *bytes,
+                    size_t length);
+
+  /**
+   * @brief The run finished: every stage exited and its output was
+   * delivered. May be NULL.
+   *
+   * @param data The pointer given to shell_run().
+   * @param run The run.
+   * @param status Wait status of the last stage, as from waitpid(). A stage
+   * that could not be started counts as exit status 127.
+   */
+  void (*on_exit)(void *data, int run, int status);
+} shell_callbacks_t;
+
+/**
+ * @brief Creates a context.
+ *
+ * @return The context, or NULL on error (errno is set).
+ */
+shell_ctx_t *shell_ctx_create(void);
+
+/**
+ * @brief Kills and reaps the runs still going and frees the context.
+ *
+ * Their on_exit callbacks are not called. Must not be called from a
+ * callback.
+ *
+ * @param ctx The context (can be NULL).
+ */
+void shell_ctx_destroy(shell_ctx_t *ctx);
+
+/**
+ * @brief Sets the directory the context's commands start in.
+ *
+ * The process's own working directory is not changed, so contexts on other
+ * threads are not affected.
+ *
+ * @param ctx The context.
+ * @param directory The directory, relative to the context's current one, or
+ * NULL for the process's.
+ * @return SHELL_OK, or SHELL_ERR_SYSTEM if it is not a directory.
+ */
+int shell_ctx_chdir(shell_ctx_t *ctx, const char *directory);
+
+/**
+ * @brief Starts a command line and returns without waiting for it.
+ *
+ * The line is split into pipeline stages and parsed like the shell does,
+ * with quotes and redirections (`<`, `>`, `>>`, `<>`, `2>&1`, `n>&-`, `&>`,
+ * `<<<`), and patterns expanded in the context's working directory.
+ * Commands are looked up in PATH and started with posix_spawnp(), so
+ * the caller's other threads never run in a half-forked child. The first
+ * stage reads /dev/null unless its input is redirected. The shell's
+ * built-ins (other than `echo`, which runs from PATH), `&`, process
+ * substitution and here-documents (whose bodies come from the lines after
+ * the command) are rejected with SHELL_ERR_UNSUPPORTED.
+ *
+ * Children are watched through pidfds and reaped with waitpid() on their own
+ * PID, so the caller must not reap them (with wait(), or by setting SIGCHLD
+ * to SIG_IGN).
+ *
+ * @param ctx The context.
+ * @param line The command line.
+ * @param callbacks How to report output and exit, or NULL for neither.
+ * @param data Passed to the callbacks.
+ * @return A positive run number, or a negative shell_result_t.
+ */
+int shell_run(shell_ctx_t *ctx, const char *line,
+              const shell_callbacks_t *callbacks, void *data);
+
+/**
+ * @brief Delivers output and exits of the context's runs.
+ *
+ * Callbacks may start new runs on the same context.
+ *
+ * @param ctx The context.
+ * @param timeout_ms Longest wait for something to happen, -1 for no limit.
+ * @return Number of runs still going (0 returns at once), or a negative
+ * shell_result_t.
+ */
+int shell_ctx_poll(shell_ctx_t *ctx, int timeout_ms);
+
+/**
+ * @brief A descriptor that becomes readable when shell_ctx_poll() has work,
+ * to wait on the context from the caller's own event loop.
+ *
+ * @param ctx The context.
+ * @return The descriptor, owned by the context.
+ */
+int shell_ctx_fd(const shell_ctx_t *ctx);
+
+/**
+ * @brief Describes the last error of the context.
+ *
+ * @param ctx The context.
+ * @return The message, empty if there was none.
+ */
+const char *shell_ctx_error(const shell_ctx_t *ctx);
+
+#endif // SHELLCORE_H
@@ -0,0 +1,130 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief Environment variable with the file the execution trace is written
+ * to. Tracing is off when it is not set.
+ */
+#define SHELL_TRACE_ENV "SHELL_TRACE"
+
+/**
+ * @brief Events kept in the ring; once it is full, the oldest are dropped.
+ */
+#define TRACE_RING_EVENTS 32768
+
+/**
+ * @brief Longest detail stored with an event (e.g. a command line).
+ */
+#define TRACE_DETAIL_SIZE 48
+
+/**
+ * @brief Non-zero while tracing. Read it through the inline helpers below.
+ */
+extern int trace_enabled;
+
+/**
+ * @brief Starts recording events.
+ *
+ * The ring is allocated here, so a shell that never traces pays only the
+ * trace_enabled test at each instrumented point. The trace is written when
+ * the process exits (only the shell itself writes it, not its forked
+ * children), on trace_flush() and on trace_stop().
+ *
+ * @param path The file for the Chrome trace JSON.
+ * @return 0 on success, -1 on error.
+ */
+int trace_start(const char *path);
+
+/**
+ * @brief Writes the events in the ring as Chrome trace JSON.
+ *
+ * The file can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ * The shell is one track and every child process gets its own, named after
+ * its command. Timestamps are in microseconds of CLOCK_MONOTONIC.
+ *
+ * @return 0 on success, -1 if the file cannot be written.
+ */
+int trace_flush(void);
+
+/**
+ * @brief Writes the trace and stops recording.
+ */
+void trace_stop(void);
+
+/**
+ * @brief Stores an event; use the inline helpers instead.
+ *
+ * @param phase 'B' (begin), 'E' (end) or 'M' (track name).
+ * @param track The process the event belongs to, 0 for the shell.
+ * @param name Event name; must be a string literal or otherwise outlive the
+ * trace.
+ * @param detail Copied and truncated to TRACE_DETAIL_SIZE, may be NULL.
+ */
+void trace_record(char phase, pid_t track, const char *name,
+                  const char *detail);
+
+/**
+ * @brief Opens a span on the shell's track.
+ *
+ * @param name What starts (e.g. "parse").
+ * @param detail Shown with the event, may be NULL.
+ */
+static inline void trace_begin(const char *name, const char *detail) {
+  if (__builtin_expect(trace_enabled, 0)) {
+    trace_record('B', 0, name, detail);
+  }
+}
+
+/**
+ * @brief Closes the innermost span on the shell's track.
+ *
+ * @param name The name given to trace_begin().
+ */
+static inline void trace_end(const char *name) {
+  if (__builtin_expect(trace_enabled, 0)) {
+    trace_record('E', 0, name, NULL);
+  }
+}
+
+/**
+ * @brief Opens a span on a child's track.
+ *
+ * @param track The child's PID.
+ * @param name What starts (e.g. "exec").
+ * @param detail Shown with the event, may be NULL.
+ */
+static inline void trace_begin_on(pid_t track, const char *name,
+                                  const char *detail) {
+  if (__builtin_expect(trace_enabled, 0)) {
+    trace_record('B', track, name, detail);
+  }
+}
+
+/**
+ * @brief Closes the innermost span on a child's track.
+ *
+ * @param track The child's PID.
+ * @param name The name given to trace_begin_on().
+ */
+static inline void trace_end_on(pid_t track, const char *name) {
+  if (__builtin_expect(trace_enabled, 0)) {
+    trace_record('E', track, name, NULL);
+  }
+}
+
+/**
+ * @brief Names a child's track.
+ *
+ * @param track The child's PID.
+ * @param command Its command line.
+ */
+static inline void trace_name_track(pid_t track, const char *command) {
+  if (__builtin_expect(trace_enabled, 0)) {
+    trace_record('M', track, "process_name", command);
+  }
+}
+
+#endif // TRACE_H
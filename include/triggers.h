@@ -0,0 +1,124 @@
+#ifndef TRIGGERS_H
+#define TRIGGERS_H
+
+#include "metric_record.h"
+#include <stddef.h>
+
+/**
+ * @brief Most rules registered at the same time.
+ */
+#define TRIGGER_MAX_RULES 32
+
+/**
+ * @brief Default minimum time between two firings of a rule (s).
+ */
+#define TRIGGER_DEFAULT_COOLDOWN 60
+
+/**
+ * @brief Default hysteresis, as a fraction of the threshold.
+ */
+#define TRIGGER_DEFAULT_HYSTERESIS 0.05
+
+/**
+ * @brief A threshold rule and its evaluation state.
+ */
+typedef struct trigger {
+  int id;                      /**< Number shown by `trigger list` */
+  char *condition;             /**< Rule text before "->" */
+  char *action;                /**< Command line run when it fires */
+  const metric_field_t *field; /**< Metric compared */
+  int above;                   /**< Non-zero for > and >= */
+  int inclusive;               /**< Non-zero for >= and <= */
+  double threshold;            /**< Value the metric is compared with */
+  double clear_level;          /**< Value that re-arms the rule */
+  double duration;             /**< Time the condition must hold (s) */
+  double cooldown;             /**< Minimum time between firings (s) */
+  double since;                /**< When it began to hold, 0 if not */
+  double last_fired;           /**< Timestamp of the last firing, 0 if none */
+  int armed;                   /**< Zero after firing, until cleared */
+  int pending;                 /**< Fired, action not launched yet */
+  double pending_value;        /**< Value that made it fire */
+  unsigned long fired;         /**< Times it fired */
+} trigger_t;
+
+/**
+ * @brief Registers a rule.
+ *
+ * Syntax: `metric op value [for D] [cooldown D] [clear value] -> command`,
+ * where op is one of `>`, `>=`, `<`, `<=` and D a duration such as `30s`.
+ * The metric is a sample field name or one of the aliases `cpu`, `mem` and
+ * `procs`.
+ *
+ * The rule fires once the condition has held for `for` (default 0). It then
+ * stays disarmed until the metric comes back past `clear` (default: the
+ * threshold moved back by TRIGGER_DEFAULT_HYSTERESIS), and never fires twice
+ * within `cooldown` (default TRIGGER_DEFAULT_COOLDOWN seconds).
+ *
+ * @param rule The rule text.
+ * @param error Receives a message when the rule is rejected.
+ * @param error_size Size of error.
+ * @return The id of the new rule, or -1 if it was rejected.
+ */
+int trigger_add(const char *rule, char *error, size_t error_size);
+
+/**
+ * @brief Removes a rule.
+ *
+ * @param id The rule id.
+ * @return 0 on success, -1 if there is no such rule.
+ */
+int trigger_remove(int id);
+
+/**
+ * @brief Looks up a rule.
+ *
+ * @param id The rule id.
+ * @return The rule, or NULL if there is none with that id.
+ */
+const trigger_t *trigger_find(int id);
+
+/**
+ * @brief Removes every rule.
+ */
+void triggers_clear(void);
+
+/**
+ * @brief Number of rules registered.
+ *
+ * @return The count.
+ */
+size_t triggers_count(void);
+
+/**
+ * @brief Prints the rules and their state.
+ */
+void triggers_print(void);
+
+/**
+ * @brief Evaluates every rule against a new sample.
+ *
+ * Durations are measured with the sample timestamps, so samples read late
+ * (the shell was busy) are judged as if they arrived on time. Rules that
+ * fire are only marked; triggers_run_pending() launches their actions.
+ *
+ * @param sample The sample.
+ */
+void triggers_evaluate(const metrics_sample_t *sample);
+
+/**
+ * @brief Number of rules that fired and wait for their action to start.
+ *
+ * @return The count.
+ */
+int triggers_pending(void);
+
+/**
+ * @brief Launches the actions of the rules that fired as background jobs.
+ *
+ * TRIGGER_METRIC and TRIGGER_VALUE are set in the action's environment.
+ *
+ * @return The number of actions launched.
+ */
+int triggers_run_pending(void);
+
+#endif // TRIGGERS_H
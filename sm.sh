@@ -0,0 +1 @@
+status_monitor -c
@@ -1,209 +1,673 @@
+#define _GNU_SOURCE
 #include "commands.h"
+#include "history_log.h"
+#include "job_usage.h"
+#include "memo.h"
+#include "metrics_archive.h"
+#include "metrics_demand.h"
+#include "metrics_history.h"
+#include "metrics_shm.h"
+#include "monitor_config.h"
+#include "monitor_supervisor.h"
 #include "parse.h"
+#include "path_cache.h"
 #include "shell.h"
-#include <cjson/cJSON.h>
-#include <dirent.h>
+#include "shell_stats.h"
+#include "trace.h"
+#include "triggers.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
+#include <poll.h>
 #include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #define BUFFER_SIZE 4096 // General buffer size for reading data
 #define JSON_ACCUMULATED_BUFFER_SIZE                                           \
   (BUFFER_SIZE * 2) // Buffer size for accumulated JSON data
 
-#define MONITOR_PID_FILE "/tmp/monitor_pid"
 #define MONITOR_PIPE "/tmp/monitor_pipe"
+#define MONITOR_RECORDER_PID_FILE "/tmp/monitor_recorder_pid"
+#define RECORDER_POLL_MS 200 // Pause between reads of the ring
+#define RECORDER_REOPEN_SECONDS 5 // Ring without samples: map it again
+#define PIPE_WAIT_MS 2000 // Longest wait for a monitor still on the FIFO
+#define METRICS_STALE_SECONDS 5 // Older samples get a warning
+#define WATCH_DEFAULT_INTERVAL 1.0 // Seconds between redraws in --watch
+#define WATCH_MIN_INTERVAL 0.01
+#define WATCH_MAX_EVENTS 4
 #define MAX_READ_ATTEMPTS 5 // Maximum number of read attempts
-#define PID_WAIT_TIME                                                          \
-  1 // Sleep time in seconds to wait for the process to terminate
 
 #define CLEAR_SCREEN_CODE "\033[H\033[J" // ANSI escape code to clear screen
-pid_t monitor_pid = 0;
+static metrics_shm_t *metrics_reader = NULL; // Mapped on first use
+static job_usage_t *timed_usage = NULL; // Set while 'time' runs a command
 
 int cmd_searchconfig(char **args) {
+  int arg = 1;
+  int num_threads = 0; // 0: un hilo por CPU
+  int use_index = 0;
+  int rebuild = 0;
+  const char *pattern = NULL; // NULL: mostrar los archivos completos
+
+  // Options: '-j N' walker threads, '-e key' only lines containing key,
+  // '--index' use the persistent index, '--rebuild' discard it first
+  while (args[arg] != NULL && args[arg][0] == '-') {
+    if (strcmp(args[arg], "-e") == 0) {
+      if (args[arg + 1] == NULL || args[arg + 1][0] == '\0') {
+        printf("searchconfig: -e needs a pattern\n");
+        return 1;
+      }
+      pattern = args[arg + 1];
+      arg += 2;
+    } else if (strcmp(args[arg], "-j") == 0) {
+      if (args[arg + 1] == NULL || atoi(args[arg + 1]) <= 0) {
+        printf("searchconfig: -j needs a positive number of threads\n");
+        return 1;
+      }
+      num_threads = atoi(args[arg + 1]);
+      arg += 2;
+    } else if (strcmp(args[arg], "--index") == 0) {
+      use_index = 1;
+      arg++;
+    } else if (strcmp(args[arg], "--rebuild") == 0) {
+      use_index = 1;
+      rebuild = 1;
+      arg++;
+    } else {
+      break;
+    }
+  }
+
   // Check if the user provided a directory
-  if (args[1] == NULL) {
-    printf("Usage: searchconfig <directory> [extension]\n");
+  if (args[arg] == NULL) {
+    printf("Usage: searchconfig [-j threads] [-e pattern] [--index] "
+           "[--rebuild] <directory> [extension]\n");
     return 1;
   }
 
-  const char *directory = args[1];
+  const char *directory = args[arg];
   // Default extension is ".config" if not provided
-  const char *extension = args[2] ? args[2] : ".config";
+  const char *extension = args[arg + 1] ? args[arg + 1] : ".config";
 
   printf("Exploring directory: %s for '%s' files\n", directory, extension);
 
-  search_directory_recursive(directory, extension);
+  if (use_index) {
+    config_matches_t matches;
+    if (config_index_query(directory, extension, rebuild, &matches) == 0) {
+      print_config_matches(&matches, pattern);
+    }
+    config_matches_free(&matches);
+  } else {
+    search_directory_recursive(directory, extension, num_threads, pattern);
+  }
 
   return 1; // Continue the shell
 }
 
-// Implement the recursive directory traversal function
-void search_directory_recursive(const char *directory, const char *extension) {
-  DIR *dir = opendir(directory);
-  if (!dir) {
-    perror(directory);
-    return;
-  }
+static volatile sig_atomic_t recorder_running = 1;
 
-  struct dirent *entry;
-  char path[PATH_MAX]; // Use PATH_MAX for maximum path length
+static void recorder_stop(int signum) {
+  (void)signum;
+  recorder_running = 0;
+}
 
-  while ((entry = readdir(dir)) != NULL) {
-    // Skip '.' and '..' directories
-    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-      continue;
+/* Proceso grabador: copia al archivo cada muestra nueva del ring hasta
+ * recibir SIGTERM, y entonces escribe el ultimo bloque */
+static void run_recorder(metrics_archive_writer_t *writer) {
+  signal(SIGINT, SIG_IGN);
+  signal(SIGTSTP, SIG_IGN);
+  signal(SIGQUIT, SIG_IGN);
+  signal(SIGCHLD, SIG_DFL);
+  struct sigaction sa_term;
+  sa_term.sa_handler = &recorder_stop;
+  sigemptyset(&sa_term.sa_mask);
+  sa_term.sa_flags = 0; // Sin SA_RESTART: corta el nanosleep
+  sigaction(SIGTERM, &sa_term, NULL);
+
+  metrics_shm_t *ring = NULL;
+  uint64_t last_seen = 0;
+  double last_written = 0;
+  int idle_polls = 0;
+  metrics_sample_t samples[METRICS_RING_SLOTS];
+
+  while (recorder_running) {
+    metrics_demand_touch(METRICS_DEMAND_LEASE_SECONDS);
+    if (!ring) {
+      ring = metrics_shm_open(METRICS_SHM_NAME);
+      last_seen = 0;
+      idle_polls = 0;
+    }
+    if (ring) {
+      size_t count = metrics_shm_read_new(ring, &last_seen, samples);
+      idle_polls = count == 0 ? idle_polls + 1 : 0;
+      for (size_t i = 0; i < count; i++) {
+        if (samples[i].timestamp <= last_written) {
+          continue;
+        }
+        if (metrics_archive_append(writer, &samples[i]) == -1) {
+          perror("Monitor: recorder");
+        }
+        last_written = samples[i].timestamp;
+      }
+      // Un monitor nuevo pudo haber creado otro ring con el mismo nombre
+      if (idle_polls * RECORDER_POLL_MS > RECORDER_REOPEN_SECONDS * 1000) {
+        metrics_shm_close(ring);
+        ring = NULL;
+      }
     }
 
-    // Build the full path
-    snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+    struct timespec pause = {0, RECORDER_POLL_MS * 1000000L};
+    nanosleep(&pause, NULL);
+  }
 
-    struct stat statbuf;
-    if (stat(path, &statbuf) == -1) {
-      perror(path);
-      continue;
+  if (metrics_archive_close(writer) == -1) {
+    perror("Monitor: recorder");
+    _exit(EXIT_FAILURE);
+  }
+  _exit(EXIT_SUCCESS);
+}
+
+/* Detiene el grabador anterior, si lo hay. SIGTERM le deja escribir el
+ * bloque que tenga a medio llenar */
+static void stop_recorder(void) {
+  FILE *pid_file = fopen(MONITOR_RECORDER_PID_FILE, "r");
+  if (!pid_file) {
+    return;
+  }
+  pid_t recorder_pid;
+  if (fscanf(pid_file, "%d", &recorder_pid) == 1 && recorder_pid > 0 &&
+      kill(recorder_pid, SIGTERM) == 0) {
+    printf("Monitor: recorder (PID: %d) stopped.\n", recorder_pid);
+  }
+  fclose(pid_file);
+  remove(MONITOR_RECORDER_PID_FILE);
+}
+
+static void start_recorder(const char *path) {
+  stop_recorder();
+
+  // Se abre aca para informar enseguida si el archivo no sirve
+  metrics_archive_writer_t *writer = metrics_archive_create(path);
+  if (!writer) {
+    fprintf(stderr, "Monitor: cannot record to %s: %s\n", path,
+            strerror(errno));
+    return;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("Monitor: recorder fork");
+  } else if (pid == 0) {
+    run_recorder(writer);
+  } else {
+    FILE *pid_file = fopen(MONITOR_RECORDER_PID_FILE, "w");
+    if (pid_file) {
+      fprintf(pid_file, "%d\n", pid);
+      fclose(pid_file);
     }
+    printf("Recording samples to %s (recorder PID: %d)\n", path, pid);
+  }
+  // El hijo tiene su propia copia; esta no tiene muestras que escribir
+  metrics_archive_close(writer);
+}
 
-    if (S_ISDIR(statbuf.st_mode)) {
-      // Recursively search subdirectories
-      search_directory_recursive(path, extension);
-    } else if (S_ISREG(statbuf.st_mode)) {
-      // Check if the file has the desired extension
-      if (has_extension(entry->d_name, extension)) {
-        printf("\nConfiguration file found: %s\n", path);
-        print_file_content(path);
-      }
+int cmd_start_monitor(char **args) {
+  const char *record_path = NULL;
+  for (int i = 1; args[i] != NULL; i++) {
+    if (strcmp(args[i], "--record") == 0 && args[i + 1] != NULL) {
+      record_path = args[++i];
+    } else {
+      printf("Usage: start_monitor [--record file]\n");
+      return 1;
     }
   }
 
-  closedir(dir);
+  // Detiene el monitor anterior, lanza el nuevo y espera a que este listo
+  if (monitor_start() != -1 && record_path) {
+    start_recorder(record_path);
+  }
+  return 1;
 }
 
-// Helper function to check if a filename has the given extension
-int has_extension(const char *filename, const char *extension) {
-  const char *dot = strrchr(filename, '.');
-  if (!dot || dot == filename)
+int cmd_stop_monitor() {
+  stop_recorder();
+
+  if (monitor_stop() == -1) {
+    fprintf(stderr, "Monitor: no monitoring process is running.\n");
+  }
+  return 1; // Indicate to the shell to keep running
+}
+
+/* Flujo JSON de los monitores que todavia publican por el FIFO. Los objetos
+ * pueden llegar partidos entre lecturas. */
+typedef struct json_stream {
+  char buffer[JSON_ACCUMULATED_BUFFER_SIZE];
+  size_t used;
+} json_stream_t;
+
+/* Lee lo disponible y se queda con el ultimo objeto completo. Devuelve 1 si
+ * actualizo la muestra, 0 si no, -1 si el escritor cerro o hubo un error */
+static int json_stream_read(json_stream_t *stream, int fd,
+                            metrics_sample_t *sample) {
+  ssize_t bytes_read =
+      read(fd, stream->buffer + stream->used,
+           sizeof(stream->buffer) - 1 - stream->used);
+  if (bytes_read == -1 && (errno == EAGAIN || errno == EINTR)) {
     return 0;
-  return strcmp(dot, extension) == 0;
+  }
+  if (bytes_read <= 0) {
+    return -1;
+  }
+  stream->used += bytes_read;
+  stream->buffer[stream->used] = '\0';
+
+  char *end = strrchr(stream->buffer, '}');
+  if (!end) {
+    if (stream->used == sizeof(stream->buffer) - 1) {
+      stream->used = 0; // Basura sin objetos: descartar
+    }
+    return 0;
+  }
+  int updated = 0;
+  *end = '\0';
+  char *start = strrchr(stream->buffer, '{');
+  *end = '}';
+  if (start) {
+    char saved = end[1];
+    end[1] = '\0';
+    if (metric_sample_from_json(start, sample) == 0) {
+      updated = 1;
+    }
+    end[1] = saved;
+  }
+  // Conservar el objeto incompleto que sigue al ultimo completo
+  size_t rest = stream->used - (size_t)(end + 1 - stream->buffer);
+  memmove(stream->buffer, end + 1, rest);
+  stream->used = rest;
+
+  if (updated && sample->timestamp == 0) {
+    // El JSON del monitor no trae la hora de la muestra
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    sample->timestamp = now.tv_sec + now.tv_nsec / 1e9;
+  }
+  return updated;
 }
 
-// Helper function to print the content of a file
-void print_file_content(const char *filepath) {
-  printf("Content of %s:\n", filepath);
+/* Lectura unica por el FIFO: se espera a lo sumo PIPE_WAIT_MS por la primera
+ * muestra y despues se toma lo que ya este disponible */
+static int read_latest_from_pipe(metrics_sample_t *sample) {
+  int fd = open(MONITOR_PIPE, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    perror("Error opening pipe to read metrics");
+    return -1;
+  }
+
+  json_stream_t stream;
+  stream.used = 0;
+  int found = -1;
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (poll(&pfd, 1, found == 0 ? 0 : PIPE_WAIT_MS) > 0) {
+    int result = json_stream_read(&stream, fd, sample);
+    if (result == -1) {
+      break; // Sin escritor
+    }
+    if (result == 1) {
+      found = 0;
+    }
+  }
+  close(fd);
+
+  if (found == -1) {
+    fprintf(stderr, "Monitor: no metrics available. Is the monitor running?\n");
+  }
+  return found;
+}
 
-  FILE *file = fopen(filepath, "r");
-  if (!file) {
-    perror(filepath);
+/* Costo del propio monitor, para saber cuanto cuesta mirar */
+static void print_overhead(void) {
+  monitor_overhead_t overhead;
+  if (monitor_overhead(&overhead) == -1) {
     return;
   }
+  printf("Collector (PID %d): %.2f%% CPU over %.1f s", overhead.pid,
+         overhead.cpu_percent, overhead.period);
+  if (overhead.sample_interval > 0) {
+    printf(", %.2f ms per sample, one every %.0f ms",
+           overhead.cpu_ms_per_sample, overhead.sample_interval * 1000);
+  }
+  printf("\n");
+}
 
-  char line[256];
-  while (fgets(line, sizeof(line), file)) {
-    printf("%s", line);
+static void print_metrics(const char *option, const metrics_sample_t *sample) {
+  if (strcmp(option, "--json") == 0) {
+    char *json = metric_sample_to_json(sample);
+    if (json) {
+      printf("%s\n", json);
+      free(json);
+    }
+    return;
   }
 
-  fclose(file);
+  printf("\n------ Monitoring System ------\n");
+
+  if (strcmp(option, "-c") == 0) // CPU
+  {
+    printf("CPU Usage: %.2f%%\n", sample->cpu_usage_percentage);
+  } else if (strcmp(option, "-m") == 0) // Memory
+  {
+    printf("Memory Usage: %.2f%%\n", sample->memory_usage_percentage);
+  } else if (strcmp(option, "-d") == 0) // Disk
+  {
+    printf("Disk Reads: %.0f\n", sample->disk_reads);
+    printf("Disk Writes: %.0f\n", sample->disk_writes);
+    printf("Disk Read Time (s): %.2f\n", sample->disk_read_time_seconds);
+    printf("Disk Write Time (s): %.2f\n", sample->disk_write_time_seconds);
+  } else if (strcmp(option, "-n") == 0) // Network
+  {
+    printf("Network RX (bytes): %.0f\n", sample->network_bandwidth_rx);
+    printf("Network TX (bytes): %.0f\n", sample->network_bandwidth_tx);
+    printf("Packet Ratio: %.2f\n", sample->network_packet_ratio);
+  } else if (strcmp(option, "-p") == 0) // Processes and Context Switches
+  {
+    printf("Running Processes: %.0f\n", sample->running_processes_count);
+    printf("Context Switches: %.0f\n", sample->context_switches_total);
+  } else // Show all metrics
+  {
+    printf("CPU Usage: %.2f%%\n", sample->cpu_usage_percentage);
+    printf("Memory Usage: %.2f%%\n", sample->memory_usage_percentage);
+    printf("Disk Reads: %.0f\n", sample->disk_reads);
+    printf("Disk Writes: %.0f\n", sample->disk_writes);
+    printf("Disk Read Time (s): %.2f\n", sample->disk_read_time_seconds);
+    printf("Disk Write Time (s): %.2f\n", sample->disk_write_time_seconds);
+    printf("Network RX (bytes): %.0f\n", sample->network_bandwidth_rx);
+    printf("Network TX (bytes): %.0f\n", sample->network_bandwidth_tx);
+    printf("Packet Ratio: %.2f\n", sample->network_packet_ratio);
+    printf("Running Processes: %.0f\n", sample->running_processes_count);
+    printf("Context Switches: %.0f\n", sample->context_switches_total);
+    print_overhead();
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  double age = now.tv_sec + now.tv_nsec / 1e9 - sample->timestamp;
+  if (age > METRICS_STALE_SECONDS) {
+    printf("(last sample is %.0f s old, is the monitor running?)\n", age);
+  }
+
+  printf("----------------------------------\n");
+}
+
+/* Muestra mas nueva del ring; el ring se mapea la primera vez que existe y
+ * a partir de ahi las lecturas no hacen syscalls */
+static int read_latest_from_ring(metrics_sample_t *sample) {
+  // Mientras alguien mira, el colector muestrea a la tasa configurada
+  metrics_demand_touch(METRICS_DEMAND_LEASE_SECONDS);
+  if (!metrics_reader) {
+    metrics_reader = metrics_shm_open(METRICS_SHM_NAME);
+  }
+  return metrics_reader &&
+                 metrics_shm_read_latest(metrics_reader, sample, NULL) == 0
+             ? 0
+             : -1;
 }
 
-int cmd_start_monitor() {
-  // Verificar si ya hay un proceso de monitoreo activo leyendo el archivo de
-  // PID
-  FILE *pid_file = fopen(MONITOR_PID_FILE, "r");
-  if (pid_file) {
-    pid_t existing_pid;
-    if (fscanf(pid_file, "%d", &existing_pid) == 1) {
-      // Si el proceso está activo, detenerlo antes de iniciar uno nuevo
-      if (kill(existing_pid, 0) == 0) {
-        printf("Stopping existing monitoring process (PID: %d)\n",
-               existing_pid);
-        kill(existing_pid, SIGTERM);
-        sleep(PID_WAIT_TIME); // Esperar un momento para asegurar que el proceso
-                              // termine
+/* Agrega o quita un descriptor del epoll del modo --watch */
+static int watch_fd(int epoll_fd, int op, int fd) {
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = fd;
+  return epoll_ctl(epoll_fd, op, fd, &event);
+}
+
+/* Modo --watch: un solo bucle de eventos con un timerfd para el refresco, un
+ * signalfd para Ctrl-C y, si el monitor todavia usa el FIFO, el FIFO */
+static void watch_metrics(const char *option, double interval, long count) {
+  sigset_t mask;
+  sigset_t old_mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  // Bloqueada, SIGINT queda pendiente y se lee por el signalfd
+  sigprocmask(SIG_BLOCK, &mask, &old_mask);
+
+  int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (signal_fd == -1 || timer_fd == -1 || epoll_fd == -1 ||
+      watch_fd(epoll_fd, EPOLL_CTL_ADD, signal_fd) == -1 ||
+      watch_fd(epoll_fd, EPOLL_CTL_ADD, timer_fd) == -1) {
+    perror("Monitor: watch");
+    goto cleanup;
+  }
+
+  struct itimerspec timer;
+  timer.it_interval.tv_sec = (time_t)interval;
+  timer.it_interval.tv_nsec = (long)((interval - (time_t)interval) * 1e9);
+  timer.it_value.tv_sec = 0;
+  timer.it_value.tv_nsec = 1; // Primera muestra de inmediato
+  timerfd_settime(timer_fd, 0, &timer, NULL);
+
+  int redraw = isatty(STDOUT_FILENO);
+  int pipe_fd = -1;
+  json_stream_t stream;
+  stream.used = 0;
+  metrics_sample_t sample;
+  int have_sample = 0;
+  long shown = 0;
+  int running = 1;
+
+  while (running && (count == 0 || shown < count)) {
+    struct epoll_event events[WATCH_MAX_EVENTS];
+    int ready = epoll_wait(epoll_fd, events, WATCH_MAX_EVENTS, -1);
+    if (ready == -1) {
+      if (errno == EINTR) {
+        continue; // SIGCHLD de algun trabajo en segundo plano
       }
+      perror("Monitor: epoll_wait");
+      break;
     }
-    fclose(pid_file);
-  }
 
-  // Iniciar un nuevo proceso de monitoreo
-  pid_t pid = fork();
-  if (pid < 0) {
-    perror("Error starting the monitoring process");
-    return 1;
-  } else if (pid == 0) {
-    // Proceso hijo: redirigir stdout y stderr a /dev/null para evitar mostrar
-    // en pantalla
-    int fd_null = open("/dev/null", O_WRONLY);
-    if (fd_null == -1) {
-      perror("Error opening /dev/null");
-      exit(EXIT_FAILURE);
-    }
-    dup2(fd_null, STDOUT_FILENO);
-    dup2(fd_null, STDERR_FILENO);
-    close(fd_null);
-
-    // Ejecutar el monitor en la ruta especificada
-    execlp("./monitoring_project", "monitoring_project", NULL);
-
-    // Si execlp falla
-    perror("Error executing the monitoring program");
-    exit(EXIT_FAILURE);
-  } else {
-    // Proceso padre: guardar el PID en el archivo y mostrar mensaje
-    monitor_pid = pid;
-    pid_file = fopen(MONITOR_PID_FILE, "w");
-    if (pid_file) {
-      fprintf(pid_file, "%d\n", monitor_pid);
-      fclose(pid_file);
+    for (int i = 0; i < ready && running; i++) {
+      int fd = events[i].data.fd;
+
+      if (fd == signal_fd) {
+        struct signalfd_siginfo info;
+        read(signal_fd, &info, sizeof(info));
+        running = 0;
+      } else if (fd == pipe_fd) {
+        int result = json_stream_read(&stream, pipe_fd, &sample);
+        if (result == -1) {
+          // El monitor cerro el FIFO: se reabre en el proximo tick
+          watch_fd(epoll_fd, EPOLL_CTL_DEL, pipe_fd);
+          close(pipe_fd);
+          pipe_fd = -1;
+          stream.used = 0;
+        } else if (result == 1) {
+          have_sample = 1; // Un objeto a medias no es una muestra
+        }
+      } else if (fd == timer_fd) {
+        uint64_t expirations;
+        read(timer_fd, &expirations, sizeof(expirations));
+
+        if (read_latest_from_ring(&sample) == 0) {
+          have_sample = 1;
+        } else if (pipe_fd == -1) {
+          pipe_fd = open(MONITOR_PIPE, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+          if (pipe_fd != -1 &&
+              watch_fd(epoll_fd, EPOLL_CTL_ADD, pipe_fd) == -1) {
+            close(pipe_fd);
+            pipe_fd = -1;
+          }
+        }
+
+        if (redraw) {
+          printf(CLEAR_SCREEN_CODE);
+        }
+        shell_tick();
+        if (have_sample) {
+          print_metrics(option, &sample);
+          shown++;
+        } else if (redraw) {
+          printf("Monitor: waiting for metrics...\n");
+        }
+        if (redraw) {
+          printf("Refreshing every %.2f s, Ctrl-C to stop.\n", interval);
+        }
+        fflush(stdout);
+      }
     }
-    printf("Monitoring process started with PID: %d\n", monitor_pid);
   }
-  return 1;
-}
 
-int cmd_stop_monitor() {
-  // Open the PID file to read the monitoring process PID
-  FILE *pid_file = fopen(MONITOR_PID_FILE, "r");
-  if (!pid_file) {
-    perror("Monitor: Could not open PID file. Is the monitor running?");
-    return 1;
+  if (pipe_fd != -1) {
+    close(pipe_fd);
   }
 
-  pid_t existing_pid;
-  if (fscanf(pid_file, "%d", &existing_pid) != 1) {
-    fprintf(stderr, "Monitor: Could not read PID from file.\n");
-    fclose(pid_file);
-    return 1;
+cleanup:
+  if (epoll_fd != -1) {
+    close(epoll_fd);
   }
-  fclose(pid_file);
+  if (timer_fd != -1) {
+    close(timer_fd);
+  }
+  if (signal_fd != -1) {
+    close(signal_fd);
+  }
+  sigprocmask(SIG_SETMASK, &old_mask, NULL);
+}
 
-  // Send SIGKILL to stop the monitoring process directly
-  if (kill(existing_pid, SIGKILL) == -1) {
-    perror("Monitor: Error sending SIGKILL to monitoring process");
-    return 1;
+/* Metricas de --history: cada una aparece con las opciones de su lista */
+static const struct {
+  const char *options;
+  const char *field;
+  const char *label;
+} history_metrics[] = {
+    {"c", "cpu_usage_percentage", "CPU Usage (%)"},
+    {"m", "memory_usage_percentage", "Memory Usage (%)"},
+    {"d", "disk_reads", "Disk Reads (/s)"},
+    {"d", "disk_writes", "Disk Writes (/s)"},
+    {"n", "network_bandwidth_rx", "Network RX (bytes/s)"},
+    {"n", "network_bandwidth_tx", "Network TX (bytes/s)"},
+    {"p", "running_processes_count", "Running Processes"},
+    {"ps", "context_switches_total", "Context Switches (/s)"},
+};
+
+static void print_history(const char *option, const char *window_text,
+                          double window, const double *percentiles,
+                          size_t count) {
+  double quantiles[METRICS_HISTORY_MAX_QUANTILES];
+  for (size_t i = 0; i < count; i++) {
+    quantiles[i] = percentiles[i] / 100;
   }
 
-  // Delete the PID file after stopping the process
-  if (remove(MONITOR_PID_FILE) != 0) {
-    perror("Monitor: Error deleting PID file");
-    // Not critical, so we don't return an error
-  } else {
-    printf("Monitor: PID file deleted successfully.\n");
+  printf("\n------ Metric History (last %s) ------\n", window_text);
+  int shown = 0;
+  for (size_t m = 0; m < sizeof(history_metrics) / sizeof(history_metrics[0]);
+       m++) {
+    if (option[0] != '\0' &&
+        (option[0] != '-' || option[1] == '\0' || option[2] != '\0' ||
+         !strchr(history_metrics[m].options, option[1]))) {
+      continue;
+    }
+
+    double values[METRICS_HISTORY_MAX_QUANTILES];
+    metrics_summary_t summary;
+    if (metrics_history_query(history_metrics[m].field, window, quantiles,
+                              count, values, &summary) == -1) {
+      printf("%s: no samples\n", history_metrics[m].label);
+      continue;
+    }
+
+    printf("%s: avg %.2f min %.2f max %.2f", history_metrics[m].label,
+           summary.avg, summary.min, summary.max);
+    for (size_t i = 0; i < count; i++) {
+      printf(" p%g %.2f", percentiles[i], values[i]);
+    }
+    printf(" (%zu samples, %.0f s buckets)\n", summary.count,
+           summary.resolution);
+    shown++;
   }
 
-  return 1; // Indicate to the shell to keep running
+  if (shown == 0) {
+    printf("(no history yet, is the monitor running?)\n");
+  }
+  printf("----------------------------------\n");
 }
 
-int cmd_status_monitor(const char *option) {
+int cmd_status_monitor(char **args) {
+  const char *option = ""; // Sin opcion: todas las metricas
+  int history = 0;
+  const char *window_text = NULL; // La ventana solo vale con --history
+  double window = 600;
+  double percentiles[METRICS_HISTORY_MAX_QUANTILES];
+  size_t percentile_count = 0;
+  int watch = 0;
+  double interval = WATCH_DEFAULT_INTERVAL;
+  long count = 0; // 0: hasta Ctrl-C
+
+  for (int i = 1; args[i] != NULL; i++) {
+    if (strcmp(args[i], "--watch") == 0) {
+      watch = 1;
+      // El intervalo es opcional: segundos sin unidad o una duracion (2s)
+      char *end;
+      if (args[i + 1] != NULL) {
+        double value = strtod(args[i + 1], &end);
+        if ((end != args[i + 1] && *end == '\0') ||
+            parse_duration(args[i + 1], &value) == 0) {
+          if (value < WATCH_MIN_INTERVAL) {
+            printf("status_monitor: interval must be at least %.2f s\n",
+                   WATCH_MIN_INTERVAL);
+            return 1;
+          }
+          interval = value;
+          i++;
+        }
+      }
+    } else if (strcmp(args[i], "--count") == 0) {
+      if (args[i + 1] == NULL || atol(args[i + 1]) <= 0) {
+        printf("status_monitor: --count needs a positive number\n");
+        return 1;
+      }
+      count = atol(args[++i]);
+      watch = 1;
+    } else if (strcmp(args[i], "--history") == 0) {
+      history = 1;
+    } else if (strncmp(args[i], "--p", 3) == 0) {
+      char *end;
+      double value = strtod(args[i] + 3, &end);
+      if (end == args[i] + 3 || *end != '\0' || value < 0 || value > 100) {
+        printf("status_monitor: bad percentile '%s'\n", args[i]);
+        return 1;
+      }
+      if (percentile_count == METRICS_HISTORY_MAX_QUANTILES) {
+        printf("status_monitor: at most %d percentiles\n",
+               METRICS_HISTORY_MAX_QUANTILES);
+        return 1;
+      }
+      percentiles[percentile_count++] = value;
+      history = 1;
+    } else if (parse_duration(args[i], &window) == 0) {
+      window_text = args[i];
+    } else {
+      option = args[i];
+    }
+  }
+
   if (strcmp(option, "--help") == 0) {
     printf("\n--- Help for status_monitor command ---\n");
-    printf("Usage: status_monitor [options]\n");
+    printf("Usage: status_monitor [options] [--watch [interval]] "
+           "[--count N]\n");
+    printf("       status_monitor [options] --history [window] [--pNN ...]"
+           "\n");
     printf("Options:\n");
     printf("  -c     Shows only CPU usage\n");
     printf("  -m     Shows only memory usage\n");
@@ -212,117 +676,465 @@ int cmd_status_monitor(const char *option) {
         "  -n     Shows only network statistics (bandwidth, packet ratio)\n");
     printf("  -p     Shows only the count of running processes\n");
     printf("  -s     Shows only context switches\n");
+    printf("  --json Prints the newest sample as JSON\n");
+    printf("  --watch [interval] Refreshes every interval (1, 0.5, 500ms, 2s; "
+           "default 1 s) until Ctrl-C\n");
+    printf("  --count N          Stops after N samples\n");
+    printf("  --history [window] Summarizes the last window (30s, 10m, 2h, "
+           "1d; default 10m)\n");
+    printf("  --pNN              Adds the NN percentile to --history (e.g. "
+           "--p95)\n");
     printf("No option: Shows all system metrics\n");
     printf("-------------------------------------------\n\n");
     return 1;
   }
 
-  int fd = open(MONITOR_PIPE, O_RDONLY);
-  if (fd == -1) {
-    perror("Error opening pipe to read metrics");
+  if (window_text && !history) {
+    printf("status_monitor: window '%s' needs --history\n", window_text);
     return 1;
   }
 
-  char buffer[BUFFER_SIZE];
-  ssize_t bytes_read;
-  cJSON *root = NULL;
+  if (history) {
+    if (!window_text) {
+      window_text = "10m";
+    }
+    if (percentile_count == 0) {
+      percentiles[percentile_count++] = 50;
+      percentiles[percentile_count++] = 95;
+      percentiles[percentile_count++] = 99;
+    }
+    shell_tick();
+    print_history(option, window_text, window, percentiles, percentile_count);
+    return 1;
+  }
 
-  while ((bytes_read = read(fd, buffer, sizeof(buffer) - 1)) > 0) {
-    buffer[bytes_read] = '\0';
+  if (watch) {
+    watch_metrics(option, interval, count);
+    return 1;
+  }
+
+  metrics_sample_t sample;
+  if (read_latest_from_ring(&sample) == 0 ||
+      read_latest_from_pipe(&sample) == 0) {
+    print_metrics(option, &sample);
+  }
+  return 1;
+}
 
-    // Identify the last complete JSON object in the buffer
-    char *start = strrchr(buffer, '{');
-    char *end = strrchr(buffer, '}');
+static int print_sample_json(const metrics_sample_t *sample, void *data) {
+  (void)data;
+  char *json = metric_sample_to_json(sample);
+  if (json) {
+    printf("%s\n", json);
+    free(json);
+  }
+  return 0;
+}
 
-    if (start && end && end > start) {
-      size_t json_length = end - start + 1;
-      char json_object[json_length + 1];
-      strncpy(json_object, start, json_length);
-      json_object[json_length] = '\0';
+int cmd_replay_monitor(char **args) {
+  const char *path = NULL;
+  const metric_field_t *only = NULL; // NULL: todos los campos
+  double from = -INFINITY;
+  double to = INFINITY;
+  double last_window = 0;
+  int json = 0;
 
-      root = cJSON_Parse(json_object);
-      if (!root) {
-        fprintf(stderr, "Error parsing JSON or incomplete JSON: %s\n",
-                json_object);
-        continue;
+  for (int i = 1; args[i] != NULL; i++) {
+    if (strcmp(args[i], "-f") == 0 && args[i + 1] != NULL) {
+      only = metric_field_find(args[++i]);
+      if (!only) {
+        printf("replay_monitor: unknown field '%s'\n", args[i]);
+        return 1;
       }
+    } else if (strcmp(args[i], "--from") == 0 && args[i + 1] != NULL) {
+      from = strtod(args[++i], NULL);
+    } else if (strcmp(args[i], "--to") == 0 && args[i + 1] != NULL) {
+      to = strtod(args[++i], NULL);
+    } else if (strcmp(args[i], "--last") == 0 && args[i + 1] != NULL) {
+      if (parse_duration(args[++i], &last_window) == -1) {
+        printf("replay_monitor: bad window '%s'\n", args[i]);
+        return 1;
+      }
+    } else if (strcmp(args[i], "--json") == 0) {
+      json = 1;
+    } else if (!path && args[i][0] != '-') {
+      path = args[i];
+    } else {
+      path = NULL;
+      break;
+    }
+  }
+  if (!path) {
+    printf("Usage: replay_monitor <file> [-f field] [--from epoch] "
+           "[--to epoch] [--last window] [--json]\n");
+    return 1;
+  }
 
-      printf("\n------ Monitoring System ------\n");
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
-      if (strcmp(option, "-c") == 0) // CPU
-      {
-        cJSON *item = cJSON_GetObjectItem(root, "cpu_usage_percentage");
-        printf("CPU Usage: %.2f%%\n", item ? item->valuedouble : 0.0);
-      } else if (strcmp(option, "-m") == 0) // Memory
-      {
-        cJSON *item = cJSON_GetObjectItem(root, "memory_usage_percentage");
-        printf("Memory Usage: %.2f%%\n", item ? item->valuedouble : 0.0);
-      } else if (strcmp(option, "-d") == 0) // Disk
-      {
-        cJSON *item = cJSON_GetObjectItem(root, "disk_reads");
-        printf("Disk Reads: %.0f\n", item ? item->valuedouble : 0.0);
-        item = cJSON_GetObjectItem(root, "disk_writes");
-        printf("Disk Writes: %.0f\n", item ? item->valuedouble : 0.0);
-        item = cJSON_GetObjectItem(root, "disk_read_time_seconds");
-        printf("Disk Read Time (s): %.2f\n", item ? item->valuedouble : 0.0);
-        item = cJSON_GetObjectItem(root, "disk_write_time_seconds");
-        printf("Disk Write Time (s): %.2f\n", item ? item->valuedouble : 0.0);
-      } else if (strcmp(option, "-n") == 0) // Network
-      {
-        cJSON *item = cJSON_GetObjectItem(root, "network_bandwidth_rx");
-        printf("Network RX (bytes): %.0f\n", item ? item->valuedouble : 0.0);
-        item = cJSON_GetObjectItem(root, "network_bandwidth_tx");
-        printf("Network TX (bytes): %.0f\n", item ? item->valuedouble : 0.0);
-        item = cJSON_GetObjectItem(root, "network_packet_ratio");
-        printf("Packet Ratio: %.2f\n", item ? item->valuedouble : 0.0);
-      } else if (strcmp(option, "-p") == 0) // Processes and Context Switches
-      {
-        cJSON *item = cJSON_GetObjectItem(root, "running_processes_count");
-        printf("Running Processes: %.0f\n", item ? item->valuedouble : 0.0);
-        item = cJSON_GetObjectItem(root, "context_switches_total");
-        printf("Context Switches: %.0f\n", item ? item->valuedouble : 0.0);
-      } else // Show all metrics
-      {
-        printf("CPU Usage: %.2f%%\n",
-               cJSON_GetObjectItem(root, "cpu_usage_percentage")->valuedouble);
-        printf(
-            "Memory Usage: %.2f%%\n",
-            cJSON_GetObjectItem(root, "memory_usage_percentage")->valuedouble);
-        printf("Disk Reads: %.0f\n",
-               cJSON_GetObjectItem(root, "disk_reads")->valuedouble);
-        printf("Disk Writes: %.0f\n",
-               cJSON_GetObjectItem(root, "disk_writes")->valuedouble);
-        printf(
-            "Disk Read Time (s): %.2f\n",
-            cJSON_GetObjectItem(root, "disk_read_time_seconds")->valuedouble);
-        printf(
-            "Disk Write Time (s): %.2f\n",
-            cJSON_GetObjectItem(root, "disk_write_time_seconds")->valuedouble);
-        printf("Network RX (bytes): %.0f\n",
-               cJSON_GetObjectItem(root, "network_bandwidth_rx")->valuedouble);
-        printf("Network TX (bytes): %.0f\n",
-               cJSON_GetObjectItem(root, "network_bandwidth_tx")->valuedouble);
-        printf("Packet Ratio: %.2f\n",
-               cJSON_GetObjectItem(root, "network_packet_ratio")->valuedouble);
-        printf(
-            "Running Processes: %.0f\n",
-            cJSON_GetObjectItem(root, "running_processes_count")->valuedouble);
-        printf(
-            "Context Switches: %.0f\n",
-            cJSON_GetObjectItem(root, "context_switches_total")->valuedouble);
-      }
+  metrics_archive_t archive;
+  if (metrics_archive_open(path, &archive) == -1) {
+    fprintf(stderr, "replay_monitor: %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+  double first;
+  double last;
+  if (metrics_archive_span(&archive, &first, &last) == -1) {
+    printf("replay_monitor: %s has no samples yet\n", path);
+    metrics_archive_unmap(&archive);
+    return 1;
+  }
+  // --last cuenta hacia atras desde la muestra mas nueva del archivo
+  if (last_window > 0) {
+    to = last;
+    from = last - last_window;
+  }
 
-      printf("----------------------------------\n");
+  if (json) {
+    if (metrics_archive_scan(&archive, from, to, print_sample_json, NULL) ==
+        -1) {
+      fprintf(stderr, "replay_monitor: %s is corrupt\n", path);
+    }
+    metrics_archive_unmap(&archive);
+    return 1;
+  }
 
-      cJSON_Delete(root);
+  printf("\n------ Recording: %s ------\n", path);
+  size_t count;
+  const metric_field_t *fields = metric_fields(&count);
+  size_t scanned = 0;
+  size_t decoded = 0;
+  int shown = 0;
+  for (size_t i = 0; i < count; i++) {
+    const metric_field_t *field = &fields[i];
+    if ((only && field != only) || (!only && i == 0)) {
+      continue; // El timestamp solo si se pide con -f
     }
+    metrics_aggregate_t aggregate;
+    if (metrics_archive_aggregate(&archive, field, from, to, &aggregate) ==
+        -1) {
+      fprintf(stderr, "replay_monitor: %s is corrupt\n", path);
+      break;
+    }
+    if (aggregate.count == 0) {
+      printf("No samples in the range.\n");
+      break;
+    }
+    if (shown++ == 0) {
+      printf("Samples: %zu over %.0f s\n", aggregate.count,
+             aggregate.last - aggregate.first);
+    }
+    printf("%s: avg %.2f min %.2f max %.2f\n", field->name,
+           aggregate.sum / aggregate.count, aggregate.min, aggregate.max);
+    scanned = aggregate.blocks_scanned;
+    decoded = aggregate.blocks_decoded;
   }
+  metrics_archive_unmap(&archive);
+
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("Scanned %zu blocks (%zu decompressed) in %.2f ms\n", scanned,
+         decoded,
+         (end.tv_sec - start.tv_sec) * 1e3 +
+             (end.tv_nsec - start.tv_nsec) / 1e6);
+  printf("----------------------------------\n");
+  return 1;
+}
 
-  if (bytes_read == -1) {
-    perror("Error reading from pipe");
+int cmd_monitor_config(char **args) {
+  char error[BUFFER_SIZE];
+  monitor_config_t config;
+
+  if (args[1] == NULL || strcmp(args[1], "get") == 0) {
+    // Lo que el monitor usa ahora; si no escucha, lo que leera al iniciar
+    if (monitor_control_get(MONITOR_CONTROL_SOCKET, &config, error,
+                            sizeof(error)) == 0) {
+      printf("Live configuration of the monitor:\n");
+    } else if (monitor_config_load(MONITOR_CONFIG_FILE, &config) == 0) {
+      printf("Configuration in %s (%s):\n", MONITOR_CONFIG_FILE, error);
+    } else {
+      fprintf(stderr, "monitor_config: %s: %s\n", MONITOR_CONFIG_FILE,
+              strerror(errno));
+      return 1;
+    }
+    monitor_config_print(&config);
+    return 1;
   }
 
-  close(fd);
+  if (strcmp(args[1], "set") != 0 || args[2] == NULL) {
+    printf("Usage: monitor_config [get]\n");
+    printf("       monitor_config set key=value ...\n");
+    printf("  interval  Time between samples (e.g. 500ms, 2s)\n");
+    printf("  metrics   Comma-separated metrics (e.g. cpu,mem) or all\n");
+    return 1;
+  }
+
+  if (monitor_config_load(MONITOR_CONFIG_FILE, &config) == -1) {
+    fprintf(stderr, "monitor_config: %s: %s\n", MONITOR_CONFIG_FILE,
+            strerror(errno));
+    return 1;
+  }
+  for (int i = 2; args[i] != NULL; i++) {
+    if (monitor_config_assign(&config, args[i], error, sizeof(error)) == -1) {
+      printf("monitor_config: %s\n", error);
+      return 1;
+    }
+  }
+
+  // Primero el archivo, asi un monitor que reinicie arranca con lo nuevo
+  if (monitor_config_save(MONITOR_CONFIG_FILE, &config) == -1) {
+    fprintf(stderr, "monitor_config: cannot write %s: %s\n",
+            MONITOR_CONFIG_FILE, strerror(errno));
+    return 1;
+  }
+  int sent = monitor_control_set(MONITOR_CONTROL_SOCKET, &config, error,
+                                 sizeof(error));
+  if (sent == 0) {
+    printf("Saved to %s and applied by the monitor:\n", MONITOR_CONFIG_FILE);
+  } else if (sent == -1) {
+    printf("Saved to %s; the monitor will apply it when it starts (%s).\n",
+           MONITOR_CONFIG_FILE, error);
+  } else {
+    printf("Saved to %s, but the monitor did not apply it: %s\n",
+           MONITOR_CONFIG_FILE, error);
+  }
+  monitor_config_print(&config);
+  return 1;
+}
+
+int cmd_trigger(const char *line) {
+  const char *rest = line + strlen("trigger");
+  rest += strspn(rest, " \t");
+  size_t length = strcspn(rest, " \t");
+  const char *argument = rest + length + strspn(rest + length, " \t");
+
+  if (length == 3 && strncmp(rest, "add", 3) == 0) {
+    char error[BUFFER_SIZE];
+    int id = trigger_add(argument, error, sizeof(error));
+    if (id == -1) {
+      printf("trigger: %s\n", error);
+    } else {
+      printf("Trigger %d added.\n", id);
+    }
+  } else if (length == 3 && strncmp(rest, "del", 3) == 0) {
+    if (trigger_remove(atoi(argument)) == -1) {
+      printf("trigger: no trigger '%s'\n", argument);
+    }
+  } else if (length == 4 && strncmp(rest, "list", 4) == 0) {
+    triggers_print();
+  } else if (length == 5 && strncmp(rest, "clear", 5) == 0) {
+    triggers_clear();
+  } else {
+    printf("\n--- Help for trigger command ---\n");
+    printf("Usage: trigger add <metric><op><value> [for D] [cooldown D] "
+           "[clear value] -> command\n");
+    printf("       trigger list | del <id> | clear\n");
+    printf("  metric   cpu, mem, procs or any field of status_monitor "
+           "--json\n");
+    printf("  op       >, >=, < or <=\n");
+    printf("  for      How long the condition must hold (e.g. 30s)\n");
+    printf("  cooldown Minimum time between two runs (default %ds)\n",
+           TRIGGER_DEFAULT_COOLDOWN);
+    printf("  clear    Value that re-arms the rule (default: %.0f%% back "
+           "from the threshold)\n",
+           TRIGGER_DEFAULT_HYSTERESIS * 100);
+    printf("The command runs as a background job with TRIGGER_METRIC and "
+           "TRIGGER_VALUE set.\n");
+    printf("-------------------------------------------\n\n");
+  }
+  return 1;
+}
+
+int cmd_jobs(char **args) {
+  int details = args[1] != NULL && strcmp(args[1], "-l") == 0;
+  if (args[1] != NULL && !details) {
+    printf("Usage: jobs [-l]\n");
+    return 1;
+  }
+  // En modo batch nadie atiende SIGCHLD entre comandos
+  sigchld_handler_logic();
+  print_jobs(details);
+  return 1;
+}
+
+int cmd_time(const char *line) {
+  const char *rest = line + strlen("time");
+  rest += strspn(rest, " \t");
+  if (*rest == '\0') {
+    printf("Usage: time <command>\n");
+    return 1;
+  }
+  char *command = strdup(rest);
+  if (!command) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  job_usage_t usage;
+  memset(&usage, 0, sizeof(usage));
+  job_usage_t *outer = timed_usage;
+  timed_usage = &usage;
+  struct rusage before, after;
+  struct timespec start, end;
+  getrusage(RUSAGE_SELF, &before);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int result = execute_command(command);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  getrusage(RUSAGE_SELF, &after);
+  timed_usage = outer;
+  // Un 'time' anidado tambien cuenta para el de afuera
+  if (outer) {
+    job_usage_add(outer, &usage);
+  }
+  // Lo que hizo la propia shell, por ejemplo un builtin
+  job_usage_add_delta(&usage, &before, &after);
+  usage.wall =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  job_usage_print(stderr, &usage);
+  free(command);
+  return result;
+}
+
+int cmd_shell_stats(char **args) {
+  if (args[1] == NULL) {
+    shell_stats_print();
+  } else if (strcmp(args[1], "--prometheus") == 0) {
+    char *text = shell_stats_render();
+    fputs(text, stdout);
+    free(text);
+  } else if (strcmp(args[1], "--listen") == 0 && args[2] != NULL) {
+    if (shell_stats_listen(args[2]) == -1) {
+      perror("shell_stats");
+    } else {
+      printf("Serving shell metrics on %s\n", args[2]);
+    }
+  } else if (strcmp(args[1], "--close") == 0) {
+    shell_stats_close();
+  } else {
+    printf("Usage: shell_stats [--prometheus | --listen <socket> | "
+           "--close]\n");
+  }
+  return 1;
+}
+
+#define HISTORY_DEFAULT_LINES 20 // Lo que muestra 'history' sin N
+
+static void print_history_entry(const history_entry_t *entry) {
+  time_t seconds = entry->start_ns / 1000000000;
+  struct tm when;
+  char stamp[32];
+  localtime_r(&seconds, &when);
+  strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &when);
+  printf("%s %9.3fs %3d  %s  (%s)\n", stamp, entry->duration_ns / 1e9,
+         entry->status, entry->command, entry->cwd);
+}
+
+int cmd_history(char **args) {
+  int search = args[1] && strcmp(args[1], "search") == 0;
+  const char *text = search ? args[2] : NULL;
+  const char *count_text = search ? (text ? args[3] : NULL) : args[1];
+  char *end = NULL;
+  long count = count_text ? strtol(count_text, &end, 10)
+                          : HISTORY_DEFAULT_LINES;
+  if ((search && !text) || (count_text && (*end != '\0' || count <= 0)) ||
+      (count_text && args[search ? 4 : 2])) {
+    printf("Usage: history [N] | history search <text> [N]\n");
+    return 1;
+  }
+  // En modo batch el historial no se abre al arrancar
+  const char *path = history_log_default_path();
+  if (history_log_count() == 0 && (!path || history_log_open(path) == -1)) {
+    printf("(no history)\n");
+    return 1;
+  }
+
+  history_entry_t *entries = malloc(count * sizeof(history_entry_t));
+  if (!entries) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  size_t found = search ? history_log_search(text, entries, count)
+                        : history_log_recent(entries, count);
+  // El mas viejo primero, como el historial de bash
+  while (found > 0) {
+    print_history_entry(&entries[--found]);
+  }
+  free(entries);
+  return 1;
+}
+
+int cmd_memo(char **args) {
+  if (args[1] && !args[2] && strcmp(args[1], "--stats") == 0) {
+    size_t entries = 0;
+    uint64_t bytes = 0;
+    const char *dir = memo_dir();
+    if (!dir || memo_usage(&entries, &bytes) == -1) {
+      perror("memo");
+      return 1;
+    }
+    printf("Cache:     %s\n", dir);
+    printf("Entries:   %zu (%.1f KiB)\n", entries, bytes / 1024.0);
+    printf("Hits:      %llu\n", (unsigned long long)shell_stats_counter(
+                                      SHELL_COUNTER_MEMO_HITS));
+    printf("Misses:    %llu\n", (unsigned long long)shell_stats_counter(
+                                      SHELL_COUNTER_MEMO_MISSES));
+    printf("Evictions: %llu\n", (unsigned long long)shell_stats_counter(
+                                      SHELL_COUNTER_MEMO_EVICTIONS));
+    return 1;
+  }
+  if (args[1] && !args[2] && strcmp(args[1], "--clear") == 0) {
+    int deleted = memo_clear();
+    if (deleted == -1) {
+      perror("memo");
+    } else {
+      printf("Deleted %d entries\n", deleted);
+    }
+    return 1;
+  }
+
+  // Una sola reserva para las tres listas, cada una con su NULL final
+  int count = 0;
+  while (args[count]) {
+    count++;
+  }
+  char **lists = calloc(3 * (count + 1), sizeof(char *));
+  if (!lists) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  memo_spec_t spec = {NULL, lists, lists + count + 1, lists + 2 * (count + 1)};
+  int envs = 0, inputs = 0, stamps = 0;
+  int i = 1;
+  for (; args[i] && args[i][0] == '-'; i++) {
+    if (strcmp(args[i], "--") == 0) {
+      i++;
+      break;
+    } else if (strcmp(args[i], "-e") == 0 && args[i + 1]) {
+      spec.env[envs++] = args[++i];
+    } else if (strcmp(args[i], "-i") == 0 && args[i + 1]) {
+      spec.inputs[inputs++] = args[++i];
+    } else if (strcmp(args[i], "-t") == 0 && args[i + 1]) {
+      spec.stamps[stamps++] = args[++i];
+    } else {
+      break;
+    }
+  }
+  if (!args[i] || args[i][0] == '-') {
+    printf("Usage: memo [-e VAR] [-i file] [-t file] [--] <command> | "
+           "memo --stats | memo --clear\n");
+    free(lists);
+    return 1;
+  }
+  spec.args = args + i;
+  int status;
+  if (memo_run(&spec, &status) == -1) {
+    status = EXIT_FAILURE;
+  }
+  last_status = status;
+  free(lists);
   return 1;
 }
 
@@ -332,11 +1144,35 @@ int cmd_help() {
   printf("clear              - Clears the screen.\n");
   printf("echo [text]        - Displays text or environment variables.\n");
   printf("quit               - Exits the shell.\n");
-  printf("start_monitor      - Starts the monitoring process.\n");
+  printf("start_monitor [--record file] - Starts the monitoring process, "
+         "optionally recording its samples to a compressed file.\n");
   printf("stop_monitor       - Stops the monitoring process.\n");
   printf("status_monitor     - Displays the system monitoring status.\n");
-  printf("searchconfig <directory> [extension] - Searches for configuration "
-         "files.\n");
+  printf("replay_monitor <file> [-f field] [--last window] - Summarizes a "
+         "recording made with start_monitor --record.\n");
+  printf("monitor_config [set key=value ...] - Shows or changes what the "
+         "monitor samples and how often, without restarting it.\n");
+  printf("searchconfig [-j N] <directory> [extension] - Searches for "
+         "configuration files using N threads.\n");
+  printf("searchconfig --index|--rebuild <directory> [extension] - Answers "
+         "from a persistent, auto-refreshed index.\n");
+  printf("searchconfig -e <pattern> <directory> [extension] - Prints only the "
+         "lines containing pattern.\n");
+  printf("trigger add <rule> -> <command> - Runs command when a monitor "
+         "metric crosses a limit (see 'trigger help').\n");
+  printf("jobs [-l]          - Lists background jobs; -l adds the PID and "
+         "the CPU, memory, faults and context switches of each.\n");
+  printf("time <command>     - Runs command and reports its wall and CPU "
+         "time, peak memory, faults and context switches.\n");
+  printf("shell_stats [--prometheus | --listen <socket>] - Shows the shell's "
+         "own latency histograms and counters, or serves them to "
+         "Prometheus.\n");
+  printf("history [N] | history search <text> [N] - Lists the newest "
+         "commands of every shell, or those containing text, with their "
+         "time, duration, status and directory.\n");
+  printf("memo [-e VAR] [-i file] [-t file] <command> - Replays the output "
+         "and status of an earlier identical run from a cache; --stats and "
+         "--clear manage it.\n");
   printf("help               - Shows this list of internal commands.\n");
 
   printf("\n--- External Commands ---\n");
@@ -356,6 +1192,17 @@ int cmd_help() {
   printf("  echo 'Hello' > file.txt    - Writes 'Hello' to file.txt.\n");
   printf("  cat < file.txt             - Reads and displays the contents of "
          "file.txt.\n");
+  printf("Use '>>' to append, '2>' to redirect errors, '2>&1' or '&>' to send "
+         "errors with the output, 'n<' / 'n>' for other descriptors, 'n>&-' to "
+         "close one and '<>' to open for reading and writing.\n");
+  printf("  make >> build.log 2>&1     - Appends output and errors to "
+         "build.log.\n");
+  printf("Use '<(cmd)' or '>(cmd)' to pass a running command as a file "
+         "name.\n");
+  printf("  diff <(sort a) <(sort b)   - Compares both sorted outputs.\n");
+  printf("Use '<<DELIM' to feed the following lines up to DELIM as input, and "
+         "'<<< word' to feed a single string.\n");
+  printf("  tr a-z A-Z <<< 'hello'     - Prints HELLO.\n");
 
   printf("\n--- Executing Command Scripts ---\n");
   printf("You can execute files with a series of commands by using: ./filename "
@@ -451,70 +1298,84 @@ int cmd_quit() {
   return 0; // Cuando retorna a 0 significa que sale de la shell
 }
 
-int execute_internal_command(char **args, char *input_file, char *output_file,
-                             int background) {
-  if (strcmp(args[0], "cd") == 0 || strcmp(args[0], "clear") == 0 ||
-      strcmp(args[0], "echo") == 0 || strcmp(args[0], "quit") == 0 ||
-      strcmp(args[0], "help") == 0 || strcmp(args[0], "start_monitor") == 0 ||
-      strcmp(args[0], "stop_monitor") == 0 ||
-      strcmp(args[0], "status_monitor") == 0 ||
-      strcmp(args[0], "searchconfig") == 0) // Verifica si el comando es interno
+/* Opciones de cada built-in, las que completa el TAB */
+static const char *const start_monitor_options[] = {"--record", NULL};
+static const char *const status_monitor_options[] = {
+    "-c", "-m", "-d", "-n", "-p", "-s", "--json", "--watch", "--count",
+    "--history", "--p50", "--p95", "--p99", "--help", NULL};
+static const char *const replay_monitor_options[] = {
+    "-f", "--from", "--to", "--last", "--json", NULL};
+static const char *const monitor_config_options[] = {"get", "set", NULL};
+static const char *const trigger_options[] = {"add", "list", "del", "clear",
+                                              NULL};
+static const char *const jobs_options[] = {"-l", NULL};
+static const char *const shell_stats_options[] = {"--prometheus", "--listen",
+                                                  "--close", NULL};
+static const char *const history_options[] = {"search", NULL};
+static const char *const memo_options[] = {"--stats", "--clear", "-e",
+                                           "-i", "-t", "--", NULL};
+static const char *const searchconfig_options[] = {"-j", "-e", "--index",
+                                                   "--rebuild", NULL};
+
+const builtin_t builtins[] = {
+    {"cd", NULL, 0},
+    {"clear", NULL, 0},
+    {"echo", NULL, 0},
+    {"quit", NULL, 0},
+    {"help", NULL, 0},
+    {"start_monitor", start_monitor_options, 0},
+    {"stop_monitor", NULL, 0},
+    {"status_monitor", status_monitor_options, 0},
+    {"replay_monitor", replay_monitor_options, 0},
+    {"monitor_config", monitor_config_options, 0},
+    {"trigger", trigger_options, 1},
+    {"jobs", jobs_options, 0},
+    {"time", NULL, 1},
+    {"shell_stats", shell_stats_options, 0},
+    {"memo", memo_options, 0},
+    {"history", history_options, 0},
+    {"searchconfig", searchconfig_options, 0},
+    {NULL, NULL, 0},
+};
+
+const builtin_t *builtin_find(const char *name) {
+  for (const builtin_t *builtin = builtins; builtin->name; builtin++) {
+    if (strcmp(builtin->name, name) == 0) {
+      return builtin;
+    }
+  }
+  return NULL;
+}
+
+int execute_internal_command(char **args, redir_t *redirs, int background) {
+  // 'trigger' y 'time' los atiende execute_command con la linea entera
+  const builtin_t *builtin = builtin_find(args[0]);
+  if (builtin && !builtin->whole_line) // Verifica si el comando es interno
   {
-    int saved_stdin = -1,
-        saved_stdout = -1;       // Descriptores de archivos originales
-    int fd_in = -1, fd_out = -1; // Descriptores de archivos (si se especifican)
-
-    /* Manejar redirección de entrada
-     * El uso de dup y dup2 me permiten redirigir STDIN o STDOUT a sus
-     * respectivos archivos para la ejecución de un código como echo EJ: echo
-     * "Hello, world!" > output.txt */
-    if (input_file) {
-      fd_in = open(input_file, O_RDONLY); // Leer archivo
-      if (fd_in == -1) {
-        perror("Shell: error al abrir archivo de entrada");
-        return 1;
-      }
-      saved_stdin = dup(STDIN_FILENO); // Se duplica para restauración
-      if (dup2(fd_in, STDIN_FILENO) ==
-          -1) // Permite modificar el archivo temporalmente sin tener que
-              // cambiar el original
-      {
-        perror("Shell: dup2 input");
-        close(fd_in);
-        return 1;
-      }
-      close(fd_in); // Ya no se usa, leo desde STDIN
-    }
-
-    // Manejar redirección de salida, lo mismo que lo anterior
-    if (output_file) {
-      fd_out = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-      /* O_CREAT -> Crea archivo si no existe
-       * O_TRUNC -> Vacía el contenido del archivo si este existe
-       */
-      if (fd_out == -1) {
-        perror("Shell: error al abrir archivo de salida");
-        if (saved_stdin != -1) {
-          dup2(saved_stdin, STDIN_FILENO);
-          close(saved_stdin);
-        }
-        return 1;
-      }
-      saved_stdout = dup(STDOUT_FILENO);
-      if (dup2(fd_out, STDOUT_FILENO) == -1) {
-        perror("Shell: dup2 output");
-        close(fd_out);
-        if (saved_stdin != -1) {
-          dup2(saved_stdin, STDIN_FILENO);
-          close(saved_stdin);
-        }
-        return 1;
-      }
-      close(fd_out);
+    /* Manejar redirecciones
+     * Los archivos se abren en el propio proceso de la shell y se aplican con
+     * dup2 sobre los descriptores originales, que se guardan para restaurarlos
+     * al terminar, EJ: echo "Hello, world!" > output.txt */
+    redir_saved_t saved;
+    saved.count = 0;
+    trace_begin("redirections", NULL);
+    int opened = redir_open(redirs, args);
+    trace_end("redirections");
+    if (opened == -1) {
+      return 1;
+    }
+    if (redir_apply(redirs, &saved) == -1) {
+      redir_restore(&saved);
+      redir_close(redirs);
+      redir_wait(redirs);
+      return 1;
     }
+    // La copia abierta ya no se usa, el built-in lee/escribe por 0, 1 y 2
+    redir_close(redirs);
 
     // Ejecutar el comando interno
     int result = -1;
+    trace_begin("builtin", args[0]);
     if (strcmp(args[0], "cd") == 0) {
       result = cmd_cd(args);
     } else if (strcmp(args[0], "clear") == 0) {
@@ -543,23 +1404,14 @@ int execute_internal_command(char **args, char *input_file, char *output_file,
           // Ejecutar el comando 'echo'
           result = cmd_echo(args);
 
-          // Restaurar los descriptores originales si STDIN o STDOUT fueron
-          // usados.
-          if (saved_stdin != -1) {
-            dup2(saved_stdin, STDIN_FILENO);
-            close(saved_stdin);
-          }
-          if (saved_stdout != -1) {
-            dup2(saved_stdout, STDOUT_FILENO);
-            close(saved_stdout);
-          }
-
-          // Terminar el proceso hijo
+          // Terminar el proceso hijo, exit vacia stdout en la redireccion
           exit(EXIT_SUCCESS);
         } else {
           // Proceso padre
 
           // Agregar el trabajo en segundo plano
+          trace_name_track(pid, "echo");
+          trace_begin_on(pid, "run", NULL);
           int job_id = add_job(pid, "echo");
           if (job_id !=
               -1) // Se agregó el trabajo en segundo plano exitosamente
@@ -577,28 +1429,30 @@ int execute_internal_command(char **args, char *input_file, char *output_file,
     } else if (strcmp(args[0], "quit") == 0) {
       result = cmd_quit();
     } else if (strcmp(args[0], "start_monitor") == 0) {
-      result = cmd_start_monitor();
+      result = cmd_start_monitor(args);
     } else if (strcmp(args[0], "stop_monitor") == 0) {
       result = cmd_stop_monitor();
     } else if (strcmp(args[0], "status_monitor") == 0) {
-      // Manejar opción adicional para status_monitor
-      const char *option =
-          args[1] ? args[1] : ""; // Obtiene el argumento, si existe
-      result = cmd_status_monitor(option);
-    }
-
-    // Restaurar los descriptores originales si STDIN o STDOUT fueron usados.
-    if (!background) // Ya se restauraron en el proceso hijo si es en segundo
-                     // plano
-    {
-      if (saved_stdin != -1) {
-        dup2(saved_stdin, STDIN_FILENO);
-        close(saved_stdin);
-      }
-      if (saved_stdout != -1) {
-        dup2(saved_stdout, STDOUT_FILENO);
-        close(saved_stdout);
-      }
+      result = cmd_status_monitor(args);
+    } else if (strcmp(args[0], "replay_monitor") == 0) {
+      result = cmd_replay_monitor(args);
+    } else if (strcmp(args[0], "monitor_config") == 0) {
+      result = cmd_monitor_config(args);
+    } else if (strcmp(args[0], "jobs") == 0) {
+      result = cmd_jobs(args);
+    } else if (strcmp(args[0], "shell_stats") == 0) {
+      result = cmd_shell_stats(args);
+    } else if (strcmp(args[0], "memo") == 0) {
+      result = cmd_memo(args);
+    } else if (strcmp(args[0], "history") == 0) {
+      result = cmd_history(args);
+    }
+    trace_end("builtin");
+
+    // Restaurar los descriptores originales
+    redir_restore(&saved);
+    if (!background) {
+      redir_wait(redirs);
     }
 
     return result;
@@ -607,15 +1461,123 @@ int execute_internal_command(char **args, char *input_file, char *output_file,
   return -1; // No es un comando interno
 }
 
+/* Pipe O_CLOEXEC para saber si el exec del hijo funciono: el exec lo cierra
+ * sin escribir nada, y si falla el hijo escribe errno antes de salir */
+static void exec_report_open(int fds[2]) {
+  if (pipe2(fds, O_CLOEXEC) == -1) {
+    fds[0] = fds[1] = -1; // Sin informe: solo se pierde la metrica
+  }
+}
+
+/* En el hijo: 0 si sale sin intentar el exec, errno si el exec fallo */
+static void exec_report_send(int fds[2], int error) {
+  if (fds[1] != -1) {
+    ssize_t written = write(fds[1], &error, sizeof(error));
+    (void)written;
+  }
+}
+
+/* En el padre: espera al exec del hijo y registra la latencia o el fallo. En
+ * la traza, la pista del hijo pasa de "exec" a "run" hasta que se lo espera */
+static void exec_report_wait(int fds[2], pid_t pid, const char *name,
+                             uint64_t start) {
+  const char *outcome = NULL;
+  if (fds[0] != -1) {
+    close(fds[1]);
+    int error = 0;
+    ssize_t count;
+    do {
+      count = read(fds[0], &error, sizeof(error));
+    } while (count == -1 && errno == EINTR);
+    close(fds[0]);
+
+    if (count == 0) {
+      shell_stats_since(SHELL_HIST_SPAWN, start);
+    } else if (count == sizeof(error) && error != 0) {
+      shell_stats_count(SHELL_COUNTER_EXEC_FAILURES);
+      path_cache_forget(name); // Quiza se movio: buscarlo de nuevo
+      outcome = "exec failed";
+    }
+  }
+  trace_end_on(pid, "exec");
+  trace_begin_on(pid, "run", outcome);
+}
+
+/* Abre la pista de un hijo recien creado en la traza */
+static void trace_child(pid_t pid, const char *command) {
+  trace_name_track(pid, command);
+  trace_begin_on(pid, "exec", NULL);
+}
+
+/* Reemplaza al hijo por el comando; solo retorna si el exec fallo */
+static void exec_command(char **args, const char *path) {
+  // execv y execvp reemplazan el proceso actual por el programa. Con la ruta
+  // de la cache no hace falta que execvp pruebe cada directorio de PATH
+  if (path) {
+    execv(path, args);
+  }
+  execvp(args[0], args);
+}
+
+/* El estado de waitpid como lo reporta sh en $? */
+static int exit_code(int status) {
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  if (WIFSIGNALED(status)) {
+    return 128 + WTERMSIG(status);
+  }
+  return WIFSTOPPED(status) ? 128 + WSTOPSIG(status) : 1;
+}
+
+/* Espera a un hijo en primer plano y suma sus recursos si 'time' mide */
+static pid_t wait_foreground(pid_t pid, int *status, int options) {
+  struct rusage usage;
+  pid_t wpid = wait4(pid, status, options, &usage);
+  if (wpid > 0 && !WIFSTOPPED(*status)) {
+    trace_end_on(wpid, "run");
+    if (timed_usage) {
+      job_usage_add_rusage(timed_usage, &usage);
+    }
+  }
+  return wpid;
+}
+
 int execute_external_command(char **args, int background, char *command_copy,
-                             char *input_file, char *output_file) {
+                             redir_t *redirs) {
   pid_t pid;
   int status;
 
+  /* Los archivos y here-documents se abren en el padre (O_CLOEXEC) y el hijo
+   * solo hace dup2, asi un error de apertura no cuesta un fork */
+  trace_begin("redirections", NULL);
+  int opened = redir_open(redirs, args);
+  trace_end("redirections");
+  if (opened == -1) {
+    last_status = 1;
+    return 1;
+  }
+
+  // Los comandos sin '/' se buscan en PATH una sola vez
+  const char *path = strchr(args[0], '/') ? NULL : path_cache_lookup(args[0]);
+  int report[2];
+  exec_report_open(report);
+
+  uint64_t start = shell_stats_now();
+  trace_begin("fork", args[0]);
   pid = fork(); // Proceso hijo.
+  if (pid != 0) {
+    trace_end("fork");
+  }
   if (pid < 0) {
     // Error en fork
     perror("Shell: fork");
+    last_status = 1;
+    redir_close(redirs);
+    if (report[0] != -1) {
+      close(report[0]);
+      close(report[1]);
+    }
     return 1;
   } else if (pid == 0) {
     // Proceso hijo
@@ -627,53 +1589,25 @@ int execute_external_command(char **args, int background, char *command_copy,
     signal(SIGTSTP, SIG_DFL);
     signal(SIGQUIT, SIG_DFL);
 
-    // Manejar redirección de entrada, explicado en el anterior bloque
-    if (input_file) {
-      int fd_in = open(input_file, O_RDONLY);
-      if (fd_in == -1) {
-        perror("Shell: error al abrir archivo de entrada");
-        exit(EXIT_FAILURE);
-      }
-      if (dup2(fd_in, STDIN_FILENO) == -1) {
-        perror("Shell: dup2 input");
-        close(fd_in);
-        exit(EXIT_FAILURE);
-      }
-      close(fd_in);
+    // Aplicar las redirecciones en el orden de la linea de comandos
+    if (redir_apply(redirs, NULL) == -1) {
+      exec_report_send(report, 0);
+      _exit(EXIT_FAILURE);
     }
 
-    // Manejar redirección de salida
-    if (output_file) {
-      int fd_out = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-      if (fd_out == -1) {
-        perror("Shell: error al abrir archivo de salida");
-        exit(EXIT_FAILURE);
-      }
-      if (dup2(fd_out, STDOUT_FILENO) == -1) {
-        perror("Shell: dup2 output");
-        close(fd_out);
-        exit(EXIT_FAILURE);
-      }
-      close(fd_out);
-    }
-
-    // Ejecutar el comando, execv y execvp reemplazan el proceso actual por el
-    // programa especificado execv usa el comando con el directorio
-    // especificado, por ej: /usr/bin/ls execvp usa el comando buscando el
-    // directorio en PATH, por ej: ls
-    if (strchr(args[0], '/')) {
-      if (execv(args[0], args) == -1) {
-        perror("Shell");
-        exit(EXIT_FAILURE);
-      }
-    } else {
-      if (execvp(args[0], args) == -1) {
-        perror("Shell");
-        exit(EXIT_FAILURE);
-      }
-    }
+    // Ejecutar el comando. _exit y no exit: vaciar los buffers de stdio
+    // heredados moveria el offset del archivo batch que lee el padre
+    exec_command(args, path);
+    exec_report_send(report, errno);
+    perror("Shell");
+    _exit(EXIT_FAILURE);
   } else // Proceso padre
   {
+    shell_stats_since(SHELL_HIST_FORK, start);
+    redir_close(redirs);
+    trace_child(pid, command_copy);
+    exec_report_wait(report, pid, args[0], start);
+
     if (background) {
       // Proceso padre, ejecución en segundo plano
       int job_id = add_job(pid, command_copy);
@@ -690,8 +1624,10 @@ int execute_external_command(char **args, int background, char *command_copy,
       // Establecer foreground_pid, indicando que es el proceso en primer plano
       foreground_pid = pid;
 
+      trace_begin("wait", args[0]);
       do {
-        pid_t wpid = waitpid(pid, &status, WUNTRACED); // Espera al proceso hijo
+        // Espera al proceso hijo, con sus recursos usados para 'time'
+        pid_t wpid = wait_foreground(pid, &status, WUNTRACED);
         if (wpid == -1) {
           /* Si el error es por interrupcion del sistema, como read, write, otro
            * waitpid implica que esa senial interrumpio la operacion antes de
@@ -702,6 +1638,7 @@ int execute_external_command(char **args, int background, char *command_copy,
             continue;
           } else {
             perror("Shell: waitpid");
+            status = EXIT_FAILURE << 8;
             break;
           }
         }
@@ -711,28 +1648,37 @@ int execute_external_command(char **args, int background, char *command_copy,
           break;
         }
       } while (!WIFEXITED(status) && !WIFSIGNALED(status));
+      trace_end("wait");
+      last_status = exit_code(status);
 
       // Proceso en primer plano terminó o fue detenido
       foreground_pid = 0;
+
+      // Las sustituciones de procesos terminan al cerrarse sus pipes
+      redir_wait(redirs);
     }
   }
   return 1;
 }
 
 int execute_single_command(char *command) {
-  char *input_file = NULL;
-  char *output_file = NULL;
-  char **args = parse_command(command, &input_file, &output_file);
+  redir_t *redirs = NULL;
+  uint64_t start = shell_stats_now();
+  trace_begin("parse", command);
+  char **args = parse_command(command, &redirs);
+  trace_end("parse");
+  shell_stats_since(SHELL_HIST_PARSE, start);
+  if (!args) {
+    // Como un comando que fallo: la shell sigue con la linea siguiente
+    fprintf(stderr, "Shell: Allocation error\n");
+    last_status = 1;
+    return 1;
+  }
 
   if (args[0] == NULL) {
     // Comando vacío
     free(args);
-    if (input_file) {
-      free(input_file);
-    }
-    if (output_file) {
-      free(output_file);
-    }
+    redir_free(redirs);
     return 1;
   }
 
@@ -749,67 +1695,95 @@ int execute_single_command(char *command) {
   }
 
   // Verificar si es un comando interno
-  int internal_status =
-      execute_internal_command(args, input_file, output_file, background);
+  int internal_status = execute_internal_command(args, redirs, background);
   if (internal_status != -1) {
     // Es un comando interno
     free(args);
-    if (input_file) {
-      free(input_file);
-    }
-    if (output_file) {
-      free(output_file);
-    }
+    redir_free(redirs);
     return internal_status;
   }
 
   // Ejecutar como comando externo
-  int status = execute_external_command(args, background, command, input_file,
-                                        output_file);
+  int status = execute_external_command(args, background, command, redirs);
 
   free(args);
-  if (input_file) {
-    free(input_file);
-  }
-  if (output_file) {
-    free(output_file);
-  }
+  redir_free(redirs);
   return status;
 }
 
-int execute_piped_commands(char **commands, int num_commands) {
+/* Libera una etapa parseada que no llego a lanzarse */
+static void free_stage(char **args, redir_t *redirs) {
+  for (int j = 0; args[j] != NULL; j++) {
+    free(args[j]);
+  }
+  free(args);
+  redir_free(redirs);
+}
+
+int spawn_pipeline(char **commands, int num_commands, int in_fd, int out_fd,
+                   pid_t *pids, redir_t **stage_redirs) {
   int i;
-  int in_fd = STDIN_FILENO; // Entrada inicial
   pid_t pid;
-  int status;
   int fd[2]; // Array para los descriptores de archivos (f[0] leer, f[1]
              // escribir)
 
-  pid_t *pids = malloc(num_commands * sizeof(pid_t)); // Varios procesos hijos
-  if (!pids) {
-    fprintf(stderr, "Shell: error de asignación de memoria\n");
-    exit(EXIT_FAILURE);
-  }
-
   for (i = 0; i < num_commands; i++) // Crea varios procesos hijos
   {
+    /* Parsear el comando actual en el padre, antes del fork, para que los
+     * here-documents se asignen a cada etapa en el orden de la linea */
+    redir_t *redirs = NULL;
+    uint64_t start = shell_stats_now();
+    trace_begin("parse", commands[i]);
+    char **args = parse_command(commands[i], &redirs);
+    trace_end("parse");
+    shell_stats_since(SHELL_HIST_PARSE, start);
+    if (!args) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      break;
+    }
+    // Si falla la apertura, la etapa igual se lanza para no romper el pipe
+    trace_begin("redirections", NULL);
+    int redir_failed = redir_open(redirs, args) == -1;
+    trace_end("redirections");
+    const char *path = args[0] && !strchr(args[0], '/')
+                           ? path_cache_lookup(args[0])
+                           : NULL;
+
     // Crear el pipe para este comando, excepto en el último
     if (i < num_commands - 1) {
       /* Se crea pipe con pipe(fd) que conecta la salida del comando actual con
-       * la entrada del siguiente */
-      if (pipe(fd) == -1) {
+       * la entrada del siguiente. O_CLOEXEC evita que otros hijos (por ejemplo
+       * una sustitucion de procesos) hereden el pipe y nunca vean EOF */
+      if (pipe2(fd, O_CLOEXEC) == -1) {
         perror("Shell: pipe");
-        exit(EXIT_FAILURE);
+        free_stage(args, redirs);
+        break;
       }
     } else {
-      fd[0] = STDIN_FILENO;
-      fd[1] = STDOUT_FILENO;
+      fd[0] = -1;
+      fd[1] = out_fd;
     }
 
+    int report[2];
+    exec_report_open(report);
+    start = shell_stats_now();
+    trace_begin("fork", args[0]);
     pid = fork();
+    if (pid != 0) {
+      trace_end("fork");
+    }
     if (pid == -1) {
       perror("Shell: fork");
-      exit(EXIT_FAILURE);
+      if (report[0] != -1) {
+        close(report[0]);
+        close(report[1]);
+      }
+      if (i < num_commands - 1) {
+        close(fd[0]);
+        close(fd[1]);
+      }
+      free_stage(args, redirs);
+      break;
     } else if (pid == 0) {
       // Proceso hijo
 
@@ -822,84 +1796,60 @@ int execute_piped_commands(char **commands, int num_commands) {
       if (in_fd != STDIN_FILENO) {
         if (dup2(in_fd, STDIN_FILENO) == -1) {
           perror("Shell: dup2 in_fd");
-          exit(EXIT_FAILURE);
+          _exit(EXIT_FAILURE);
         }
         close(in_fd);
       }
 
       // Redireccionar salida si no es el último comando
-      if (i < num_commands - 1) {
+      if (fd[1] != STDOUT_FILENO) {
         if (dup2(fd[1], STDOUT_FILENO) == -1) {
           perror("Shell: dup2 fd[1]");
-          exit(EXIT_FAILURE);
+          _exit(EXIT_FAILURE);
         }
         close(fd[1]);
-        close(fd[0]);
       }
-
-      // Parsear el comando actual en argumentos, incluyendo redirección
-      char *input_file = NULL;
-      char *output_file = NULL;
-      char **args = parse_command(commands[i], &input_file, &output_file);
-
-      if (args[0] == NULL) {
-        // Comando vacío
-        free(args);
-        if (input_file)
-          free(input_file);
-        if (output_file)
-          free(output_file);
-        exit(EXIT_FAILURE);
+      if (fd[0] != -1) {
+        close(fd[0]);
       }
 
-      // Manejar redirección de entrada
-      if (input_file) {
-        int fd_in = open(input_file, O_RDONLY);
-        if (fd_in == -1) {
-          perror("Shell: error al abrir archivo de entrada");
-          exit(EXIT_FAILURE);
-        }
-        if (dup2(fd_in, STDIN_FILENO) == -1) {
-          perror("Shell: dup2 input");
-          close(fd_in);
-          exit(EXIT_FAILURE);
-        }
-        close(fd_in);
-        free(input_file);
+      if (args[0] == NULL || redir_failed) {
+        // Comando vacío o redirección inválida
+        exec_report_send(report, 0);
+        _exit(EXIT_FAILURE);
       }
 
-      // Manejar redirección de salida
-      if (output_file) {
-        int fd_out = open(output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-        if (fd_out == -1) {
-          perror("Shell: error al abrir archivo de salida");
-          exit(EXIT_FAILURE);
-        }
-        if (dup2(fd_out, STDOUT_FILENO) == -1) {
-          perror("Shell: dup2 output");
-          close(fd_out);
-          exit(EXIT_FAILURE);
-        }
-        close(fd_out);
-        free(output_file);
+      /* Las redirecciones de la etapa se aplican despues del pipe, asi
+       * 'cmd 2>&1 | grep' envia stderr al pipe */
+      if (redir_apply(redirs, NULL) == -1) {
+        exec_report_send(report, 0);
+        _exit(EXIT_FAILURE);
       }
 
-      // Ejecutar el comando
-      if (execvp(args[0], args) == -1) {
-        perror("Shell");
-        // Liberar memoria antes de salir
-        int j = 0;
-        while (args[j]) {
-          free(args[j]);
-          j++;
-        }
-        free(args);
-        exit(EXIT_FAILURE);
-      }
+      // Ejecutar el comando (_exit: ver execute_external_command)
+      exec_command(args, path);
+      exec_report_send(report, errno);
+      perror("Shell");
+      _exit(EXIT_FAILURE);
     } else {
       // Proceso padre
 
+      shell_stats_since(SHELL_HIST_FORK, start);
       pids[i] = pid;
+      trace_child(pid, commands[i]);
+      exec_report_wait(report, pid, args[0] ? args[0] : "", start);
+
+      // Liberar la etapa parseada, el hijo ya tiene su copia
+      for (int j = 0; args[j] != NULL; j++) {
+        free(args[j]);
+      }
+      free(args);
+      redir_close(redirs);
+      if (stage_redirs) {
+        stage_redirs[i] = redirs; // El llamador espera sus sustituciones
+      } else {
+        redir_free(redirs);
+      }
 
       // Cerrar descriptores que no se necesitan
       if (in_fd != STDIN_FILENO) {
@@ -914,21 +1864,66 @@ int execute_piped_commands(char **commands, int num_commands) {
     }
   }
 
+  /* Los extremos recibidos ya estan en los hijos. Si una etapa no arranco
+   * se cierra el pipe de la anterior, que termina por SIGPIPE */
+  if (in_fd != STDIN_FILENO && in_fd != -1) {
+    close(in_fd);
+  }
+  if (out_fd != STDOUT_FILENO) {
+    close(out_fd);
+  }
+  return i;
+}
+
+int execute_piped_commands(char **commands, int num_commands) {
+  int i;
+  int status;
+
+  pid_t *pids = malloc(num_commands * sizeof(pid_t)); // Varios procesos hijos
+  redir_t **stage_redirs = calloc(num_commands, sizeof(redir_t *));
+  if (!pids || !stage_redirs) {
+    fprintf(stderr, "Shell: error de asignación de memoria\n");
+    free(pids);
+    free(stage_redirs);
+    last_status = 1;
+    return 1;
+  }
+
+  shell_stats_record(SHELL_HIST_PIPELINE_STAGES, num_commands);
+
+  // Todas las etapas arrancan a la vez, conectadas por pipes
+  int started = spawn_pipeline(commands, num_commands, STDIN_FILENO,
+                               STDOUT_FILENO, pids, stage_redirs);
+
   // Esperar a todos los procesos hijos
-  for (i = 0; i < num_commands; i++) {
+  status = EXIT_FAILURE << 8; // Si ninguna etapa arranco
+  trace_begin("wait", NULL);
+  for (i = 0; i < started; i++) {
     do {
-      pid_t wpid = waitpid(pids[i], &status, 0);
+      pid_t wpid = wait_foreground(pids[i], &status, 0);
       if (wpid == -1) {
         if (errno == EINTR) {
           continue;
         } else {
           perror("Shell: waitpid");
+          status = EXIT_FAILURE << 8;
           break;
         }
       }
     } while (!WIFEXITED(status) && !WIFSIGNALED(status));
   }
+  trace_end("wait");
+  // Como en sh, el estado de un pipeline es el de su ultima etapa; si no
+  // arrancaron todas, fallo
+  last_status = started < num_commands ? 1 : exit_code(status);
+
+  // Esperar a las sustituciones de procesos de cada etapa
+  for (i = 0; i < num_commands; i++) {
+    redir_wait(stage_redirs[i]);
+    redir_free(stage_redirs[i]);
+  }
 
+  free(stage_redirs);
   free(pids);
   return 1;
 }
@@ -0,0 +1,500 @@
+#define _GNU_SOURCE
+#include "completion.h"
+#include "commands.h"
+#include <dirent.h>
+#include <limits.h>
+#include <readline/readline.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define COMMAND_SEPARATORS "|;&(" // Despues de estos viene un comando
+#define WORD_BREAKS " \t\n\"'<>|&;("
+#define QUOTED_CHARACTERS " \t\n\"'\\<>|&;()$`"
+
+/* Nombres de un directorio, ordenados; los subdirectorios terminan en '/' */
+typedef struct {
+  char *dir; // NULL: slot libre
+  struct timespec mtime;
+  int listed;
+  int racy; // Cambio en el mismo tick en que se leyo: el mtime no alcanza
+  char **names;
+  size_t count;
+  unsigned long used; // Para reemplazar el listado menos usado
+} listing_t;
+
+/* Todos los ejecutables de PATH, un listado por directorio */
+static struct {
+  char *path_var; // PATH con el que se armo
+  listing_t *dirs;
+  size_t dir_count;
+  const char **names; // Los de todos los listados, ordenados y sin repetir
+  size_t count;
+} executables;
+
+static listing_t listings[COMPLETION_DIR_CACHE];
+static unsigned long listings_clock = 0;
+
+typedef struct {
+  char **items;
+  size_t count;
+  size_t capacity;
+} match_list_t;
+
+static void *xrealloc(void *data, size_t size) {
+  void *grown = realloc(data, size);
+  if (!grown) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  return grown;
+}
+
+static char *xstrdup(const char *text) {
+  char *copy = strdup(text);
+  if (!copy) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  return copy;
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/* Primer nombre >= prefix */
+static size_t lower_bound(const char *const *names, size_t count,
+                          const char *prefix) {
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (strcmp(names[mid], prefix) < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static void free_names(listing_t *listing) {
+  for (size_t i = 0; i < listing->count; i++) {
+    free(listing->names[i]);
+  }
+  free(listing->names);
+  listing->names = NULL;
+  listing->count = 0;
+  listing->listed = 0;
+}
+
+/* Lee el directorio; executables_only deja solo los archivos ejecutables */
+static void list_dir(listing_t *listing, int executables_only) {
+  free_names(listing);
+  listing->listed = 1;
+  DIR *dir = opendir(listing->dir);
+  if (!dir) {
+    return;
+  }
+  size_t capacity = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      continue;
+    }
+    int is_dir = entry->d_type == DT_DIR;
+    // El tipo de un enlace es el de su destino
+    if (executables_only || entry->d_type == DT_LNK ||
+        entry->d_type == DT_UNKNOWN) {
+      struct stat st;
+      if (fstatat(dirfd(dir), name, &st, 0) == -1) {
+        st.st_mode = 0;
+      }
+      if (executables_only &&
+          (!S_ISREG(st.st_mode) || !(st.st_mode & 0111))) {
+        continue;
+      }
+      is_dir = S_ISDIR(st.st_mode);
+    }
+    if (listing->count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      listing->names = xrealloc(listing->names, capacity * sizeof(char *));
+    }
+    size_t length = strlen(name);
+    char *copy = xrealloc(NULL, length + 2);
+    memcpy(copy, name, length);
+    copy[length] = is_dir ? '/' : '\0';
+    copy[length + 1] = '\0';
+    listing->names[listing->count++] = copy;
+  }
+  closedir(dir);
+  qsort(listing->names, listing->count, sizeof(char *), compare_names);
+}
+
+static int timespec_cmp(struct timespec a, struct timespec b) {
+  if (a.tv_sec != b.tv_sec) {
+    return a.tv_sec < b.tv_sec ? -1 : 1;
+  }
+  return (a.tv_nsec > b.tv_nsec) - (a.tv_nsec < b.tv_nsec);
+}
+
+/* Vuelve a leer el directorio si su mtime cambio; 1 si lo leyo */
+static int refresh_listing(listing_t *listing, int executables_only) {
+  struct stat st;
+  if (stat(listing->dir, &st) == -1) {
+    int had_names = listing->count > 0 || !listing->listed;
+    free_names(listing);
+    listing->listed = 1;
+    listing->mtime = (struct timespec){0, 0};
+    return had_names;
+  }
+  if (listing->listed && !listing->racy &&
+      timespec_cmp(st.st_mtim, listing->mtime) == 0) {
+    return 0;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME_COARSE, &now);
+  list_dir(listing, executables_only);
+  listing->mtime = st.st_mtim;
+  // Un archivo creado en este mismo tick no moveria el mtime
+  listing->racy = timespec_cmp(st.st_mtim, now) >= 0;
+  return 1;
+}
+
+static void free_executables(void) {
+  for (size_t i = 0; i < executables.dir_count; i++) {
+    free_names(&executables.dirs[i]);
+    free(executables.dirs[i].dir);
+  }
+  free(executables.dirs);
+  free(executables.names);
+  free(executables.path_var);
+  memset(&executables, 0, sizeof(executables));
+}
+
+/* Pone al dia el indice; solo se vuelven a leer los directorios que
+ * cambiaron, y solo entonces se rearma la lista ordenada */
+static void refresh_executables(void) {
+  const char *path_var = getenv("PATH");
+  if (!path_var) {
+    path_var = "/bin:/usr/bin"; // Como path_cache
+  }
+  int changed = 0;
+  if (!executables.path_var || strcmp(executables.path_var, path_var) != 0) {
+    free_executables();
+    executables.path_var = xstrdup(path_var);
+    for (const char *dir = path_var;; dir += strcspn(dir, ":") + 1) {
+      size_t length = strcspn(dir, ":");
+      executables.dirs =
+          xrealloc(executables.dirs,
+                   (executables.dir_count + 1) * sizeof(listing_t));
+      listing_t *listing = &executables.dirs[executables.dir_count++];
+      memset(listing, 0, sizeof(*listing));
+      // Un directorio vacio es el actual
+      listing->dir = length ? strndup(dir, length) : xstrdup(".");
+      if (!listing->dir) {
+        fprintf(stderr, "Shell: Allocation error\n");
+        exit(EXIT_FAILURE);
+      }
+      if (dir[length] == '\0') {
+        break;
+      }
+    }
+    changed = 1;
+  }
+  for (size_t i = 0; i < executables.dir_count; i++) {
+    changed |= refresh_listing(&executables.dirs[i], 1);
+  }
+  if (!changed) {
+    return;
+  }
+
+  size_t total = 0;
+  for (size_t i = 0; i < executables.dir_count; i++) {
+    total += executables.dirs[i].count;
+  }
+  executables.names =
+      xrealloc(executables.names, (total ? total : 1) * sizeof(char *));
+  executables.count = 0;
+  for (size_t i = 0; i < executables.dir_count; i++) {
+    listing_t *listing = &executables.dirs[i];
+    for (size_t j = 0; j < listing->count; j++) {
+      executables.names[executables.count++] = listing->names[j];
+    }
+  }
+  qsort(executables.names, executables.count, sizeof(char *), compare_names);
+  size_t unique = 0;
+  for (size_t i = 0; i < executables.count; i++) {
+    if (unique == 0 ||
+        strcmp(executables.names[unique - 1], executables.names[i]) != 0) {
+      executables.names[unique++] = executables.names[i];
+    }
+  }
+  executables.count = unique;
+}
+
+/* El listado de dir, leido de nuevo si cambio */
+static listing_t *find_listing(const char *dir) {
+  listing_t *victim = &listings[0];
+  for (size_t i = 0; i < COMPLETION_DIR_CACHE; i++) {
+    if (listings[i].dir && strcmp(listings[i].dir, dir) == 0) {
+      victim = &listings[i];
+      break;
+    }
+    if (!listings[i].dir ||
+        (victim->dir && listings[i].used < victim->used)) {
+      victim = &listings[i];
+    }
+  }
+  if (!victim->dir || strcmp(victim->dir, dir) != 0) {
+    free_names(victim);
+    free(victim->dir);
+    victim->dir = xstrdup(dir);
+  }
+  victim->used = ++listings_clock;
+  refresh_listing(victim, 0);
+  return victim;
+}
+
+static void add_match(match_list_t *list, const char *head, size_t head_length,
+                      const char *name) {
+  if (list->count + 1 >= list->capacity) {
+    list->capacity = list->capacity ? list->capacity * 2 : 16;
+    list->items = xrealloc(list->items, list->capacity * sizeof(char *));
+  }
+  size_t length = strlen(name);
+  char *match = xrealloc(NULL, head_length + length + 1);
+  memcpy(match, head, head_length);
+  memcpy(match + head_length, name, length + 1);
+  list->items[list->count++] = match;
+}
+
+static void complete_command(match_list_t *list, const char *word) {
+  size_t length = strlen(word);
+  for (const builtin_t *builtin = builtins; builtin->name; builtin++) {
+    if (strncmp(builtin->name, word, length) == 0) {
+      add_match(list, "", 0, builtin->name);
+    }
+  }
+  refresh_executables();
+  for (size_t i = lower_bound(executables.names, executables.count, word);
+       i < executables.count &&
+       strncmp(executables.names[i], word, length) == 0;
+       i++) {
+    add_match(list, "", 0, executables.names[i]);
+  }
+}
+
+static void complete_option(match_list_t *list, const builtin_t *builtin,
+                            const char *word, int dashed) {
+  size_t length = strlen(word);
+  for (const char *const *option = builtin->options; *option; option++) {
+    if ((**option == '-') == dashed && strncmp(*option, word, length) == 0) {
+      add_match(list, "", 0, *option);
+    }
+  }
+}
+
+static void complete_file(match_list_t *list, const char *word,
+                          int directories_only) {
+  const char *slash = strrchr(word, '/');
+  size_t head_length = slash ? (size_t)(slash - word) + 1 : 0;
+  const char *base = word + head_length;
+
+  // El directorio como path absoluto: los listados no dependen del cwd
+  char dir[PATH_MAX];
+  char cwd[PATH_MAX];
+  const char *home = getenv("HOME");
+  int written;
+  if (word[0] == '/') {
+    written = snprintf(dir, sizeof(dir), "%.*s", (int)head_length, word);
+  } else if (word[0] == '~' && word[1] == '/' && home) {
+    written = snprintf(dir, sizeof(dir), "%s%.*s", home,
+                       (int)head_length - 1, word + 1);
+  } else if (getcwd(cwd, sizeof(cwd))) {
+    written = snprintf(dir, sizeof(dir), "%s/%.*s", cwd, (int)head_length,
+                       word);
+  } else {
+    return;
+  }
+  if (written < 0 || (size_t)written >= sizeof(dir)) {
+    return;
+  }
+
+  listing_t *listing = find_listing(dir);
+  size_t length = strlen(base);
+  for (size_t i = lower_bound((const char *const *)listing->names,
+                              listing->count, base);
+       i < listing->count && strncmp(listing->names[i], base, length) == 0;
+       i++) {
+    const char *name = listing->names[i];
+    // Los ocultos solo si se empezo a escribir el punto
+    if ((name[0] == '.' && base[0] != '.') ||
+        (directories_only && name[strlen(name) - 1] != '/')) {
+      continue;
+    }
+    add_match(list, word, head_length, name);
+  }
+}
+
+/* Comienzo de la etapa donde esta el cursor: despues de un '|', ';', '&' o
+ * '(' fuera de comillas que no sea parte de una redireccion como 2>&1 */
+static const char *stage_start(const char *line, int start) {
+  const char *stage = line;
+  char quote = 0;
+  for (int i = 0; i < start; i++) {
+    if (quote) {
+      quote = line[i] == quote ? 0 : quote;
+    } else if (line[i] == '\'' || line[i] == '"') {
+      quote = line[i];
+    } else if (strchr(COMMAND_SEPARATORS, line[i]) &&
+               !(line[i] == '&' && i > 0 && strchr("<>", line[i - 1]))) {
+      stage = line + i + 1;
+    }
+  }
+  return stage;
+}
+
+/* Las palabras de la etapa antes del cursor: cuantas hay y la primera */
+static int words_before(const char *stage, const char *cursor, char *first,
+                        size_t size) {
+  int words = 0;
+  const char *p = stage;
+  while (p < cursor) {
+    p += strspn(p, " \t");
+    if (p >= cursor) {
+      break;
+    }
+    const char *word = p;
+    char quote = 0;
+    while (p < cursor && (quote || (*p != ' ' && *p != '\t'))) {
+      if (quote) {
+        quote = *p == quote ? 0 : quote;
+      } else if (*p == '\'' || *p == '"') {
+        quote = *p;
+      }
+      p++;
+    }
+    // 'time' mide la linea: lo que sigue es otro comando
+    if (words == 0 && p - word == 4 && strncmp(word, "time", 4) == 0) {
+      continue;
+    }
+    if (words++ == 0) {
+      snprintf(first, size, "%.*s", (int)(p - word), word);
+    }
+  }
+  return words;
+}
+
+/* Las coincidencias sin ordenar; files indica si son nombres de archivo */
+static void complete(match_list_t *list, const char *line, int start, int end,
+                     int *files) {
+  char *word = strndup(line + start, end - start);
+  if (!word) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  char command[NAME_MAX + 1] = "";
+  int words = words_before(stage_start(line, start), line + start, command,
+                           sizeof(command));
+  *files = 0;
+  if (words == 0 && !strchr(word, '/')) {
+    complete_command(list, word);
+  } else {
+    const builtin_t *builtin = words > 0 ? builtin_find(command) : NULL;
+    if (builtin && builtin->options && word[0] == '-') {
+      complete_option(list, builtin, word, 1);
+    } else {
+      if (builtin && builtin->options && words == 1) {
+        complete_option(list, builtin, word, 0); // Subcomandos
+      }
+      complete_file(list, word, builtin && strcmp(builtin->name, "cd") == 0);
+      *files = 1;
+    }
+  }
+  free(word);
+}
+
+static char **finish(match_list_t *list) {
+  if (list->count == 0) {
+    free(list->items);
+    return NULL;
+  }
+  qsort(list->items, list->count, sizeof(char *), compare_names);
+  size_t unique = 1;
+  for (size_t i = 1; i < list->count; i++) {
+    if (strcmp(list->items[unique - 1], list->items[i]) == 0) {
+      free(list->items[i]);
+    } else {
+      list->items[unique++] = list->items[i];
+    }
+  }
+  list->items[unique] = NULL;
+  return list->items;
+}
+
+char **completion_matches(const char *line, int start, int end) {
+  match_list_t list = {NULL, 0, 0};
+  int files;
+  complete(&list, line, start, end, &files);
+  return finish(&list);
+}
+
+/* Readline pide las coincidencias de a una */
+static char **pending = NULL;
+static size_t pending_next = 0;
+
+static char *next_match(const char *text, int state) {
+  (void)text;
+  (void)state;
+  if (!pending) {
+    return NULL;
+  }
+  char *match = pending[pending_next++];
+  if (!match) {
+    free(pending); // Los strings ya son de readline
+    pending = NULL;
+  }
+  return match;
+}
+
+static char **attempt_completion(const char *text, int start, int end) {
+  rl_attempted_completion_over = 1; // Nada del completado propio de readline
+  match_list_t list = {NULL, 0, 0};
+  int files;
+  complete(&list, rl_line_buffer, start, end, &files);
+  pending = finish(&list);
+  pending_next = 0;
+  if (!pending) {
+    return NULL;
+  }
+  // Readline comilla los nombres de archivo y muestra solo su ultima parte
+  rl_filename_completion_desired = files;
+  // Un directorio ya termina en '/': se sigue escribiendo adentro
+  size_t length = strlen(pending[0]);
+  rl_completion_suppress_append =
+      !pending[1] && length > 0 && pending[0][length - 1] == '/';
+  return rl_completion_matches(text, next_match);
+}
+
+void completion_install(void) {
+  rl_attempted_completion_function = attempt_completion;
+  rl_completer_word_break_characters = WORD_BREAKS;
+  rl_completer_quote_characters = "\"'";
+  rl_filename_quote_characters = QUOTED_CHARACTERS;
+}
+
+void completion_clear(void) {
+  free_executables();
+  for (size_t i = 0; i < COMPLETION_DIR_CACHE; i++) {
+    free_names(&listings[i]);
+    free(listings[i].dir);
+    listings[i].dir = NULL;
+  }
+  listings_clock = 0;
+}
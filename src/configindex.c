@@ -0,0 +1,847 @@
+#define _GNU_SOURCE
+#include "configindex.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC 0x58494353u // "SCIX"
+#define INDEX_VERSION 1
+#define INDEX_NONE UINT32_MAX             // No directory
+#define INDEX_CACHE_DIR "shell-searchconfig" // Directory inside the cache
+#define INDEX_INITIAL_CAPACITY 64
+#define INOTIFY_BUFFER_SIZE 16384
+#define WATCH_MASK                                                             \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY |           \
+   IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/* Formato del archivo: cabecera, directorios, archivos y cadenas. Los
+ * directorios estan en orden de recorrido en anchura, asi los hijos de cada
+ * uno quedan contiguos; los archivos de cada directorio tambien. */
+typedef struct index_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_dirs;
+  uint32_t num_files;
+  uint64_t strings_size;
+  uint32_t root; // Ruta canonica de la raiz, para detectar colisiones
+  uint32_t reserved;
+} index_header_t;
+
+typedef struct index_dir {
+  uint32_t path; // Relativa a la raiz ("" para la raiz)
+  uint32_t first_child;
+  uint32_t num_children;
+  uint32_t first_file;
+  uint32_t num_files;
+  uint32_t reserved;
+  int64_t mtime_sec; // 0: volver a leerlo en la proxima consulta
+  int64_t mtime_nsec;
+} index_dir_t;
+
+typedef struct index_file {
+  uint32_t name;
+  uint32_t ext; // Apunta dentro de name, o a su '\0' si no tiene extension
+  uint32_t dir;
+  uint32_t reserved;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} index_file_t;
+
+/* Indice en memoria, ya sea el archivo mapeado o uno recien construido */
+typedef struct index_view {
+  const index_dir_t *dirs;
+  uint32_t num_dirs;
+  const index_file_t *files;
+  uint32_t num_files;
+  const char *strings;
+  size_t strings_size;
+  uint32_t root;
+} index_view_t;
+
+typedef struct index_builder {
+  index_dir_t *dirs;
+  size_t num_dirs;
+  size_t dirs_capacity;
+  uint32_t *origin; // Directorio equivalente del indice anterior
+  size_t origin_capacity;
+  index_file_t *files;
+  size_t num_files;
+  size_t files_capacity;
+  char *strings;
+  size_t strings_size;
+  size_t strings_capacity;
+  uint32_t root;
+} index_builder_t;
+
+/* Entrada leida de un directorio antes de ordenarla */
+typedef struct scan_entry {
+  char *name;
+  bool is_dir;
+  int64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} scan_entry_t;
+
+/* Estado de inotify de cada raiz consultada en esta sesion */
+typedef struct index_root {
+  char *path;       // Ruta canonica
+  bool watching;    // Todos los directorios indexados tienen un watch
+  bool failed;      // Limite de watches alcanzado: solo mtimes
+  bool lost_events; // Cola desbordada o demasiados cambios
+  char **dirty;     // Directorios cambiados (rutas relativas)
+  size_t num_dirty;
+} index_root_t;
+
+typedef struct watch_entry {
+  int wd;
+  int root;
+  char *rel;
+} watch_entry_t;
+
+static int inotify_fd = -1;
+static watch_entry_t *watches = NULL;
+static size_t num_watches = 0;
+static size_t watches_capacity = 0;
+static index_root_t roots[CONFIG_INDEX_MAX_ROOTS];
+static int num_roots = 0;
+
+static void *grow_array(void *items, size_t *capacity, size_t needed,
+                        size_t item_size) {
+  if (needed <= *capacity) {
+    return items;
+  }
+  size_t new_capacity = *capacity ? *capacity : INDEX_INITIAL_CAPACITY;
+  while (new_capacity < needed) {
+    new_capacity *= 2;
+  }
+  void *new_items = realloc(items, new_capacity * item_size);
+  if (!new_items) {
+    fprintf(stderr, "Shell: memory allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  *capacity = new_capacity;
+  return new_items;
+}
+
+static uint32_t add_string(index_builder_t *b, const char *s) {
+  size_t len = strlen(s) + 1;
+  b->strings = grow_array(b->strings, &b->strings_capacity,
+                          b->strings_size + len, 1);
+  uint32_t offset = (uint32_t)b->strings_size;
+  memcpy(b->strings + offset, s, len);
+  b->strings_size += len;
+  return offset;
+}
+
+static uint32_t add_dir(index_builder_t *b, const char *rel, uint32_t origin) {
+  b->dirs = grow_array(b->dirs, &b->dirs_capacity, b->num_dirs + 1,
+                       sizeof(index_dir_t));
+  b->origin = grow_array(b->origin, &b->origin_capacity, b->num_dirs + 1,
+                         sizeof(uint32_t));
+  uint32_t path = add_string(b, rel);
+  index_dir_t *dir = &b->dirs[b->num_dirs];
+  memset(dir, 0, sizeof(*dir));
+  dir->path = path;
+  b->origin[b->num_dirs] = origin;
+  return (uint32_t)b->num_dirs++;
+}
+
+static void add_file(index_builder_t *b, uint32_t dir, const char *name,
+                     int64_t size, int64_t mtime_sec, int64_t mtime_nsec) {
+  b->files = grow_array(b->files, &b->files_capacity, b->num_files + 1,
+                        sizeof(index_file_t));
+  uint32_t offset = add_string(b, name);
+  // Misma regla que has_extension(): un punto inicial no es extension
+  const char *dot = strrchr(name, '.');
+  index_file_t *file = &b->files[b->num_files++];
+  file->name = offset;
+  file->ext = offset + (uint32_t)((dot && dot != name) ? (size_t)(dot - name)
+                                                       : strlen(name));
+  file->dir = dir;
+  file->reserved = 0;
+  file->size = size;
+  file->mtime_sec = mtime_sec;
+  file->mtime_nsec = mtime_nsec;
+}
+
+static void builder_free(index_builder_t *b) {
+  free(b->dirs);
+  free(b->origin);
+  free(b->files);
+  free(b->strings);
+  memset(b, 0, sizeof(*b));
+}
+
+static index_view_t builder_view(const index_builder_t *b) {
+  index_view_t view = {b->dirs,    (uint32_t)b->num_dirs,
+                       b->files,   (uint32_t)b->num_files,
+                       b->strings, b->strings_size,
+                       b->root};
+  return view;
+}
+
+/* Ruta absoluta de un directorio del indice */
+static void full_path(char *out, size_t size, const char *root,
+                      const char *rel) {
+  if (rel[0] == '\0') {
+    snprintf(out, size, "%s", root);
+  } else {
+    snprintf(out, size, "%s/%s", root, rel);
+  }
+}
+
+static const char *base_name(const char *rel) {
+  const char *slash = strrchr(rel, '/');
+  return slash ? slash + 1 : rel;
+}
+
+/* ---- inotify ---- */
+
+static int root_find(const char *root) {
+  for (int i = 0; i < num_roots; i++) {
+    if (strcmp(roots[i].path, root) == 0) {
+      return i;
+    }
+  }
+  if (num_roots == CONFIG_INDEX_MAX_ROOTS) {
+    return -1;
+  }
+  char *path = strdup(root);
+  if (!path) {
+    return -1;
+  }
+  index_root_t *state = &roots[num_roots];
+  memset(state, 0, sizeof(*state));
+  state->path = path;
+  return num_roots++;
+}
+
+static void root_clear_dirty(index_root_t *state) {
+  for (size_t i = 0; i < state->num_dirty; i++) {
+    free(state->dirty[i]);
+  }
+  state->num_dirty = 0;
+  state->lost_events = false;
+}
+
+static void root_mark_dirty(index_root_t *state, const char *rel) {
+  if (state->lost_events) {
+    return;
+  }
+  // Los eventos de un mismo directorio suelen llegar seguidos
+  if (state->num_dirty > 0 &&
+      strcmp(state->dirty[state->num_dirty - 1], rel) == 0) {
+    return;
+  }
+  if (!state->dirty) {
+    state->dirty = malloc(CONFIG_INDEX_MAX_DIRTY * sizeof(char *));
+  }
+  char *copy = state->dirty && state->num_dirty < CONFIG_INDEX_MAX_DIRTY
+                   ? strdup(rel)
+                   : NULL;
+  if (!copy) {
+    // Sin lugar para recordarlo: validar todo por mtime
+    state->lost_events = true;
+    return;
+  }
+  state->dirty[state->num_dirty++] = copy;
+}
+
+/* Primer watch con descriptor >= wd; los watches estan ordenados por (wd, raiz)
+ */
+static size_t watch_lower_bound(int wd) {
+  size_t low = 0;
+  size_t high = num_watches;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    if (watches[mid].wd < wd) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+static void watch_add(int root, const char *path, const char *rel) {
+  if (roots[root].failed) {
+    return;
+  }
+  if (inotify_fd == -1) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1) {
+      roots[root].failed = true;
+      return;
+    }
+  }
+
+  int wd = inotify_add_watch(inotify_fd, path, WATCH_MASK);
+  if (wd == -1) {
+    // ENOENT: el directorio ya no esta y su padre lo notara
+    if (errno == ENOSPC || errno == ENOMEM) {
+      roots[root].failed = true;
+    }
+    return;
+  }
+
+  // Un mismo inodo devuelve el mismo wd: actualizar la ruta si ya existe
+  size_t pos = watch_lower_bound(wd);
+  while (pos < num_watches && watches[pos].wd == wd &&
+         watches[pos].root < root) {
+    pos++;
+  }
+  char *copy = strdup(rel);
+  if (!copy) {
+    roots[root].failed = true;
+    return;
+  }
+  if (pos < num_watches && watches[pos].wd == wd &&
+      watches[pos].root == root) {
+    free(watches[pos].rel);
+    watches[pos].rel = copy;
+    return;
+  }
+  watches = grow_array(watches, &watches_capacity, num_watches + 1,
+                       sizeof(watch_entry_t));
+  memmove(&watches[pos + 1], &watches[pos],
+          (num_watches - pos) * sizeof(watch_entry_t));
+  watches[pos].wd = wd;
+  watches[pos].root = root;
+  watches[pos].rel = copy;
+  num_watches++;
+}
+
+/* Lee los eventos acumulados desde la ultima consulta sin bloquear */
+static void watch_drain(void) {
+  if (inotify_fd == -1) {
+    return;
+  }
+
+  char buffer[INOTIFY_BUFFER_SIZE]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+    const struct inotify_event *event;
+    for (char *ptr = buffer; ptr < buffer + len;
+         ptr += sizeof(struct inotify_event) + event->len) {
+      event = (const struct inotify_event *)ptr;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        for (int i = 0; i < num_roots; i++) {
+          roots[i].lost_events = true;
+        }
+        continue;
+      }
+
+      size_t first = watch_lower_bound(event->wd);
+      size_t last = first;
+      while (last < num_watches && watches[last].wd == event->wd) {
+        root_mark_dirty(&roots[watches[last].root], watches[last].rel);
+        last++;
+      }
+
+      // El directorio se borro o se desmonto: el kernel ya quito el watch
+      if (event->mask & IN_IGNORED) {
+        for (size_t i = first; i < last; i++) {
+          free(watches[i].rel);
+        }
+        memmove(&watches[first], &watches[last],
+                (num_watches - last) * sizeof(watch_entry_t));
+        num_watches -= last - first;
+      }
+    }
+  }
+}
+
+/* ---- Archivo del indice ---- */
+
+static int index_file_path(const char *root, char *out, size_t size) {
+  char base[PATH_MAX];
+  const char *cache = getenv("XDG_CACHE_HOME");
+  if (cache && cache[0] != '\0') {
+    snprintf(base, sizeof(base), "%s", cache);
+  } else {
+    const char *home = getenv("HOME");
+    snprintf(base, sizeof(base), "%s/.cache", home ? home : "/tmp");
+  }
+  if (mkdir(base, 0700) == -1 && errno != EEXIST) {
+    fprintf(stderr, "Shell: %s: %s\n", base, strerror(errno));
+    return -1;
+  }
+
+  char dir[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s/%s", base, INDEX_CACHE_DIR);
+  if (mkdir(dir, 0700) == -1 && errno != EEXIST) {
+    fprintf(stderr, "Shell: %s: %s\n", dir, strerror(errno));
+    return -1;
+  }
+
+  // FNV-1a de la ruta canonica
+  uint64_t hash = 1469598103934665603ULL;
+  for (const char *c = root; *c; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 1099511628211ULL;
+  }
+  snprintf(out, size, "%s/%016llx.idx", dir, (unsigned long long)hash);
+  return 0;
+}
+
+/* Mapea el indice guardado; -1 si no existe o no corresponde a esta raiz */
+static int index_load(const char *path, const char *root, index_view_t *view,
+                      void **map, size_t *map_size) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == -1 ||
+      (size_t)statbuf.st_size < sizeof(index_header_t)) {
+    close(fd);
+    return -1;
+  }
+  size_t size = (size_t)statbuf.st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  const index_header_t *header = data;
+  size_t dirs_size = (size_t)header->num_dirs * sizeof(index_dir_t);
+  size_t files_size = (size_t)header->num_files * sizeof(index_file_t);
+  if (header->magic != INDEX_MAGIC || header->version != INDEX_VERSION ||
+      header->num_dirs == 0 ||
+      sizeof(index_header_t) + dirs_size + files_size + header->strings_size !=
+          size) {
+    munmap(data, size);
+    return -1;
+  }
+
+  view->dirs = (const index_dir_t *)((const char *)data +
+                                     sizeof(index_header_t));
+  view->num_dirs = header->num_dirs;
+  view->files =
+      (const index_file_t *)((const char *)view->dirs + dirs_size);
+  view->num_files = header->num_files;
+  view->strings = (const char *)view->files + files_size;
+  view->strings_size = header->strings_size;
+  view->root = header->root;
+
+  // Todas las referencias deben caer dentro del archivo
+  bool valid = view->strings_size > 0 &&
+               view->strings[view->strings_size - 1] == '\0' &&
+               view->root < view->strings_size &&
+               strcmp(view->strings + view->root, root) == 0;
+  for (uint32_t i = 0; valid && i < view->num_dirs; i++) {
+    const index_dir_t *dir = &view->dirs[i];
+    valid = dir->path < view->strings_size &&
+            (uint64_t)dir->first_child + dir->num_children <= view->num_dirs &&
+            (uint64_t)dir->first_file + dir->num_files <= view->num_files;
+  }
+  for (uint32_t i = 0; valid && i < view->num_files; i++) {
+    const index_file_t *file = &view->files[i];
+    valid = file->name < view->strings_size && file->ext >= file->name &&
+            file->ext < view->strings_size && file->dir < view->num_dirs;
+  }
+  if (!valid) {
+    munmap(data, size);
+    return -1;
+  }
+
+  *map = data;
+  *map_size = size;
+  return 0;
+}
+
+/* Escribe el indice en un temporal y lo renombra para no dejarlo a medias */
+static int index_write(const char *path, const index_view_t *view) {
+  char tmp_path[PATH_MAX];
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp.%d", path, (int)getpid());
+
+  FILE *file = fopen(tmp_path, "w");
+  if (!file) {
+    return -1;
+  }
+  index_header_t header = {INDEX_MAGIC,       INDEX_VERSION,
+                           view->num_dirs,    view->num_files,
+                           view->strings_size, view->root,
+                           0};
+  bool ok =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(view->dirs, sizeof(index_dir_t), view->num_dirs, file) ==
+          view->num_dirs &&
+      fwrite(view->files, sizeof(index_file_t), view->num_files, file) ==
+          view->num_files &&
+      fwrite(view->strings, 1, view->strings_size, file) == view->strings_size;
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+  if (!ok || rename(tmp_path, path) == -1) {
+    unlink(tmp_path);
+    return -1;
+  }
+  return 0;
+}
+
+/* ---- Actualizacion ---- */
+
+static int compare_entries(const void *a, const void *b) {
+  const scan_entry_t *left = a;
+  const scan_entry_t *right = b;
+  return strcmp(left->name, right->name);
+}
+
+/* Copia un directorio sin cambios desde el indice anterior */
+static void copy_dir(index_builder_t *b, uint32_t index,
+                     const index_view_t *old, uint32_t origin) {
+  const index_dir_t *src = &old->dirs[origin];
+
+  uint32_t first_file = (uint32_t)b->num_files;
+  for (uint32_t i = 0; i < src->num_files; i++) {
+    const index_file_t *file = &old->files[src->first_file + i];
+    add_file(b, index, old->strings + file->name, file->size, file->mtime_sec,
+             file->mtime_nsec);
+  }
+  uint32_t first_child = (uint32_t)b->num_dirs;
+  for (uint32_t i = 0; i < src->num_children; i++) {
+    uint32_t child = src->first_child + i;
+    add_dir(b, old->strings + old->dirs[child].path, child);
+  }
+
+  index_dir_t *dir = &b->dirs[index];
+  dir->first_file = first_file;
+  dir->num_files = src->num_files;
+  dir->first_child = first_child;
+  dir->num_children = src->num_children;
+  dir->mtime_sec = src->mtime_sec;
+  dir->mtime_nsec = src->mtime_nsec;
+}
+
+/* Lee un directorio de nuevo. Los subdirectorios que ya estaban en el indice
+ * anterior conservan su origen para poder copiarse si no cambiaron. */
+static int scan_dir(index_builder_t *b, uint32_t index, const char *root,
+                    const index_view_t *old, uint32_t origin, int watch_root,
+                    time_t started) {
+  char rel[PATH_MAX];
+  snprintf(rel, sizeof(rel), "%s", b->strings + b->dirs[index].path);
+  char path[PATH_MAX];
+  full_path(path, sizeof(path), root, rel);
+
+  // El watch va antes de leer para no perder cambios hechos mientras tanto
+  if (watch_root != -1) {
+    watch_add(watch_root, path, rel);
+  }
+
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return index == 0 ? -1 : 0;
+  }
+  struct stat dirstat;
+  DIR *dir = fstat(fd, &dirstat) == 0 ? fdopendir(fd) : NULL;
+  if (!dir) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    close(fd);
+    return index == 0 ? -1 : 0;
+  }
+
+  scan_entry_t *entries = NULL;
+  size_t num_entries = 0;
+  size_t capacity = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *name = entry->d_name;
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+
+    // Igual que el recorrido paralelo: los enlaces a directorios no se siguen
+    unsigned char type = entry->d_type;
+    struct stat statbuf;
+    if (type == DT_UNKNOWN) {
+      if (fstatat(fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+        continue;
+      }
+      type = IFTODT(statbuf.st_mode);
+    }
+    bool is_dir = type == DT_DIR;
+    if (!is_dir) {
+      if ((type != DT_REG && type != DT_LNK) ||
+          fstatat(fd, name, &statbuf, 0) == -1 || !S_ISREG(statbuf.st_mode)) {
+        continue;
+      }
+    }
+
+    char *copy = strdup(name);
+    if (!copy) {
+      fprintf(stderr, "Shell: memory allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    entries = grow_array(entries, &capacity, num_entries + 1,
+                         sizeof(scan_entry_t));
+    scan_entry_t *item = &entries[num_entries++];
+    item->name = copy;
+    item->is_dir = is_dir;
+    item->size = is_dir ? 0 : statbuf.st_size;
+    item->mtime_sec = is_dir ? 0 : statbuf.st_mtim.tv_sec;
+    item->mtime_nsec = is_dir ? 0 : statbuf.st_mtim.tv_nsec;
+  }
+  closedir(dir);
+
+  qsort(entries, num_entries, sizeof(scan_entry_t), compare_entries);
+
+  uint32_t first_file = (uint32_t)b->num_files;
+  for (size_t i = 0; i < num_entries; i++) {
+    if (!entries[i].is_dir) {
+      add_file(b, index, entries[i].name, entries[i].size,
+               entries[i].mtime_sec, entries[i].mtime_nsec);
+    }
+  }
+  uint32_t num_files = (uint32_t)b->num_files - first_file;
+
+  // Ambas listas estan ordenadas por nombre: emparejar en un solo paso
+  const index_dir_t *src = origin != INDEX_NONE ? &old->dirs[origin] : NULL;
+  uint32_t old_child = 0;
+  uint32_t first_child = (uint32_t)b->num_dirs;
+  for (size_t i = 0; i < num_entries; i++) {
+    if (!entries[i].is_dir) {
+      continue;
+    }
+    uint32_t child_origin = INDEX_NONE;
+    while (src && old_child < src->num_children) {
+      uint32_t candidate = src->first_child + old_child;
+      int cmp = strcmp(base_name(old->strings + old->dirs[candidate].path),
+                       entries[i].name);
+      if (cmp > 0) {
+        break;
+      }
+      old_child++;
+      if (cmp == 0) {
+        child_origin = candidate;
+        break;
+      }
+    }
+
+    char child_rel[PATH_MAX];
+    if (rel[0] == '\0') {
+      snprintf(child_rel, sizeof(child_rel), "%s", entries[i].name);
+    } else {
+      snprintf(child_rel, sizeof(child_rel), "%s/%s", rel, entries[i].name);
+    }
+    add_dir(b, child_rel, child_origin);
+  }
+
+  for (size_t i = 0; i < num_entries; i++) {
+    free(entries[i].name);
+  }
+  free(entries);
+
+  index_dir_t *record = &b->dirs[index];
+  record->first_file = first_file;
+  record->num_files = num_files;
+  record->first_child = first_child;
+  record->num_children = (uint32_t)b->num_dirs - first_child;
+  /* Un cambio en el mismo segundo de la lectura podria no mover el mtime:
+   * se guarda 0 para que la proxima validacion lo lea otra vez */
+  if (dirstat.st_mtim.tv_sec >= started) {
+    record->mtime_sec = 0;
+    record->mtime_nsec = 0;
+  } else {
+    record->mtime_sec = dirstat.st_mtim.tv_sec;
+    record->mtime_nsec = dirstat.st_mtim.tv_nsec;
+  }
+  return 0;
+}
+
+/* Construye el indice nuevo recorriendo en anchura: lo que no cambio se copia
+ * del anterior y solo se leen los directorios marcados o nuevos */
+static int index_refresh(index_builder_t *b, const char *root,
+                         const index_view_t *old, const bool *rescan,
+                         int watch_root) {
+  time_t started = time(NULL);
+  b->root = add_string(b, root);
+  add_dir(b, "", old ? 0 : INDEX_NONE);
+
+  for (uint32_t i = 0; i < b->num_dirs; i++) {
+    uint32_t origin = b->origin[i];
+    if (origin != INDEX_NONE && !rescan[origin]) {
+      copy_dir(b, i, old, origin);
+    } else if (scan_dir(b, i, root, old, origin, watch_root, started) == -1) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Sin eventos confiables: comparar el mtime de cada directorio */
+static bool validate_dirs(const char *root, const index_view_t *old,
+                          bool *rescan) {
+  bool changed = false;
+  char path[PATH_MAX];
+  for (uint32_t i = 0; i < old->num_dirs; i++) {
+    const index_dir_t *dir = &old->dirs[i];
+    full_path(path, sizeof(path), root, old->strings + dir->path);
+    struct stat statbuf;
+    rescan[i] = dir->mtime_sec == 0 || stat(path, &statbuf) == -1 ||
+                !S_ISDIR(statbuf.st_mode) ||
+                statbuf.st_mtim.tv_sec != dir->mtime_sec ||
+                statbuf.st_mtim.tv_nsec != dir->mtime_nsec;
+    changed |= rescan[i];
+  }
+  return changed;
+}
+
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Con inotify activo solo se releen los directorios que recibieron eventos */
+static bool mark_dirty_dirs(const index_view_t *old, index_root_t *state,
+                            bool *rescan) {
+  if (state->num_dirty == 0) {
+    return false;
+  }
+  qsort(state->dirty, state->num_dirty, sizeof(char *), compare_strings);
+  bool changed = false;
+  for (uint32_t i = 0; i < old->num_dirs; i++) {
+    const char *rel = old->strings + old->dirs[i].path;
+    rescan[i] = bsearch(&rel, state->dirty, state->num_dirty, sizeof(char *),
+                        compare_strings) != NULL;
+    changed |= rescan[i];
+  }
+  return changed;
+}
+
+static void watch_all(int root, const char *root_path,
+                      const index_view_t *old) {
+  char path[PATH_MAX];
+  for (uint32_t i = 0; i < old->num_dirs && !roots[root].failed; i++) {
+    const char *rel = old->strings + old->dirs[i].path;
+    full_path(path, sizeof(path), root_path, rel);
+    watch_add(root, path, rel);
+  }
+}
+
+static void query_view(const index_view_t *view, const char *directory,
+                       const char *extension, config_matches_t *matches) {
+  for (uint32_t i = 0; i < view->num_files; i++) {
+    const index_file_t *file = &view->files[i];
+    if (strcmp(view->strings + file->ext, extension) != 0) {
+      continue;
+    }
+    const char *rel = view->strings + view->dirs[file->dir].path;
+    const char *name = view->strings + file->name;
+    size_t length = strlen(directory) + strlen(rel) + strlen(name) + 3;
+    char *path = malloc(length);
+    if (!path) {
+      fprintf(stderr, "Shell: memory allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    // Las rutas se arman con el directorio tal como lo escribio el usuario
+    if (rel[0] == '\0') {
+      snprintf(path, length, "%s/%s", directory, name);
+    } else {
+      snprintf(path, length, "%s/%s/%s", directory, rel, name);
+    }
+    config_matches_add(matches, path, 0);
+  }
+}
+
+static int compare_matches(const void *a, const void *b) {
+  const config_match_t *left = a;
+  const config_match_t *right = b;
+  return strcmp(left->path, right->path);
+}
+
+int config_index_query(const char *directory, const char *extension,
+                       int rebuild, config_matches_t *matches) {
+  matches->items = NULL;
+  matches->count = 0;
+  matches->capacity = 0;
+
+  char root[PATH_MAX];
+  if (!realpath(directory, root)) {
+    fprintf(stderr, "Shell: %s: %s\n", directory, strerror(errno));
+    return -1;
+  }
+  char index_path[PATH_MAX];
+  if (index_file_path(root, index_path, sizeof(index_path)) == -1) {
+    return -1;
+  }
+
+  watch_drain();
+  int watch_root = root_find(root);
+  index_root_t *state = watch_root != -1 ? &roots[watch_root] : NULL;
+
+  index_view_t old;
+  void *map = NULL;
+  size_t map_size = 0;
+  bool have_old =
+      !rebuild && index_load(index_path, root, &old, &map, &map_size) == 0;
+
+  bool *rescan = NULL;
+  bool changed = true;
+  if (have_old) {
+    rescan = calloc(old.num_dirs, sizeof(bool));
+    if (!rescan) {
+      fprintf(stderr, "Shell: memory allocation error\n");
+      munmap(map, map_size);
+      return -1;
+    }
+    if (state && state->watching && !state->failed && !state->lost_events) {
+      changed = mark_dirty_dirs(&old, state, rescan);
+    } else {
+      // Los watches se ponen antes de validar para no perder nada en medio
+      if (state && !state->watching) {
+        watch_all(watch_root, root, &old);
+      }
+      changed = validate_dirs(root, &old, rescan);
+    }
+  }
+
+  int status = 0;
+  if (!changed) {
+    query_view(&old, directory, extension, matches);
+  } else {
+    index_builder_t builder;
+    memset(&builder, 0, sizeof(builder));
+    if (index_refresh(&builder, root, have_old ? &old : NULL, rescan,
+                      watch_root) == -1) {
+      status = -1;
+    } else {
+      index_view_t view = builder_view(&builder);
+      if (index_write(index_path, &view) == -1) {
+        fprintf(stderr, "Shell: could not save index %s: %s\n", index_path,
+                strerror(errno));
+      }
+      query_view(&view, directory, extension, matches);
+    }
+    builder_free(&builder);
+  }
+
+  if (state) {
+    root_clear_dirty(state);
+    state->watching = status == 0 && !state->failed;
+  }
+  free(rescan);
+  if (map) {
+    munmap(map, map_size);
+  }
+
+  qsort(matches->items, matches->count, sizeof(config_match_t),
+        compare_matches);
+  return status;
+}
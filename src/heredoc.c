@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include "heredoc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <readline/readline.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define HEREDOC_PROMPT "> " // Continuation prompt while reading a body
+
+/* Cola de cuerpos leidos, en el orden en que aparecen los operadores */
+typedef struct heredoc_body {
+  char *data;
+  struct heredoc_body *next;
+} heredoc_body_t;
+
+static heredoc_body_t *body_head = NULL;
+static heredoc_body_t *body_tail = NULL;
+
+static void queue_body(char *data) {
+  heredoc_body_t *node = malloc(sizeof(heredoc_body_t));
+  if (!node) {
+    fprintf(stderr, "Shell: memory allocation error\n");
+    free(data);
+    return;
+  }
+  node->data = data;
+  node->next = NULL;
+  if (body_tail) {
+    body_tail->next = node;
+  } else {
+    body_head = node;
+  }
+  body_tail = node;
+}
+
+/* Reads one line without its newline. Returns NULL on EOF. */
+static char *read_body_line(FILE *input_stream) {
+  if (input_stream == stdin) {
+    return readline(HEREDOC_PROMPT);
+  }
+
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len = getline(&line, &cap, input_stream);
+  if (len == -1) {
+    free(line);
+    return NULL;
+  }
+  line[strcspn(line, "\n")] = '\0';
+  return line;
+}
+
+/* Reads lines until `delimiter`, returning the body with newlines kept */
+static char *read_body(FILE *input_stream, const char *delimiter,
+                       int strip_tabs, int *eof) {
+  size_t size = 0;
+  size_t cap = 256;
+  char *body = malloc(cap);
+  if (!body) {
+    fprintf(stderr, "Shell: memory allocation error\n");
+    return NULL;
+  }
+  body[0] = '\0';
+
+  char *line;
+  while ((line = read_body_line(input_stream)) != NULL) {
+    char *text = line;
+    if (strip_tabs) {
+      while (*text == '\t')
+        text++;
+    }
+    if (strcmp(text, delimiter) == 0) {
+      free(line);
+      return body;
+    }
+
+    size_t len = strlen(text);
+    if (size + len + 2 > cap) {
+      while (size + len + 2 > cap)
+        cap *= 2;
+      char *grown = realloc(body, cap);
+      if (!grown) {
+        fprintf(stderr, "Shell: memory allocation error\n");
+        free(line);
+        free(body);
+        return NULL;
+      }
+      body = grown;
+    }
+    memcpy(body + size, text, len);
+    size += len;
+    body[size++] = '\n';
+    body[size] = '\0';
+    free(line);
+  }
+
+  *eof = 1;
+  return body;
+}
+
+int heredoc_collect(const char *line, FILE *input_stream) {
+  const char *ptr = line;
+
+  while (*ptr) {
+    // Los operadores dentro de comillas no cuentan
+    if (*ptr == '\'' || *ptr == '\"') {
+      char quote = *ptr++;
+      while (*ptr && *ptr != quote)
+        ptr++;
+      if (*ptr)
+        ptr++;
+      continue;
+    }
+
+    if (ptr[0] != '<' || ptr[1] != '<') {
+      ptr++;
+      continue;
+    }
+    if (ptr[2] == '<') {
+      // Here-string, el contenido esta en la misma linea
+      ptr += 3;
+      continue;
+    }
+
+    ptr += 2;
+    int strip_tabs = 0;
+    if (*ptr == '-') {
+      strip_tabs = 1;
+      ptr++;
+    }
+    while (*ptr == ' ' || *ptr == '\t')
+      ptr++;
+
+    // Delimiter, optionally quoted
+    const char *start = ptr;
+    size_t len;
+    if (*ptr == '\'' || *ptr == '\"') {
+      char quote = *ptr++;
+      start = ptr;
+      while (*ptr && *ptr != quote)
+        ptr++;
+      len = ptr - start;
+      if (*ptr)
+        ptr++;
+    } else {
+      while (*ptr && *ptr != ' ' && *ptr != '\t' && *ptr != '<' &&
+             *ptr != '>' && *ptr != '|')
+        ptr++;
+      len = ptr - start;
+    }
+    if (len == 0) {
+      fprintf(stderr, "Shell: missing here-document delimiter\n");
+      return -1;
+    }
+
+    char *delimiter = strndup(start, len);
+    if (!delimiter) {
+      fprintf(stderr, "Shell: memory allocation error\n");
+      return -1;
+    }
+
+    int eof = 0;
+    char *body = read_body(input_stream, delimiter, strip_tabs, &eof);
+    if (eof) {
+      fprintf(stderr,
+              "Shell: here-document delimited by end-of-file (wanted '%s')\n",
+              delimiter);
+    }
+    free(delimiter);
+    if (!body) {
+      return -1;
+    }
+    queue_body(body);
+    if (eof) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+char *heredoc_next_body(void) {
+  heredoc_body_t *node = body_head;
+  if (!node) {
+    return NULL;
+  }
+  body_head = node->next;
+  if (!body_head) {
+    body_tail = NULL;
+  }
+  char *data = node->data;
+  free(node);
+  return data;
+}
+
+void heredoc_discard(void) {
+  char *data;
+  while ((data = heredoc_next_body()) != NULL) {
+    free(data);
+  }
+}
+
+/* Escribe todo el buffer, reintentando si una senial interrumpe write */
+static int write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    data += written;
+    length -= written;
+  }
+  return 0;
+}
+
+int heredoc_open(const char *data, size_t length) {
+  if (length <= HEREDOC_PIPE_MAX) {
+    // Cabe entero en el pipe: se escribe y se cierra el extremo de escritura
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+      perror("Shell: here-document pipe");
+      return -1;
+    }
+    if (write_all(fds[1], data, length) == -1) {
+      perror("Shell: here-document write");
+      close(fds[0]);
+      close(fds[1]);
+      return -1;
+    }
+    close(fds[1]);
+    return fds[0];
+  }
+
+  int fd = memfd_create("heredoc", MFD_CLOEXEC);
+  if (fd == -1) {
+    perror("Shell: memfd_create");
+    return -1;
+  }
+  if (write_all(fd, data, length) == -1 || lseek(fd, 0, SEEK_SET) == -1) {
+    perror("Shell: here-document write");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
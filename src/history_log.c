@@ -0,0 +1,584 @@
+#define _GNU_SOURCE
+#include "history_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HISTORY_MAGIC "SHHIST1"
+#define HISTORY_HEADER_SIZE 64
+#define RECORD_MAGIC 0x48495354u  // "HIST"
+#define TRAILER_MAGIC 0x454e4448u // "ENDH"
+#define RECORD_ALIGN 8
+#define INITIAL_SLOTS 1024 // Tablas de hash, siempre potencias de 2
+
+/* Cabecera de cada registro; le siguen el comando y el cwd con su '\0',
+ * relleno hasta RECORD_ALIGN y el trailer */
+typedef struct {
+  uint32_t magic;
+  uint32_t length; // Registro completo, trailer incluido
+  int64_t start_ns;
+  uint64_t duration_ns;
+  int32_t status;
+  int32_t pid;
+  uint32_t command_length;
+  uint32_t cwd_length;
+} record_t;
+
+/* El trailer se escribe al final: sin el, el registro todavia no existe */
+typedef struct {
+  uint32_t magic;
+  uint32_t length;
+} trailer_t;
+
+/* Un comando distinto y su ejecucion mas nueva */
+typedef struct {
+  uint64_t hash;
+  uint64_t last; // Offset del registro
+} distinct_t;
+
+/* Lista de comandos distintos que contienen un trigrama, en orden */
+typedef struct {
+  uint32_t key; // Los tres bytes + 1; 0 es un slot libre
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t *ids;
+} gram_t;
+
+static struct {
+  int fd;
+  char *path;
+  char *map;
+  size_t mapped;
+  dev_t dev;
+  ino_t inode;
+  size_t end;     // Hasta donde hay registros completos
+  size_t records; // Registros hasta end
+  int indexed;    // El indice de trigramas se construye con la 1ra busqueda
+  size_t scanned; // Hasta donde llegan las tablas
+  distinct_t *distinct;
+  size_t distinct_count, distinct_capacity;
+  uint32_t *slots; // Ids de distinct + 1 por hash del comando
+  size_t slot_count;
+  gram_t *grams;
+  size_t gram_count, gram_slots;
+} hlog = {.fd = -1};
+
+static void *xrealloc(void *data, size_t size) {
+  void *grown = realloc(data, size);
+  if (!grown) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  return grown;
+}
+
+static uint64_t fnv1a(const char *text, size_t length) {
+  uint64_t hash = 1469598103934665603ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)text[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static size_t align_up(size_t size) {
+  return (size + RECORD_ALIGN - 1) & ~(size_t)(RECORD_ALIGN - 1);
+}
+
+const char *history_log_default_path(void) {
+  static char path[PATH_MAX];
+  const char *file = getenv(HISTORY_FILE_ENV);
+  if (file) {
+    return *file ? file : NULL;
+  }
+  const char *home = getenv("HOME");
+  if (!home || !*home) {
+    return NULL;
+  }
+  snprintf(path, sizeof(path), "%s/.shell_history", home);
+  return path;
+}
+
+static uint64_t max_bytes(void) {
+  const char *value = getenv(HISTORY_MAX_BYTES_ENV);
+  if (value && *value) {
+    char *end;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (*end == '\0' && parsed >= HISTORY_HEADER_SIZE * 2) {
+      return parsed;
+    }
+  }
+  return HISTORY_DEFAULT_MAX_BYTES;
+}
+
+/* El registro en offset si esta completo y es coherente, si no NULL */
+static const record_t *record_at(size_t offset, size_t size) {
+  if (offset + sizeof(record_t) + sizeof(trailer_t) > size) {
+    return NULL;
+  }
+  const record_t *record = (const record_t *)(hlog.map + offset);
+  if (record->magic != RECORD_MAGIC || record->length > size - offset ||
+      record->length < sizeof(record_t) + sizeof(trailer_t) ||
+      sizeof(record_t) + record->command_length + record->cwd_length + 2 >
+          record->length - sizeof(trailer_t)) {
+    return NULL;
+  }
+  const trailer_t *trailer =
+      (const trailer_t *)(hlog.map + offset + record->length -
+                          sizeof(trailer_t));
+  if (trailer->magic != TRAILER_MAGIC || trailer->length != record->length) {
+    return NULL;
+  }
+  return record;
+}
+
+static const char *record_command(const record_t *record) {
+  return (const char *)(record + 1);
+}
+
+static void fill_entry(size_t offset, history_entry_t *entry) {
+  const record_t *record = (const record_t *)(hlog.map + offset);
+  entry->command = record_command(record);
+  entry->cwd = entry->command + record->command_length + 1;
+  entry->status = record->status;
+  entry->start_ns = record->start_ns;
+  entry->duration_ns = record->duration_ns;
+  entry->pid = record->pid;
+}
+
+static void free_index(void) {
+  for (size_t i = 0; i < hlog.gram_slots; i++) {
+    free(hlog.grams[i].ids);
+  }
+  free(hlog.grams);
+  free(hlog.slots);
+  free(hlog.distinct);
+  hlog.grams = NULL;
+  hlog.slots = NULL;
+  hlog.distinct = NULL;
+  hlog.gram_count = hlog.gram_slots = 0;
+  hlog.slot_count = 0;
+  hlog.distinct_count = hlog.distinct_capacity = 0;
+  hlog.scanned = HISTORY_HEADER_SIZE;
+}
+
+static gram_t *find_gram(uint32_t key, int create) {
+  if (create && (hlog.gram_count + 1) * 2 > hlog.gram_slots) {
+    size_t old_slots = hlog.gram_slots;
+    gram_t *old = hlog.grams;
+    hlog.gram_slots = old_slots ? old_slots * 2 : INITIAL_SLOTS;
+    hlog.grams = calloc(hlog.gram_slots, sizeof(gram_t));
+    if (!hlog.grams) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < old_slots; i++) {
+      if (old[i].key) {
+        size_t slot = (old[i].key * 2654435761u) & (hlog.gram_slots - 1);
+        while (hlog.grams[slot].key) {
+          slot = (slot + 1) & (hlog.gram_slots - 1);
+        }
+        hlog.grams[slot] = old[i];
+      }
+    }
+    free(old);
+  }
+  if (hlog.gram_slots == 0) {
+    return NULL;
+  }
+  size_t slot = (key * 2654435761u) & (hlog.gram_slots - 1);
+  while (hlog.grams[slot].key && hlog.grams[slot].key != key) {
+    slot = (slot + 1) & (hlog.gram_slots - 1);
+  }
+  if (hlog.grams[slot].key == key) {
+    return &hlog.grams[slot];
+  }
+  if (!create) {
+    return NULL;
+  }
+  hlog.grams[slot].key = key;
+  hlog.gram_count++;
+  return &hlog.grams[slot];
+}
+
+static uint32_t gram_key(const char *text) {
+  return ((uint32_t)(unsigned char)text[0] << 16 |
+          (uint32_t)(unsigned char)text[1] << 8 |
+          (uint32_t)(unsigned char)text[2]) +
+         1;
+}
+
+/* Agrega un comando nuevo a las listas de sus trigramas */
+static void index_grams(const char *command, size_t length, uint32_t id) {
+  for (size_t i = 0; i + 3 <= length; i++) {
+    gram_t *gram = find_gram(gram_key(command + i), 1);
+    // Los ids crecen: un trigrama repetido en el comando ya quedo al final
+    if (gram->count > 0 && gram->ids[gram->count - 1] == id) {
+      continue;
+    }
+    if (gram->count == gram->capacity) {
+      gram->capacity = gram->capacity ? gram->capacity * 2 : 4;
+      gram->ids = xrealloc(gram->ids, gram->capacity * sizeof(uint32_t));
+    }
+    gram->ids[gram->count++] = id;
+  }
+}
+
+static void grow_slots(void) {
+  free(hlog.slots);
+  hlog.slot_count = hlog.slot_count ? hlog.slot_count * 2 : INITIAL_SLOTS;
+  hlog.slots = calloc(hlog.slot_count, sizeof(uint32_t));
+  if (!hlog.slots) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t id = 0; id < hlog.distinct_count; id++) {
+    size_t slot = hlog.distinct[id].hash & (hlog.slot_count - 1);
+    while (hlog.slots[slot]) {
+      slot = (slot + 1) & (hlog.slot_count - 1);
+    }
+    hlog.slots[slot] = id + 1;
+  }
+}
+
+/* Suma un registro a las tablas: un comando visto es solo su ultima vez */
+static void index_record(size_t offset, const record_t *record) {
+  const char *command = record_command(record);
+  size_t length = record->command_length;
+  uint64_t hash = fnv1a(command, length);
+  if ((hlog.distinct_count + 1) * 2 > hlog.slot_count) {
+    grow_slots();
+  }
+  size_t slot = hash & (hlog.slot_count - 1);
+  while (hlog.slots[slot]) {
+    distinct_t *known = &hlog.distinct[hlog.slots[slot] - 1];
+    const record_t *last = (const record_t *)(hlog.map + known->last);
+    if (known->hash == hash && last->command_length == length &&
+        memcmp(record_command(last), command, length) == 0) {
+      known->last = offset;
+      return;
+    }
+    slot = (slot + 1) & (hlog.slot_count - 1);
+  }
+  if (hlog.distinct_count == hlog.distinct_capacity) {
+    hlog.distinct_capacity =
+        hlog.distinct_capacity ? hlog.distinct_capacity * 2 : INITIAL_SLOTS;
+    hlog.distinct = xrealloc(hlog.distinct,
+                             hlog.distinct_capacity * sizeof(distinct_t));
+  }
+  uint32_t id = hlog.distinct_count++;
+  hlog.distinct[id].hash = hash;
+  hlog.distinct[id].last = offset;
+  hlog.slots[slot] = id + 1;
+  index_grams(command, length, id);
+}
+
+/* Cierra el archivo actual sin tocar el path */
+static void unmap(void) {
+  if (hlog.map) {
+    munmap(hlog.map, hlog.mapped);
+    hlog.map = NULL;
+    hlog.mapped = 0;
+  }
+  if (hlog.fd != -1) {
+    close(hlog.fd);
+    hlog.fd = -1;
+  }
+  free_index();
+  hlog.end = HISTORY_HEADER_SIZE;
+  hlog.records = 0;
+}
+
+/* Abre hlog.path; si esta vacio le escribe la cabecera */
+static int open_file(void) {
+  int fd = open(hlog.path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    return -1;
+  }
+  struct stat st;
+  flock(fd, LOCK_EX);
+  if (fstat(fd, &st) == 0 && st.st_size == 0) {
+    char header[HISTORY_HEADER_SIZE] = HISTORY_MAGIC;
+    if (pwrite(fd, header, sizeof(header), 0) != sizeof(header)) {
+      flock(fd, LOCK_UN);
+      close(fd);
+      return -1;
+    }
+  }
+  flock(fd, LOCK_UN);
+  char magic[sizeof(HISTORY_MAGIC)];
+  if (fstat(fd, &st) == -1 ||
+      pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+      memcmp(magic, HISTORY_MAGIC, sizeof(magic)) != 0) {
+    close(fd);
+    errno = EINVAL; // No es un historial
+    return -1;
+  }
+  hlog.fd = fd;
+  hlog.dev = st.st_dev;
+  hlog.inode = st.st_ino;
+  hlog.end = HISTORY_HEADER_SIZE;
+  hlog.scanned = HISTORY_HEADER_SIZE;
+  hlog.records = 0;
+  return 0;
+}
+
+/* Lo que otras shells escribieron: un archivo compactado se reabre y un
+ * archivo mas largo se vuelve a mapear */
+static int refresh(void) {
+  if (hlog.fd == -1) {
+    return -1;
+  }
+  struct stat st;
+  if (stat(hlog.path, &st) == 0 &&
+      (st.st_dev != hlog.dev || st.st_ino != hlog.inode)) {
+    unmap();
+    if (open_file() == -1) {
+      return -1;
+    }
+  }
+  if (fstat(hlog.fd, &st) == -1) {
+    return -1;
+  }
+  size_t size = st.st_size;
+  if (size > hlog.mapped) {
+    char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, hlog.fd, 0);
+    if (map == MAP_FAILED) {
+      return -1;
+    }
+    if (hlog.map) {
+      munmap(hlog.map, hlog.mapped);
+    }
+    hlog.map = map;
+    hlog.mapped = size;
+  }
+
+  // Un archivo recortado sigue mapeado entero: no leer pasado su final
+  size_t valid = size < hlog.mapped ? size : hlog.mapped;
+  const record_t *record;
+  while ((record = record_at(hlog.end, valid))) {
+    hlog.end += record->length;
+    hlog.records++;
+  }
+  if (hlog.indexed) {
+    while (hlog.scanned < hlog.end) {
+      record = (const record_t *)(hlog.map + hlog.scanned);
+      index_record(hlog.scanned, record);
+      hlog.scanned += record->length;
+    }
+  }
+  return 0;
+}
+
+int history_log_open(const char *path) {
+  history_log_close();
+  hlog.path = strdup(path);
+  if (!hlog.path) {
+    return -1;
+  }
+  if (open_file() == -1 || refresh() == -1) {
+    int error = errno;
+    history_log_close();
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+void history_log_close(void) {
+  unmap();
+  free(hlog.path);
+  hlog.path = NULL;
+  hlog.indexed = 0;
+}
+
+/* Con el lock tomado: copia la mitad mas nueva a un archivo nuevo y lo
+ * renombra sobre el viejo */
+static void compact(uint64_t limit) {
+  if (refresh() == -1) {
+    return;
+  }
+  // Primer registro desde el que lo que queda entra en la mitad del limite
+  size_t offset = HISTORY_HEADER_SIZE;
+  while (offset < hlog.end && hlog.end - offset > limit / 2) {
+    offset += ((const record_t *)(hlog.map + offset))->length;
+  }
+
+  char tmp[PATH_MAX];
+  snprintf(tmp, sizeof(tmp), "%s.%d.tmp", hlog.path, (int)getpid());
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    return;
+  }
+  char header[HISTORY_HEADER_SIZE] = HISTORY_MAGIC;
+  size_t length = hlog.end - offset;
+  int failed =
+      write(fd, header, sizeof(header)) != sizeof(header) ||
+      (length > 0 && write(fd, hlog.map + offset, length) != (ssize_t)length);
+  if (close(fd) == -1 || failed || rename(tmp, hlog.path) == -1) {
+    unlink(tmp);
+  }
+}
+
+int history_log_append(const char *command, const char *cwd, int status,
+                       int64_t start_ns, uint64_t duration_ns) {
+  if (hlog.fd == -1) {
+    return -1;
+  }
+  size_t command_length = strlen(command);
+  size_t cwd_length = strlen(cwd);
+  size_t length = align_up(sizeof(record_t) + command_length + cwd_length +
+                           2) +
+                  sizeof(trailer_t);
+  if (length > UINT32_MAX) {
+    errno = E2BIG;
+    return -1;
+  }
+  char *buffer = calloc(1, length);
+  if (!buffer) {
+    return -1;
+  }
+  record_t *record = (record_t *)buffer;
+  record->magic = RECORD_MAGIC;
+  record->length = length;
+  record->start_ns = start_ns;
+  record->duration_ns = duration_ns;
+  record->status = status;
+  record->pid = getpid();
+  record->command_length = command_length;
+  record->cwd_length = cwd_length;
+  memcpy(buffer + sizeof(record_t), command, command_length);
+  memcpy(buffer + sizeof(record_t) + command_length + 1, cwd, cwd_length);
+  trailer_t trailer = {TRAILER_MAGIC, length};
+  memcpy(buffer + length - sizeof(trailer), &trailer, sizeof(trailer));
+
+  // Si otra shell compacto mientras se esperaba el lock, el archivo es otro
+  int result = -1;
+  for (int tries = 0; tries < 3 && result == -1; tries++) {
+    if (refresh() == -1) {
+      break;
+    }
+    flock(hlog.fd, LOCK_EX);
+    struct stat st;
+    if (stat(hlog.path, &st) == 0 &&
+        (st.st_dev != hlog.dev || st.st_ino != hlog.inode)) {
+      flock(hlog.fd, LOCK_UN);
+      continue;
+    }
+    /* Un escritor que murio a mitad del pwrite deja un registro cortado, y
+     * todo lo que se anexe detras quedaria invisible: se recorta el archivo
+     * hasta el ultimo registro completo, como metrics_archive_create */
+    if (refresh() == -1) {
+      flock(hlog.fd, LOCK_UN);
+      break;
+    }
+    off_t end = hlog.end;
+    if (lseek(hlog.fd, 0, SEEK_END) > end && ftruncate(hlog.fd, end) == -1) {
+      perror("history");
+      flock(hlog.fd, LOCK_UN);
+      break;
+    }
+    if (pwrite(hlog.fd, buffer, length, end) == (ssize_t)length) {
+      result = 0;
+      uint64_t limit = max_bytes();
+      if ((uint64_t)end + length > limit) {
+        compact(limit);
+      }
+    } else {
+      // Un registro a medias no debe quedar delante del siguiente
+      if (ftruncate(hlog.fd, end) == -1) {
+        perror("history");
+      }
+      tries = 3;
+    }
+    flock(hlog.fd, LOCK_UN);
+  }
+  free(buffer);
+  refresh();
+  return result;
+}
+
+static int newer_first(const void *a, const void *b) {
+  uint64_t left = hlog.distinct[*(const uint32_t *)a].last;
+  uint64_t right = hlog.distinct[*(const uint32_t *)b].last;
+  return (left < right) - (left > right);
+}
+
+size_t history_log_search(const char *text, history_entry_t *matches,
+                          size_t max) {
+  if (!hlog.indexed) {
+    hlog.indexed = 1;
+    hlog.scanned = HISTORY_HEADER_SIZE;
+  }
+  if (refresh() == -1 || max == 0) {
+    return 0;
+  }
+
+  // Candidatos: la lista mas corta de los trigramas de la consulta
+  size_t length = strlen(text);
+  const uint32_t *candidates = NULL;
+  size_t count = hlog.distinct_count;
+  for (size_t i = 0; i + 3 <= length; i++) {
+    gram_t *gram = find_gram(gram_key(text + i), 0);
+    if (!gram) {
+      return 0;
+    }
+    if (!candidates || gram->count < count) {
+      candidates = gram->ids;
+      count = gram->count;
+    }
+  }
+
+  uint32_t *found = malloc((count ? count : 1) * sizeof(uint32_t));
+  if (!found) {
+    return 0;
+  }
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint32_t id = candidates ? candidates[i] : i;
+    const record_t *record =
+        (const record_t *)(hlog.map + hlog.distinct[id].last);
+    if (memmem(record_command(record), record->command_length, text,
+               length)) {
+      found[total++] = id;
+    }
+  }
+  qsort(found, total, sizeof(uint32_t), newer_first);
+  if (total > max) {
+    total = max;
+  }
+  for (size_t i = 0; i < total; i++) {
+    fill_entry(hlog.distinct[found[i]].last, &matches[i]);
+  }
+  free(found);
+  return total;
+}
+
+size_t history_log_recent(history_entry_t *entries, size_t max) {
+  if (refresh() == -1) {
+    return 0;
+  }
+  // Hacia atras, con la longitud de cada trailer
+  size_t count = 0;
+  size_t offset = hlog.end;
+  while (count < max && offset > HISTORY_HEADER_SIZE) {
+    const trailer_t *trailer =
+        (const trailer_t *)(hlog.map + offset - sizeof(trailer_t));
+    offset -= trailer->length;
+    fill_entry(offset, &entries[count++]);
+  }
+  return count;
+}
+
+size_t history_log_count(void) {
+  refresh();
+  return hlog.records;
+}
@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include "job_usage.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STAT_BUFFER_SIZE 1024   // Una linea de /proc/<pid>/stat
+#define STATUS_BUFFER_SIZE 4096 // /proc/<pid>/status completo
+
+static double timeval_seconds(const struct timeval *value) {
+  return value->tv_sec + value->tv_usec / 1e6;
+}
+
+void job_usage_add_rusage(job_usage_t *usage, const struct rusage *rusage) {
+  usage->user += timeval_seconds(&rusage->ru_utime);
+  usage->sys += timeval_seconds(&rusage->ru_stime);
+  if (rusage->ru_maxrss > usage->max_rss) {
+    usage->max_rss = rusage->ru_maxrss;
+  }
+  usage->minor_faults += rusage->ru_minflt;
+  usage->major_faults += rusage->ru_majflt;
+  usage->voluntary_switches += rusage->ru_nvcsw;
+  usage->involuntary_switches += rusage->ru_nivcsw;
+}
+
+void job_usage_add_delta(job_usage_t *usage, const struct rusage *before,
+                         const struct rusage *after) {
+  usage->user +=
+      timeval_seconds(&after->ru_utime) - timeval_seconds(&before->ru_utime);
+  usage->sys +=
+      timeval_seconds(&after->ru_stime) - timeval_seconds(&before->ru_stime);
+  usage->minor_faults += after->ru_minflt - before->ru_minflt;
+  usage->major_faults += after->ru_majflt - before->ru_majflt;
+  usage->voluntary_switches += after->ru_nvcsw - before->ru_nvcsw;
+  usage->involuntary_switches += after->ru_nivcsw - before->ru_nivcsw;
+}
+
+void job_usage_add(job_usage_t *usage, const job_usage_t *other) {
+  usage->user += other->user;
+  usage->sys += other->sys;
+  if (other->max_rss > usage->max_rss) {
+    usage->max_rss = other->max_rss;
+  }
+  usage->minor_faults += other->minor_faults;
+  usage->major_faults += other->major_faults;
+  usage->voluntary_switches += other->voluntary_switches;
+  usage->involuntary_switches += other->involuntary_switches;
+}
+
+/* Valor de un campo 'Nombre:\tvalor' de status, que empieza en line */
+static int status_field(const char *line, const char *name, long *value) {
+  size_t length = strlen(name);
+  if (strncmp(line, name, length) != 0 || line[length] != ':') {
+    return 0;
+  }
+  *value = strtol(line + length + 1, NULL, 10);
+  return 1;
+}
+
+int job_usage_sample(proc_file_t *stat, proc_file_t *status,
+                     job_usage_t *usage) {
+  char text[STAT_BUFFER_SIZE];
+  if (proc_file_read(stat, text, sizeof(text)) <= 0) {
+    return -1;
+  }
+  // El nombre del comando puede tener espacios: se cuenta desde el ')'
+  char *fields = strrchr(text, ')');
+  unsigned long minflt, cminflt, majflt, cmajflt;
+  unsigned long long utime, stime;
+  long long cutime, cstime;
+  if (!fields ||
+      sscanf(fields + 2,
+             "%*c %*d %*d %*d %*d %*d %*u %lu %lu %lu %lu %llu %llu %lld %lld",
+             &minflt, &cminflt, &majflt, &cmajflt, &utime, &stime, &cutime,
+             &cstime) != 8) {
+    return -1;
+  }
+  // Como wait4, se cuentan tambien los hijos que el proceso ya espero
+  double ticks = sysconf(_SC_CLK_TCK);
+  usage->user = (utime + cutime) / ticks;
+  usage->sys = (stime + cstime) / ticks;
+  usage->minor_faults = minflt + cminflt;
+  usage->major_faults = majflt + cmajflt;
+
+  char lines[STATUS_BUFFER_SIZE];
+  if (status->fd == -1 || proc_file_read(status, lines, sizeof(lines)) <= 0) {
+    return 0;
+  }
+  // Los tres campos estan al final: se corta al encontrar el ultimo
+  int found = 0;
+  for (char *line = lines; line && found < 3; line = strchr(line, '\n')) {
+    if (*line == '\n') {
+      line++;
+    }
+    found += status_field(line, "VmHWM", &usage->max_rss) ||
+             status_field(line, "voluntary_ctxt_switches",
+                          &usage->voluntary_switches) ||
+             status_field(line, "nonvoluntary_ctxt_switches",
+                          &usage->involuntary_switches);
+  }
+  return 0;
+}
+
+void job_usage_print_short(FILE *stream, const job_usage_t *usage) {
+  fprintf(stream, "%.2fs real, %.2fs user, %.2fs sys", usage->wall,
+          usage->user, usage->sys);
+  if (usage->max_rss > 0) {
+    fprintf(stream, ", %ld KiB RSS", usage->max_rss);
+  }
+  fprintf(stream, ", %ld/%ld faults, %ld/%ld switches", usage->minor_faults,
+          usage->major_faults, usage->voluntary_switches,
+          usage->involuntary_switches);
+}
+
+void job_usage_print(FILE *stream, const job_usage_t *usage) {
+  fprintf(stream, "\nreal     %.3fs\n", usage->wall);
+  fprintf(stream, "user     %.3fs\n", usage->user);
+  fprintf(stream, "sys      %.3fs\n", usage->sys);
+  if (usage->max_rss > 0) {
+    fprintf(stream, "max RSS  %ld KiB\n", usage->max_rss);
+  }
+  fprintf(stream, "faults   %ld minor, %ld major\n", usage->minor_faults,
+          usage->major_faults);
+  fprintf(stream, "switches %ld voluntary, %ld involuntary\n",
+          usage->voluntary_switches, usage->involuntary_switches);
+}
@@ -1,12 +1,25 @@
 #include "commands.h"
+#include "completion.h"
+#include "heredoc.h"
+#include "serve.h"
 #include "shell.h"
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 int main(int argc, char** argv)
 {
+    // Servidor de comandos: sin prompt, animacion ni trabajos propios
+    if (argc == 3 && strcmp(argv[1], SERVE_OPTION) == 0)
+    {
+        return serve_run(argv[2]);
+    }
+
     // Inicializar la shell
     init_shell();
 
@@ -29,11 +42,13 @@ int main(int argc, char** argv)
     // Error de uso, mas de un argumento.
     else if (argc > 2)
     {
-        fprintf(stderr, "Uso: %s [archivo_de_comandos]\n", argv[0]);
+        fprintf(stderr, "Uso: %s [archivo_de_comandos | " SERVE_OPTION " socket]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    // Modo interactivo
+    // Modo interactivo, con el historial compartido entre shells y TAB
+    shell_history_start();
+    completion_install();
     while (true)
     {
         if (sigchld_flag)
@@ -52,8 +67,36 @@ int main(int argc, char** argv)
             break;
         }
 
+        // Leer los cuerpos de los here-documents, si los hay
+        if (heredoc_collect(input, stdin) == -1)
+        {
+            heredoc_discard();
+            free(input);
+            continue;
+        }
+
+        // execute_command separa la linea en su lugar: el historial guarda una copia
+        char* line = strdup(input);
+        char cwd[PATH_MAX];
+        if (!getcwd(cwd, sizeof(cwd)))
+        {
+            strcpy(cwd, "?");
+        }
+        struct timespec wall, start, end;
+        clock_gettime(CLOCK_REALTIME, &wall);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
         // Ejecutar el comando ingresado
-        if (execute_command(input) == 0)
+        int keep_going = execute_command(input);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (line)
+        {
+            shell_history_record(line, cwd, (int64_t)wall.tv_sec * 1000000000 + wall.tv_nsec,
+                                 (uint64_t)((end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec)));
+            free(line);
+        }
+        if (keep_going == 0)
         {
             free(input);
             break; // Salir de la shell si execute_command retorna 0
@@ -0,0 +1,558 @@
+#define _GNU_SOURCE
+#include "memo.h"
+#include "path_cache.h"
+#include "shell.h"
+#include "shell_stats.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MEMO_MAGIC "SHMEMO1"
+#define MEMO_SUFFIX ".memo"
+#define MEMO_CHUNK 65536
+#define MEMO_STALE_TMP_SECONDS 3600 // Temporales de una corrida que murio
+#define MEMO_NOT_FOUND 127          // Estado de un comando que no arranco
+
+/* Cabecera de cada entrada; le siguen la clave, stdout y stderr */
+typedef struct {
+  char magic[8];
+  uint32_t key_length;
+  int32_t status;
+  uint64_t out_length;
+  uint64_t err_length;
+} memo_header_t;
+
+typedef struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+} buffer_t;
+
+typedef struct {
+  char name[NAME_MAX + 1];
+  struct timespec used; // mtime: la ultima vez que se escribio o repitio
+  off_t size;
+} entry_t;
+
+static void append(buffer_t *buffer, const void *data, size_t length) {
+  if (buffer->length + length > buffer->capacity) {
+    size_t capacity = buffer->capacity ? buffer->capacity : 256;
+    while (capacity < buffer->length + length) {
+      capacity *= 2;
+    }
+    char *grown = realloc(buffer->data, capacity);
+    if (!grown) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    buffer->data = grown;
+    buffer->capacity = capacity;
+  }
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+}
+
+/* Cada campo de la clave termina en '\0', asi "a b" y "a", "b" difieren.
+ * Los de longitud libre van con append_text, sin truncar */
+static void append_text(buffer_t *key, const char *label, const char *text) {
+  append(key, label, strlen(label));
+  append(key, text, strlen(text) + 1);
+}
+
+static void append_field(buffer_t *key, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void append_field(buffer_t *key, const char *format, ...) {
+  char field[PATH_MAX + 64];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(field, sizeof(field), format, args);
+  va_end(args);
+  if (length >= (int)sizeof(field)) {
+    length = sizeof(field) - 1;
+  }
+  append(key, field, length + 1);
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+#define FNV_OFFSET 1469598103934665603ULL
+
+static int hash_file(const char *path, uint64_t *digest) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  char *chunk = malloc(MEMO_CHUNK);
+  if (!chunk) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  uint64_t hash = FNV_OFFSET;
+  ssize_t count;
+  while ((count = read(fd, chunk, MEMO_CHUNK)) != 0) {
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    hash = fnv1a(hash, chunk, count);
+  }
+  int error = count == -1 ? errno : 0;
+  free(chunk);
+  close(fd);
+  *digest = hash;
+  errno = error;
+  return error ? -1 : 0;
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return -1;
+    }
+    data += written;
+    length -= written;
+  }
+  return 0;
+}
+
+/* Marca de uso para el LRU. El reloj de los archivos avanza de a ticks del
+ * kernel; con el de CLOCK_REALTIME dos usos seguidos no empatan */
+static void mark_used(int fd) {
+  struct timespec times[2];
+  clock_gettime(CLOCK_REALTIME, &times[0]);
+  times[1] = times[0];
+  futimens(fd, times);
+}
+
+static uint64_t max_bytes(void) {
+  const char *value = getenv(MEMO_MAX_BYTES_ENV);
+  if (value && *value) {
+    char *end;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (*end == '\0' && parsed > 0) {
+      return parsed;
+    }
+  }
+  return MEMO_DEFAULT_MAX_BYTES;
+}
+
+/* Crea los directorios que falten de path */
+static int make_dirs(char *path) {
+  for (char *slash = strchr(path + 1, '/'); slash;
+       slash = strchr(slash + 1, '/')) {
+    *slash = '\0';
+    int made = mkdir(path, 0700);
+    *slash = '/';
+    if (made == -1 && errno != EEXIST) {
+      return -1;
+    }
+  }
+  return mkdir(path, 0700) == -1 && errno != EEXIST ? -1 : 0;
+}
+
+const char *memo_dir(void) {
+  static char path[PATH_MAX];
+  const char *dir = getenv(MEMO_DIR_ENV);
+  const char *base = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int length;
+  if (dir && *dir) {
+    length = snprintf(path, sizeof(path), "%s", dir);
+  } else if (base && *base) {
+    length = snprintf(path, sizeof(path), "%s/shell/memo", base);
+  } else if (home && *home) {
+    length = snprintf(path, sizeof(path), "%s/.cache/shell/memo", home);
+  } else {
+    return NULL;
+  }
+  if (length >= (int)sizeof(path) || make_dirs(path) == -1) {
+    return NULL;
+  }
+  return path;
+}
+
+/* Describe todo lo que determina el resultado; -1 si un input no se lee */
+static int build_key(const memo_spec_t *spec, const char *program,
+                     buffer_t *key) {
+  char cwd[PATH_MAX];
+  append_text(key, "", MEMO_MAGIC);
+  append_text(key, "cwd=", getcwd(cwd, sizeof(cwd)) ? cwd : "?");
+
+  struct stat st;
+  if (program && stat(program, &st) == 0) {
+    append_field(key, "program=%s:%lld:%lld.%09ld", program,
+                 (long long)st.st_size, (long long)st.st_mtim.tv_sec,
+                 st.st_mtim.tv_nsec);
+  } else {
+    append_field(key, "program=?");
+  }
+  for (int i = 0; spec->args[i]; i++) {
+    append_text(key, "arg=", spec->args[i]);
+  }
+  for (int i = 0; spec->env && spec->env[i]; i++) {
+    const char *value = getenv(spec->env[i]);
+    // Una variable vacia no es lo mismo que una sin definir
+    append_text(key, value ? "env=" : "unset=", spec->env[i]);
+    if (value) {
+      append_text(key, "", value);
+    }
+  }
+  for (int i = 0; spec->inputs && spec->inputs[i]; i++) {
+    uint64_t digest;
+    if (hash_file(spec->inputs[i], &digest) == -1) {
+      fprintf(stderr, "memo: %s: %s\n", spec->inputs[i], strerror(errno));
+      return -1;
+    }
+    append_field(key, "input=%s:%016llx", spec->inputs[i],
+                 (unsigned long long)digest);
+  }
+  for (int i = 0; spec->stamps && spec->stamps[i]; i++) {
+    if (stat(spec->stamps[i], &st) == -1) {
+      fprintf(stderr, "memo: %s: %s\n", spec->stamps[i], strerror(errno));
+      return -1;
+    }
+    append_field(key, "stamp=%s:%lld:%lld.%09ld", spec->stamps[i],
+                 (long long)st.st_size, (long long)st.st_mtim.tv_sec,
+                 st.st_mtim.tv_nsec);
+  }
+  return 0;
+}
+
+/* Reproduce una entrada si su clave coincide; -1 si no esta */
+static int replay(const char *path, const buffer_t *key, int *status) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  memo_header_t header;
+  char *chunk = malloc(MEMO_CHUNK);
+  int hit = chunk && read(fd, &header, sizeof(header)) == sizeof(header) &&
+            memcmp(header.magic, MEMO_MAGIC, sizeof(header.magic)) == 0 &&
+            header.key_length == key->length;
+  // La clave completa se compara: un choque del hash no devuelve otra cosa
+  for (size_t done = 0; hit && done < key->length;) {
+    size_t want = key->length - done < MEMO_CHUNK ? key->length - done
+                                                  : MEMO_CHUNK;
+    ssize_t count = read(fd, chunk, want);
+    hit = count > 0 && memcmp(chunk, key->data + done, count) == 0;
+    done += count > 0 ? count : 0;
+  }
+  if (hit) {
+    fflush(stdout);
+    fflush(stderr);
+    uint64_t lengths[2] = {header.out_length, header.err_length};
+    for (int stream = 0; stream < 2; stream++) {
+      for (uint64_t left = lengths[stream]; left > 0;) {
+        ssize_t count = read(fd, chunk, left < MEMO_CHUNK ? left : MEMO_CHUNK);
+        if (count <= 0) {
+          break; // Entrada truncada: se ve en la salida, no se repite
+        }
+        write_all(stream == 0 ? STDOUT_FILENO : STDERR_FILENO, chunk, count);
+        left -= count;
+      }
+    }
+    *status = header.status;
+    mark_used(fd);
+  }
+  free(chunk);
+  close(fd);
+  return hit ? 0 : -1;
+}
+
+/* Corre el comando pasando su salida y guardandola mientras quepa */
+static int run_captured(char **args, const char *program, buffer_t out[2],
+                        uint64_t limit, int *fits, int *wait_status) {
+  int pipes[2][2];
+  if (pipe2(pipes[0], O_CLOEXEC) == -1) {
+    return -1;
+  }
+  if (pipe2(pipes[1], O_CLOEXEC) == -1) {
+    close(pipes[0][0]);
+    close(pipes[0][1]);
+    return -1;
+  }
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == 0) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    dup2(pipes[0][1], STDOUT_FILENO);
+    dup2(pipes[1][1], STDERR_FILENO);
+    if (program) {
+      execv(program, args);
+    }
+    execvp(args[0], args);
+    fprintf(stderr, "memo: %s: %s\n", args[0], strerror(errno));
+    _exit(MEMO_NOT_FOUND);
+  }
+  close(pipes[0][1]);
+  close(pipes[1][1]);
+  if (pid == -1) {
+    close(pipes[0][0]);
+    close(pipes[1][0]);
+    return -1;
+  }
+
+  foreground_pid = pid; // CTRL-C llega al comando, no a la shell
+  struct pollfd fds[2] = {{pipes[0][0], POLLIN, 0}, {pipes[1][0], POLLIN, 0}};
+  char *chunk = malloc(MEMO_CHUNK);
+  if (!chunk) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  *fits = 1;
+  while (fds[0].fd != -1 || fds[1].fd != -1) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    for (int stream = 0; stream < 2; stream++) {
+      if (fds[stream].fd == -1 || !fds[stream].revents) {
+        continue;
+      }
+      ssize_t count = read(fds[stream].fd, chunk, MEMO_CHUNK);
+      if (count == -1 && errno == EINTR) {
+        continue;
+      }
+      if (count <= 0) {
+        close(fds[stream].fd);
+        fds[stream].fd = -1;
+        continue;
+      }
+      write_all(stream == 0 ? STDOUT_FILENO : STDERR_FILENO, chunk, count);
+      if (*fits && out[0].length + out[1].length + count <= limit) {
+        append(&out[stream], chunk, count);
+      } else {
+        *fits = 0; // Mas grande que la cache: se pasa pero no se guarda
+      }
+    }
+  }
+  free(chunk);
+  for (int stream = 0; stream < 2; stream++) {
+    if (fds[stream].fd != -1) {
+      close(fds[stream].fd);
+    }
+  }
+  while (waitpid(pid, wait_status, 0) == -1 && errno == EINTR) {
+  }
+  foreground_pid = 0;
+  return 0;
+}
+
+/* Escribe la entrada en un temporal y la publica con rename */
+static void store(const char *dir, const char *path, const buffer_t *key,
+                  int status, const buffer_t out[2]) {
+  char tmp[PATH_MAX];
+  snprintf(tmp, sizeof(tmp), "%s/.%d.tmp", dir, (int)getpid());
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    return;
+  }
+  memo_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MEMO_MAGIC, sizeof(MEMO_MAGIC));
+  header.key_length = key->length;
+  header.status = status;
+  header.out_length = out[0].length;
+  header.err_length = out[1].length;
+  int failed = write_all(fd, (const char *)&header, sizeof(header)) == -1 ||
+               write_all(fd, key->data, key->length) == -1 ||
+               write_all(fd, out[0].data, out[0].length) == -1 ||
+               write_all(fd, out[1].data, out[1].length) == -1;
+  mark_used(fd);
+  if (close(fd) == -1 || failed || rename(tmp, path) == -1) {
+    unlink(tmp);
+  }
+}
+
+/* Lista las entradas; los temporales abandonados se borran al pasar */
+static entry_t *list_entries(const char *dir, size_t *count) {
+  DIR *stream = opendir(dir);
+  if (!stream) {
+    return NULL;
+  }
+  entry_t *entries = NULL;
+  size_t capacity = 0;
+  *count = 0;
+  time_t now = time(NULL);
+  struct dirent *dirent;
+  while ((dirent = readdir(stream))) {
+    struct stat st;
+    const char *name = dirent->d_name;
+    size_t length = strlen(name);
+    if (fstatat(dirfd(stream), name, &st, AT_SYMLINK_NOFOLLOW) == -1 ||
+        !S_ISREG(st.st_mode)) {
+      continue;
+    }
+    if (name[0] == '.' && now - st.st_mtime > MEMO_STALE_TMP_SECONDS) {
+      unlinkat(dirfd(stream), name, 0);
+      continue;
+    }
+    if (length <= strlen(MEMO_SUFFIX) ||
+        strcmp(name + length - strlen(MEMO_SUFFIX), MEMO_SUFFIX) != 0) {
+      continue;
+    }
+    if (*count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      entry_t *grown = realloc(entries, capacity * sizeof(entry_t));
+      if (!grown) {
+        fprintf(stderr, "Shell: Allocation error\n");
+        exit(EXIT_FAILURE);
+      }
+      entries = grown;
+    }
+    entry_t *entry = &entries[(*count)++];
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    entry->used = st.st_mtim;
+    entry->size = st.st_size;
+  }
+  closedir(stream);
+  if (!entries) {
+    entries = malloc(sizeof(entry_t)); // Vacia pero no es un error
+  }
+  return entries;
+}
+
+static int older_first(const void *a, const void *b) {
+  const struct timespec *left = &((const entry_t *)a)->used;
+  const struct timespec *right = &((const entry_t *)b)->used;
+  if (left->tv_sec != right->tv_sec) {
+    return left->tv_sec < right->tv_sec ? -1 : 1;
+  }
+  return (left->tv_nsec > right->tv_nsec) - (left->tv_nsec < right->tv_nsec);
+}
+
+/* Borra las entradas usadas hace mas tiempo hasta volver bajo el limite */
+static void evict(const char *dir, uint64_t limit) {
+  size_t count;
+  entry_t *entries = list_entries(dir, &count);
+  if (!entries) {
+    return;
+  }
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    total += entries[i].size;
+  }
+  if (total > limit) {
+    qsort(entries, count, sizeof(entry_t), older_first);
+    char path[PATH_MAX];
+    for (size_t i = 0; i < count && total > limit; i++) {
+      snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+      if (unlink(path) == 0) {
+        shell_stats_count(SHELL_COUNTER_MEMO_EVICTIONS);
+      }
+      total -= entries[i].size; // Si otra shell lo borro, tampoco ocupa
+    }
+  }
+  free(entries);
+}
+
+int memo_run(const memo_spec_t *spec, int *status) {
+  const char *dir = memo_dir();
+  if (!dir) {
+    fprintf(stderr, "memo: no cache directory (set %s)\n", MEMO_DIR_ENV);
+    return -1;
+  }
+  const char *program =
+      strchr(spec->args[0], '/') ? spec->args[0]
+                                 : path_cache_lookup(spec->args[0]);
+  buffer_t key = {NULL, 0, 0};
+  if (build_key(spec, program, &key) == -1) {
+    free(key.data);
+    return -1;
+  }
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%016llx" MEMO_SUFFIX, dir,
+           (unsigned long long)fnv1a(FNV_OFFSET, key.data, key.length));
+
+  if (replay(path, &key, status) == 0) {
+    shell_stats_count(SHELL_COUNTER_MEMO_HITS);
+    free(key.data);
+    return 1;
+  }
+  shell_stats_count(SHELL_COUNTER_MEMO_MISSES);
+
+  uint64_t limit = max_bytes();
+  buffer_t out[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+  int fits, wait_status;
+  if (run_captured(spec->args, program, out, limit, &fits, &wait_status) ==
+      -1) {
+    perror("memo");
+    free(key.data);
+    return -1;
+  }
+  if (WIFEXITED(wait_status)) {
+    *status = WEXITSTATUS(wait_status);
+  } else {
+    *status = 128 + (WIFSIGNALED(wait_status) ? WTERMSIG(wait_status) : 0);
+  }
+  // Solo se guarda un resultado completo de un comando que si corrio
+  if (fits && WIFEXITED(wait_status) && *status != MEMO_NOT_FOUND) {
+    store(dir, path, &key, *status, out);
+    evict(dir, limit);
+  }
+  free(out[0].data);
+  free(out[1].data);
+  free(key.data);
+  return 0;
+}
+
+int memo_usage(size_t *entries_count, uint64_t *bytes) {
+  const char *dir = memo_dir();
+  entry_t *entries = dir ? list_entries(dir, entries_count) : NULL;
+  if (!entries) {
+    return -1;
+  }
+  *bytes = 0;
+  for (size_t i = 0; i < *entries_count; i++) {
+    *bytes += entries[i].size;
+  }
+  free(entries);
+  return 0;
+}
+
+int memo_clear(void) {
+  const char *dir = memo_dir();
+  size_t count;
+  entry_t *entries = dir ? list_entries(dir, &count) : NULL;
+  if (!entries) {
+    return -1;
+  }
+  int deleted = 0;
+  char path[PATH_MAX];
+  for (size_t i = 0; i < count; i++) {
+    snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+    deleted += unlink(path) == 0;
+  }
+  free(entries);
+  return deleted;
+}
@@ -0,0 +1,146 @@
+#include "metric_record.h"
+#include <cjson/cJSON.h>
+#include <string.h>
+
+#define METRIC_FIELD(name)                                                     \
+  { #name, offsetof(metrics_sample_t, name) }
+
+static const metric_field_t fields[] = {
+    METRIC_FIELD(timestamp),
+    METRIC_FIELD(cpu_usage_percentage),
+    METRIC_FIELD(memory_usage_percentage),
+    METRIC_FIELD(disk_reads),
+    METRIC_FIELD(disk_writes),
+    METRIC_FIELD(disk_read_time_seconds),
+    METRIC_FIELD(disk_write_time_seconds),
+    METRIC_FIELD(network_bandwidth_rx),
+    METRIC_FIELD(network_bandwidth_tx),
+    METRIC_FIELD(network_packet_ratio),
+    METRIC_FIELD(running_processes_count),
+    METRIC_FIELD(context_switches_total),
+};
+
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+_Static_assert(NUM_FIELDS * sizeof(double) == sizeof(metrics_sample_t),
+               "every field of metrics_sample_t must be in the table");
+_Static_assert(sizeof(metric_record_t) % METRIC_RECORD_ALIGN == 0,
+               "metric_record_t must fill whole cache lines");
+
+const metric_field_t *metric_fields(size_t *count) {
+  *count = NUM_FIELDS;
+  return fields;
+}
+
+const metric_field_t *metric_field_find(const char *name) {
+  for (size_t i = 0; i < NUM_FIELDS; i++) {
+    if (strcmp(fields[i].name, name) == 0) {
+      return &fields[i];
+    }
+  }
+  return NULL;
+}
+
+/* Nombres cortos para las metricas mas usadas */
+static const struct {
+  const char *alias;
+  const char *field;
+} aliases[] = {
+    {"cpu", "cpu_usage_percentage"},
+    {"mem", "memory_usage_percentage"},
+    {"memory", "memory_usage_percentage"},
+    {"procs", "running_processes_count"},
+};
+
+const metric_field_t *metric_field_resolve(const char *name) {
+  for (size_t i = 0; i < sizeof(aliases) / sizeof(aliases[0]); i++) {
+    if (strcmp(aliases[i].alias, name) == 0) {
+      return metric_field_find(aliases[i].field);
+    }
+  }
+  const metric_field_t *field = metric_field_find(name);
+  // El timestamp no es una metrica
+  return field && field->offset != 0 ? field : NULL;
+}
+
+double metric_field_value(const metrics_sample_t *sample,
+                          const metric_field_t *field) {
+  double value;
+  memcpy(&value, (const char *)sample + field->offset, sizeof(value));
+  return value;
+}
+
+uint32_t metric_schema_hash(void) {
+  static uint32_t hash = 0;
+  if (hash != 0) {
+    return hash;
+  }
+
+  // FNV-1a sobre "nombre:offset;" de cada campo
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < NUM_FIELDS; i++) {
+    for (const char *c = fields[i].name; *c; c++) {
+      h = (h ^ (unsigned char)*c) * 16777619u;
+    }
+    size_t offset = fields[i].offset;
+    for (size_t b = 0; b < sizeof(uint32_t); b++) {
+      h = (h ^ ((offset >> (8 * b)) & 0xff)) * 16777619u;
+    }
+    h = (h ^ ';') * 16777619u;
+  }
+  hash = h ? h : 1; // 0 queda reservado para "sin calcular"
+  return hash;
+}
+
+void metric_record_encode(metric_record_t *record,
+                          const metrics_sample_t *sample, uint64_t sequence) {
+  record->version = METRIC_RECORD_VERSION;
+  record->schema_hash = metric_schema_hash();
+  record->sequence = sequence;
+  record->sample = *sample;
+}
+
+int metric_record_decode(const metric_record_t *record,
+                         metrics_sample_t *sample) {
+  if (record->version != METRIC_RECORD_VERSION ||
+      record->schema_hash != metric_schema_hash()) {
+    return -1;
+  }
+  *sample = record->sample;
+  return 0;
+}
+
+char *metric_sample_to_json(const metrics_sample_t *sample) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) {
+    return NULL;
+  }
+  for (size_t i = 0; i < NUM_FIELDS; i++) {
+    cJSON_AddNumberToObject(root, fields[i].name,
+                            metric_field_value(sample, &fields[i]));
+  }
+  char *json = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  return json;
+}
+
+int metric_sample_from_json(const char *json, metrics_sample_t *sample) {
+  cJSON *root = cJSON_Parse(json);
+  if (!root || !cJSON_IsObject(root)) {
+    cJSON_Delete(root);
+    return -1;
+  }
+
+  memset(sample, 0, sizeof(*sample));
+  // Una sola pasada por las claves del objeto
+  const cJSON *item;
+  cJSON_ArrayForEach(item, root) {
+    const metric_field_t *field = metric_field_find(item->string);
+    if (field && cJSON_IsNumber(item)) {
+      memcpy((char *)sample + field->offset, &item->valuedouble,
+             sizeof(double));
+    }
+  }
+  cJSON_Delete(root);
+  return 0;
+}
@@ -0,0 +1,657 @@
+#define _GNU_SOURCE
+#include "metrics_archive.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ARCHIVE_MAGIC 0x4843524du // "MRCH"
+#define BLOCK_MAGIC 0x4b4c424du   // "MBLK"
+#define ARCHIVE_VERSION 1
+#define NUM_COLUMNS (sizeof(metrics_sample_t) / sizeof(double))
+#define BLOCK_ALIGN 8 // Los encabezados quedan alineados dentro del mmap
+
+typedef struct archive_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t schema_hash; // metric_schema_hash() del que escribio
+  uint32_t columns;
+  uint32_t reserved[12];
+} archive_header_t;
+
+typedef struct column_summary {
+  double min;
+  double max;
+  double sum;
+} column_summary_t;
+
+/* Cada bloque empieza con este encabezado; las columnas siguen comprimidas,
+ * cada una desde un byte propio */
+typedef struct block_header {
+  uint32_t magic;
+  uint32_t count;
+  uint32_t size;     // Bytes del bloque, encabezado y relleno incluidos
+  uint32_t data_end; // Fin de la ultima columna
+  int64_t first_ms;
+  int64_t last_ms;
+  uint32_t offset[NUM_COLUMNS]; // Inicio de cada columna, desde el bloque
+  column_summary_t summary[NUM_COLUMNS];
+} block_header_t;
+
+_Static_assert(sizeof(archive_header_t) % BLOCK_ALIGN == 0,
+               "archive header must keep blocks aligned");
+_Static_assert(sizeof(block_header_t) % BLOCK_ALIGN == 0,
+               "block header must keep columns aligned");
+
+typedef struct bit_writer {
+  unsigned char *data;
+  size_t size; // Bytes completos
+  size_t capacity;
+  uint64_t pending; // Bits que todavia no completan un byte
+  int pending_bits;
+} bit_writer_t;
+
+typedef struct bit_reader {
+  const unsigned char *data;
+  size_t size;
+  size_t position; // En bits
+  int overrun;
+} bit_reader_t;
+
+struct metrics_archive_writer {
+  int fd;
+  off_t end; // Fin del ultimo bloque valido
+  size_t count;
+  bit_writer_t bits;
+  metrics_sample_t samples[METRICS_ARCHIVE_BLOCK_SAMPLES];
+};
+
+static void put_byte(bit_writer_t *bits, unsigned char byte) {
+  if (bits->size == bits->capacity) {
+    bits->capacity = bits->capacity ? bits->capacity * 2 : 4096;
+    bits->data = realloc(bits->data, bits->capacity);
+    if (!bits->data) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  bits->data[bits->size++] = byte;
+}
+
+/* Escribe los n bits bajos de value, el mas significativo primero */
+static void put_bits(bit_writer_t *bits, uint64_t value, int n) {
+  if (n > 32) {
+    put_bits(bits, value >> 32, n - 32);
+    n = 32;
+  }
+  bits->pending = (bits->pending << n) | (value & ((1ULL << n) - 1));
+  bits->pending_bits += n;
+  while (bits->pending_bits >= 8) {
+    bits->pending_bits -= 8;
+    put_byte(bits, (unsigned char)(bits->pending >> bits->pending_bits));
+  }
+}
+
+/* Completa el ultimo byte y rellena con ceros hasta un multiplo de align */
+static void align_bits(bit_writer_t *bits, size_t align) {
+  if (bits->pending_bits > 0) {
+    put_bits(bits, 0, 8 - bits->pending_bits);
+  }
+  while (bits->size % align != 0) {
+    put_byte(bits, 0);
+  }
+}
+
+static uint64_t get_bits(bit_reader_t *reader, int n) {
+  uint64_t value = 0;
+  while (n > 0) {
+    size_t byte = reader->position >> 3;
+    if (byte >= reader->size) {
+      reader->overrun = 1;
+      return 0;
+    }
+    int available = 8 - (int)(reader->position & 7);
+    int take = n < available ? n : available;
+    unsigned chunk =
+        (reader->data[byte] >> (available - take)) & ((1u << take) - 1);
+    value = (value << take) | chunk;
+    reader->position += take;
+    n -= take;
+  }
+  return value;
+}
+
+static int64_t sign_extend(uint64_t value, int n) {
+  if (n < 64 && (value & (1ULL << (n - 1)))) {
+    value |= ~0ULL << n;
+  }
+  return (int64_t)value;
+}
+
+static int64_t to_ms(double timestamp) { return llround(timestamp * 1000); }
+
+static uint64_t column_bits(const metrics_sample_t *sample, size_t column) {
+  uint64_t bits;
+  memcpy(&bits, (const char *)sample + column * sizeof(double), sizeof(bits));
+  return bits;
+}
+
+/* Timestamps: delta-of-delta en milisegundos con prefijos de largo variable.
+ * A intervalo regular cada muestra ocupa un bit */
+static void encode_timestamps(bit_writer_t *bits,
+                              const metrics_sample_t *samples, size_t count) {
+  int64_t previous = to_ms(samples[0].timestamp);
+  int64_t previous_delta = 0;
+  put_bits(bits, (uint64_t)previous, 64);
+
+  for (size_t i = 1; i < count; i++) {
+    int64_t current = to_ms(samples[i].timestamp);
+    int64_t delta = current - previous;
+    int64_t dod = delta - previous_delta;
+    if (dod == 0) {
+      put_bits(bits, 0, 1);
+    } else if (dod >= -64 && dod <= 63) {
+      put_bits(bits, 2, 2); // 10
+      put_bits(bits, (uint64_t)dod, 7);
+    } else if (dod >= -256 && dod <= 255) {
+      put_bits(bits, 6, 3); // 110
+      put_bits(bits, (uint64_t)dod, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+      put_bits(bits, 14, 4); // 1110
+      put_bits(bits, (uint64_t)dod, 12);
+    } else {
+      put_bits(bits, 15, 4); // 1111
+      put_bits(bits, (uint64_t)dod, 64);
+    }
+    previous = current;
+    previous_delta = delta;
+  }
+}
+
+static void decode_timestamps(bit_reader_t *reader, size_t count,
+                              double *values) {
+  int64_t current = (int64_t)get_bits(reader, 64);
+  int64_t delta = 0;
+  values[0] = current / 1000.0;
+
+  for (size_t i = 1; i < count; i++) {
+    int width = 0;
+    if (get_bits(reader, 1) == 1) {
+      if (get_bits(reader, 1) == 0) {
+        width = 7;
+      } else if (get_bits(reader, 1) == 0) {
+        width = 9;
+      } else {
+        width = get_bits(reader, 1) == 0 ? 12 : 64;
+      }
+    }
+    if (width > 0) {
+      delta += sign_extend(get_bits(reader, width), width);
+    }
+    current += delta;
+    values[i] = current / 1000.0;
+  }
+}
+
+/* Valores: XOR con el anterior. Si los bits significativos del XOR caben en
+ * la ventana del anterior se reusa (10), si no se escribe una nueva (11) */
+static void encode_values(bit_writer_t *bits, const metrics_sample_t *samples,
+                          size_t count, size_t column) {
+  uint64_t previous = column_bits(&samples[0], column);
+  int leading = -1; // Sin ventana todavia
+  int trailing = 0;
+  put_bits(bits, previous, 64);
+
+  for (size_t i = 1; i < count; i++) {
+    uint64_t current = column_bits(&samples[i], column);
+    uint64_t xor = current ^ previous;
+    previous = current;
+    if (xor == 0) {
+      put_bits(bits, 0, 1);
+      continue;
+    }
+
+    int lead = __builtin_clzll(xor);
+    int trail = __builtin_ctzll(xor);
+    if (lead > 31) {
+      lead = 31; // Tiene que caber en 5 bits
+    }
+    if (leading >= 0 && lead >= leading && trail >= trailing) {
+      put_bits(bits, 2, 2); // 10
+      put_bits(bits, xor >> trailing, 64 - leading - trailing);
+    } else {
+      int significant = 64 - lead - trail;
+      put_bits(bits, 3, 2); // 11
+      put_bits(bits, (uint64_t)lead, 5);
+      put_bits(bits, (uint64_t)(significant - 1), 6);
+      put_bits(bits, xor >> trail, significant);
+      leading = lead;
+      trailing = trail;
+    }
+  }
+}
+
+static void decode_values(bit_reader_t *reader, size_t count, double *values) {
+  uint64_t current = get_bits(reader, 64);
+  int leading = 0;
+  int trailing = 0;
+  memcpy(&values[0], &current, sizeof(double));
+
+  for (size_t i = 1; i < count; i++) {
+    if (get_bits(reader, 1) == 1) {
+      if (get_bits(reader, 1) == 1) {
+        leading = (int)get_bits(reader, 5);
+        int significant = (int)get_bits(reader, 6) + 1;
+        trailing = 64 - leading - significant;
+        if (trailing < 0) {
+          reader->overrun = 1;
+          return;
+        }
+      }
+      current ^= get_bits(reader, 64 - leading - trailing) << trailing;
+    }
+    memcpy(&values[i], &current, sizeof(double));
+  }
+}
+
+/* Valida los bloques desde el encabezado del archivo y devuelve hasta donde
+ * llegan los completos */
+static size_t valid_length(const unsigned char *data, size_t size) {
+  size_t offset = sizeof(archive_header_t);
+  while (offset + sizeof(block_header_t) <= size) {
+    const block_header_t *block = (const block_header_t *)(data + offset);
+    if (block->magic != BLOCK_MAGIC || block->count == 0 ||
+        block->count > METRICS_ARCHIVE_BLOCK_SAMPLES ||
+        block->size < sizeof(block_header_t) ||
+        block->size % BLOCK_ALIGN != 0 || block->size > size - offset ||
+        block->data_end > block->size) {
+      break;
+    }
+    int ok = 1;
+    for (size_t c = 0; c < NUM_COLUMNS; c++) {
+      size_t end = c + 1 < NUM_COLUMNS ? block->offset[c + 1] : block->data_end;
+      if (block->offset[c] < sizeof(block_header_t) ||
+          block->offset[c] > end || end > block->data_end) {
+        ok = 0;
+        break;
+      }
+    }
+    if (!ok) {
+      break;
+    }
+    offset += block->size;
+  }
+  return offset;
+}
+
+static int check_header(const archive_header_t *header) {
+  if (header->magic != ARCHIVE_MAGIC || header->version != ARCHIVE_VERSION ||
+      header->schema_hash != metric_schema_hash() ||
+      header->columns != NUM_COLUMNS) {
+    errno = EPROTO;
+    return -1;
+  }
+  return 0;
+}
+
+static int write_all(int fd, const void *buffer, size_t size, off_t offset) {
+  const char *data = buffer;
+  while (size > 0) {
+    ssize_t written = pwrite(fd, data, size, offset);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    data += written;
+    size -= written;
+    offset += written;
+  }
+  return 0;
+}
+
+metrics_archive_writer_t *metrics_archive_create(const char *path) {
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    return NULL;
+  }
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == -1) {
+    close(fd);
+    return NULL;
+  }
+
+  off_t end;
+  if (statbuf.st_size == 0) {
+    archive_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ARCHIVE_MAGIC;
+    header.version = ARCHIVE_VERSION;
+    header.schema_hash = metric_schema_hash();
+    header.columns = NUM_COLUMNS;
+    if (write_all(fd, &header, sizeof(header), 0) == -1) {
+      close(fd);
+      return NULL;
+    }
+    end = sizeof(header);
+  } else {
+    if ((size_t)statbuf.st_size < sizeof(archive_header_t)) {
+      close(fd);
+      errno = EPROTO;
+      return NULL;
+    }
+    void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return NULL;
+    }
+    if (check_header(data) == -1) {
+      munmap(data, statbuf.st_size);
+      close(fd);
+      errno = EPROTO;
+      return NULL;
+    }
+    end = valid_length(data, statbuf.st_size);
+    munmap(data, statbuf.st_size);
+    // Cortar un bloque a medio escribir para que no tape a los siguientes
+    if (end < statbuf.st_size && ftruncate(fd, end) == -1) {
+      close(fd);
+      return NULL;
+    }
+  }
+
+  metrics_archive_writer_t *writer = calloc(1, sizeof(*writer));
+  if (!writer) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  writer->fd = fd;
+  writer->end = end;
+  return writer;
+}
+
+int metrics_archive_flush(metrics_archive_writer_t *writer) {
+  size_t count = writer->count;
+  if (count == 0) {
+    return 0;
+  }
+  writer->count = 0;
+
+  block_header_t header;
+  memset(&header, 0, sizeof(header));
+  header.magic = BLOCK_MAGIC;
+  header.count = count;
+  header.first_ms = to_ms(writer->samples[0].timestamp);
+  header.last_ms = to_ms(writer->samples[count - 1].timestamp);
+
+  // El encabezado va al principio del mismo buffer: un solo pwrite
+  bit_writer_t *bits = &writer->bits;
+  bits->size = 0;
+  bits->pending = 0;
+  bits->pending_bits = 0;
+  for (size_t i = 0; i < sizeof(header); i++) {
+    put_byte(bits, 0);
+  }
+
+  for (size_t c = 0; c < NUM_COLUMNS; c++) {
+    header.offset[c] = bits->size;
+    if (c == 0) {
+      encode_timestamps(bits, writer->samples, count);
+    } else {
+      encode_values(bits, writer->samples, count, c);
+    }
+    align_bits(bits, 1);
+
+    column_summary_t *summary = &header.summary[c];
+    for (size_t i = 0; i < count; i++) {
+      double value;
+      if (c == 0) {
+        value = to_ms(writer->samples[i].timestamp) / 1000.0;
+      } else {
+        uint64_t word = column_bits(&writer->samples[i], c);
+        memcpy(&value, &word, sizeof(value));
+      }
+      if (i == 0 || value < summary->min) {
+        summary->min = value;
+      }
+      if (i == 0 || value > summary->max) {
+        summary->max = value;
+      }
+      summary->sum += value;
+    }
+  }
+  header.data_end = bits->size;
+  align_bits(bits, BLOCK_ALIGN);
+  header.size = bits->size;
+  memcpy(bits->data, &header, sizeof(header));
+
+  if (write_all(writer->fd, bits->data, bits->size, writer->end) == -1) {
+    int saved = errno;
+    ftruncate(writer->fd, writer->end); // No dejar un bloque a medias
+    errno = saved;
+    return -1;
+  }
+  writer->end += bits->size;
+  return 0;
+}
+
+int metrics_archive_append(metrics_archive_writer_t *writer,
+                           const metrics_sample_t *sample) {
+  int result = 0;
+  if (writer->count > 0 &&
+      (writer->count == METRICS_ARCHIVE_BLOCK_SAMPLES ||
+       sample->timestamp - writer->samples[0].timestamp >=
+           METRICS_ARCHIVE_FLUSH_SECONDS)) {
+    result = metrics_archive_flush(writer);
+  }
+  writer->samples[writer->count++] = *sample;
+  return result;
+}
+
+int metrics_archive_close(metrics_archive_writer_t *writer) {
+  if (!writer) {
+    return 0;
+  }
+  int result = metrics_archive_flush(writer);
+  close(writer->fd);
+  free(writer->bits.data);
+  free(writer);
+  return result;
+}
+
+int metrics_archive_open(const char *path, metrics_archive_t *archive) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == -1) {
+    close(fd);
+    return -1;
+  }
+  if ((size_t)statbuf.st_size < sizeof(archive_header_t)) {
+    close(fd);
+    errno = EPROTO;
+    return -1;
+  }
+  void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+  if (check_header(data) == -1) {
+    munmap(data, statbuf.st_size);
+    errno = EPROTO;
+    return -1;
+  }
+  madvise(data, statbuf.st_size, MADV_SEQUENTIAL);
+
+  archive->data = data;
+  archive->mapped = statbuf.st_size;
+  archive->size = valid_length(data, statbuf.st_size);
+  return 0;
+}
+
+void metrics_archive_unmap(metrics_archive_t *archive) {
+  if (archive->data) {
+    munmap((void *)archive->data, archive->mapped);
+  }
+  archive->data = NULL;
+  archive->size = 0;
+  archive->mapped = 0;
+}
+
+/* Descomprime una columna de un bloque ya validado */
+static int decode_column(const block_header_t *block, size_t column,
+                         double *values) {
+  size_t end =
+      column + 1 < NUM_COLUMNS ? block->offset[column + 1] : block->data_end;
+  bit_reader_t reader;
+  reader.data = (const unsigned char *)block + block->offset[column];
+  reader.size = end - block->offset[column];
+  reader.position = 0;
+  reader.overrun = 0;
+  if (column == 0) {
+    decode_timestamps(&reader, block->count, values);
+  } else {
+    decode_values(&reader, block->count, values);
+  }
+  return reader.overrun ? -1 : 0;
+}
+
+static void aggregate_add(metrics_aggregate_t *aggregate, double timestamp,
+                          double value) {
+  if (aggregate->count == 0 || value < aggregate->min) {
+    aggregate->min = value;
+  }
+  if (aggregate->count == 0 || value > aggregate->max) {
+    aggregate->max = value;
+  }
+  if (aggregate->count == 0) {
+    aggregate->first = timestamp;
+  }
+  aggregate->last = timestamp;
+  aggregate->sum += value;
+  aggregate->count++;
+}
+
+int metrics_archive_aggregate(const metrics_archive_t *archive,
+                              const metric_field_t *field, double from,
+                              double to, metrics_aggregate_t *aggregate) {
+  memset(aggregate, 0, sizeof(*aggregate));
+  size_t column = field->offset / sizeof(double);
+  double timestamps[METRICS_ARCHIVE_BLOCK_SAMPLES];
+  double values[METRICS_ARCHIVE_BLOCK_SAMPLES];
+
+  size_t offset = sizeof(archive_header_t);
+  while (offset < archive->size) {
+    const block_header_t *block =
+        (const block_header_t *)(archive->data + offset);
+    offset += block->size;
+    double first = block->first_ms / 1000.0;
+    double last = block->last_ms / 1000.0;
+    if (last < from || first > to) {
+      continue;
+    }
+    aggregate->blocks_scanned++;
+
+    if (first >= from && last <= to) {
+      // Todo el bloque entra: alcanza con su resumen
+      const column_summary_t *summary = &block->summary[column];
+      if (aggregate->count == 0 || summary->min < aggregate->min) {
+        aggregate->min = summary->min;
+      }
+      if (aggregate->count == 0 || summary->max > aggregate->max) {
+        aggregate->max = summary->max;
+      }
+      if (aggregate->count == 0) {
+        aggregate->first = first;
+      }
+      aggregate->last = last;
+      aggregate->sum += summary->sum;
+      aggregate->count += block->count;
+      continue;
+    }
+
+    aggregate->blocks_decoded++;
+    if (decode_column(block, 0, timestamps) == -1 ||
+        decode_column(block, column, values) == -1) {
+      return -1;
+    }
+    for (size_t i = 0; i < block->count; i++) {
+      if (timestamps[i] >= from && timestamps[i] <= to) {
+        aggregate_add(aggregate, timestamps[i], values[i]);
+      }
+    }
+  }
+  return 0;
+}
+
+long metrics_archive_scan(const metrics_archive_t *archive, double from,
+                          double to, metrics_archive_visit_t visit,
+                          void *data) {
+  double *values = malloc(METRICS_ARCHIVE_BLOCK_SAMPLES * sizeof(double));
+  metrics_sample_t *samples =
+      malloc(METRICS_ARCHIVE_BLOCK_SAMPLES * sizeof(metrics_sample_t));
+  if (!values || !samples) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  long visited = 0;
+  int stop = 0;
+  size_t offset = sizeof(archive_header_t);
+  while (offset < archive->size && !stop) {
+    const block_header_t *block =
+        (const block_header_t *)(archive->data + offset);
+    offset += block->size;
+    if (block->last_ms / 1000.0 < from || block->first_ms / 1000.0 > to) {
+      continue;
+    }
+
+    for (size_t c = 0; c < NUM_COLUMNS; c++) {
+      if (decode_column(block, c, values) == -1) {
+        visited = -1;
+        stop = 1;
+        break;
+      }
+      for (size_t i = 0; i < block->count; i++) {
+        memcpy((char *)&samples[i] + c * sizeof(double), &values[i],
+               sizeof(double));
+      }
+    }
+    for (size_t i = 0; i < block->count && !stop; i++) {
+      if (samples[i].timestamp >= from && samples[i].timestamp <= to) {
+        visited++;
+        stop = visit && visit(&samples[i], data) != 0;
+      }
+    }
+  }
+
+  free(values);
+  free(samples);
+  return visited;
+}
+
+int metrics_archive_span(const metrics_archive_t *archive, double *first,
+                         double *last) {
+  size_t offset = sizeof(archive_header_t);
+  if (offset >= archive->size) {
+    return -1;
+  }
+  *first = ((const block_header_t *)(archive->data + offset))->first_ms /
+           1000.0;
+  while (offset < archive->size) {
+    const block_header_t *block =
+        (const block_header_t *)(archive->data + offset);
+    *last = block->last_ms / 1000.0;
+    offset += block->size;
+  }
+  return 0;
+}
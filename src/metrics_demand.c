@@ -0,0 +1,104 @@
+#define _GNU_SOURCE
+#include "metrics_demand.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Lo comparten lectores y colector; lo crea el primero que lo usa */
+struct metrics_demand {
+  uint64_t lease_until; // CLOCK_MONOTONIC en ns; 0: nadie pidio muestras
+};
+
+static struct metrics_demand *demand = NULL; // Mapped on first use
+
+static uint64_t monotonic_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+static struct metrics_demand *map_demand(void) {
+  if (demand) {
+    return demand;
+  }
+  // Solo el usuario del monitor: otro podria dejarlo muestreando a pleno
+  int fd = shm_open(METRICS_DEMAND_NAME, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd == -1) {
+    return NULL;
+  }
+  // Dos procesos pueden crearlo a la vez: ftruncate al mismo tamaño no
+  // pierde datos. Un objeto de otro usuario no se usa, y uno propio creado
+  // con permisos mas abiertos se restringe
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_uid != geteuid() ||
+      ((st.st_mode & 077) != 0 && fchmod(fd, 0600) == -1) ||
+      (st.st_size < (off_t)sizeof(struct metrics_demand) &&
+       ftruncate(fd, sizeof(struct metrics_demand)) == -1)) {
+    close(fd);
+    return NULL;
+  }
+  void *data = mmap(NULL, sizeof(struct metrics_demand),
+                    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  demand = data;
+  return demand;
+}
+
+void metrics_demand_touch(double seconds) {
+  struct metrics_demand *shared = map_demand();
+  if (!shared) {
+    return;
+  }
+  uint64_t until = monotonic_ns() + (uint64_t)(seconds * 1e9);
+  uint64_t current = __atomic_load_n(&shared->lease_until, __ATOMIC_RELAXED);
+  // Solo se extiende: otro lector puede haber pedido un plazo mas largo
+  while (current < until &&
+         !__atomic_compare_exchange_n(&shared->lease_until, &current, until,
+                                      1, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+  }
+}
+
+int metrics_demand_active(void) {
+  struct metrics_demand *shared = map_demand();
+  return shared && __atomic_load_n(&shared->lease_until, __ATOMIC_RELAXED) >
+                       monotonic_ns();
+}
+
+void metrics_pacer_init(metrics_pacer_t *pacer) {
+  pacer->last_sample = 0;
+  pacer->idle_interval = 0;
+}
+
+int metrics_pacer_due(metrics_pacer_t *pacer, double now,
+                      double base_interval, int demanded) {
+  if (demanded) {
+    pacer->idle_interval = base_interval;
+    pacer->last_sample = now;
+    return 1;
+  }
+
+  if (pacer->idle_interval < base_interval) {
+    pacer->idle_interval = base_interval;
+  }
+  // Medio tick de margen: los despertares del colector no son exactos
+  if (pacer->last_sample != 0 &&
+      now - pacer->last_sample < pacer->idle_interval - base_interval / 2) {
+    return 0;
+  }
+  if (pacer->last_sample != 0) {
+    pacer->idle_interval *= 2;
+    if (pacer->idle_interval > base_interval * METRICS_IDLE_MAX_FACTOR) {
+      pacer->idle_interval = base_interval * METRICS_IDLE_MAX_FACTOR;
+    }
+  }
+  pacer->last_sample = now;
+  return 1;
+}
@@ -0,0 +1,380 @@
+#include "metrics_history.h"
+#include "metrics_shm.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_TIERS 3
+#define METRICS_HISTORY_REOPEN_SECONDS 5 // Reintento del ring sin muestras
+
+/* Un bucket resume las muestras de un intervalo de una resolucion */
+typedef struct history_bucket {
+  int64_t epoch; // floor(timestamp / resolucion)
+  uint32_t count;
+  uint32_t centroids; // Centroides en uso, ordenados por media
+  double sum;
+  double min;
+  double max;
+  double mean[METRICS_SKETCH_CENTROIDS];
+  double weight[METRICS_SKETCH_CENTROIDS];
+} history_bucket_t;
+
+typedef struct history_tier {
+  double resolution; // Segundos por bucket
+  size_t slots;
+} history_tier_t;
+
+/* 1 s durante 10 min, 10 s durante 1 h, 1 min durante 1 dia */
+static const history_tier_t tiers[NUM_TIERS] = {
+    {1.0, 600},
+    {10.0, 360},
+    {60.0, 1440},
+};
+
+typedef struct history_metric {
+  const char *name;
+  int rate;        // Contador acumulado: se guarda la tasa por segundo
+  double last_raw; // Ultimo valor crudo, para calcular la tasa
+  double last_timestamp;
+  int has_last;
+} history_metric_t;
+
+static history_metric_t metrics[] = {
+    {"cpu_usage_percentage", 0, 0, 0, 0},
+    {"memory_usage_percentage", 0, 0, 0, 0},
+    {"disk_reads", 1, 0, 0, 0},
+    {"disk_writes", 1, 0, 0, 0},
+    {"network_bandwidth_rx", 1, 0, 0, 0},
+    {"network_bandwidth_tx", 1, 0, 0, 0},
+    {"running_processes_count", 0, 0, 0, 0},
+    {"context_switches_total", 1, 0, 0, 0},
+};
+
+#define NUM_METRICS (sizeof(metrics) / sizeof(metrics[0]))
+
+static history_bucket_t *storage = NULL; // NUM_METRICS x todos los tiers
+static size_t slots_per_metric = 0;
+
+static metrics_shm_t *reader = NULL;
+static uint64_t last_seen = 0;         // Ultimo numero de muestra leido
+static double last_ingested = 0;       // Timestamp de la ultima muestra
+static double last_open_attempt = -1e9; // CLOCK_MONOTONIC
+static double last_progress = 0;
+
+static double monotonic_seconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int ensure_storage(void) {
+  if (storage) {
+    return 0;
+  }
+  slots_per_metric = 0;
+  for (int t = 0; t < NUM_TIERS; t++) {
+    slots_per_metric += tiers[t].slots;
+  }
+  storage = calloc(NUM_METRICS * slots_per_metric, sizeof(history_bucket_t));
+  return storage ? 0 : -1;
+}
+
+static history_bucket_t *tier_buckets(size_t metric, int tier) {
+  history_bucket_t *buckets = storage + metric * slots_per_metric;
+  for (int t = 0; t < tier; t++) {
+    buckets += tiers[t].slots;
+  }
+  return buckets;
+}
+
+/* Inserta un valor en el sketch del bucket. Con el sketch lleno se fusiona
+ * el par de centroides vecinos de menor peso combinado, asi los extremos
+ * (las colas que piden los percentiles altos) quedan con mas detalle */
+static void sketch_add(history_bucket_t *bucket, double value) {
+  uint32_t n = bucket->centroids;
+  uint32_t pos = 0;
+  while (pos < n && bucket->mean[pos] < value) {
+    pos++;
+  }
+  if (pos < n && bucket->mean[pos] == value) {
+    bucket->weight[pos] += 1;
+    return;
+  }
+
+  double mean[METRICS_SKETCH_CENTROIDS + 1];
+  double weight[METRICS_SKETCH_CENTROIDS + 1];
+  memcpy(mean, bucket->mean, pos * sizeof(double));
+  memcpy(weight, bucket->weight, pos * sizeof(double));
+  mean[pos] = value;
+  weight[pos] = 1;
+  memcpy(mean + pos + 1, bucket->mean + pos, (n - pos) * sizeof(double));
+  memcpy(weight + pos + 1, bucket->weight + pos, (n - pos) * sizeof(double));
+  n++;
+
+  if (n > METRICS_SKETCH_CENTROIDS) {
+    uint32_t best = 0;
+    for (uint32_t i = 1; i + 1 < n; i++) {
+      if (weight[i] + weight[i + 1] < weight[best] + weight[best + 1]) {
+        best = i;
+      }
+    }
+    double merged = weight[best] + weight[best + 1];
+    mean[best] =
+        (mean[best] * weight[best] + mean[best + 1] * weight[best + 1]) /
+        merged;
+    weight[best] = merged;
+    memmove(mean + best + 1, mean + best + 2,
+            (n - best - 2) * sizeof(double));
+    memmove(weight + best + 1, weight + best + 2,
+            (n - best - 2) * sizeof(double));
+    n--;
+  }
+
+  memcpy(bucket->mean, mean, n * sizeof(double));
+  memcpy(bucket->weight, weight, n * sizeof(double));
+  bucket->centroids = n;
+}
+
+static void bucket_add(history_bucket_t *bucket, int64_t epoch, double value) {
+  if (bucket->count > 0 && bucket->epoch > epoch) {
+    return; // Muestra mas vieja que lo que ya ocupa el slot
+  }
+  if (bucket->count == 0 || bucket->epoch != epoch) {
+    memset(bucket, 0, sizeof(*bucket));
+    bucket->epoch = epoch;
+    bucket->min = value;
+    bucket->max = value;
+  }
+  bucket->count++;
+  bucket->sum += value;
+  if (value < bucket->min) {
+    bucket->min = value;
+  }
+  if (value > bucket->max) {
+    bucket->max = value;
+  }
+  sketch_add(bucket, value);
+}
+
+static size_t slot_of(int64_t epoch, size_t slots) {
+  int64_t slot = epoch % (int64_t)slots;
+  return (size_t)(slot < 0 ? slot + (int64_t)slots : slot);
+}
+
+void metrics_history_add(const metrics_sample_t *sample) {
+  if (ensure_storage() == -1) {
+    return;
+  }
+
+  double timestamp = sample->timestamp;
+  for (size_t m = 0; m < NUM_METRICS; m++) {
+    history_metric_t *metric = &metrics[m];
+    double value = metric_field_value(sample, metric_field_find(metric->name));
+
+    if (metric->rate) {
+      double raw = value;
+      int usable = metric->has_last && timestamp > metric->last_timestamp &&
+                   raw >= metric->last_raw; // Un reinicio pone el contador a 0
+      value = usable ? (raw - metric->last_raw) /
+                           (timestamp - metric->last_timestamp)
+                     : 0;
+      metric->last_raw = raw;
+      metric->last_timestamp = timestamp;
+      metric->has_last = 1;
+      if (!usable) {
+        continue;
+      }
+    }
+
+    for (int t = 0; t < NUM_TIERS; t++) {
+      int64_t epoch = (int64_t)floor(timestamp / tiers[t].resolution);
+      history_bucket_t *buckets = tier_buckets(m, t);
+      bucket_add(&buckets[slot_of(epoch, tiers[t].slots)], epoch, value);
+    }
+  }
+}
+
+int metrics_history_poll(metrics_sample_hook_t hook) {
+  double now = monotonic_seconds();
+  if (!reader) {
+    if (now - last_open_attempt < METRICS_HISTORY_REOPEN_SECONDS) {
+      return 0;
+    }
+    last_open_attempt = now;
+    reader = metrics_shm_open(METRICS_SHM_NAME);
+    if (!reader) {
+      return 0;
+    }
+    last_seen = 0;
+    last_progress = now;
+  }
+
+  metrics_sample_t samples[METRICS_RING_SLOTS];
+  size_t count = metrics_shm_read_new(reader, &last_seen, samples);
+  if (count == 0) {
+    // Sin muestras nuevas: puede que el monitor haya creado otro ring
+    if (now - last_progress > METRICS_HISTORY_REOPEN_SECONDS) {
+      metrics_shm_close(reader);
+      reader = NULL;
+      last_open_attempt = now;
+    }
+    return 0;
+  }
+
+  int added = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (samples[i].timestamp > last_ingested) {
+      metrics_history_add(&samples[i]);
+      if (hook) {
+        hook(&samples[i]);
+      }
+      last_ingested = samples[i].timestamp;
+      added++;
+    }
+  }
+  last_progress = now;
+  return added;
+}
+
+typedef struct centroid {
+  double mean;
+  double weight;
+} centroid_t;
+
+static int compare_centroids(const void *a, const void *b) {
+  double x = ((const centroid_t *)a)->mean;
+  double y = ((const centroid_t *)b)->mean;
+  return (x > y) - (x < y);
+}
+
+/* Interpola entre los centros de los centroides vecinos; por fuera del primer
+ * y el ultimo centro se interpola hacia el minimo y el maximo */
+static double estimate_quantile(const centroid_t *centroids, size_t n,
+                                double total, double min, double max,
+                                double q) {
+  double rank = q * total;
+  double previous_center = 0;
+  double previous_mean = min;
+  double cumulative = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    double center = cumulative + centroids[i].weight / 2;
+    if (rank <= center) {
+      double span = center - previous_center;
+      double fraction = span > 0 ? (rank - previous_center) / span : 1;
+      return previous_mean + fraction * (centroids[i].mean - previous_mean);
+    }
+    previous_center = center;
+    previous_mean = centroids[i].mean;
+    cumulative += centroids[i].weight;
+  }
+
+  double span = total - previous_center;
+  double fraction = span > 0 ? (rank - previous_center) / span : 1;
+  return previous_mean + fraction * (max - previous_mean);
+}
+
+int metrics_history_query(const char *metric, double window,
+                          const double *quantiles, size_t count,
+                          double *values, metrics_summary_t *summary) {
+  size_t m = 0;
+  while (m < NUM_METRICS && strcmp(metrics[m].name, metric) != 0) {
+    m++;
+  }
+  if (m == NUM_METRICS || !storage || window <= 0 ||
+      count > METRICS_HISTORY_MAX_QUANTILES) {
+    return -1;
+  }
+
+  // La resolucion mas fina que cubra toda la ventana
+  int t = 0;
+  while (t < NUM_TIERS - 1 &&
+         tiers[t].resolution * tiers[t].slots < window) {
+    t++;
+  }
+  const history_tier_t *tier = &tiers[t];
+  size_t span = (size_t)ceil(window / tier->resolution);
+  if (span > tier->slots) {
+    span = tier->slots;
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  int64_t newest = (int64_t)floor((now.tv_sec + now.tv_nsec / 1e9) /
+                                  tier->resolution);
+  int64_t oldest = newest - (int64_t)span + 1;
+
+  centroid_t *centroids =
+      malloc(span * METRICS_SKETCH_CENTROIDS * sizeof(centroid_t));
+  if (!centroids) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+
+  const history_bucket_t *buckets = tier_buckets(m, t);
+  size_t n = 0;
+  double total = 0;
+  double sum = 0;
+  double min = 0;
+  double max = 0;
+  for (int64_t epoch = oldest; epoch <= newest; epoch++) {
+    const history_bucket_t *bucket = &buckets[slot_of(epoch, tier->slots)];
+    if (bucket->count == 0 || bucket->epoch != epoch) {
+      continue;
+    }
+    if (total == 0 || bucket->min < min) {
+      min = bucket->min;
+    }
+    if (total == 0 || bucket->max > max) {
+      max = bucket->max;
+    }
+    total += bucket->count;
+    sum += bucket->sum;
+    for (uint32_t c = 0; c < bucket->centroids; c++) {
+      centroids[n].mean = bucket->mean[c];
+      centroids[n].weight = bucket->weight[c];
+      n++;
+    }
+  }
+
+  if (total == 0) {
+    free(centroids);
+    return -1;
+  }
+
+  qsort(centroids, n, sizeof(centroid_t), compare_centroids);
+  for (size_t i = 0; i < count; i++) {
+    values[i] = estimate_quantile(centroids, n, total, min, max, quantiles[i]);
+  }
+  free(centroids);
+
+  summary->count = (size_t)total;
+  summary->min = min;
+  summary->max = max;
+  summary->avg = sum / total;
+  summary->resolution = tier->resolution;
+  return 0;
+}
+
+int metrics_history_is_rate(const char *metric) {
+  for (size_t m = 0; m < NUM_METRICS; m++) {
+    if (strcmp(metrics[m].name, metric) == 0) {
+      return metrics[m].rate;
+    }
+  }
+  return 0;
+}
+
+void metrics_history_reset(void) {
+  if (storage) {
+    memset(storage, 0, NUM_METRICS * slots_per_metric *
+                           sizeof(history_bucket_t));
+  }
+  for (size_t m = 0; m < NUM_METRICS; m++) {
+    metrics[m].has_last = 0;
+  }
+  // last_ingested se conserva: lo que ya esta en el ring no vuelve a entrar
+}
@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include "metrics_shm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define METRICS_MAGIC 0x4d455452u // "METR"
+#define METRICS_VERSION 2
+#define CACHE_LINE 64
+
+#define RECORD_WORDS (sizeof(metric_record_t) / sizeof(uint64_t))
+
+/* Cada slot ocupa lineas de cache propias para que escribir uno no invalide
+ * al que estan leyendo */
+typedef struct metrics_slot {
+  uint64_t seq;                 // Impar mientras el escritor lo modifica
+  uint64_t words[RECORD_WORDS]; // metric_record_t
+} __attribute__((aligned(CACHE_LINE))) metrics_slot_t;
+
+struct metrics_ring {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_size;
+  pid_t writer_pid;
+  uint64_t head __attribute__((aligned(CACHE_LINE))); // Ultima publicada
+  metrics_slot_t slots[METRICS_RING_SLOTS];
+};
+
+_Static_assert(sizeof(metric_record_t) % sizeof(uint64_t) == 0,
+               "metric_record_t must be made of 8-byte words");
+
+static metrics_shm_t *map_ring(int fd, int writable) {
+  metrics_shm_t *shm = malloc(sizeof(metrics_shm_t));
+  if (!shm) {
+    return NULL;
+  }
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *data = mmap(NULL, sizeof(struct metrics_ring), prot, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    free(shm);
+    return NULL;
+  }
+  shm->ring = data;
+  shm->writable = writable;
+  return shm;
+}
+
+metrics_shm_t *metrics_shm_create(const char *name) {
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(struct metrics_ring)) == -1) {
+    close(fd);
+    return NULL;
+  }
+  metrics_shm_t *shm = map_ring(fd, 1);
+  close(fd);
+  if (!shm) {
+    return NULL;
+  }
+
+  struct metrics_ring *ring = shm->ring;
+  if (ring->magic != METRICS_MAGIC || ring->version != METRICS_VERSION ||
+      ring->slot_count != METRICS_RING_SLOTS ||
+      ring->slot_size != sizeof(metrics_slot_t)) {
+    // Objeto nuevo o de otra version: empezar de cero
+    memset(ring, 0, sizeof(*ring));
+    ring->slot_count = METRICS_RING_SLOTS;
+    ring->slot_size = sizeof(metrics_slot_t);
+    ring->version = METRICS_VERSION;
+    __atomic_store_n(&ring->magic, METRICS_MAGIC, __ATOMIC_RELEASE);
+  }
+  ring->writer_pid = getpid();
+  return shm;
+}
+
+metrics_shm_t *metrics_shm_open(const char *name) {
+  int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd == -1) {
+    return NULL;
+  }
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == -1 ||
+      (size_t)statbuf.st_size < sizeof(struct metrics_ring)) {
+    close(fd);
+    errno = ENODATA;
+    return NULL;
+  }
+  metrics_shm_t *shm = map_ring(fd, 0);
+  close(fd);
+  if (!shm) {
+    return NULL;
+  }
+
+  struct metrics_ring *ring = shm->ring;
+  if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) != METRICS_MAGIC ||
+      ring->version != METRICS_VERSION ||
+      ring->slot_size != sizeof(metrics_slot_t)) {
+    metrics_shm_close(shm);
+    errno = EPROTO;
+    return NULL;
+  }
+  return shm;
+}
+
+void metrics_shm_publish(metrics_shm_t *shm, const metrics_sample_t *sample) {
+  struct metrics_ring *ring = shm->ring;
+  // Un solo escritor: head solo cambia aqui
+  uint64_t number = __atomic_load_n(&ring->head, __ATOMIC_RELAXED) + 1;
+  metrics_slot_t *slot = &ring->slots[(number - 1) % METRICS_RING_SLOTS];
+
+  metric_record_t record;
+  metric_record_encode(&record, sample, number);
+  uint64_t words[RECORD_WORDS];
+  memcpy(words, &record, sizeof(words));
+
+  uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for (size_t i = 0; i < RECORD_WORDS; i++) {
+    __atomic_store_n(&slot->words[i], words[i], __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+
+  __atomic_store_n(&ring->head, number, __ATOMIC_RELEASE);
+}
+
+uint64_t metrics_shm_head(const metrics_shm_t *shm) {
+  return __atomic_load_n(&shm->ring->head, __ATOMIC_ACQUIRE);
+}
+
+int metrics_shm_read(const metrics_shm_t *shm, uint64_t number,
+                     metrics_sample_t *sample) {
+  if (number == 0) {
+    return -1;
+  }
+  const metrics_slot_t *slot =
+      &shm->ring->slots[(number - 1) % METRICS_RING_SLOTS];
+  metric_record_t record;
+  uint64_t words[RECORD_WORDS];
+
+  for (int attempt = 0; attempt < METRICS_READ_RETRIES; attempt++) {
+    uint64_t before = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      continue; // El escritor esta en medio de este slot
+    }
+    for (size_t i = 0; i < RECORD_WORDS; i++) {
+      words[i] = __atomic_load_n(&slot->words[i], __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != before) {
+      continue;
+    }
+    memcpy(&record, words, sizeof(words));
+    if (record.sequence != number) {
+      return -1; // Ya fue reemplazada por una muestra mas nueva
+    }
+    return metric_record_decode(&record, sample);
+  }
+  return -1;
+}
+
+int metrics_shm_read_latest(const metrics_shm_t *shm, metrics_sample_t *sample,
+                            uint64_t *number) {
+  for (int attempt = 0; attempt < METRICS_READ_RETRIES; attempt++) {
+    uint64_t head = metrics_shm_head(shm);
+    if (head == 0) {
+      return -1;
+    }
+    // Si el escritor dio toda la vuelta mientras tanto, probar con la nueva
+    if (metrics_shm_read(shm, head, sample) == 0) {
+      if (number) {
+        *number = head;
+      }
+      return 0;
+    }
+  }
+  return -1;
+}
+
+size_t metrics_shm_read_new(const metrics_shm_t *shm, uint64_t *last_seen,
+                            metrics_sample_t *samples) {
+  uint64_t head = metrics_shm_head(shm);
+  if (head < *last_seen) {
+    *last_seen = 0; // Ring nuevo con el mismo nombre
+  }
+
+  uint64_t first = *last_seen + 1;
+  if (head > METRICS_RING_SLOTS && first < head - METRICS_RING_SLOTS + 1) {
+    first = head - METRICS_RING_SLOTS + 1; // El resto ya se sobrescribio
+  }
+
+  size_t count = 0;
+  for (uint64_t number = first; number <= head; number++) {
+    if (metrics_shm_read(shm, number, &samples[count]) == 0) {
+      count++;
+    }
+  }
+  *last_seen = head;
+  return count;
+}
+
+void metrics_shm_close(metrics_shm_t *shm) {
+  if (!shm) {
+    return;
+  }
+  munmap(shm->ring, sizeof(struct metrics_ring));
+  free(shm);
+}
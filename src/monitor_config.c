@@ -0,0 +1,453 @@
+#define _GNU_SOURCE
+#include "monitor_config.h"
+#include "metric_record.h"
+#include "parse.h"
+#include <cjson/cJSON.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MONITOR_CONFIG_MAX_SIZE 65536
+#define CONTROL_SERVE_WAIT_MS 100 // Wait for the request of a new client
+
+/* Bit de cada campo; el timestamp (bit 0) siempre se muestrea */
+static uint32_t all_metrics(void) {
+  size_t count;
+  metric_fields(&count);
+  return count >= 32 ? UINT32_MAX : (1u << count) - 1;
+}
+
+static uint32_t metric_bit(const metric_field_t *field) {
+  size_t count;
+  return 1u << (field - metric_fields(&count));
+}
+
+void monitor_config_default(monitor_config_t *config) {
+  config->interval = MONITOR_CONFIG_DEFAULT_INTERVAL;
+  config->metrics = all_metrics();
+}
+
+static int set_interval(monitor_config_t *config, double interval,
+                        char *error, size_t error_size) {
+  if (!(interval >= MONITOR_CONFIG_MIN_INTERVAL &&
+        interval <= MONITOR_CONFIG_MAX_INTERVAL)) {
+    snprintf(error, error_size, "interval must be between %g s and %g s",
+             MONITOR_CONFIG_MIN_INTERVAL, MONITOR_CONFIG_MAX_INTERVAL);
+    return -1;
+  }
+  config->interval = interval;
+  return 0;
+}
+
+/* Cambia las claves presentes en el objeto; deja el resto como estaba */
+static int config_from_json(const cJSON *root, monitor_config_t *config,
+                            char *error, size_t error_size) {
+  if (!cJSON_IsObject(root)) {
+    snprintf(error, error_size, "configuration is not a JSON object");
+    return -1;
+  }
+  monitor_config_t updated = *config;
+
+  const cJSON *interval = cJSON_GetObjectItemCaseSensitive(root, "interval_ms");
+  if (interval) {
+    if (!cJSON_IsNumber(interval) ||
+        set_interval(&updated, interval->valuedouble / 1000, error,
+                     error_size) == -1) {
+      if (error[0] == '\0') {
+        snprintf(error, error_size, "interval_ms must be a number");
+      }
+      return -1;
+    }
+  }
+
+  const cJSON *metrics = cJSON_GetObjectItemCaseSensitive(root, "metrics");
+  if (metrics) {
+    if (!cJSON_IsArray(metrics)) {
+      snprintf(error, error_size, "metrics must be a list of names");
+      return -1;
+    }
+    updated.metrics = metric_bit(metric_field_find("timestamp"));
+    const cJSON *item;
+    cJSON_ArrayForEach(item, metrics) {
+      if (!cJSON_IsString(item)) {
+        snprintf(error, error_size, "metrics must be a list of names");
+        return -1;
+      }
+      const metric_field_t *field = metric_field_resolve(item->valuestring);
+      if (!field) {
+        snprintf(error, error_size, "unknown metric '%s'", item->valuestring);
+        return -1;
+      }
+      updated.metrics |= metric_bit(field);
+    }
+  }
+
+  *config = updated;
+  return 0;
+}
+
+static cJSON *config_to_cjson(const monitor_config_t *config) {
+  cJSON *root = cJSON_CreateObject();
+  if (!root) {
+    return NULL;
+  }
+  cJSON_AddNumberToObject(root, "interval_ms",
+                          round(config->interval * 1000));
+  cJSON *metrics = cJSON_AddArrayToObject(root, "metrics");
+
+  size_t count;
+  const metric_field_t *fields = metric_fields(&count);
+  for (size_t i = 1; i < count && metrics; i++) {
+    if (config->metrics & metric_bit(&fields[i])) {
+      cJSON_AddItemToArray(metrics, cJSON_CreateString(fields[i].name));
+    }
+  }
+  return root;
+}
+
+char *monitor_config_to_json(const monitor_config_t *config) {
+  cJSON *root = config_to_cjson(config);
+  char *json = root ? cJSON_Print(root) : NULL;
+  cJSON_Delete(root);
+  return json;
+}
+
+int monitor_config_load(const char *path, monitor_config_t *config) {
+  monitor_config_default(config);
+
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return errno == ENOENT ? 0 : -1;
+  }
+  char *text = malloc(MONITOR_CONFIG_MAX_SIZE);
+  if (!text) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  size_t length = fread(text, 1, MONITOR_CONFIG_MAX_SIZE - 1, file);
+  text[length] = '\0';
+  fclose(file);
+
+  char error[128] = "";
+  cJSON *root = cJSON_Parse(text);
+  int result = root ? config_from_json(root, config, error, sizeof(error)) : -1;
+  cJSON_Delete(root);
+  free(text);
+  if (result == -1) {
+    errno = EINVAL;
+  }
+  return result;
+}
+
+int monitor_config_save(const char *path, const monitor_config_t *config) {
+  char *json = monitor_config_to_json(config);
+  if (!json) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  // El temporal va en el mismo directorio: rename no cruza sistemas de
+  // archivos
+  char temp[PATH_MAX];
+  snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+  int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    free(json);
+    return -1;
+  }
+
+  size_t length = strlen(json);
+  json[length] = '\n'; // Reemplaza el terminador: se escribe con su largo
+  size_t written = 0;
+  while (written <= length) {
+    ssize_t count = write(fd, json + written, length + 1 - written);
+    if (count == -1 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      break;
+    }
+    written += count;
+  }
+  free(json);
+
+  if (written != length + 1 || fsync(fd) == -1) {
+    int saved = errno;
+    close(fd);
+    unlink(temp);
+    errno = saved;
+    return -1;
+  }
+  close(fd);
+  if (rename(temp, path) == -1) {
+    int saved = errno;
+    unlink(temp);
+    errno = saved;
+    return -1;
+  }
+
+  // El rename queda persistido al sincronizar el directorio
+  char dir_path[PATH_MAX];
+  snprintf(dir_path, sizeof(dir_path), "%s", path);
+  int dir_fd = open(dirname(dir_path), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd != -1) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  return 0;
+}
+
+int monitor_config_assign(monitor_config_t *config, const char *assignment,
+                          char *error, size_t error_size) {
+  error[0] = '\0';
+  const char *equals = strchr(assignment, '=');
+  if (!equals || equals == assignment || equals[1] == '\0') {
+    snprintf(error, error_size, "expected key=value, got '%s'", assignment);
+    return -1;
+  }
+  size_t key_length = equals - assignment;
+  const char *value = equals + 1;
+
+  if (key_length == 8 && strncmp(assignment, "interval", 8) == 0) {
+    double interval;
+    if (parse_duration(value, &interval) == -1) {
+      snprintf(error, error_size, "bad interval '%s' (e.g. 500ms, 2s)",
+               value);
+      return -1;
+    }
+    return set_interval(config, interval, error, error_size);
+  }
+
+  if (key_length == 7 && strncmp(assignment, "metrics", 7) == 0) {
+    if (strcmp(value, "all") == 0) {
+      config->metrics = all_metrics();
+      return 0;
+    }
+    uint32_t metrics = metric_bit(metric_field_find("timestamp"));
+    char *list = strdup(value);
+    if (!list) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    char *saveptr = NULL;
+    for (char *name = strtok_r(list, ",", &saveptr); name;
+         name = strtok_r(NULL, ",", &saveptr)) {
+      const metric_field_t *field = metric_field_resolve(name);
+      if (!field) {
+        snprintf(error, error_size, "unknown metric '%s'", name);
+        free(list);
+        return -1;
+      }
+      metrics |= metric_bit(field);
+    }
+    free(list);
+    config->metrics = metrics;
+    return 0;
+  }
+
+  snprintf(error, error_size, "unknown key '%.*s' (interval, metrics)",
+           (int)key_length, assignment);
+  return -1;
+}
+
+void monitor_config_print(const monitor_config_t *config) {
+  printf("interval: %g ms\n", config->interval * 1000);
+  printf("metrics: ");
+  if (config->metrics == all_metrics()) {
+    printf("all\n");
+    return;
+  }
+  size_t count;
+  const metric_field_t *fields = metric_fields(&count);
+  const char *separator = "";
+  for (size_t i = 1; i < count; i++) {
+    if (config->metrics & metric_bit(&fields[i])) {
+      printf("%s%s", separator, fields[i].name);
+      separator = ", ";
+    }
+  }
+  printf("%s\n", separator[0] ? "" : "none");
+}
+
+int monitor_control_listen(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  unlink(path); // Socket de un monitor anterior
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+      listen(fd, SOMAXCONN) == -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  return fd;
+}
+
+static char *control_reply(const monitor_config_t *config,
+                           const char *error) {
+  cJSON *reply = cJSON_CreateObject();
+  if (!reply) {
+    return NULL;
+  }
+  cJSON_AddBoolToObject(reply, "ok", error == NULL);
+  if (error) {
+    cJSON_AddStringToObject(reply, "error", error);
+  } else {
+    cJSON_AddItemToObject(reply, "config", config_to_cjson(config));
+  }
+  char *text = cJSON_PrintUnformatted(reply);
+  cJSON_Delete(reply);
+  return text;
+}
+
+static char *control_handle(const char *request, monitor_config_t *config,
+                            int *changed) {
+  char error[128] = "";
+  cJSON *root = cJSON_Parse(request);
+  const cJSON *command = cJSON_GetObjectItemCaseSensitive(root, "command");
+
+  if (!cJSON_IsString(command)) {
+    snprintf(error, sizeof(error), "request without a command");
+  } else if (strcmp(command->valuestring, "set") == 0) {
+    monitor_config_t updated = *config;
+    if (config_from_json(cJSON_GetObjectItemCaseSensitive(root, "config"),
+                         &updated, error, sizeof(error)) == 0) {
+      *changed |= updated.interval != config->interval ||
+                  updated.metrics != config->metrics;
+      *config = updated;
+    }
+  } else if (strcmp(command->valuestring, "get") != 0) {
+    snprintf(error, sizeof(error), "unknown command '%s'",
+             command->valuestring);
+  }
+  cJSON_Delete(root);
+  return control_reply(config, error[0] ? error : NULL);
+}
+
+int monitor_control_serve(int listen_fd, monitor_config_t *config) {
+  int changed = 0;
+  int client;
+  while ((client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) != -1) {
+    // El cliente manda el pedido apenas se conecta
+    char request[MONITOR_CONTROL_MESSAGE_SIZE];
+    struct pollfd pfd = {client, POLLIN, 0};
+    ssize_t length = -1;
+    if (poll(&pfd, 1, CONTROL_SERVE_WAIT_MS) > 0) {
+      length = recv(client, request, sizeof(request) - 1, 0);
+    }
+    if (length > 0) {
+      request[length] = '\0';
+      char *reply = control_handle(request, config, &changed);
+      if (reply) {
+        send(client, reply, strlen(reply), MSG_NOSIGNAL);
+        free(reply);
+      }
+    }
+    close(client);
+  }
+  return changed;
+}
+
+/* Un pedido y su respuesta por una conexion nueva */
+static int control_request(const char *path, cJSON *request,
+                           monitor_config_t *config, char *error,
+                           size_t error_size) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1 ||
+      connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+    snprintf(error, error_size, "monitor not listening on %s: %s", path,
+             strerror(errno));
+    if (fd != -1) {
+      close(fd);
+    }
+    return -1;
+  }
+
+  char *text = cJSON_PrintUnformatted(request);
+  char reply[MONITOR_CONTROL_MESSAGE_SIZE];
+  ssize_t length = -1;
+  if (text && send(fd, text, strlen(text), MSG_NOSIGNAL) != -1) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    if (poll(&pfd, 1, MONITOR_CONTROL_TIMEOUT_MS) > 0) {
+      length = recv(fd, reply, sizeof(reply) - 1, 0);
+    }
+  }
+  free(text);
+  close(fd);
+  if (length <= 0) {
+    snprintf(error, error_size, "no answer from the monitor");
+    return -2;
+  }
+  reply[length] = '\0';
+
+  cJSON *root = cJSON_Parse(reply);
+  const cJSON *reason = cJSON_GetObjectItemCaseSensitive(root, "error");
+  int result = -2;
+  if (!cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(root, "ok"))) {
+    snprintf(error, error_size, "monitor: %s",
+             cJSON_IsString(reason) ? reason->valuestring : "bad reply");
+  } else {
+    monitor_config_default(config);
+    result = config_from_json(cJSON_GetObjectItemCaseSensitive(root, "config"),
+                              config, error, error_size) == 0
+                 ? 0
+                 : -2;
+  }
+  cJSON_Delete(root);
+  return result;
+}
+
+int monitor_control_get(const char *path, monitor_config_t *config,
+                        char *error, size_t error_size) {
+  error[0] = '\0';
+  cJSON *request = cJSON_CreateObject();
+  if (!request) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  cJSON_AddStringToObject(request, "command", "get");
+  int result = control_request(path, request, config, error, error_size);
+  cJSON_Delete(request);
+  return result;
+}
+
+int monitor_control_set(const char *path, monitor_config_t *config,
+                        char *error, size_t error_size) {
+  error[0] = '\0';
+  cJSON *request = cJSON_CreateObject();
+  if (!request) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  cJSON_AddStringToObject(request, "command", "set");
+  cJSON_AddItemToObject(request, "config", config_to_cjson(config));
+  int result = control_request(path, request, config, error, error_size);
+  cJSON_Delete(request);
+  return result;
+}
@@ -1,13 +1,84 @@
 #include "parse.h"
+#include "pathexp.h"
+#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define INITIAL_BUFSIZE 64  // Initial buffer size for token arrays
 #define BUFFER_INCREMENT 64 // Amount by which to expand buffer when needed
+#define PARSE_NO_MEMORY -2  // Result of the helpers when an allocation fails
 
-static char* input_file = NULL;
-static char* output_file = NULL;
+/* Find the next '|' that is not quoted or inside a process substitution */
+static char* find_pipe(char* ptr)
+{
+    int depth = 0; // Nesting level of <( ... ) and >( ... )
+
+    while (*ptr)
+    {
+        if (*ptr == '\'' || *ptr == '\"')
+        {
+            char quote = *ptr++;
+            while (*ptr && *ptr != quote)
+                ptr++;
+            if (!*ptr)
+                break;
+        }
+        else if ((*ptr == '<' || *ptr == '>') && ptr[1] == '(')
+        {
+            depth++;
+            ptr++;
+        }
+        else if (*ptr == ')' && depth > 0)
+        {
+            depth--;
+        }
+        else if (*ptr == '|' && depth == 0)
+        {
+            return ptr;
+        }
+        ptr++;
+    }
+    return NULL;
+}
+
+/* Cut `command` at its next top-level pipe, strtok style (empty pieces are skipped) */
+static char* next_subcommand(char** rest_ptr)
+{
+    char* start = *rest_ptr;
+    if (!start)
+        return NULL;
+
+    while (*start == '|')
+        start++;
+    if (*start == '\0')
+    {
+        *rest_ptr = NULL;
+        return NULL;
+    }
+
+    char* pipe = find_pipe(start);
+    if (pipe)
+    {
+        *pipe = '\0';
+        *rest_ptr = pipe + 1;
+    }
+    else
+    {
+        *rest_ptr = NULL;
+    }
+    return start;
+}
+
+/* Release the first `count` tokens and the array itself */
+static void free_tokens(char** tokens, int count)
+{
+    for (int i = 0; i < count; i++)
+        free(tokens[i]);
+    free(tokens);
+}
 
 char** split_by_pipes(char* command, int* num_commands)
 {
@@ -15,15 +86,13 @@ char** split_by_pipes(char* command, int* num_commands)
     int position = 0;                                // Tracks the current position in the tokens array
     char** tokens = malloc(bufsize * sizeof(char*)); // Array to store the subcommands
     char* token;                                     // Pointer to hold each subcommand while processing pipes
+    char* rest = command;                            // Remainder of the command still to be split
 
     if (!tokens)
-    {
-        fprintf(stderr, "Shell: memory allocation error\n");
-        exit(EXIT_FAILURE);
-    }
+        return NULL;
 
-    // Use strtok to split by '|'
-    token = strtok(command, "|");
+    // Split by '|', leaving quoted text and <( ... ) / >( ... ) intact
+    token = next_subcommand(&rest);
     while (token != NULL)
     {
         // Remove leading whitespace
@@ -36,30 +105,290 @@ char** split_by_pipes(char* command, int* num_commands)
             *end-- = '\0';
 
         // Copy the token to store independently of the original memory
-        tokens[position++] = strdup(token);
+        tokens[position] = strdup(token);
+        if (!tokens[position])
+        {
+            free_tokens(tokens, position);
+            return NULL;
+        }
+        position++;
 
         // Expand the tokens array if necessary
         if (position >= bufsize)
         {
             bufsize += BUFFER_INCREMENT;
-            tokens = realloc(tokens, bufsize * sizeof(char*));
-            if (!tokens)
+            char** grown = realloc(tokens, bufsize * sizeof(char*));
+            if (!grown)
             {
-                fprintf(stderr, "Shell: memory allocation error\n");
-                exit(EXIT_FAILURE);
+                free_tokens(tokens, position);
+                return NULL;
             }
+            tokens = grown;
         }
 
         // Continue tokenizing by '|'
-        token = strtok(NULL, "|");
+        token = next_subcommand(&rest);
     }
     tokens[position] = NULL;  // Mark end of the array
     *num_commands = position; // Store the total number of subcommands
     return tokens;            // Contains each subcommand separated by pipes
 }
 
+/* Read the word after a redirection operator, honouring single and double quotes */
+static char* read_redirection_word(char** ptr_ref)
+{
+    char* ptr = *ptr_ref;
+    char* start;
+    int len;
+
+    // Skip whitespace between the operator and its word
+    while (*ptr == ' ' || *ptr == '\t')
+        ptr++;
+    start = ptr;
+
+    if (*ptr == '\'' || *ptr == '\"')
+    {
+        char quote = *ptr++;
+        start = ptr;
+        while (*ptr && *ptr != quote)
+            ptr++;
+        len = ptr - start;
+        if (*ptr == quote)
+            ptr++;
+    }
+    else
+    {
+        while (*ptr && *ptr != ' ' && *ptr != '\t' && *ptr != '<' && *ptr != '>')
+            ptr++;
+        len = ptr - start;
+    }
+
+    *ptr_ref = ptr;
+    if (len == 0)
+        return NULL;
+    return strndup(start, len);
+}
+
+/* Append an open() of the word after the operator onto `fd` */
+static int add_open(redir_t** redirs_ptr, int fd, int flags, char** ptr_ref)
+{
+    char* path = read_redirection_word(ptr_ref);
+    if (!path)
+        return -1;
+
+    redir_t* r = redir_append(redirs_ptr, REDIR_OPEN, fd);
+    if (!r)
+    {
+        free(path);
+        return PARSE_NO_MEMORY;
+    }
+    r->flags = flags;
+    r->path = path;
+    return 1;
+}
+
+/* Append a duplication (n>&m) or a close (n>&-) onto `fd` */
+static int add_dup(redir_t** redirs_ptr, int fd, char** ptr_ref)
+{
+    char* ptr = *ptr_ref;
+    redir_t* r;
+
+    if (*ptr == '-')
+    {
+        *ptr_ref = ptr + 1;
+        r = redir_append(redirs_ptr, REDIR_CLOSE, fd);
+        return r ? 1 : PARSE_NO_MEMORY;
+    }
+    if (!isdigit((unsigned char)*ptr))
+        return -1;
+
+    r = redir_append(redirs_ptr, REDIR_DUP, fd);
+    if (!r)
+        return PARSE_NO_MEMORY;
+    r->target_fd = (int)strtol(ptr, ptr_ref, 10);
+    return 1;
+}
+
+/* Append inline data (here-document or here-string) as `fd`; takes `data` */
+static int add_data(redir_t** redirs_ptr, int fd, char* data)
+{
+    if (!data)
+        return PARSE_NO_MEMORY;
+    redir_t* r = redir_append(redirs_ptr, REDIR_DATA, fd);
+    if (!r)
+    {
+        free(data);
+        return PARSE_NO_MEMORY;
+    }
+    r->data = data;
+    return 1;
+}
+
+/*
+ * Parse one redirection operator at *ptr_ref, if there is one:
+ *   [n]<file  [n]>file  [n]>>file  [n]<>file  [n]>&m  [n]<&m  [n]>&-
+ *   &>file  &>>file  [n]<<DELIM  [n]<<<word
+ * Returns 1 if an operator was consumed, 0 if *ptr_ref is not a redirection,
+ * -1 on a syntax error and PARSE_NO_MEMORY if an allocation failed.
+ */
+static int parse_redirection(char** ptr_ref, redir_t** redirs_ptr)
+{
+    char* ptr = *ptr_ref;
+    int fd = -1;
+    int both = 0; // &> redirects stdout and stderr
+    int result;
+
+    if (isdigit((unsigned char)*ptr))
+    {
+        char* end = ptr;
+        while (isdigit((unsigned char)*end))
+            end++;
+        if (*end != '<' && *end != '>')
+            return 0;
+        fd = (int)strtol(ptr, NULL, 10);
+        ptr = end;
+    }
+    else if (ptr[0] == '&' && ptr[1] == '>')
+    {
+        both = 1;
+        ptr++;
+    }
+    else if (*ptr != '<' && *ptr != '>')
+    {
+        return 0;
+    }
+
+    if (ptr[0] == '<')
+    {
+        if (fd == -1)
+            fd = STDIN_FILENO;
+
+        if (ptr[1] == '<' && ptr[2] == '<')
+        {
+            // A here-string is fed to the command followed by a newline
+            ptr += 3;
+            char* word = read_redirection_word(&ptr);
+            if (!word)
+                return -1;
+            char* data = malloc(strlen(word) + 2);
+            if (data)
+                sprintf(data, "%s\n", word);
+            free(word);
+            result = add_data(redirs_ptr, fd, data);
+        }
+        else if (ptr[1] == '<')
+        {
+            ptr += 2;
+            if (*ptr == '-')
+                ptr++;
+            // The body was read by heredoc_collect() and redir_open() takes it; the delimiter is only skipped
+            char* delimiter = read_redirection_word(&ptr);
+            if (!delimiter)
+                return -1;
+            free(delimiter);
+            result = redir_append(redirs_ptr, REDIR_HEREDOC, fd) ? 1 : PARSE_NO_MEMORY;
+        }
+        else if (ptr[1] == '>')
+        {
+            ptr += 2;
+            result = add_open(redirs_ptr, fd, O_RDWR | O_CREAT, &ptr);
+        }
+        else if (ptr[1] == '&')
+        {
+            ptr += 2;
+            result = add_dup(redirs_ptr, fd, &ptr);
+        }
+        else
+        {
+            ptr++;
+            result = add_open(redirs_ptr, fd, O_RDONLY, &ptr);
+        }
+    }
+    else
+    {
+        if (fd == -1)
+            fd = STDOUT_FILENO;
+
+        if (ptr[1] == '>')
+        {
+            ptr += 2;
+            result = add_open(redirs_ptr, fd, O_WRONLY | O_CREAT | O_APPEND, &ptr);
+        }
+        else if (ptr[1] == '&' && !both)
+        {
+            ptr += 2;
+            result = add_dup(redirs_ptr, fd, &ptr);
+        }
+        else
+        {
+            ptr++;
+            if (*ptr == '|')
+                ptr++;
+            result = add_open(redirs_ptr, fd, O_WRONLY | O_CREAT | O_TRUNC, &ptr);
+        }
+
+        // &> and &>> send stderr wherever stdout now points
+        if (result == 1 && both)
+        {
+            redir_t* r = redir_append(redirs_ptr, REDIR_DUP, STDERR_FILENO);
+            if (!r)
+                return PARSE_NO_MEMORY;
+            r->target_fd = STDOUT_FILENO;
+        }
+    }
+
+    *ptr_ref = ptr;
+    return result;
+}
+/* Append a token, growing the array when it fills up; -1 if either allocation failed */
+static int push_token(char*** tokens_ptr, int* position, int* bufsize, char* token)
+{
+    if (!token)
+        return -1;
+    (*tokens_ptr)[(*position)++] = token;
+
+    if (*position >= *bufsize)
+    {
+        char** grown = realloc(*tokens_ptr, (*bufsize + BUFFER_INCREMENT) * sizeof(char*));
+        if (!grown)
+            return -1;
+        *bufsize += BUFFER_INCREMENT;
+        *tokens_ptr = grown;
+    }
+    return 0;
+}
+
+/* Append the paths matching an unquoted pattern, or the pattern itself when nothing matches */
+static int push_expansion(char*** tokens_ptr, int* position, int* bufsize, char* pattern, const char* directory)
+{
+    char** matches;
+    long count = pathexp_expand(pattern, directory, &matches);
+    if (count == -1)
+    {
+        free(pattern);
+        return -1;
+    }
+    if (count == 0)
+        return push_token(tokens_ptr, position, bufsize, pattern);
+
+    free(pattern);
+    long i = 0;
+    while (i < count && push_token(tokens_ptr, position, bufsize, matches[i]) == 0)
+        i++;
+    if (i < count)
+    {
+        // push_token already keeps matches[i]
+        while (++i < count)
+            free(matches[i]);
+        free(matches);
+        return -1;
+    }
+    free(matches);
+    return 0;
+}
+
 /* Handle input and output redirection and treat a sequence of words as a single argument */
-char** parse_command(char* command, char** input_file_ptr, char** output_file_ptr)
+char** parse_command_quiet(char* command, redir_t** redirs_ptr, const char* directory, const char** error)
 {
     int bufsize = INITIAL_BUFSIZE;
     int position = 0;
@@ -67,15 +396,15 @@ char** parse_command(char* command, char** input_file_ptr, char** output_file_pt
     char* cmd_copy = strdup(command);
     char* ptr = cmd_copy;
 
-    if (!tokens)
+    *redirs_ptr = NULL;
+    *error = NULL;
+    if (!tokens || !cmd_copy)
     {
-        fprintf(stderr, "Shell: memory allocation error\n");
-        exit(EXIT_FAILURE);
+        free(tokens);
+        free(cmd_copy);
+        return NULL;
     }
 
-    *input_file_ptr = NULL;
-    *output_file_ptr = NULL;
-
     while (*ptr)
     {
         // Skip whitespace
@@ -85,30 +414,63 @@ char** parse_command(char* command, char** input_file_ptr, char** output_file_pt
         if (*ptr == '\0')
             break;
 
-        // Handle input/output redirection
-        if (*ptr == '<' || *ptr == '>')
+        // Handle process substitution: the argument becomes /dev/fd/N once started
+        if ((*ptr == '<' || *ptr == '>') && ptr[1] == '(')
         {
-            char redir_op = *ptr;
-            ptr++;
-            // Skip whitespace
-            while (*ptr == ' ' || *ptr == '\t')
-                ptr++;
-            // Capture the filename
             char* start = ptr;
-            while (*ptr && *ptr != ' ' && *ptr != '\t' && *ptr != '<' && *ptr != '>')
-                ptr++;
-            int len = ptr - start;
-            char* filename = strndup(start, len);
+            char* inner = ptr + 2;
+            int depth = 1;
+            ptr = inner;
+            while (*ptr && depth > 0)
+            {
+                if (*ptr == '\'' || *ptr == '\"')
+                {
+                    char quote = *ptr++;
+                    while (*ptr && *ptr != quote)
+                        ptr++;
+                }
+                else if (*ptr == '(')
+                    depth++;
+                else if (*ptr == ')')
+                    depth--;
+                if (*ptr && depth > 0)
+                    ptr++;
+            }
+            if (depth > 0)
+            {
+                *error = "syntax error: unterminated process substitution";
+                break;
+            }
 
-            if (redir_op == '<')
-                *input_file_ptr = filename;
-            else
-                *output_file_ptr = filename;
+            redir_t* r = redir_append(redirs_ptr, REDIR_PROCSUB, -1);
+            if (!r || !(r->data = strndup(inner, ptr - inner)))
+                goto no_memory;
+            r->flags = *start == '<' ? O_RDONLY : O_WRONLY;
+            r->arg_index = position;
+            ptr++; // Skip ')'
+
+            // Placeholder, replaced by redir_open()
+            if (push_token(&tokens, &position, &bufsize, strndup(start, ptr - start)) == -1)
+                goto no_memory;
+            continue;
+        }
+
+        // Handle redirections, applied later in the order they appear
+        int redirection = parse_redirection(&ptr, redirs_ptr);
+        if (redirection == PARSE_NO_MEMORY)
+        {
+            goto no_memory;
+        }
+        else if (redirection == -1)
+        {
+            *error = "syntax error near redirection";
+            break;
         }
         // Handle quoted arguments
-        else
+        else if (redirection == 0)
         {
             char* start = ptr;
+            int quoted = *ptr == '\'' || *ptr == '\"'; // Quoted words are never patterns
 
             // Handle single quotes
             if (*ptr == '\'')
@@ -147,17 +509,14 @@ char** parse_command(char* command, char** input_file_ptr, char** output_file_pt
             {
                 int len = ptr - start;
                 char* token = strndup(start, len);
-                tokens[position++] = token;
-
-                if (position >= bufsize)
+                if (!quoted && token && pathexp_has_magic(token))
+                {
+                    if (push_expansion(&tokens, &position, &bufsize, token, directory) == -1)
+                        goto no_memory;
+                }
+                else if (push_token(&tokens, &position, &bufsize, token) == -1)
                 {
-                    bufsize += BUFFER_INCREMENT;
-                    tokens = realloc(tokens, bufsize * sizeof(char*));
-                    if (!tokens)
-                    {
-                        fprintf(stderr, "Shell: memory allocation error\n");
-                        exit(EXIT_FAILURE);
-                    }
+                    goto no_memory;
                 }
 
                 if (*ptr == '<' || *ptr == '>')
@@ -168,7 +527,68 @@ char** parse_command(char* command, char** input_file_ptr, char** output_file_pt
         }
     }
 
+    if (*error)
+    {
+        // Return an empty command so nothing is executed
+        for (int i = 0; i < position; i++)
+            free(tokens[i]);
+        position = 0;
+        redir_free(*redirs_ptr);
+        *redirs_ptr = NULL;
+    }
     tokens[position] = NULL;
     free(cmd_copy);
     return tokens;
+
+no_memory:
+    free_tokens(tokens, position);
+    free(cmd_copy);
+    redir_free(*redirs_ptr);
+    *redirs_ptr = NULL;
+    return NULL;
+}
+
+char** parse_command(char* command, redir_t** redirs_ptr)
+{
+    const char* error;
+    char** tokens = parse_command_quiet(command, redirs_ptr, NULL, &error);
+    if (error)
+        fprintf(stderr, "Shell: %s\n", error);
+    return tokens;
+}
+
+/* La unidad es obligatoria para no confundir una duracion con un numero
+ * comun, como el intervalo de status_monitor --watch */
+int parse_duration(const char* text, double* seconds)
+{
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || value <= 0 || end[0] == '\0')
+        return -1;
+
+    if (strcmp(end, "ms") == 0)
+    {
+        *seconds = value / 1000;
+        return 0;
+    }
+    if (end[1] != '\0')
+        return -1;
+
+    switch (*end)
+    {
+    case 's':
+        *seconds = value;
+        return 0;
+    case 'm':
+        *seconds = value * 60;
+        return 0;
+    case 'h':
+        *seconds = value * 3600;
+        return 0;
+    case 'd':
+        *seconds = value * 86400;
+        return 0;
+    default:
+        return -1;
+    }
 }
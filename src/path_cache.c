@@ -0,0 +1,131 @@
+#define _GNU_SOURCE
+#include "path_cache.h"
+#include "shell_stats.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TABLE_SLOTS (PATH_CACHE_SIZE * 2) // Mitad vacia: sondeos cortos
+
+typedef struct {
+  char *name; // NULL: libre
+  char *path;
+} path_entry_t;
+
+static path_entry_t table[TABLE_SLOTS];
+static size_t used = 0;
+static char *cached_path_var = NULL; // PATH con el que se lleno la tabla
+
+static size_t hash_name(const char *name) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (; *name; name++) {
+    hash = (hash ^ (unsigned char)*name) * 16777619u;
+  }
+  return hash % TABLE_SLOTS;
+}
+
+static size_t find_slot(const char *name) {
+  size_t slot = hash_name(name);
+  while (table[slot].name && strcmp(table[slot].name, name) != 0) {
+    slot = (slot + 1) % TABLE_SLOTS;
+  }
+  return slot;
+}
+
+void path_cache_clear(void) {
+  for (size_t i = 0; i < TABLE_SLOTS; i++) {
+    free(table[i].name);
+    free(table[i].path);
+    table[i].name = NULL;
+    table[i].path = NULL;
+  }
+  used = 0;
+}
+
+void path_cache_forget(const char *name) {
+  size_t slot = find_slot(name);
+  if (!table[slot].name) {
+    return;
+  }
+  free(table[slot].name);
+  free(table[slot].path);
+  table[slot].name = NULL;
+  table[slot].path = NULL;
+  used--;
+  // Las entradas que siguen pueden haber sondeado a traves del hueco
+  for (size_t next = (slot + 1) % TABLE_SLOTS; table[next].name;
+       next = (next + 1) % TABLE_SLOTS) {
+    path_entry_t entry = table[next];
+    table[next].name = NULL;
+    table[next].path = NULL;
+    table[find_slot(entry.name)] = entry;
+  }
+}
+
+/* Busca name en cada directorio de PATH, como execvp */
+static char *search_path(const char *path_var, const char *name) {
+  char candidate[PATH_MAX];
+  const char *dir = path_var;
+  while (1) {
+    size_t length = strcspn(dir, ":");
+    // Un directorio vacio es el actual
+    int written = length == 0
+                      ? snprintf(candidate, sizeof(candidate), "%s", name)
+                      : snprintf(candidate, sizeof(candidate), "%.*s/%s",
+                                 (int)length, dir, name);
+    struct stat st;
+    if (written > 0 && (size_t)written < sizeof(candidate) &&
+        stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+        access(candidate, X_OK) == 0) {
+      return strdup(candidate);
+    }
+    if (dir[length] == '\0') {
+      return NULL;
+    }
+    dir += length + 1;
+  }
+}
+
+const char *path_cache_lookup(const char *name) {
+  const char *path_var = getenv("PATH");
+  if (!path_var) {
+    path_var = "/bin:/usr/bin";
+  }
+  if (!cached_path_var || strcmp(cached_path_var, path_var) != 0) {
+    path_cache_clear();
+    free(cached_path_var);
+    cached_path_var = strdup(path_var);
+    if (!cached_path_var) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  size_t slot = find_slot(name);
+  if (table[slot].name) {
+    shell_stats_count(SHELL_COUNTER_PATH_HITS);
+    return table[slot].path;
+  }
+  shell_stats_count(SHELL_COUNTER_PATH_MISSES);
+  char *path = search_path(path_var, name);
+  if (!path) {
+    return NULL;
+  }
+  if (used >= PATH_CACHE_SIZE) {
+    path_cache_clear();
+    slot = find_slot(name);
+  }
+  table[slot].name = strdup(name);
+  if (!table[slot].name) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  table[slot].path = path;
+  used++;
+  return path;
+}
@@ -0,0 +1,619 @@
+#define _GNU_SOURCE
+#include "pathexp.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DENTS_BUFFER_SIZE 65536 // Bytes por llamada a getdents64
+#define RADIX_CUTOFF 32         // Baldes mas chicos se ordenan por insercion
+#define INITIAL_SLOTS 64        // Tabla de listados, siempre potencia de 2
+
+typedef enum { OP_LITERAL, OP_ANY, OP_CLASS, OP_STAR } op_kind_t;
+
+/* Un paso del matcher compilado */
+typedef struct {
+  op_kind_t kind;
+  const char *text; // OP_LITERAL: apunta al componente
+  size_t length;
+  uint8_t set[32]; // OP_CLASS: un bit por byte, con el '!' ya aplicado
+} op_t;
+
+/* Un componente del patron, entre dos '/' */
+typedef struct {
+  char *text;
+  int magic;    // 0: se compara tal cual
+  int globstar; // Es "**"
+  int dot;      // Empieza con un '.' literal: ve los nombres ocultos
+  int star;     // Tiene algun '*'
+  op_t *ops;
+  size_t op_count;
+  size_t min_length; // Bytes que piden los pasos que no son '*'
+  const char *suffix; // Literal final despues del ultimo '*', o NULL
+  size_t suffix_length;
+} component_t;
+
+typedef struct {
+  size_t offset; // En names
+  size_t length;
+  unsigned char type; // d_type
+} entry_t;
+
+/* Un directorio leido: sus nombres seguidos, cada uno con su '\0' */
+typedef struct {
+  char *path; // Como se muestra en los resultados
+  char *names;
+  entry_t *entries;
+  size_t count;
+} listing_t;
+
+typedef struct {
+  component_t *components;
+  size_t count;
+  int dirs_only; // El patron termina en '/'
+  const char *base;
+  listing_t **slots; // Punteros: un listado no se mueve mientras se recorre
+  size_t slot_count;
+  size_t listing_count;
+  char *dents; // Buffer de getdents64
+  char **matches;
+  size_t match_count;
+  size_t match_capacity;
+  int failed; // Fallo una asignacion
+} expansion_t;
+
+/* Donde termina la clase que abre p, sin cruzar un '/', o NULL */
+static const char *class_end(const char *p) {
+  const char *q = p + 1;
+  if (*q == '!' || *q == '^') {
+    q++;
+  }
+  if (*q == ']') {
+    q++; // Un ']' al principio es parte de la clase
+  }
+  while (*q && *q != ']' && *q != '/') {
+    q++;
+  }
+  return *q == ']' ? q : NULL;
+}
+
+int pathexp_has_magic(const char *word) {
+  for (const char *p = word; *p; p++) {
+    if (*p == '*' || *p == '?' || (*p == '[' && class_end(p))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static void parse_class(op_t *op, const char *p, const char *end) {
+  int negate = *p == '!' || *p == '^';
+  p += negate;
+  memset(op->set, 0, sizeof(op->set));
+  while (p < end) {
+    unsigned char low = *p;
+    unsigned char high = low;
+    if (p + 2 < end && p[1] == '-') {
+      high = p[2];
+      p += 3;
+    } else {
+      p++;
+    }
+    for (unsigned int c = low; c <= high; c++) {
+      op->set[c / 8] |= 1u << (c % 8);
+    }
+  }
+  if (negate) {
+    for (size_t i = 0; i < sizeof(op->set); i++) {
+      op->set[i] = ~op->set[i];
+    }
+  }
+}
+
+/* Traduce el componente a pasos; -1 si falta memoria */
+static int compile(component_t *component) {
+  const char *p = component->text;
+  component->globstar = strcmp(p, "**") == 0;
+  component->dot = *p == '.';
+  component->magic = pathexp_has_magic(p);
+  if (!component->magic || component->globstar) {
+    return 0;
+  }
+  component->ops = malloc((strlen(p) + 1) * sizeof(op_t));
+  if (!component->ops) {
+    return -1;
+  }
+  while (*p) {
+    op_t *op = &component->ops[component->op_count++];
+    if (*p == '*') {
+      while (*p == '*') {
+        p++;
+      }
+      op->kind = OP_STAR;
+      component->star = 1;
+    } else if (*p == '?') {
+      op->kind = OP_ANY;
+      component->min_length++;
+      p++;
+    } else if (*p == '[' && class_end(p)) {
+      const char *end = class_end(p);
+      op->kind = OP_CLASS;
+      parse_class(op, p + 1, end);
+      component->min_length++;
+      p = end + 1;
+    } else {
+      op->kind = OP_LITERAL;
+      op->text = p;
+      do {
+        p++;
+      } while (*p && *p != '*' && *p != '?' && !(*p == '[' && class_end(p)));
+      op->length = p - op->text;
+      component->min_length += op->length;
+    }
+  }
+  // "*.gz" casi nunca llega al matcher: se descarta por el final
+  const op_t *last = &component->ops[component->op_count - 1];
+  if (component->star && last->kind == OP_LITERAL) {
+    component->suffix = last->text;
+    component->suffix_length = last->length;
+  }
+  return 0;
+}
+
+static int in_class(const op_t *step, char c) {
+  unsigned char byte = c;
+  return step->set[byte / 8] & 1u << (byte % 8);
+}
+
+/* Compara con vuelta atras solo hasta el ultimo '*' */
+static int match_ops(const component_t *component, const char *name,
+                     size_t length) {
+  const char *p = name;
+  const char *end = name + length;
+  size_t op = 0;
+  size_t star_op = 0;
+  const char *star_p = NULL;
+  while (p < end || op < component->op_count) {
+    if (op < component->op_count) {
+      const op_t *step = &component->ops[op];
+      if (step->kind == OP_STAR) {
+        star_op = ++op;
+        star_p = p;
+        continue;
+      }
+      if (step->kind == OP_LITERAL && (size_t)(end - p) >= step->length &&
+          memcmp(p, step->text, step->length) == 0) {
+        p += step->length;
+        op++;
+        continue;
+      }
+      if (p < end && (step->kind == OP_ANY ||
+                      (step->kind == OP_CLASS && in_class(step, *p)))) {
+        p++;
+        op++;
+        continue;
+      }
+    }
+    if (star_p && star_p < end) {
+      p = ++star_p;
+      op = star_op;
+      continue;
+    }
+    return 0;
+  }
+  return 1;
+}
+
+static int matches(const component_t *component, const char *name,
+                   size_t length) {
+  if (length < component->min_length ||
+      (!component->star && length != component->min_length)) {
+    return 0;
+  }
+  if (component->suffix &&
+      memcmp(name + length - component->suffix_length, component->suffix,
+             component->suffix_length) != 0) {
+    return 0;
+  }
+  return match_ops(component, name, length);
+}
+
+static size_t hash_path(const char *path) {
+  uint64_t hash = 1469598103934665603ULL; // FNV-1a
+  for (; *path; path++) {
+    hash = (hash ^ (unsigned char)*path) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* El path en el sistema de archivos de lo que se muestra como display */
+static const char *fs_path(const expansion_t *state, const char *display,
+                           char *buffer) {
+  if (display[0] == '/' || !state->base) {
+    return display[0] ? display : ".";
+  }
+  snprintf(buffer, PATH_MAX, "%s/%s", state->base, display);
+  return buffer;
+}
+
+static void free_listing(listing_t *listing) {
+  free(listing->path);
+  free(listing->names);
+  free(listing->entries);
+  free(listing);
+}
+
+/* Lee el directorio con getdents64; un directorio que no se puede abrir
+ * queda vacio */
+static listing_t *read_listing(expansion_t *state, const char *display) {
+  listing_t *listing = calloc(1, sizeof(listing_t));
+  if (!listing || !(listing->path = strdup(display))) {
+    free(listing);
+    return NULL;
+  }
+  char buffer[PATH_MAX];
+  int fd = open(fs_path(state, display, buffer),
+                O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    return listing;
+  }
+  size_t names_size = 0;
+  size_t names_capacity = 0;
+  size_t capacity = 0;
+  ssize_t read_bytes;
+  while ((read_bytes = getdents64(fd, state->dents, DENTS_BUFFER_SIZE)) > 0) {
+    for (ssize_t offset = 0; offset < read_bytes;) {
+      struct dirent64 *dirent = (struct dirent64 *)(state->dents + offset);
+      offset += dirent->d_reclen;
+      const char *name = dirent->d_name;
+      if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        continue;
+      }
+      size_t length = strlen(name);
+      if (names_size + length + 1 > names_capacity ||
+          listing->count == capacity) {
+        names_capacity = (names_capacity + length + 1) * 2;
+        capacity = capacity ? capacity * 2 : 64;
+        char *names = realloc(listing->names, names_capacity);
+        if (names) {
+          listing->names = names;
+        }
+        entry_t *entries =
+            realloc(listing->entries, capacity * sizeof(entry_t));
+        if (entries) {
+          listing->entries = entries;
+        }
+        if (!names || !entries) {
+          close(fd);
+          free_listing(listing);
+          return NULL;
+        }
+      }
+      memcpy(listing->names + names_size, name, length + 1);
+      listing->entries[listing->count].offset = names_size;
+      listing->entries[listing->count].length = length;
+      listing->entries[listing->count].type = dirent->d_type;
+      listing->count++;
+      names_size += length + 1;
+    }
+  }
+  close(fd);
+  return listing;
+}
+
+/* El listado de display, leido la primera vez que se lo pide */
+static listing_t *get_listing(expansion_t *state, const char *display) {
+  if ((state->listing_count + 1) * 2 > state->slot_count) {
+    size_t old_count = state->slot_count;
+    listing_t **old = state->slots;
+    size_t slot_count = old_count ? old_count * 2 : INITIAL_SLOTS;
+    listing_t **slots = calloc(slot_count, sizeof(listing_t *));
+    if (!slots) {
+      return NULL;
+    }
+    for (size_t i = 0; i < old_count; i++) {
+      if (old[i]) {
+        size_t slot = hash_path(old[i]->path) & (slot_count - 1);
+        while (slots[slot]) {
+          slot = (slot + 1) & (slot_count - 1);
+        }
+        slots[slot] = old[i];
+      }
+    }
+    free(old);
+    state->slots = slots;
+    state->slot_count = slot_count;
+  }
+  size_t slot = hash_path(display) & (state->slot_count - 1);
+  while (state->slots[slot]) {
+    if (strcmp(state->slots[slot]->path, display) == 0) {
+      return state->slots[slot];
+    }
+    slot = (slot + 1) & (state->slot_count - 1);
+  }
+  listing_t *listing = read_listing(state, display);
+  if (listing) {
+    state->slots[slot] = listing;
+    state->listing_count++;
+  }
+  return listing;
+}
+
+static void add_match(expansion_t *state, const char *path) {
+  if (state->match_count + 1 >= state->match_capacity) {
+    size_t capacity = state->match_capacity ? state->match_capacity * 2 : 16;
+    char **grown = realloc(state->matches, capacity * sizeof(char *));
+    if (!grown) {
+      state->failed = 1;
+      return;
+    }
+    state->matches = grown;
+    state->match_capacity = capacity;
+  }
+  char *copy = strdup(path);
+  if (!copy) {
+    state->failed = 1;
+    return;
+  }
+  state->matches[state->match_count++] = copy;
+}
+
+/* Si la entrada es un directorio; follow sigue los enlaces */
+static int is_dir(const expansion_t *state, const char *display,
+                  unsigned char type, int follow) {
+  if (type == DT_DIR) {
+    return 1;
+  }
+  if (type != DT_UNKNOWN && (type != DT_LNK || !follow)) {
+    return 0;
+  }
+  char buffer[PATH_MAX];
+  struct stat st;
+  const char *path = fs_path(state, display, buffer);
+  return (follow ? stat(path, &st) : lstat(path, &st)) == 0 &&
+         S_ISDIR(st.st_mode);
+}
+
+static int exists(const expansion_t *state, const char *display) {
+  char buffer[PATH_MAX];
+  struct stat st;
+  if (lstat(fs_path(state, display, buffer), &st) == -1) {
+    return 0;
+  }
+  return !state->dirs_only ||
+         is_dir(state, display, S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN,
+                1);
+}
+
+/* Agrega lo que cuelga de display (que termina en '/' o esta vacio) y
+ * coincide con los componentes desde index */
+static void expand(expansion_t *state, char *display, size_t length,
+                   size_t index) {
+  if (state->failed) {
+    return;
+  }
+  const component_t *component = &state->components[index];
+  int last = index + 1 == state->count;
+
+  if (!component->magic) {
+    size_t text_length = strlen(component->text);
+    if (length + text_length + 2 >= PATH_MAX) {
+      return;
+    }
+    memcpy(display + length, component->text, text_length + 1);
+    if (last) {
+      if (exists(state, display)) {
+        if (state->dirs_only) {
+          strcpy(display + length + text_length, "/");
+        }
+        add_match(state, display);
+      }
+    } else {
+      strcpy(display + length + text_length, "/");
+      expand(state, display, length + text_length + 1, index + 1);
+    }
+    display[length] = '\0';
+    return;
+  }
+
+  listing_t *listing = get_listing(state, display);
+  if (!listing) {
+    state->failed = 1;
+    return;
+  }
+  if (component->globstar && !last) {
+    // Cero directorios; los subdirectorios siguen en el bucle
+    expand(state, display, length, index + 1);
+  }
+  for (size_t i = 0; i < listing->count && !state->failed; i++) {
+    const entry_t *entry = &listing->entries[i];
+    const char *name = listing->names + entry->offset;
+    if (name[0] == '.' && !component->dot) {
+      continue; // Los ocultos solo con un '.' explicito
+    }
+    if (!component->globstar && !matches(component, name, entry->length)) {
+      continue;
+    }
+    if (length + entry->length + 2 >= PATH_MAX) {
+      continue;
+    }
+    memcpy(display + length, name, entry->length + 1);
+    if (component->globstar) {
+      // Al final, "**" es todo lo que hay debajo
+      if (last && !state->dirs_only) {
+        add_match(state, display);
+      }
+      // Sin seguir enlaces: un enlace a un ancestro no termina nunca
+      if (is_dir(state, display, entry->type, 0)) {
+        strcpy(display + length + entry->length, "/");
+        if (last && state->dirs_only) {
+          add_match(state, display);
+        }
+        expand(state, display, length + entry->length + 1, index);
+      }
+    } else if (last && !state->dirs_only) {
+      add_match(state, display);
+    } else if (is_dir(state, display, entry->type, 1)) {
+      strcpy(display + length + entry->length, "/");
+      if (last) {
+        add_match(state, display);
+      } else {
+        expand(state, display, length + entry->length + 1, index + 1);
+      }
+    }
+  }
+  display[length] = '\0';
+}
+
+static void insertion_sort(char **items, size_t count, size_t depth) {
+  for (size_t i = 1; i < count; i++) {
+    char *item = items[i];
+    size_t j = i;
+    while (j > 0 && strcmp(items[j - 1] + depth, item + depth) > 0) {
+      items[j] = items[j - 1];
+      j--;
+    }
+    items[j] = item;
+  }
+}
+
+/* Radix sort MSD: reparte por el byte en depth y ordena cada balde desde el
+ * byte siguiente. Un prefijo comun a todos se saltea sin recursion */
+static void radix_sort(char **items, char **scratch, size_t count,
+                       size_t depth) {
+  while (count >= RADIX_CUTOFF) {
+    size_t counts[256] = {0};
+    for (size_t i = 0; i < count; i++) {
+      counts[(unsigned char)items[i][depth]]++;
+    }
+    unsigned char first = (unsigned char)items[0][depth];
+    if (counts[first] == count) {
+      if (first == '\0') {
+        return; // Todos iguales
+      }
+      depth++;
+      continue;
+    }
+    size_t starts[256];
+    size_t total = 0;
+    for (int b = 0; b < 256; b++) {
+      starts[b] = total;
+      total += counts[b];
+    }
+    for (size_t i = 0; i < count; i++) {
+      scratch[starts[(unsigned char)items[i][depth]]++] = items[i];
+    }
+    memcpy(items, scratch, count * sizeof(char *));
+    // starts quedo en el final de cada balde; el 0 son cadenas terminadas
+    for (int b = 1; b < 256; b++) {
+      if (counts[b] > 1) {
+        radix_sort(items + starts[b] - counts[b], scratch, counts[b],
+                   depth + 1);
+      }
+    }
+    return;
+  }
+  insertion_sort(items, count, depth);
+}
+
+/* Separa el patron en componentes; -1 si falta memoria */
+static int split_pattern(expansion_t *state, const char *pattern) {
+  size_t capacity = 1;
+  for (const char *p = pattern; *p; p++) {
+    capacity += *p == '/';
+  }
+  state->components = calloc(capacity, sizeof(component_t));
+  if (!state->components) {
+    return -1;
+  }
+  const char *p = pattern;
+  while (*p) {
+    size_t length = strcspn(p, "/");
+    if (length > 0) {
+      component_t *component = &state->components[state->count++];
+      component->text = strndup(p, length);
+      if (!component->text || compile(component) == -1) {
+        return -1;
+      }
+    }
+    p += length;
+    while (*p == '/') {
+      p++;
+    }
+  }
+  state->dirs_only = p > pattern && p[-1] == '/';
+  return 0;
+}
+
+long pathexp_expand(const char *pattern, const char *directory,
+                    char ***matches_ptr) {
+  expansion_t state;
+  memset(&state, 0, sizeof(state));
+  state.base = directory;
+  *matches_ptr = NULL;
+
+  char display[PATH_MAX] = "";
+  size_t length = 0;
+  if (pattern[0] == '/') {
+    strcpy(display, "/");
+    length = 1;
+  }
+  if (split_pattern(&state, pattern) == -1 ||
+      !(state.dents = malloc(DENTS_BUFFER_SIZE))) {
+    state.failed = 1;
+  } else if (state.count > 0) {
+    expand(&state, display, length, 0);
+  }
+
+  if (!state.failed && state.match_count > 1) {
+    char **scratch = malloc(state.match_count * sizeof(char *));
+    if (scratch) {
+      radix_sort(state.matches, scratch, state.match_count, 0);
+      free(scratch);
+    } else {
+      state.failed = 1;
+    }
+  }
+
+  for (size_t i = 0; i < state.count; i++) {
+    free(state.components[i].text);
+    free(state.components[i].ops);
+  }
+  free(state.components);
+  for (size_t i = 0; i < state.slot_count; i++) {
+    if (state.slots[i]) {
+      free_listing(state.slots[i]);
+    }
+  }
+  free(state.slots);
+  free(state.dents);
+
+  if (state.failed) {
+    for (size_t i = 0; i < state.match_count; i++) {
+      free(state.matches[i]);
+    }
+    free(state.matches);
+    return -1;
+  }
+  if (state.match_count == 0) {
+    free(state.matches);
+    return 0;
+  }
+  // '**/x' y 'x' pueden nombrar lo mismo por dos caminos: un solo resultado
+  size_t unique = 1;
+  for (size_t i = 1; i < state.match_count; i++) {
+    if (strcmp(state.matches[unique - 1], state.matches[i]) == 0) {
+      free(state.matches[i]);
+    } else {
+      state.matches[unique++] = state.matches[i];
+    }
+  }
+  state.matches[unique] = NULL;
+  *matches_ptr = state.matches;
+  return unique;
+}
@@ -0,0 +1,41 @@
+#define _GNU_SOURCE
+#include "proc_file.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int proc_file_open(proc_file_t *file, const char *path) {
+  file->fd = open(path, O_RDONLY | O_CLOEXEC);
+  return file->fd == -1 ? -1 : 0;
+}
+
+ssize_t proc_file_read(proc_file_t *file, char *buffer, size_t size) {
+  if (file->fd == -1) {
+    errno = EBADF;
+    return -1;
+  }
+  // Leer desde el offset 0 hace que el kernel genere el contenido de nuevo
+  size_t length = 0;
+  while (length < size - 1) {
+    ssize_t count = pread(file->fd, buffer + length, size - 1 - length, length);
+    if (count == -1 && errno == EINTR) {
+      continue;
+    }
+    if (count == -1) {
+      return -1;
+    }
+    if (count == 0) {
+      break;
+    }
+    length += count;
+  }
+  buffer[length] = '\0';
+  return length;
+}
+
+void proc_file_close(proc_file_t *file) {
+  if (file->fd != -1) {
+    close(file->fd);
+    file->fd = -1;
+  }
+}
@@ -0,0 +1,48 @@
+#include "redirect.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Armar, cerrar y liberar las listas, lo que necesitan el parser y
+ * libshellcore. Abrirlas y aplicarlas (redirect.c) arranca las sustituciones
+ * de procesos con el ejecutor de la shell, asi que queda fuera */
+
+redir_t *redir_append(redir_t **list_ptr, redir_kind_t kind, int fd) {
+  redir_t *node = calloc(1, sizeof(redir_t));
+  if (!node) {
+    return NULL;
+  }
+  node->kind = kind;
+  node->fd = fd;
+  node->target_fd = -1;
+  node->opened_fd = -1;
+
+  // Se agrega al final para respetar el orden de la linea de comandos
+  while (*list_ptr != NULL) {
+    list_ptr = &(*list_ptr)->next;
+  }
+  *list_ptr = node;
+  return node;
+}
+
+void redir_close(redir_t *list) {
+  for (redir_t *r = list; r != NULL; r = r->next) {
+    if (r->opened_fd != -1) {
+      close(r->opened_fd);
+      r->opened_fd = -1;
+    }
+  }
+}
+
+void redir_free(redir_t *list) {
+  while (list != NULL) {
+    redir_t *next = list->next;
+    if (list->opened_fd != -1) {
+      close(list->opened_fd);
+    }
+    free(list->path);
+    free(list->data);
+    free(list->pids);
+    free(list);
+    list = next;
+  }
+}
@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include "redirect.h"
+#include "commands.h"
+#include "heredoc.h"
+#include "parse.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DEV_FD_PATH_SIZE 32 // Room for "/dev/fd/N"
+
+/* Mueve un descriptor recien abierto por encima de REDIR_FD_BASE */
+static int move_above_base(int fd) {
+  if (fd >= REDIR_FD_BASE) {
+    return fd;
+  }
+  int moved = fcntl(fd, F_DUPFD_CLOEXEC, REDIR_FD_BASE);
+  close(fd);
+  return moved;
+}
+
+/* Arranca <(cmd) o >(cmd) y devuelve el extremo del pipe para el comando */
+static int start_substitution(redir_t *r) {
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) == -1) {
+    perror("Shell: pipe");
+    return -1;
+  }
+
+  char *inner = strdup(r->data);
+  if (!inner) {
+    fprintf(stderr, "Shell: memory allocation error\n");
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  int num_commands = 0;
+  char **commands = split_by_pipes(inner, &num_commands);
+  free(inner);
+
+  r->pids = commands ? malloc(num_commands * sizeof(pid_t)) : NULL;
+  if (!r->pids) {
+    fprintf(stderr, "Shell: memory allocation error\n");
+    close(fds[0]);
+    close(fds[1]);
+    for (int i = 0; commands && i < num_commands; i++) {
+      free(commands[i]);
+    }
+    free(commands);
+    return -1;
+  }
+
+  /* <(cmd): el productor escribe en el pipe y el comando lee /dev/fd/N
+   * >(cmd): el comando escribe en /dev/fd/N y el consumidor lee del pipe
+   * spawn_pipeline se queda con el extremo que recibe y lo cierra */
+  int keep;
+  if (r->flags == O_RDONLY) {
+    r->num_pids = spawn_pipeline(commands, num_commands, STDIN_FILENO, fds[1],
+                                 r->pids, NULL);
+    keep = fds[0];
+  } else {
+    r->num_pids = spawn_pipeline(commands, num_commands, fds[0], STDOUT_FILENO,
+                                 r->pids, NULL);
+    keep = fds[1];
+  }
+
+  for (int i = 0; i < num_commands; i++) {
+    free(commands[i]);
+  }
+  free(commands);
+  return keep;
+}
+
+int redir_open(redir_t *list, char **args) {
+  for (redir_t *r = list; r != NULL; r = r->next) {
+    int fd = -1;
+
+    if (r->kind == REDIR_PROCSUB) {
+      fd = start_substitution(r);
+      if (fd == -1) {
+        redir_close(list);
+        return -1;
+      }
+    } else if (r->kind == REDIR_OPEN) {
+      fd = open(r->path, r->flags | O_CLOEXEC, REDIR_FILE_MODE);
+      if (fd == -1) {
+        fprintf(stderr, "Shell: %s: %s\n", r->path, strerror(errno));
+        redir_close(list);
+        return -1;
+      }
+    } else if (r->kind == REDIR_DATA || r->kind == REDIR_HEREDOC) {
+      if (r->kind == REDIR_HEREDOC) {
+        // El cuerpo que leyo heredoc_collect(), en el orden de los operadores
+        r->data = heredoc_next_body();
+        r->data = r->data ? r->data : strdup("");
+        if (!r->data) {
+          fprintf(stderr, "Shell: memory allocation error\n");
+          redir_close(list);
+          return -1;
+        }
+        r->kind = REDIR_DATA;
+      }
+      fd = heredoc_open(r->data, strlen(r->data));
+      if (fd == -1) {
+        redir_close(list);
+        return -1;
+      }
+    } else {
+      continue;
+    }
+
+    r->opened_fd = move_above_base(fd);
+    if (r->opened_fd == -1) {
+      perror("Shell: fcntl");
+      redir_close(list);
+      return -1;
+    }
+
+    if (r->kind == REDIR_PROCSUB && args) {
+      char path[DEV_FD_PATH_SIZE];
+      snprintf(path, sizeof(path), "/dev/fd/%d", r->opened_fd);
+      char *replacement = strdup(path);
+      if (!replacement) {
+        fprintf(stderr, "Shell: memory allocation error\n");
+        redir_close(list);
+        return -1;
+      }
+      free(args[r->arg_index]);
+      args[r->arg_index] = replacement;
+    }
+  }
+  return 0;
+}
+
+/* Guarda una copia del descriptor original antes de modificarlo */
+static int save_fd(redir_saved_t *saved, int fd) {
+  for (int i = 0; i < saved->count; i++) {
+    if (saved->fds[i] == fd) {
+      return 0; // Ya se guardo el original
+    }
+  }
+  if (saved->count == REDIR_MAX_SAVED) {
+    fprintf(stderr, "Shell: too many redirections\n");
+    return -1;
+  }
+
+  int copy = fcntl(fd, F_DUPFD_CLOEXEC, REDIR_FD_BASE);
+  if (copy == -1 && errno != EBADF) {
+    perror("Shell: fcntl");
+    return -1;
+  }
+  saved->fds[saved->count] = fd;
+  saved->saved[saved->count] = copy; // -1 si el descriptor estaba cerrado
+  saved->count++;
+  return 0;
+}
+
+int redir_apply(redir_t *list, redir_saved_t *saved) {
+  if (saved) {
+    saved->count = 0;
+    // Lo que el built-in ya imprimio debe salir por el descriptor original
+    fflush(stdout);
+    fflush(stderr);
+  }
+
+  for (redir_t *r = list; r != NULL; r = r->next) {
+    if (r->kind == REDIR_PROCSUB) {
+      // El programa debe heredar el pipe para poder abrir /dev/fd/N
+      if (!saved && fcntl(r->opened_fd, F_SETFD, 0) == -1) {
+        perror("Shell: fcntl");
+        return -1;
+      }
+      continue;
+    }
+
+    if (saved && save_fd(saved, r->fd) == -1) {
+      return -1;
+    }
+
+    switch (r->kind) {
+    case REDIR_OPEN:
+    case REDIR_DATA:
+    case REDIR_HEREDOC:
+      if (dup2(r->opened_fd, r->fd) == -1) {
+        perror("Shell: dup2");
+        return -1;
+      }
+      break;
+    case REDIR_DUP:
+      if (r->target_fd != r->fd && dup2(r->target_fd, r->fd) == -1) {
+        fprintf(stderr, "Shell: %d: %s\n", r->target_fd, strerror(errno));
+        return -1;
+      }
+      break;
+    case REDIR_CLOSE:
+      close(r->fd);
+      break;
+    case REDIR_PROCSUB:
+      break;
+    }
+  }
+  return 0;
+}
+
+void redir_restore(redir_saved_t *saved) {
+  fflush(stdout);
+  fflush(stderr);
+
+  // Se deshace en orden inverso
+  for (int i = saved->count - 1; i >= 0; i--) {
+    if (saved->saved[i] != -1) {
+      dup2(saved->saved[i], saved->fds[i]);
+      close(saved->saved[i]);
+    } else {
+      close(saved->fds[i]);
+    }
+  }
+  saved->count = 0;
+}
+
+void redir_wait(redir_t *list) {
+  for (redir_t *r = list; r != NULL; r = r->next) {
+    for (int i = 0; i < r->num_pids; i++) {
+      // ECHILD: ya lo recogio el manejador de SIGCHLD
+      while (waitpid(r->pids[i], NULL, 0) == -1 && errno == EINTR)
+        ;
+    }
+    r->num_pids = 0;
+  }
+}
@@ -0,0 +1,536 @@
+#define _GNU_SOURCE
+#include "searchconfig.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEQUE_INITIAL_CAPACITY 64  // Initial slots in each worker's deque
+#define MATCHES_INITIAL_CAPACITY 64 // Initial slots in each result list
+#define IDLE_WAIT_NS 1000000       // Idle workers re-check for work every 1 ms
+#define COPY_BUFFER_SIZE 65536     // Fallback copy when sendfile is refused
+
+/* Deque de directorios pendientes. El duenio trabaja por el final (LIFO,
+ * recorre en profundidad) y los demas roban por el principio (FIFO, se llevan
+ * los subarboles mas grandes). */
+typedef struct walk_deque {
+  pthread_mutex_t lock;
+  char **items;
+  size_t head; // Primer elemento valido
+  size_t tail; // Uno despues del ultimo
+  size_t capacity;
+} walk_deque_t;
+
+struct walker;
+
+typedef struct walk_worker {
+  struct walker *walker;
+  int id;
+  walk_deque_t deque;
+  config_matches_t matches; // Resultados propios, sin compartir
+  pthread_t thread;
+} walk_worker_t;
+
+typedef struct walker {
+  walk_worker_t *workers;
+  int num_workers;
+  const char *extension;
+  long pending; // Directorios en cola o en proceso
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle_cond;
+} walker_t;
+
+int config_matches_add(config_matches_t *matches, char *path, int error) {
+  if (matches->count == matches->capacity) {
+    size_t capacity = matches->capacity ? matches->capacity * 2
+                                        : MATCHES_INITIAL_CAPACITY;
+    config_match_t *items =
+        realloc(matches->items, capacity * sizeof(config_match_t));
+    if (!items) {
+      free(path);
+      return -1;
+    }
+    matches->items = items;
+    matches->capacity = capacity;
+  }
+  matches->items[matches->count].path = path;
+  matches->items[matches->count].error = error;
+  matches->count++;
+  return 0;
+}
+
+void config_matches_free(config_matches_t *matches) {
+  for (size_t i = 0; i < matches->count; i++) {
+    free(matches->items[i].path);
+  }
+  free(matches->items);
+  matches->items = NULL;
+  matches->count = 0;
+  matches->capacity = 0;
+}
+
+static char *join_path(const char *directory, const char *name) {
+  size_t dir_len = strlen(directory);
+  size_t name_len = strlen(name);
+  char *path = malloc(dir_len + name_len + 2);
+  if (!path) {
+    return NULL;
+  }
+  memcpy(path, directory, dir_len);
+  path[dir_len] = '/';
+  memcpy(path + dir_len + 1, name, name_len + 1);
+  return path;
+}
+
+static void deque_push(walk_deque_t *deque, char *path) {
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail == deque->capacity) {
+    if (deque->head > 0) {
+      // Compactar antes de crecer
+      memmove(deque->items, deque->items + deque->head,
+              (deque->tail - deque->head) * sizeof(char *));
+      deque->tail -= deque->head;
+      deque->head = 0;
+    }
+    if (deque->tail == deque->capacity) {
+      size_t capacity = deque->capacity ? deque->capacity * 2
+                                        : DEQUE_INITIAL_CAPACITY;
+      char **items = realloc(deque->items, capacity * sizeof(char *));
+      if (!items) {
+        pthread_mutex_unlock(&deque->lock);
+        fprintf(stderr, "Shell: memory allocation error\n");
+        exit(EXIT_FAILURE);
+      }
+      deque->items = items;
+      deque->capacity = capacity;
+    }
+  }
+  deque->items[deque->tail++] = path;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+static char *deque_pop(walk_deque_t *deque) {
+  char *path = NULL;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail > deque->head) {
+    path = deque->items[--deque->tail];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return path;
+}
+
+static char *deque_steal(walk_deque_t *deque) {
+  char *path = NULL;
+  // Si otro hilo lo tiene tomado se prueba con la siguiente victima
+  if (pthread_mutex_trylock(&deque->lock) != 0) {
+    return NULL;
+  }
+  if (deque->tail > deque->head) {
+    path = deque->items[deque->head++];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return path;
+}
+
+static void push_directory(walk_worker_t *worker, char *path) {
+  walker_t *walker = worker->walker;
+  __atomic_add_fetch(&walker->pending, 1, __ATOMIC_SEQ_CST);
+  deque_push(&worker->deque, path);
+  pthread_cond_signal(&walker->idle_cond);
+}
+
+int config_entry_type(int dir_fd, const char *name, unsigned char d_type) {
+  /* d_type ahorra el stat; solo se consulta al sistema de archivos cuando
+   * no lo informa o cuando es un enlace (se sigue si apunta a un archivo,
+   * los enlaces a directorios no se siguen para evitar ciclos) */
+  struct stat statbuf;
+  if (d_type == DT_UNKNOWN) {
+    if (fstatat(dir_fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+      return -1;
+    }
+    d_type = IFTODT(statbuf.st_mode);
+  }
+  if (d_type == DT_LNK) {
+    if (fstatat(dir_fd, name, &statbuf, 0) == -1) {
+      return -1;
+    }
+    return S_ISREG(statbuf.st_mode) ? DT_REG : DT_UNKNOWN;
+  }
+  return d_type == DT_DIR || d_type == DT_REG ? d_type : DT_UNKNOWN;
+}
+
+/* Lee un directorio: los subdirectorios van a la cola propia y los archivos
+ * con la extension a los resultados del hilo. Los subdirectorios se encolan
+ * por ruta completa y se abren con open() al procesarlos: guardar el
+ * descriptor del padre para un openat() dejaria un descriptor abierto por
+ * cada directorio en cola, y en arboles anchos eso agota RLIMIT_NOFILE */
+static void process_directory(walk_worker_t *worker, const char *directory) {
+  const char *extension = worker->walker->extension;
+
+  int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    config_matches_add(&worker->matches, strdup(directory), errno);
+    return;
+  }
+  DIR *dir = fdopendir(fd);
+  if (!dir) {
+    config_matches_add(&worker->matches, strdup(directory), errno);
+    close(fd);
+    return;
+  }
+
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *name = entry->d_name;
+    // Skip '.' and '..' directories
+    if (name[0] == '.' &&
+        (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+      continue;
+    }
+
+    int type = config_entry_type(dirfd(dir), name, entry->d_type);
+    if (type == -1) {
+      config_matches_add(&worker->matches, join_path(directory, name), errno);
+      continue;
+    }
+
+    if (type == DT_DIR) {
+      char *path = join_path(directory, name);
+      if (path) {
+        push_directory(worker, path);
+      }
+    } else if (type == DT_REG && has_extension(name, extension)) {
+      char *path = join_path(directory, name);
+      if (path) {
+        config_matches_add(&worker->matches, path, 0);
+      }
+    }
+  }
+
+  closedir(dir);
+}
+
+static char *find_work(walk_worker_t *worker) {
+  walker_t *walker = worker->walker;
+  char *path = deque_pop(&worker->deque);
+  if (path) {
+    return path;
+  }
+  // Robar empezando por el vecino para repartir las victimas
+  for (int i = 1; i < walker->num_workers; i++) {
+    walk_worker_t *victim =
+        &walker->workers[(worker->id + i) % walker->num_workers];
+    path = deque_steal(&victim->deque);
+    if (path) {
+      return path;
+    }
+  }
+  return NULL;
+}
+
+static void *walk_thread(void *arg) {
+  walk_worker_t *worker = arg;
+  walker_t *walker = worker->walker;
+
+  while (true) {
+    char *path = find_work(worker);
+    if (path) {
+      process_directory(worker, path);
+      free(path);
+      if (__atomic_sub_fetch(&walker->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+        // Ultimo directorio: despertar a todos para que terminen
+        pthread_mutex_lock(&walker->idle_lock);
+        pthread_cond_broadcast(&walker->idle_cond);
+        pthread_mutex_unlock(&walker->idle_lock);
+      }
+      continue;
+    }
+
+    if (__atomic_load_n(&walker->pending, __ATOMIC_SEQ_CST) == 0) {
+      break;
+    }
+
+    // Sin trabajo visible pero hay directorios en proceso: esperar un poco
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += IDLE_WAIT_NS;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&walker->idle_lock);
+    if (__atomic_load_n(&walker->pending, __ATOMIC_SEQ_CST) != 0) {
+      pthread_cond_timedwait(&walker->idle_cond, &walker->idle_lock,
+                             &deadline);
+    }
+    pthread_mutex_unlock(&walker->idle_lock);
+  }
+  return NULL;
+}
+
+static int compare_matches(const void *a, const void *b) {
+  const config_match_t *left = a;
+  const config_match_t *right = b;
+  return strcmp(left->path, right->path);
+}
+
+int search_directory_parallel(const char *directory, const char *extension,
+                              int num_threads, config_matches_t *matches) {
+  matches->items = NULL;
+  matches->count = 0;
+  matches->capacity = 0;
+
+  if (num_threads <= 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = cpus > 0 ? (int)cpus : 1;
+    if (num_threads > SEARCHCONFIG_DEFAULT_THREADS) {
+      num_threads = SEARCHCONFIG_DEFAULT_THREADS;
+    }
+  }
+  if (num_threads > SEARCHCONFIG_MAX_THREADS) {
+    num_threads = SEARCHCONFIG_MAX_THREADS;
+  }
+
+  walker_t walker;
+  walker.num_workers = num_threads;
+  walker.extension = extension;
+  walker.pending = 0;
+  walker.workers = calloc(num_threads, sizeof(walk_worker_t));
+  if (!walker.workers) {
+    fprintf(stderr, "Shell: memory allocation error\n");
+    return -1;
+  }
+  pthread_mutex_init(&walker.idle_lock, NULL);
+  pthread_cond_init(&walker.idle_cond, NULL);
+
+  for (int i = 0; i < num_threads; i++) {
+    walker.workers[i].walker = &walker;
+    walker.workers[i].id = i;
+    pthread_mutex_init(&walker.workers[i].deque.lock, NULL);
+  }
+
+  char *root = strdup(directory);
+  if (!root) {
+    fprintf(stderr, "Shell: memory allocation error\n");
+    free(walker.workers);
+    return -1;
+  }
+  push_directory(&walker.workers[0], root);
+
+  // El hilo actual hace de trabajador 0
+  int started = 1;
+  for (int i = 1; i < num_threads; i++) {
+    if (pthread_create(&walker.workers[i].thread, NULL, walk_thread,
+                       &walker.workers[i]) != 0) {
+      break;
+    }
+    started++;
+  }
+  walk_thread(&walker.workers[0]);
+  for (int i = 1; i < started; i++) {
+    pthread_join(walker.workers[i].thread, NULL);
+  }
+
+  // Unir los resultados de cada hilo y ordenarlos por ruta
+  size_t total = 0;
+  for (int i = 0; i < num_threads; i++) {
+    total += walker.workers[i].matches.count;
+  }
+  int status = 0;
+  if (total > 0) {
+    matches->items = malloc(total * sizeof(config_match_t));
+    if (!matches->items) {
+      fprintf(stderr, "Shell: memory allocation error\n");
+      status = -1;
+    }
+  }
+  for (int i = 0; i < num_threads; i++) {
+    config_matches_t *own = &walker.workers[i].matches;
+    if (status == 0 && own->count > 0) {
+      memcpy(matches->items + matches->count, own->items,
+             own->count * sizeof(config_match_t));
+      matches->count += own->count;
+      free(own->items);
+    } else {
+      config_matches_free(own);
+    }
+    free(walker.workers[i].deque.items);
+    pthread_mutex_destroy(&walker.workers[i].deque.lock);
+  }
+  matches->capacity = matches->count;
+  qsort(matches->items, matches->count, sizeof(config_match_t),
+        compare_matches);
+
+  pthread_cond_destroy(&walker.idle_cond);
+  pthread_mutex_destroy(&walker.idle_lock);
+  free(walker.workers);
+  return status;
+}
+
+void print_config_matches(const config_matches_t *matches,
+                          const char *pattern) {
+  // La salida se produce una vez terminado el recorrido, en orden de ruta
+  for (size_t i = 0; i < matches->count; i++) {
+    const config_match_t *match = &matches->items[i];
+    if (match->error) {
+      fflush(stdout);
+      fprintf(stderr, "%s: %s\n", match->path, strerror(match->error));
+      continue;
+    }
+    if (pattern) {
+      print_matching_lines(match->path, pattern);
+      continue;
+    }
+    printf("\nConfiguration file found: %s\n", match->path);
+    print_file_content(match->path);
+  }
+}
+
+void search_directory_recursive(const char *directory, const char *extension,
+                                int num_threads, const char *pattern) {
+  config_matches_t matches;
+  if (search_directory_parallel(directory, extension, num_threads, &matches) ==
+      -1) {
+    return;
+  }
+  print_config_matches(&matches, pattern);
+  config_matches_free(&matches);
+}
+
+// Helper function to check if a filename has the given extension
+int has_extension(const char *filename, const char *extension) {
+  const char *dot = strrchr(filename, '.');
+  if (!dot || dot == filename)
+    return 0;
+  return strcmp(dot, extension) == 0;
+}
+
+/* Copia con read/write cuando sendfile no acepta el destino */
+static void copy_file_content(int fd, off_t offset) {
+  char buffer[COPY_BUFFER_SIZE];
+  if (lseek(fd, offset, SEEK_SET) == -1) {
+    return;
+  }
+  ssize_t bytes_read;
+  while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
+    ssize_t written = 0;
+    while (written < bytes_read) {
+      ssize_t n = write(STDOUT_FILENO, buffer + written, bytes_read - written);
+      if (n == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      written += n;
+    }
+  }
+}
+
+// Helper function to print the content of a file
+void print_file_content(const char *filepath) {
+  printf("Content of %s:\n", filepath);
+
+  int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    perror(filepath);
+    return;
+  }
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == -1) {
+    perror(filepath);
+    close(fd);
+    return;
+  }
+
+  // El contenido va directo del page cache al descriptor de salida
+  fflush(stdout);
+  off_t offset = 0;
+  while (offset < statbuf.st_size) {
+    ssize_t sent =
+        sendfile(STDOUT_FILENO, fd, &offset, statbuf.st_size - offset);
+    if (sent == -1 && errno == EINTR) {
+      continue;
+    }
+    if (sent == -1 && (errno == EINVAL || errno == ENOSYS)) {
+      copy_file_content(fd, offset);
+      break;
+    }
+    if (sent <= 0) {
+      break; // Error de escritura o el archivo se achico
+    }
+  }
+  close(fd);
+}
+
+void print_matching_lines(const char *filepath, const char *pattern) {
+  size_t pattern_len = strlen(pattern);
+  int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    perror(filepath);
+    return;
+  }
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == -1) {
+    perror(filepath);
+    close(fd);
+    return;
+  }
+  if (statbuf.st_size == 0 || pattern_len == 0) {
+    close(fd);
+    return;
+  }
+
+  size_t size = (size_t)statbuf.st_size;
+  char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror(filepath);
+    return;
+  }
+  madvise(data, size, MADV_SEQUENTIAL);
+
+  const char *end = data + size;
+  const char *cursor = data; // Inicio de la linea actual
+  size_t line = 1;
+  while (cursor < end) {
+    /* memchr y memmem de glibc estan vectorizados: se busca el patron en
+     * todo el resto del archivo y recien despues se cuentan las lineas */
+    const char *found =
+        pattern_len == 1
+            ? memchr(cursor, pattern[0], end - cursor)
+            : memmem(cursor, end - cursor, pattern, pattern_len);
+    if (!found) {
+      break;
+    }
+
+    const char *newline;
+    while ((newline = memchr(cursor, '\n', found - cursor)) != NULL) {
+      cursor = newline + 1;
+      line++;
+    }
+
+    const char *line_end = memchr(found, '\n', end - found);
+    if (!line_end) {
+      line_end = end;
+    }
+    printf("%s:%zu: %.*s\n", filepath, line, (int)(line_end - cursor),
+           cursor);
+
+    // Una sola vez por linea aunque el patron aparezca varias veces
+    cursor = line_end + 1;
+    line++;
+  }
+
+  munmap(data, size);
+}
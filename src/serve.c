@@ -0,0 +1,314 @@
+#define _GNU_SOURCE
+#include "serve.h"
+#include "heredoc.h"
+#include "shell.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SERVE_REAP_MS 1000 // Cada cuanto se recogen las conexiones cerradas
+
+static volatile sig_atomic_t stop_flag = 0;
+
+static void stop_handler(int signo) {
+  (void)signo;
+  stop_flag = 1;
+}
+
+/* Un pedido ya separado; las cadenas apuntan al mensaje recibido */
+typedef struct {
+  const char *cwd;
+  char *line;
+  char *env; // Primer cambio del entorno
+  char *end;
+} request_t;
+
+static void close_fds(int *fds, int count) {
+  for (int i = 0; i < count; i++) {
+    close(fds[i]);
+  }
+}
+
+/* Recibe un pedido y sus descriptores. 0 al cerrarse la conexion, -1 si el
+ * mensaje no es un pedido valido */
+static int receive(int conn, char *data, request_t *request,
+                   int fds[SERVE_FDS]) {
+  union {
+    char buffer[CMSG_SPACE(SERVE_FDS * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = {data, SERVE_REQUEST_MAX};
+  struct msghdr message = {0};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  ssize_t length;
+  do {
+    length = recvmsg(conn, &message, MSG_CMSG_CLOEXEC);
+  } while (length == -1 && errno == EINTR);
+  if (length <= 0) {
+    return 0;
+  }
+
+  int received = 0;
+  for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message); cmsg;
+       cmsg = CMSG_NXTHDR(&message, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      memcpy(fds, CMSG_DATA(cmsg), received * sizeof(int));
+    }
+  }
+
+  // Magia, directorio y linea, cada cadena terminada en '\0'
+  size_t magic = strlen(SERVE_MAGIC);
+  int valid = received == SERVE_FDS &&
+              !(message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) &&
+              (size_t)length > magic && data[length - 1] == '\0' &&
+              memcmp(data, SERVE_MAGIC, magic) == 0;
+  if (valid) {
+    request->cwd = data + magic;
+    request->line = data + magic + strlen(request->cwd) + 1;
+    request->end = data + length;
+    valid = request->line < request->end;
+  }
+  if (!valid) {
+    close_fds(fds, received);
+    return -1;
+  }
+  request->env = request->line + strlen(request->line) + 1;
+  return 1;
+}
+
+/* Corre cada linea del pedido como lo hace execute_batch_file, sin avisar
+ * del fin del archivo en la salida del cliente */
+static void run_lines(FILE *script) {
+  char *command = NULL;
+  size_t size = 0;
+  while (getline(&command, &size, script) != -1) {
+    command[strcspn(command, "\n")] = '\0';
+    if (command[0] == '\0' || command[0] == '#') {
+      continue;
+    }
+    if (heredoc_collect(command, script) == -1) {
+      heredoc_discard();
+      continue;
+    }
+    if (execute_command(command) == 0) {
+      break;
+    }
+  }
+  free(command);
+}
+
+/* En el hijo: toma los descriptores, el directorio y el entorno del cliente y
+ * corre sus lineas */
+static void run_request(const request_t *request, int fds[SERVE_FDS]) {
+  setpgid(0, 0); // Para matar la linea entera si el cliente se va
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGPIPE, SIG_DFL);
+
+  for (int i = 0; i < SERVE_FDS; i++) {
+    if (dup2(fds[i], i) == -1) {
+      _exit(EXIT_FAILURE);
+    }
+  }
+  if (*request->cwd && chdir(request->cwd) == -1) {
+    fprintf(stderr, "Shell: %s: %s\n", request->cwd, strerror(errno));
+    _exit(EXIT_FAILURE);
+  }
+  for (char *change = request->env; change < request->end;
+       change += strlen(change) + 1) {
+    char *equals = strchr(change, '=');
+    if (equals) {
+      *equals = '\0';
+      setenv(change, equals + 1, 1);
+    } else {
+      unsetenv(change);
+    }
+  }
+
+  FILE *script = fmemopen(request->line, strlen(request->line), "r");
+  if (!script) {
+    perror("Shell: fmemopen");
+    _exit(EXIT_FAILURE);
+  }
+  run_lines(script);
+  fclose(script);
+  fflush(NULL);
+  _exit(last_status);
+}
+
+/* Espera a la linea; si el cliente cierra la conexion antes, la mata */
+static int wait_request(int conn, pid_t pid) {
+  int pidfd = syscall(SYS_pidfd_open, pid, 0);
+  while (pidfd != -1) {
+    struct pollfd fds[2] = {{conn, POLLRDHUP, 0}, {pidfd, POLLIN, 0}};
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[0].revents && !fds[1].revents) {
+      kill(-pid, SIGTERM);
+    }
+    break;
+  }
+  if (pidfd != -1) {
+    close(pidfd);
+  }
+
+  int status;
+  while (waitpid(pid, &status, 0) == -1) {
+    if (errno != EINTR) {
+      return EXIT_FAILURE;
+    }
+  }
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : EXIT_FAILURE;
+}
+
+/* En el hijo que atiende una conexion: un pedido tras otro hasta que el
+ * cliente cierra */
+static void serve_connection(int conn) {
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  char *data = malloc(SERVE_REQUEST_MAX);
+  if (!data) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    _exit(EXIT_FAILURE);
+  }
+
+  request_t request;
+  int fds[SERVE_FDS];
+  while (receive(conn, data, &request, fds) == 1) {
+    fflush(NULL); // Que el hijo no herede salida pendiente
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(conn);
+      run_request(&request, fds);
+    }
+    close_fds(fds, SERVE_FDS);
+    int status = pid == -1 ? EXIT_FAILURE : wait_request(conn, pid);
+    if (send(conn, &status, sizeof(status), MSG_NOSIGNAL) == -1) {
+      break;
+    }
+  }
+  // Un mensaje invalido tambien cierra la conexion
+  free(data);
+  close(conn);
+  _exit(EXIT_SUCCESS);
+}
+
+/* Solo se atiende a procesos del mismo usuario, o de root */
+static int trusted(int conn) {
+  struct ucred cred;
+  socklen_t length = sizeof(cred);
+  if (getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &length) == -1) {
+    return 0;
+  }
+  return cred.uid == geteuid() || cred.uid == 0;
+}
+
+/* Crea el socket; uno abandonado se reemplaza, uno atendido es un error */
+static int listen_on(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int live = serve_connect(path);
+  if (live != -1) {
+    close(live);
+    errno = EADDRINUSE;
+    return -1;
+  }
+  unlink(path);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  mode_t previous = umask(0177);
+  int bound = bind(fd, (struct sockaddr *)&address, sizeof(address));
+  umask(previous);
+  if (bound == -1 || listen(fd, SOMAXCONN) == -1) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+int serve_run(const char *path) {
+  int listen_fd = listen_on(path);
+  if (listen_fd == -1) {
+    fprintf(stderr, "Shell: cannot serve on %s: %s\n", path, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  // Sin SA_RESTART, para que la senial despierte al poll
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stop_handler;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGCHLD, SIG_DFL);
+  stop_flag = 0;
+  fprintf(stderr, "Shell: serving on %s\n", path);
+
+  while (!stop_flag) {
+    // Recoger las conexiones que terminaron
+    while (waitpid(-1, NULL, WNOHANG) > 0) {
+    }
+    struct pollfd pfd = {listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, SERVE_REAP_MS) <= 0) {
+      continue;
+    }
+    int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (conn == -1) {
+      continue;
+    }
+    if (!trusted(conn)) {
+      close(conn);
+      continue;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(listen_fd);
+      serve_connection(conn);
+    } else if (pid == -1) {
+      perror("Shell: fork");
+    }
+    close(conn);
+  }
+
+  // Las conexiones abiertas terminan su pedido en curso por su cuenta
+  close(listen_fd);
+  unlink(path);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  return EXIT_SUCCESS;
+}
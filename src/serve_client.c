@@ -0,0 +1,106 @@
+#define _GNU_SOURCE
+#include "serve.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Lado del cliente del protocolo; no depende del resto de la shell, asi el
+ * cliente no carga readline */
+
+int serve_connect(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+/* Agrega text con su '\0' al pedido */
+static int append(char *request, size_t *length, const char *text) {
+  size_t size = strlen(text) + 1;
+  if (*length + size > SERVE_REQUEST_MAX) {
+    errno = E2BIG;
+    return -1;
+  }
+  memcpy(request + *length, text, size);
+  *length += size;
+  return 0;
+}
+
+int serve_send_request(int sock, const char *cwd, const char *line,
+                       char *const env[], const int fds[SERVE_FDS]) {
+  char *request = malloc(SERVE_REQUEST_MAX);
+  if (!request) {
+    return -1;
+  }
+  size_t length = strlen(SERVE_MAGIC);
+  memcpy(request, SERVE_MAGIC, length);
+  int result = append(request, &length, cwd ? cwd : "");
+  if (result == 0) {
+    result = append(request, &length, line);
+  }
+  for (int i = 0; env && env[i] && result == 0; i++) {
+    result = append(request, &length, env[i]);
+  }
+  if (result == -1) {
+    free(request);
+    return -1;
+  }
+
+  // Los descriptores viajan como datos auxiliares del mismo mensaje
+  union {
+    char buffer[CMSG_SPACE(SERVE_FDS * sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+  struct iovec iov = {request, length};
+  struct msghdr message = {0};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(SERVE_FDS * sizeof(int));
+  memcpy(CMSG_DATA(cmsg), fds, SERVE_FDS * sizeof(int));
+
+  ssize_t sent;
+  do {
+    sent = sendmsg(sock, &message, MSG_NOSIGNAL);
+  } while (sent == -1 && errno == EINTR);
+  free(request);
+  return sent == (ssize_t)length ? 0 : -1;
+}
+
+int serve_recv_status(int sock, int *status) {
+  ssize_t received;
+  do {
+    received = recv(sock, status, sizeof(*status), 0);
+  } while (received == -1 && errno == EINTR);
+  if (received != sizeof(*status)) {
+    if (received >= 0) {
+      errno = ECONNRESET; // El servidor cerro sin responder
+    }
+    return -1;
+  }
+  return 0;
+}
@@ -1,6 +1,15 @@
 #include "shell.h"
 #include "commands.h"
+#include "completion.h"
+#include "heredoc.h"
+#include "history_log.h"
+#include "metrics_demand.h"
+#include "metrics_history.h"
+#include "monitor_supervisor.h"
 #include "parse.h"
+#include "shell_stats.h"
+#include "trace.h"
+#include "triggers.h"
 #include <bits/posix1_lim.h>
 #include <dirent.h>
 #include <errno.h>
@@ -14,16 +23,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 // Buffer Sizes
 #define INPUT_BUFFER_SIZE 1024 // Buffer size for input in read_command()
 #define PROMPT_BUFFER_SIZE 256 // Buffer size for the prompt in read_command()
 
+// Persistent history
+#define HISTORY_READLINE_ENTRIES 1000 // Commands loaded for the arrow keys
+#define HISTORY_SEARCH_MATCHES 64     // Matches Ctrl-R steps through
+
 // Job ID Initialization
 #define INITIAL_JOB_ID 1 // Initial ID for job tracking in add_job()
 
@@ -56,6 +71,7 @@
 static job_t *job_list = NULL;
 static int next_job_id = INITIAL_JOB_ID;
 pid_t foreground_pid = 0;
+int last_status = 0;
 struct termios orig_termios;
 volatile sig_atomic_t sigchld_flag = 0;
 
@@ -136,6 +152,50 @@ void init_shell() {
     perror("shell: sigaction SIGQUIT");
     exit(EXIT_FAILURE);
   }
+
+  // Trabajo periodico mientras readline espera una linea
+  rl_event_hook = shell_tick;
+
+  // Metricas propias de la shell, para Prometheus
+  const char *stats_socket = getenv(SHELL_STATS_SOCKET_ENV);
+  if (stats_socket && *stats_socket &&
+      shell_stats_listen(stats_socket) == -1) {
+    perror("shell: metrics socket");
+  }
+
+  // Linea de tiempo de la ejecucion, para Perfetto
+  const char *trace_file = getenv(SHELL_TRACE_ENV);
+  if (trace_file && *trace_file && trace_start(trace_file) == -1) {
+    fprintf(stderr, "shell: cannot trace to %s\n", trace_file);
+  }
+}
+
+int shell_tick(void) {
+  // Reaping enseguida deja el tiempo de los trabajos cerca del real
+  if (sigchld_flag) {
+    sigchld_flag = 0;
+    sigchld_handler_logic();
+  }
+  // Las reglas necesitan muestras a la tasa configurada
+  if (triggers_count() > 0) {
+    metrics_demand_touch(METRICS_DEMAND_LEASE_SECONDS);
+  }
+  metrics_history_poll(triggers_evaluate);
+
+  if (triggers_pending() > 0 || monitor_supervise_pending()) {
+    // Si readline esta esperando una linea, no escribir sobre el prompt
+    int in_prompt = RL_ISSTATE(RL_STATE_READCMD);
+    if (in_prompt) {
+      printf("\n");
+    }
+    triggers_run_pending();
+    monitor_supervise();
+    if (in_prompt) {
+      rl_on_new_line();
+      rl_redisplay();
+    }
+  }
+  return 0;
 }
 
 char *read_command(FILE *input_stream) {
@@ -195,6 +255,21 @@ char *read_command(FILE *input_stream) {
 }
 
 int execute_command(char *command) {
+  last_status = 0; // Lo cambian los comandos externos en primer plano
+
+  /* 'trigger' recibe la linea sin separar: la regla lleva '>' o '<' y la
+   * accion puede tener sus propios pipes y redirecciones */
+  const char *start = command + strspn(command, " \t");
+  if (strncmp(start, "trigger", 7) == 0 &&
+      (start[7] == '\0' || start[7] == ' ' || start[7] == '\t')) {
+    return cmd_trigger(start);
+  }
+  // 'time' mide la linea completa, con pipes incluidos
+  if (strncmp(start, "time", 4) == 0 &&
+      (start[4] == '\0' || start[4] == ' ' || start[4] == '\t')) {
+    return cmd_time(start);
+  }
+
   /* Verificar si el comando contiene '|'
    * Si el comando tiene pipes, los divide y ejecuta de forma encadenada
    * Si el comando NO tiene pipes, ejecuta directamente
@@ -207,10 +282,24 @@ int execute_command(char *command) {
      * Commands es un array de cadenas, cada token contiene un comando a
      * ejecutar.
      */
+    trace_begin("split_pipes", NULL);
     char **commands = split_by_pipes(command, &num_commands);
+    trace_end("split_pipes");
+    if (!commands) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      heredoc_discard();
+      last_status = 1;
+      return 1;
+    }
 
-    /* Ejecuta los comandos de forma encadenada */
-    int status = execute_piped_commands(commands, num_commands);
+    /* Ejecuta los comandos de forma encadenada. Si el unico '|' estaba dentro
+     * de comillas o de una sustitucion <( ... ), es un comando simple */
+    int status;
+    if (num_commands == 1) {
+      status = execute_single_command(commands[0]);
+    } else {
+      status = execute_piped_commands(commands, num_commands);
+    }
 
     // Liberar memoria
     for (int i = 0; i < num_commands; i++) {
@@ -218,10 +307,14 @@ int execute_command(char *command) {
     }
     free(commands);
 
+    // Descartar here-documents que ninguna etapa consumio
+    heredoc_discard();
     return status;
   } else {
     // No contiene pipes, ejecutar normalmente
-    return execute_single_command(command);
+    int status = execute_single_command(command);
+    heredoc_discard();
+    return status;
   }
 }
 
@@ -229,14 +322,35 @@ int execute_command(char *command) {
 int execute_batch_file(FILE *batch_file) {
   char *command;
 
-  while ((command = read_command(batch_file)) != NULL) {
+  while (1) {
+    trace_begin("read_line", NULL);
+    command = read_command(batch_file);
+    trace_end("read_line");
+    if (command == NULL) {
+      break;
+    }
+
     // Ignorar líneas vacías y comentarios
     if (strlen(command) == 0 || command[0] == '#') {
       continue;
     }
 
-    // Ejecutar el comando
-    if (execute_command(command) == 0) {
+    // Leer los cuerpos de los here-documents de las lineas siguientes
+    trace_begin("heredoc", NULL);
+    int collected = heredoc_collect(command, batch_file);
+    trace_end("heredoc");
+    if (collected == -1) {
+      heredoc_discard();
+      continue;
+    }
+
+    shell_tick();
+
+    // Ejecutar el comando, un tramo por linea en la traza
+    trace_begin("line", command);
+    int status = execute_command(command);
+    trace_end("line");
+    if (status == 0) {
       break; // Salir de la shell si execute_command retorna 0
     }
   }
@@ -244,6 +358,82 @@ int execute_batch_file(FILE *batch_file) {
   return 1;
 }
 
+/* Estado de CTRL-R: las coincidencias de la ultima busqueda */
+static char *search_matches[HISTORY_SEARCH_MATCHES];
+static size_t search_found = 0;
+static size_t search_next = 0;
+static char *search_shown = NULL; // Lo que puso el ultimo CTRL-R
+
+static void search_reset(void) {
+  for (size_t i = 0; i < search_found; i++) {
+    free(search_matches[i]);
+  }
+  search_found = search_next = 0;
+  free(search_shown);
+  search_shown = NULL;
+}
+
+/* CTRL-R busca lo escrito; repetido sobre su propio resultado, sigue con la
+ * coincidencia anterior en el tiempo */
+static int history_search_key(int count, int key) {
+  (void)count;
+  (void)key;
+  if (!search_shown || strcmp(rl_line_buffer, search_shown) != 0) {
+    search_reset();
+    history_entry_t matches[HISTORY_SEARCH_MATCHES];
+    size_t found =
+        history_log_search(rl_line_buffer, matches, HISTORY_SEARCH_MATCHES);
+    for (size_t i = 0; i < found; i++) {
+      // La linea tal cual ya esta en pantalla
+      if (strcmp(matches[i].command, rl_line_buffer) == 0) {
+        continue;
+      }
+      search_matches[search_found] = strdup(matches[i].command);
+      if (search_matches[search_found]) {
+        search_found++;
+      }
+    }
+  }
+  if (search_next >= search_found) {
+    rl_ding();
+    return 0;
+  }
+  rl_replace_line(search_matches[search_next++], 0);
+  rl_point = rl_end;
+  free(search_shown);
+  search_shown = strdup(rl_line_buffer);
+  return 0;
+}
+
+void shell_history_start(void) {
+  const char *path = history_log_default_path();
+  if (!path) {
+    return;
+  }
+  if (history_log_open(path) == -1) {
+    fprintf(stderr, "Shell: history %s: %s\n", path, strerror(errno));
+    return;
+  }
+  history_entry_t *recent =
+      malloc(HISTORY_READLINE_ENTRIES * sizeof(history_entry_t));
+  if (recent) {
+    size_t count = history_log_recent(recent, HISTORY_READLINE_ENTRIES);
+    // Readline quiere el mas viejo primero
+    while (count > 0) {
+      add_history(recent[--count].command);
+    }
+    free(recent);
+  }
+  rl_bind_keyseq("\\C-r", history_search_key);
+}
+
+void shell_history_record(const char *line, const char *cwd,
+                          int64_t start_ns, uint64_t duration_ns) {
+  if (*line != '\0' && *line != ' ') { // Como HISTCONTROL=ignorespace
+    history_log_append(line, cwd, last_status, start_ns, duration_ns);
+  }
+}
+
 void cleanup_shell() {
   // Limpiar la lista de trabajos en segundo plano
   job_t *current = job_list;
@@ -251,10 +441,22 @@ void cleanup_shell() {
     job_t *temp = current;
     current = current->next;
     /* Libero memoria de los nodos y las cadenas asociadas  */
+    proc_file_close(&temp->stat);
+    proc_file_close(&temp->status_file);
     free(temp->command);
     free(temp);
   }
   job_list = NULL;
+  shell_stats_close();
+  search_reset();
+  history_log_close();
+  completion_clear();
+}
+
+static double monotonic_seconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
 }
 
 int add_job(pid_t pid, const char *command) {
@@ -272,46 +474,161 @@ int add_job(pid_t pid, const char *command) {
     free(new_job);
     return -1;
   }
+  new_job->started = monotonic_seconds();
+  new_job->done = 0;
+  new_job->status = 0;
+  memset(&new_job->usage, 0, sizeof(new_job->usage));
+  // Los archivos de /proc se abren al primer 'jobs -l'
+  new_job->stat.fd = -1;
+  new_job->status_file.fd = -1;
+  shell_stats_count(SHELL_COUNTER_JOBS_STARTED);
+  shell_stats_gauge_add(SHELL_GAUGE_JOBS_RUNNING, 1);
   new_job->next = job_list; // Primer elemento de la lista
   job_list = new_job;       // El puntero job_list apunta al nuevo trabajo
   return new_job->job_id;   // Para rastrear el proceso
 }
 
+/* Saca un trabajo de la lista y libera su memoria */
+static void unlink_job(job_t *job) {
+  job_t **link = &job_list;
+  while (*link != NULL && *link != job) {
+    link = &(*link)->next;
+  }
+  if (*link == NULL) {
+    return;
+  }
+  *link = job->next;
+  if (!job->done) {
+    shell_stats_gauge_add(SHELL_GAUGE_JOBS_RUNNING, -1);
+  }
+  proc_file_close(&job->stat);
+  proc_file_close(&job->status_file);
+  free(job->command);
+  free(job);
+}
+
 void remove_job(pid_t pid) {
   /* Busca un trabajo en la lista enlazada usando el pid, eliminando el proceso
    * al encontrarlo y liberando la memoria asignada.
    */
   job_t *current = job_list;
-  job_t *prev = NULL;
+  while (current != NULL && current->pid != pid) {
+    current = current->next;
+  }
+  if (current != NULL) {
+    unlink_job(current);
+  }
+}
 
+int finish_job(pid_t pid, int status, const struct rusage *usage) {
+  // Un PID reciclado puede estar tambien en un trabajo ya terminado
+  job_t *job = job_list;
+  while (job != NULL && (job->pid != pid || job->done)) {
+    job = job->next;
+  }
+  if (job == NULL) {
+    return 0;
+  }
+  job->done = 1;
+  job->status = status;
+  trace_end_on(pid, "run");
+  shell_stats_gauge_add(SHELL_GAUGE_JOBS_RUNNING, -1);
+  memset(&job->usage, 0, sizeof(job->usage));
+  job->usage.wall = monotonic_seconds() - job->started;
+  job_usage_add_rusage(&job->usage, usage);
+  // El proceso ya no existe, sus archivos de /proc solo darian ESRCH
+  proc_file_close(&job->stat);
+  proc_file_close(&job->status_file);
+
+  // La lista va del mas nuevo al mas viejo: sobran los ultimos terminados
+  int kept = 0;
+  job_t *current = job_list;
   while (current != NULL) {
-    if (current->pid == pid) {
-      if (prev == NULL) {
-        job_list = current->next;
-      } else {
-        prev->next = current->next;
-      }
-      free(current->command);
-      free(current);
-      return;
+    job_t *next = current->next;
+    if (current->done && ++kept > MAX_DONE_JOBS) {
+      unlink_job(current);
     }
-    prev = current;
-    current = current->next;
+    current = next;
+  }
+  return 1;
+}
+
+/* Una linea de 'jobs': estado y, con details, PID y recursos usados */
+static void print_job(job_t *job, int details) {
+  char state[32];
+  if (!job->done) {
+    snprintf(state, sizeof(state), "Running");
+  } else if (WIFSIGNALED(job->status)) {
+    snprintf(state, sizeof(state), "Killed (%s)",
+             strsignal(WTERMSIG(job->status)));
+  } else if (WEXITSTATUS(job->status) != 0) {
+    snprintf(state, sizeof(state), "Exit %d", WEXITSTATUS(job->status));
+  } else {
+    snprintf(state, sizeof(state), "Done");
+  }
+
+  if (!details) {
+    printf("[%d]  %-12s %s\n", job->job_id, state, job->command);
+    return;
+  }
+  if (!job->done) {
+    // Los archivos quedan abiertos: cada 'jobs -l' es un pread por archivo
+    if (job->stat.fd == -1) {
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "/proc/%d/stat", job->pid);
+      proc_file_open(&job->stat, path);
+      snprintf(path, sizeof(path), "/proc/%d/status", job->pid);
+      proc_file_open(&job->status_file, path);
+    }
+    job->usage.wall = monotonic_seconds() - job->started;
+    job_usage_sample(&job->stat, &job->status_file, &job->usage);
+  }
+  printf("[%d]  %d %-12s %s\n     ", job->job_id, job->pid, state,
+         job->command);
+  job_usage_print_short(stdout, &job->usage);
+  printf("\n");
+}
+
+/* La lista va del mas nuevo al mas viejo: se imprime desde el final */
+static void print_job_list(job_t *job, int details) {
+  if (job == NULL) {
+    return;
+  }
+  print_job_list(job->next, details);
+  print_job(job, details);
+}
+
+void print_jobs(int details) {
+  print_job_list(job_list, details);
+
+  // Los terminados se informan una sola vez
+  job_t *current = job_list;
+  while (current != NULL) {
+    job_t *next = current->next;
+    if (current->done) {
+      unlink_job(current);
+    }
+    current = next;
   }
 }
 
 void sigchld_handler_logic() {
   pid_t pid;
   int status;
+  struct rusage usage;
 
   // Esperar a todos los procesos hijos que han terminado
-  while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-    remove_job(pid); // Remover el trabajo del proceso terminado
+  while ((pid = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+    if (monitor_reaped(pid, status)) {
+      continue; // El supervisor decide si reiniciarlo
+    }
+    // Guardar el estado y los recursos usados para 'jobs'
+    finish_job(pid, status, &usage);
     fflush(stdout);
   }
 
   if (pid == -1 && errno != ECHILD) {
-    perror("waitpid");
+    perror("wait4");
   }
 }
 
@@ -0,0 +1,442 @@
+#define _GNU_SOURCE
+#include "shell_stats.h"
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SUB_BUCKETS (1u << SHELL_STATS_SUB_BITS)
+#define LARGEST_VALUE ((1ull << SHELL_STATS_MAX_BITS) - 1)
+#define REQUEST_WAIT_MS 100 // Espera por un pedido HTTP antes de responder
+#define REQUEST_SIZE 1024
+#define RENDER_INITIAL_SIZE 8192
+
+/* Lo que registra un hilo; solo ese hilo escribe, los lectores suman */
+struct stats_shard {
+  uint64_t counters[SHELL_COUNTER_COUNT];
+  struct {
+    uint64_t sum;
+    uint64_t buckets[SHELL_STATS_BUCKETS];
+  } histograms[SHELL_HIST_COUNT];
+  int in_use;               // 0: el hilo termino, otro puede adoptarlo
+  struct stats_shard *next; // Lista que solo crece
+};
+
+static struct stats_shard *shards = NULL;
+static __thread struct stats_shard *local_shard = NULL;
+static pthread_key_t release_key;
+static pthread_once_t release_once = PTHREAD_ONCE_INIT;
+static int64_t gauges[SHELL_GAUGE_COUNT];
+
+static const double duration_bounds[] = {
+    1e-6, 2.5e-6, 5e-6, 1e-5, 2.5e-5, 5e-5, 1e-4, 2.5e-4, 5e-4, 1e-3,
+    2.5e-3, 5e-3, 1e-2, 2.5e-2, 5e-2, 0.1, 0.25, 0.5, 1, 0};
+static const double stage_bounds[] = {1, 2, 3, 4, 6, 8, 12, 16, 32, 0};
+
+/* Como se exporta cada histograma */
+static const struct {
+  const char *name;
+  const char *help;
+  double scale;         // Unidad exportada por unidad registrada
+  const double *bounds; // Limites 'le' en unidades exportadas, hasta un 0
+} histograms[SHELL_HIST_COUNT] = {
+    {"shell_parse_duration_seconds", "Time to parse one command.", 1e-9,
+     duration_bounds},
+    {"shell_fork_duration_seconds", "Time spent in the fork() call.", 1e-9,
+     duration_bounds},
+    {"shell_spawn_duration_seconds",
+     "Time from fork() to a successful exec of the command.", 1e-9,
+     duration_bounds},
+    {"shell_pipeline_stages", "Commands in each pipeline.", 1, stage_bounds},
+};
+
+static const struct {
+  const char *name;
+  const char *help;
+} counters[SHELL_COUNTER_COUNT] = {
+    {"shell_exec_failures_total", "Commands that could not be executed."},
+    {"shell_path_cache_hits_total", "Commands found in the PATH cache."},
+    {"shell_path_cache_misses_total", "Commands searched for in PATH."},
+    {"shell_jobs_started_total", "Background jobs started."},
+    {"shell_memo_hits_total", "memo results replayed from the cache."},
+    {"shell_memo_misses_total", "memo commands that had to run."},
+    {"shell_memo_evictions_total", "memo entries evicted by the size limit."},
+};
+
+static const struct {
+  const char *name;
+  const char *help;
+} gauge_info[SHELL_GAUGE_COUNT] = {
+    {"shell_jobs_running", "Background jobs not reaped yet."},
+};
+
+static void release_shard(void *shard) {
+  __atomic_store_n(&((struct stats_shard *)shard)->in_use, 0,
+                   __ATOMIC_RELEASE);
+}
+
+static void create_release_key(void) {
+  pthread_key_create(&release_key, release_shard);
+}
+
+/* El shard del hilo: uno que dejo un hilo terminado, o uno nuevo */
+static struct stats_shard *get_shard(void) {
+  if (local_shard) {
+    return local_shard;
+  }
+  pthread_once(&release_once, create_release_key);
+
+  struct stats_shard *shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+  for (; shard; shard = shard->next) {
+    int unused = 0;
+    if (__atomic_compare_exchange_n(&shard->in_use, &unused, 1, 0,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+  if (!shard) {
+    shard = calloc(1, sizeof(*shard));
+    if (!shard) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+    shard->in_use = 1;
+    shard->next = __atomic_load_n(&shards, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&shards, &shard->next, shard, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+  }
+  // Al terminar el hilo, el shard (con sus cuentas) queda para otro
+  pthread_setspecific(release_key, shard);
+  local_shard = shard;
+  return shard;
+}
+
+/* Suma sin instruccion atomica: este hilo es el unico que escribe */
+static void add(uint64_t *slot, uint64_t value) {
+  __atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + value,
+                   __ATOMIC_RELAXED);
+}
+
+static size_t bucket_of(uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return value;
+  }
+  if (value > LARGEST_VALUE) {
+    value = LARGEST_VALUE;
+  }
+  // Los SUB_BITS bits que siguen al uno mas alto eligen el sub-bucket
+  int shift = 63 - __builtin_clzll(value) - SHELL_STATS_SUB_BITS;
+  return (size_t)(shift + 1) * SUB_BUCKETS +
+         ((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+static uint64_t bucket_upper(size_t bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  int shift = bucket / SUB_BUCKETS - 1;
+  uint64_t lower = (uint64_t)(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+  return lower + (1ull << shift) - 1;
+}
+
+uint64_t shell_stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+void shell_stats_record(shell_histogram_t histogram, uint64_t value) {
+  struct stats_shard *shard = get_shard();
+  add(&shard->histograms[histogram].buckets[bucket_of(value)], 1);
+  add(&shard->histograms[histogram].sum, value);
+}
+
+void shell_stats_since(shell_histogram_t histogram, uint64_t start) {
+  shell_stats_record(histogram, shell_stats_now() - start);
+}
+
+void shell_stats_count(shell_counter_t counter) {
+  add(&get_shard()->counters[counter], 1);
+}
+
+void shell_stats_gauge_add(shell_gauge_t gauge, int64_t delta) {
+  __atomic_add_fetch(&gauges[gauge], delta, __ATOMIC_RELAXED);
+}
+
+uint64_t shell_stats_counter(shell_counter_t counter) {
+  uint64_t total = 0;
+  struct stats_shard *shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+  for (; shard; shard = shard->next) {
+    total += __atomic_load_n(&shard->counters[counter], __ATOMIC_RELAXED);
+  }
+  return total;
+}
+
+void shell_stats_snapshot(shell_histogram_t histogram,
+                          shell_histogram_snapshot_t *snapshot) {
+  memset(snapshot, 0, sizeof(*snapshot));
+  struct stats_shard *shard = __atomic_load_n(&shards, __ATOMIC_ACQUIRE);
+  for (; shard; shard = shard->next) {
+    const uint64_t *buckets = shard->histograms[histogram].buckets;
+    for (size_t i = 0; i < SHELL_STATS_BUCKETS; i++) {
+      uint64_t count = __atomic_load_n(&buckets[i], __ATOMIC_RELAXED);
+      snapshot->buckets[i] += count;
+      // La cuenta sale de los buckets: cuadra aunque otro hilo este
+      // registrando
+      snapshot->count += count;
+    }
+    snapshot->sum +=
+        __atomic_load_n(&shard->histograms[histogram].sum, __ATOMIC_RELAXED);
+  }
+}
+
+uint64_t shell_stats_quantile(const shell_histogram_snapshot_t *snapshot,
+                              double quantile) {
+  if (snapshot->count == 0) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)ceil(quantile * snapshot->count);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (size_t i = 0; i < SHELL_STATS_BUCKETS; i++) {
+    seen += snapshot->buckets[i];
+    if (seen >= rank) {
+      return bucket_upper(i);
+    }
+  }
+  return bucket_upper(SHELL_STATS_BUCKETS - 1);
+}
+
+/* Texto que crece segun haga falta */
+typedef struct {
+  char *data;
+  size_t length;
+  size_t size;
+} text_t;
+
+static void append(text_t *text, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void append(text_t *text, const char *format, ...) {
+  va_list args;
+  for (;;) {
+    va_start(args, format);
+    int needed = vsnprintf(text->data + text->length,
+                           text->size - text->length, format, args);
+    va_end(args);
+    if (needed < 0) {
+      return;
+    }
+    if (text->length + needed < text->size) {
+      text->length += needed;
+      return;
+    }
+    text->size = (text->length + needed + 1) * 2;
+    text->data = realloc(text->data, text->size);
+    if (!text->data) {
+      fprintf(stderr, "Shell: Allocation error\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+char *shell_stats_render(void) {
+  text_t text = {malloc(RENDER_INITIAL_SIZE), 0, RENDER_INITIAL_SIZE};
+  if (!text.data) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  text.data[0] = '\0';
+
+  shell_histogram_snapshot_t snapshot;
+  for (int h = 0; h < SHELL_HIST_COUNT; h++) {
+    shell_stats_snapshot(h, &snapshot);
+    append(&text, "# HELP %s %s\n# TYPE %s histogram\n", histograms[h].name,
+           histograms[h].help, histograms[h].name);
+    // Cada limite cuenta los buckets HDR que terminan antes de el
+    size_t bucket = 0;
+    uint64_t cumulative = 0;
+    for (const double *bound = histograms[h].bounds; *bound != 0; bound++) {
+      while (bucket < SHELL_STATS_BUCKETS &&
+             bucket_upper(bucket) * histograms[h].scale <= *bound) {
+        cumulative += snapshot.buckets[bucket++];
+      }
+      append(&text, "%s_bucket{le=\"%g\"} %llu\n", histograms[h].name, *bound,
+             (unsigned long long)cumulative);
+    }
+    append(&text, "%s_bucket{le=\"+Inf\"} %llu\n", histograms[h].name,
+           (unsigned long long)snapshot.count);
+    append(&text, "%s_sum %.9g\n%s_count %llu\n", histograms[h].name,
+           snapshot.sum * histograms[h].scale, histograms[h].name,
+           (unsigned long long)snapshot.count);
+  }
+  for (int c = 0; c < SHELL_COUNTER_COUNT; c++) {
+    append(&text, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+           counters[c].name, counters[c].help, counters[c].name,
+           counters[c].name, (unsigned long long)shell_stats_counter(c));
+  }
+  for (int g = 0; g < SHELL_GAUGE_COUNT; g++) {
+    append(&text, "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n",
+           gauge_info[g].name, gauge_info[g].help, gauge_info[g].name,
+           gauge_info[g].name,
+           (long long)__atomic_load_n(&gauges[g], __ATOMIC_RELAXED));
+  }
+  return text.data;
+}
+
+void shell_stats_print(void) {
+  shell_histogram_snapshot_t snapshot;
+  printf("%-30s %8s %10s %10s %10s %10s\n", "Histogram", "Count", "p50",
+         "p90", "p99", "Max");
+  for (int h = 0; h < SHELL_HIST_COUNT; h++) {
+    shell_stats_snapshot(h, &snapshot);
+    printf("%-30s %8llu", histograms[h].name,
+           (unsigned long long)snapshot.count);
+    double quantiles[] = {0.5, 0.9, 0.99, 1.0};
+    for (int q = 0; q < 4; q++) {
+      double value =
+          shell_stats_quantile(&snapshot, quantiles[q]) * histograms[h].scale;
+      if (histograms[h].scale == 1) {
+        printf(" %10.0f", value);
+      } else {
+        printf(" %8.3fms", value * 1e3);
+      }
+    }
+    printf("\n");
+  }
+  for (int c = 0; c < SHELL_COUNTER_COUNT; c++) {
+    printf("%-30s %8llu\n", counters[c].name,
+           (unsigned long long)shell_stats_counter(c));
+  }
+  for (int g = 0; g < SHELL_GAUGE_COUNT; g++) {
+    printf("%-30s %8lld\n", gauge_info[g].name,
+           (long long)__atomic_load_n(&gauges[g], __ATOMIC_RELAXED));
+  }
+}
+
+/* Socket servido por el hilo de fondo */
+static struct {
+  int fd;
+  pthread_t thread;
+  char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+} server = {-1, 0, ""};
+
+static void write_all(int fd, const char *data, size_t length) {
+  while (length > 0) {
+    ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return;
+    }
+    data += written;
+    length -= written;
+  }
+}
+
+static void *serve_metrics(void *arg) {
+  int listen_fd = *(int *)arg;
+  free(arg);
+  for (;;) {
+    int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (client == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      break; // shell_stats_close() cerro el socket
+    }
+    // Un cliente HTTP manda su pedido enseguida; otro no manda nada
+    char request[REQUEST_SIZE];
+    ssize_t length = 0;
+    struct pollfd pfd = {client, POLLIN, 0};
+    if (poll(&pfd, 1, REQUEST_WAIT_MS) == 1) {
+      length = recv(client, request, sizeof(request) - 1, MSG_DONTWAIT);
+    }
+    char *body = shell_stats_render();
+    if (length >= 4 && strncmp(request, "GET ", 4) == 0) {
+      char header[256];
+      int size = snprintf(header, sizeof(header),
+                          "HTTP/1.0 200 OK\r\nContent-Type: text/plain; "
+                          "version=0.0.4\r\nContent-Length: %zu\r\n\r\n",
+                          strlen(body));
+      write_all(client, header, size);
+    }
+    write_all(client, body, strlen(body));
+    free(body);
+    close(client);
+  }
+  return NULL;
+}
+
+int shell_stats_listen(const char *path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  shell_stats_close();
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+      listen(fd, SOMAXCONN) == -1) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+
+  int *arg = malloc(sizeof(int));
+  if (!arg) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  *arg = fd;
+  // Las seniales (SIGCHLD, SIGINT...) siguen llegando al hilo principal
+  sigset_t all, previous;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &previous);
+  int error = pthread_create(&server.thread, NULL, serve_metrics, arg);
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+  if (error != 0) {
+    free(arg);
+    close(fd);
+    unlink(path);
+    errno = error;
+    return -1;
+  }
+  server.fd = fd;
+  strcpy(server.path, path);
+  return 0;
+}
+
+void shell_stats_close(void) {
+  if (server.fd == -1) {
+    return;
+  }
+  // shutdown despierta al accept() bloqueado del hilo
+  shutdown(server.fd, SHUT_RDWR);
+  pthread_join(server.thread, NULL);
+  close(server.fd);
+  unlink(server.path);
+  server.fd = -1;
+}
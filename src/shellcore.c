@@ -0,0 +1,605 @@
+#define _GNU_SOURCE
+#include "shellcore.h"
+#include "heredoc.h"
+#include "parse.h"
+#include "redirect.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHELL_POLL_EVENTS 16
+#define SHELL_NOT_STARTED 127 // Estado de una etapa que no se pudo lanzar
+
+extern char **environ;
+
+typedef enum { WATCH_STDOUT, WATCH_STDERR, WATCH_STAGE } watch_kind_t;
+
+struct shell_run;
+
+/* Lo que el epoll del contexto devuelve en data.ptr */
+typedef struct {
+  struct shell_run *run;
+  watch_kind_t kind;
+  int stage;
+} watch_t;
+
+typedef struct shell_run {
+  int id;
+  int stages;
+  pid_t *pids;      // 0: la etapa ya termino (o nunca arranco)
+  int *pidfds;      // -1 cuando no hay proceso que vigilar
+  watch_t *watches; // Uno por etapa, mas stdout y stderr
+  int running;      // Etapas sin recoger
+  int status;       // Estado de la ultima etapa
+  int out_fd;       // Extremos de lectura, -1 cerrados o sin capturar
+  int err_fd;
+  shell_callbacks_t callbacks;
+  void *data;
+  struct shell_run *next;
+} shell_run_t;
+
+struct shell_ctx {
+  int epoll_fd;
+  int next_id;
+  char *cwd; // NULL: el del proceso
+  shell_run_t *runs;
+  char error[SHELL_ERROR_SIZE];
+};
+
+/* Los built-ins de la shell (builtins[] en commands.c) actuan sobre su
+ * estado, que el contexto no tiene; echo se deja al de PATH */
+static const char *const unsupported_builtins[] = {
+    "cd", "clear", "quit", "help", "start_monitor", "stop_monitor",
+    "status_monitor", "replay_monitor", "monitor_config", "trigger", "jobs",
+    "time", "shell_stats", "memo", "history", "searchconfig", NULL};
+
+/* Una etapa ya separada, antes de lanzarla */
+typedef struct {
+  char **args;
+  redir_t *redirs;
+} stage_t;
+
+static int pidfd_open(pid_t pid) {
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+}
+
+/* Guarda el mensaje y devuelve el codigo, para terminar con return */
+static int fail(shell_ctx_t *ctx, int result, const char *format, ...) {
+  int saved_errno = errno;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(ctx->error, sizeof(ctx->error), format, args);
+  va_end(args);
+  errno = saved_errno;
+  return result;
+}
+
+shell_ctx_t *shell_ctx_create(void) {
+  shell_ctx_t *ctx = calloc(1, sizeof(shell_ctx_t));
+  if (!ctx) {
+    return NULL;
+  }
+  ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (ctx->epoll_fd == -1) {
+    free(ctx);
+    return NULL;
+  }
+  ctx->next_id = 1;
+  return ctx;
+}
+
+int shell_ctx_chdir(shell_ctx_t *ctx, const char *directory) {
+  char *resolved = NULL;
+  if (directory) {
+    // Relativo al directorio del contexto, como haria cd
+    char joined[PATH_MAX];
+    if (directory[0] != '/' && ctx->cwd) {
+      snprintf(joined, sizeof(joined), "%s/%s", ctx->cwd, directory);
+      directory = joined;
+    }
+    struct stat st;
+    resolved = realpath(directory, NULL);
+    if (!resolved || stat(resolved, &st) == -1 || !S_ISDIR(st.st_mode)) {
+      int saved = resolved ? ENOTDIR : errno;
+      free(resolved);
+      errno = saved;
+      return fail(ctx, SHELL_ERR_SYSTEM, "%s: %s", directory,
+                  strerror(saved));
+    }
+  }
+  free(ctx->cwd);
+  ctx->cwd = resolved;
+  return SHELL_OK;
+}
+
+int shell_ctx_fd(const shell_ctx_t *ctx) { return ctx->epoll_fd; }
+
+const char *shell_ctx_error(const shell_ctx_t *ctx) { return ctx->error; }
+
+static void close_fd(int *fd) {
+  if (*fd != -1) {
+    close(*fd);
+    *fd = -1;
+  }
+}
+
+/* Deja de vigilar y cierra. Se saca del epoll explicitamente: un hijo que
+ * todavia no hizo exec puede tener una copia y el close solo no alcanza */
+static void unwatch(shell_ctx_t *ctx, int *fd) {
+  if (*fd != -1) {
+    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, *fd, NULL);
+    close_fd(fd);
+  }
+}
+
+/* Mata y recoge lo que quede de la corrida y la libera */
+static void free_run(shell_ctx_t *ctx, shell_run_t *run) {
+  for (int i = 0; i < run->stages; i++) {
+    if (run->pids[i] > 0) {
+      // Sin recoger, el PID no se reutiliza: la senial no le llega a otro
+      kill(run->pids[i], SIGKILL);
+      while (waitpid(run->pids[i], NULL, 0) == -1 && errno == EINTR)
+        ;
+    }
+    unwatch(ctx, &run->pidfds[i]);
+  }
+  unwatch(ctx, &run->out_fd);
+  unwatch(ctx, &run->err_fd);
+  free(run->pids);
+  free(run->pidfds);
+  free(run->watches);
+  free(run);
+}
+
+void shell_ctx_destroy(shell_ctx_t *ctx) {
+  if (!ctx) {
+    return;
+  }
+  while (ctx->runs) {
+    shell_run_t *next = ctx->runs->next;
+    free_run(ctx, ctx->runs);
+    ctx->runs = next;
+  }
+  close(ctx->epoll_fd);
+  free(ctx->cwd);
+  free(ctx);
+}
+
+static void free_stages(stage_t *stages, int count) {
+  for (int i = 0; i < count; i++) {
+    if (stages[i].args) {
+      for (int j = 0; stages[i].args[j]; j++) {
+        free(stages[i].args[j]);
+      }
+      free(stages[i].args);
+    }
+    redir_free(stages[i].redirs);
+  }
+  free(stages);
+}
+
+/* Separa y parsea todas las etapas antes de lanzar ninguna */
+static int parse_stages(shell_ctx_t *ctx, const char *line,
+                        stage_t **stages_ptr, int *count_ptr) {
+  char *copy = strdup(line);
+  if (!copy) {
+    return fail(ctx, SHELL_ERR_NO_MEMORY, "out of memory");
+  }
+  int count = 0;
+  char **commands = split_by_pipes(copy, &count);
+  free(copy);
+  if (!commands) {
+    return fail(ctx, SHELL_ERR_NO_MEMORY, "out of memory");
+  }
+
+  int result = SHELL_OK;
+  stage_t *stages = calloc(count > 0 ? count : 1, sizeof(stage_t));
+  if (!stages) {
+    result = fail(ctx, SHELL_ERR_NO_MEMORY, "out of memory");
+  } else if (count == 0) {
+    result = fail(ctx, SHELL_ERR_SYNTAX, "empty command");
+  }
+  for (int i = 0; i < count; i++) {
+    if (result == SHELL_OK) {
+      const char *error;
+      stages[i].args =
+          parse_command_quiet(commands[i], &stages[i].redirs, ctx->cwd,
+                              &error);
+      if (!stages[i].args) {
+        result = fail(ctx, SHELL_ERR_NO_MEMORY, "out of memory");
+      } else if (error) {
+        result = fail(ctx, SHELL_ERR_SYNTAX, "%s", error);
+      } else if (!stages[i].args[0]) {
+        result = fail(ctx, SHELL_ERR_SYNTAX, "empty command in '%s'", line);
+      }
+    }
+    free(commands[i]);
+  }
+  free(commands);
+
+  for (int i = 0; i < count && result == SHELL_OK; i++) {
+    char **args = stages[i].args;
+    int last = 0;
+    while (args[last + 1]) {
+      last++;
+    }
+    if (strcmp(args[last], "&") == 0) {
+      result = fail(ctx, SHELL_ERR_UNSUPPORTED, "background jobs ('&')");
+    }
+    for (int b = 0; unsupported_builtins[b] && result == SHELL_OK; b++) {
+      if (strcmp(args[0], unsupported_builtins[b]) == 0) {
+        result = fail(ctx, SHELL_ERR_UNSUPPORTED, "built-in '%s'", args[0]);
+      }
+    }
+    for (redir_t *r = stages[i].redirs; r && result == SHELL_OK;
+         r = r->next) {
+      if (r->kind == REDIR_PROCSUB) {
+        result = fail(ctx, SHELL_ERR_UNSUPPORTED, "process substitution");
+      } else if (r->kind == REDIR_HEREDOC) {
+        // Su cuerpo esta en la cola global de la shell: no se toca
+        result = fail(ctx, SHELL_ERR_UNSUPPORTED, "here-documents ('<<')");
+      }
+    }
+  }
+
+  if (result != SHELL_OK) {
+    if (stages) {
+      free_stages(stages, count);
+    }
+    return result;
+  }
+  *stages_ptr = stages;
+  *count_ptr = count;
+  return SHELL_OK;
+}
+
+/* Las redirecciones de la etapa, en el orden de la linea, como acciones del
+ * hijo. Los datos de <<< se abren aca y quedan en r->opened_fd */
+static int add_redirections(shell_ctx_t *ctx, redir_t *redirs,
+                            posix_spawn_file_actions_t *actions) {
+  int error = 0;
+  for (redir_t *r = redirs; r && error == 0; r = r->next) {
+    switch (r->kind) {
+    case REDIR_OPEN:
+      error = posix_spawn_file_actions_addopen(actions, r->fd, r->path,
+                                               r->flags, REDIR_FILE_MODE);
+      break;
+    case REDIR_DATA:
+      r->opened_fd = heredoc_open(r->data, strlen(r->data));
+      if (r->opened_fd == -1) {
+        return fail(ctx, SHELL_ERR_SYSTEM, "here-string: %s",
+                    strerror(errno));
+      }
+      error = posix_spawn_file_actions_adddup2(actions, r->opened_fd, r->fd);
+      break;
+    case REDIR_DUP:
+      if (r->target_fd != r->fd) {
+        error =
+            posix_spawn_file_actions_adddup2(actions, r->target_fd, r->fd);
+      }
+      break;
+    case REDIR_CLOSE:
+      error = posix_spawn_file_actions_addclose(actions, r->fd);
+      break;
+    case REDIR_HEREDOC:
+    case REDIR_PROCSUB:
+      break; // Rechazados por parse_stages
+    }
+  }
+  if (error) {
+    errno = error;
+    return fail(ctx, SHELL_ERR_SYSTEM, "redirection: %s", strerror(error));
+  }
+  return SHELL_OK;
+}
+
+/* Escribe todo, reintentando si una senial interrumpe write */
+static void write_all(int fd, const char *text, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(fd, text, length);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return;
+    }
+    text += written;
+    length -= written;
+  }
+}
+
+/* Lanza una etapa leyendo de in_fd y escribiendo en out_fd/err_fd (-1: los
+ * del proceso). Si no arranca, el error va por su stderr como en la shell */
+static int spawn_stage(shell_ctx_t *ctx, shell_run_t *run, int stage,
+                       stage_t *command, int in_fd, int out_fd, int err_fd) {
+  posix_spawn_file_actions_t actions;
+  int error = posix_spawn_file_actions_init(&actions);
+  if (error) {
+    errno = error;
+    return fail(ctx, SHELL_ERR_SYSTEM, "posix_spawn: %s", strerror(error));
+  }
+
+  if (in_fd == -1) {
+    error = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO,
+                                             "/dev/null", O_RDONLY, 0);
+  } else {
+    error = posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+  }
+  if (!error && out_fd != -1) {
+    error = posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+  }
+  if (!error && err_fd != -1) {
+    error = posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+  }
+  if (!error && ctx->cwd) {
+    error = posix_spawn_file_actions_addchdir_np(&actions, ctx->cwd);
+  }
+  int result = SHELL_OK;
+  if (error) {
+    errno = error;
+    result = fail(ctx, SHELL_ERR_SYSTEM, "posix_spawn: %s", strerror(error));
+  } else {
+    result = add_redirections(ctx, command->redirs, &actions);
+  }
+  if (result != SHELL_OK) {
+    posix_spawn_file_actions_destroy(&actions);
+    return result;
+  }
+
+  pid_t pid;
+  error = posix_spawnp(&pid, command->args[0], &actions, NULL, command->args,
+                       environ);
+  posix_spawn_file_actions_destroy(&actions);
+  redir_close(command->redirs);
+
+  if (error) {
+    // Como una etapa que salio con 127; las demas siguen
+    char message[SHELL_ERROR_SIZE];
+    int length = snprintf(message, sizeof(message), "%s: %s\n",
+                          command->args[0], strerror(error));
+    write_all(err_fd != -1 ? err_fd : STDERR_FILENO, message,
+              length < (int)sizeof(message) ? (size_t)length
+                                            : sizeof(message) - 1);
+    if (stage == run->stages - 1) {
+      run->status = SHELL_NOT_STARTED << 8;
+    }
+    return SHELL_OK;
+  }
+
+  run->pids[stage] = pid;
+  run->running++;
+  // Todavia no se recogio: el pidfd apunta a este proceso aunque ya termino
+  run->pidfds[stage] = pidfd_open(pid);
+  if (run->pidfds[stage] == -1) {
+    return fail(ctx, SHELL_ERR_SYSTEM, "pidfd_open: %s", strerror(errno));
+  }
+  return SHELL_OK;
+}
+
+static int watch(shell_ctx_t *ctx, int fd, watch_t *watch) {
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = watch;
+  if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    return fail(ctx, SHELL_ERR_SYSTEM, "epoll_ctl: %s", strerror(errno));
+  }
+  return SHELL_OK;
+}
+
+/* Abre los pipes de captura; los extremos de escritura quedan en out y err */
+static int open_capture(shell_ctx_t *ctx, shell_run_t *run, int *out,
+                        int *err) {
+  int out_pipe[2];
+  int err_pipe[2];
+  if (pipe2(out_pipe, O_CLOEXEC) == -1) {
+    return fail(ctx, SHELL_ERR_SYSTEM, "pipe: %s", strerror(errno));
+  }
+  if (pipe2(err_pipe, O_CLOEXEC) == -1) {
+    close(out_pipe[0]);
+    close(out_pipe[1]);
+    return fail(ctx, SHELL_ERR_SYSTEM, "pipe: %s", strerror(errno));
+  }
+  run->out_fd = out_pipe[0];
+  run->err_fd = err_pipe[0];
+  *out = out_pipe[1];
+  *err = err_pipe[1];
+  fcntl(run->out_fd, F_SETFL, O_NONBLOCK);
+  fcntl(run->err_fd, F_SETFL, O_NONBLOCK);
+  return SHELL_OK;
+}
+
+static shell_run_t *new_run(int stages) {
+  shell_run_t *run = calloc(1, sizeof(shell_run_t));
+  if (!run) {
+    return NULL;
+  }
+  run->stages = stages;
+  run->out_fd = -1;
+  run->err_fd = -1;
+  run->pids = calloc(stages, sizeof(pid_t));
+  run->pidfds = malloc(stages * sizeof(int));
+  run->watches = calloc(stages + 2, sizeof(watch_t));
+  if (!run->pids || !run->pidfds || !run->watches) {
+    free(run->pids);
+    free(run->pidfds);
+    free(run->watches);
+    free(run);
+    return NULL;
+  }
+  for (int i = 0; i < stages; i++) {
+    run->pidfds[i] = -1;
+  }
+  return run;
+}
+
+int shell_run(shell_ctx_t *ctx, const char *line,
+              const shell_callbacks_t *callbacks, void *data) {
+  stage_t *stages = NULL;
+  int count = 0;
+  ctx->error[0] = '\0';
+  int result = parse_stages(ctx, line, &stages, &count);
+  if (result != SHELL_OK) {
+    return result;
+  }
+
+  shell_run_t *run = new_run(count);
+  if (!run) {
+    free_stages(stages, count);
+    return fail(ctx, SHELL_ERR_NO_MEMORY, "out of memory");
+  }
+  if (callbacks) {
+    run->callbacks = *callbacks;
+  }
+  run->data = data;
+
+  int out = -1; // Extremos de escritura de la captura
+  int err = -1;
+  if (run->callbacks.on_output) {
+    result = open_capture(ctx, run, &out, &err);
+  }
+
+  // Cada etapa lee lo que dejo la anterior
+  int in_fd = -1;
+  for (int i = 0; i < count && result == SHELL_OK; i++) {
+    int pipe_fds[2] = {-1, -1};
+    if (i < count - 1 && pipe2(pipe_fds, O_CLOEXEC) == -1) {
+      result = fail(ctx, SHELL_ERR_SYSTEM, "pipe: %s", strerror(errno));
+      break;
+    }
+    result = spawn_stage(ctx, run, i, &stages[i], in_fd,
+                         i < count - 1 ? pipe_fds[1] : out, err);
+    close_fd(&in_fd);
+    close_fd(&pipe_fds[1]);
+    in_fd = pipe_fds[0];
+  }
+  close_fd(&in_fd);
+  close_fd(&out);
+  close_fd(&err);
+  free_stages(stages, count);
+
+  for (int i = 0; i < count && result == SHELL_OK; i++) {
+    run->watches[i] = (watch_t){run, WATCH_STAGE, i};
+    if (run->pidfds[i] != -1) {
+      result = watch(ctx, run->pidfds[i], &run->watches[i]);
+    }
+  }
+  run->watches[count] = (watch_t){run, WATCH_STDOUT, 0};
+  run->watches[count + 1] = (watch_t){run, WATCH_STDERR, 0};
+  if (result == SHELL_OK && run->out_fd != -1) {
+    result = watch(ctx, run->out_fd, &run->watches[count]);
+  }
+  if (result == SHELL_OK && run->err_fd != -1) {
+    result = watch(ctx, run->err_fd, &run->watches[count + 1]);
+  }
+  if (result != SHELL_OK) {
+    free_run(ctx, run);
+    return result;
+  }
+
+  run->id = ctx->next_id++;
+  if (ctx->next_id <= 0) {
+    ctx->next_id = 1;
+  }
+  run->next = ctx->runs;
+  ctx->runs = run;
+  return run->id;
+}
+
+/* Entrega lo que haya en un pipe de captura; lo cierra al llegar al EOF */
+static void drain(shell_ctx_t *ctx, shell_run_t *run, int *fd, int which) {
+  if (*fd == -1) {
+    return; // Ya se cerro en este mismo lote de eventos
+  }
+  char buffer[SHELL_READ_SIZE];
+  ssize_t length = read(*fd, buffer, sizeof(buffer));
+  if (length > 0) {
+    run->callbacks.on_output(run->data, run->id, which, buffer, length);
+  } else if (length == 0 || (errno != EAGAIN && errno != EINTR)) {
+    unwatch(ctx, fd);
+  }
+}
+
+static void reap(shell_ctx_t *ctx, shell_run_t *run, int stage) {
+  if (run->pids[stage] == 0) {
+    return;
+  }
+  int status;
+  pid_t pid = waitpid(run->pids[stage], &status, WNOHANG);
+  if (pid == 0) {
+    return; // Todavia no termino
+  }
+  if (pid == -1) {
+    status = SHELL_NOT_STARTED << 8; // Alguien mas lo recogio
+  }
+  if (stage == run->stages - 1) {
+    run->status = status;
+  }
+  run->pids[stage] = 0;
+  unwatch(ctx, &run->pidfds[stage]);
+  run->running--;
+}
+
+/* Termino cada etapa y se entrego toda su salida */
+static int finished(const shell_run_t *run) {
+  return run->running == 0 && run->out_fd == -1 && run->err_fd == -1;
+}
+
+int shell_ctx_poll(shell_ctx_t *ctx, int timeout_ms) {
+  if (!ctx->runs) {
+    return 0;
+  }
+  // Una corrida sin ninguna etapa lanzada no tiene nada que esperar
+  for (shell_run_t *run = ctx->runs; run; run = run->next) {
+    if (finished(run)) {
+      timeout_ms = 0;
+    }
+  }
+
+  struct epoll_event events[SHELL_POLL_EVENTS];
+  int ready = epoll_wait(ctx->epoll_fd, events, SHELL_POLL_EVENTS, timeout_ms);
+  if (ready == -1 && errno != EINTR) {
+    return fail(ctx, SHELL_ERR_SYSTEM, "epoll_wait: %s", strerror(errno));
+  }
+  for (int i = 0; i < ready; i++) {
+    watch_t *watch = events[i].data.ptr;
+    shell_run_t *run = watch->run;
+    if (watch->kind == WATCH_STDOUT) {
+      drain(ctx, run, &run->out_fd, STDOUT_FILENO);
+    } else if (watch->kind == WATCH_STDERR) {
+      drain(ctx, run, &run->err_fd, STDERR_FILENO);
+    } else {
+      reap(ctx, run, watch->stage);
+    }
+  }
+
+  // Se desengancha antes del callback, que puede lanzar otra corrida
+  shell_run_t **link = &ctx->runs;
+  while (*link) {
+    shell_run_t *run = *link;
+    if (!finished(run)) {
+      link = &run->next;
+      continue;
+    }
+    *link = run->next;
+    if (run->callbacks.on_exit) {
+      run->callbacks.on_exit(run->data, run->id, run->status);
+    }
+    free_run(ctx, run);
+  }
+
+  int active = 0;
+  for (shell_run_t *run = ctx->runs; run; run = run->next) {
+    active++;
+  }
+  return active;
+}
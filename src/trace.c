@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+  uint64_t time; // CLOCK_MONOTONIC en ns
+  const char *name;
+  pid_t track; // 0: la shell
+  char phase;
+  char detail[TRACE_DETAIL_SIZE];
+} trace_event_t;
+
+int trace_enabled = 0;
+
+static trace_event_t *ring = NULL;
+static uint64_t recorded = 0; // Eventos escritos desde el inicio
+static char *trace_path = NULL;
+static pid_t owner = 0; // Los hijos heredan el anillo, solo este escribe
+
+void trace_record(char phase, pid_t track, const char *name,
+                  const char *detail) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  trace_event_t *event = &ring[recorded++ % TRACE_RING_EVENTS];
+  event->time = (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+  event->name = name;
+  event->track = track;
+  event->phase = phase;
+  if (detail) {
+    strncpy(event->detail, detail, sizeof(event->detail) - 1);
+    event->detail[sizeof(event->detail) - 1] = '\0';
+  } else {
+    event->detail[0] = '\0';
+  }
+}
+
+static void flush_at_exit(void) {
+  if (trace_enabled && getpid() == owner) {
+    trace_flush();
+  }
+}
+
+int trace_start(const char *path) {
+  static int registered = 0;
+  if (!ring) {
+    ring = malloc(TRACE_RING_EVENTS * sizeof(trace_event_t));
+    if (!ring) {
+      return -1;
+    }
+  }
+  free(trace_path);
+  trace_path = strdup(path);
+  if (!trace_path) {
+    return -1;
+  }
+  recorded = 0;
+  owner = getpid();
+  trace_enabled = 1;
+  if (!registered) {
+    atexit(flush_at_exit);
+    registered = 1;
+  }
+  return 0;
+}
+
+/* Escribe text como string JSON */
+static void write_json_string(FILE *file, const char *text) {
+  fputc('"', file);
+  for (; *text; text++) {
+    unsigned char c = *text;
+    if (c == '"' || c == '\\') {
+      fprintf(file, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    } else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+int trace_flush(void) {
+  if (!ring || !trace_path) {
+    return -1;
+  }
+  FILE *file = fopen(trace_path, "w");
+  if (!file) {
+    return -1;
+  }
+  uint64_t first =
+      recorded > TRACE_RING_EVENTS ? recorded - TRACE_RING_EVENTS : 0;
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(file,
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+          "\"args\":{\"name\":\"shell\"}}",
+          owner, owner);
+  if (first > 0) {
+    // El anillo se lleno: los primeros eventos se perdieron
+    fprintf(file,
+            ",\n{\"name\":\"trace_dropped\",\"ph\":\"M\",\"pid\":%d,"
+            "\"tid\":%d,\"args\":{\"events\":%llu}}",
+            owner, owner, (unsigned long long)first);
+  }
+  for (uint64_t i = first; i < recorded; i++) {
+    const trace_event_t *event = &ring[i % TRACE_RING_EVENTS];
+    pid_t pid = event->track ? event->track : owner;
+    fprintf(file, ",\n{\"name\":");
+    write_json_string(file, event->name);
+    if (event->phase == 'M') {
+      // El nombre de la pista va en args.name
+      fprintf(file, ",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+              pid, pid);
+      write_json_string(file, event->detail);
+      fprintf(file, "}}");
+      continue;
+    }
+    fprintf(file, ",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+            event->phase, event->time / 1e3, pid, pid);
+    if (event->detail[0]) {
+      fprintf(file, ",\"args\":{\"detail\":");
+      write_json_string(file, event->detail);
+      fprintf(file, "}");
+    }
+    fprintf(file, "}");
+  }
+  fprintf(file, "\n]}\n");
+  return fclose(file) == 0 ? 0 : -1;
+}
+
+void trace_stop(void) {
+  if (!trace_enabled) {
+    return;
+  }
+  trace_flush();
+  trace_enabled = 0;
+  free(ring);
+  ring = NULL;
+  free(trace_path);
+  trace_path = NULL;
+}
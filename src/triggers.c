@@ -0,0 +1,299 @@
+#include "triggers.h"
+#include "parse.h"
+#include "shell.h"
+#include "trace.h"
+#include <ctype.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TRIGGER_VALUE_SIZE 32
+
+static trigger_t rules[TRIGGER_MAX_RULES];
+static size_t rule_count = 0;
+static int next_trigger_id = 1;
+
+static char *trim_copy(const char *start, size_t length) {
+  while (length > 0 && isspace((unsigned char)*start)) {
+    start++;
+    length--;
+  }
+  while (length > 0 && isspace((unsigned char)start[length - 1])) {
+    length--;
+  }
+  char *copy = strndup(start, length);
+  if (!copy) {
+    fprintf(stderr, "Shell: Allocation error\n");
+    exit(EXIT_FAILURE);
+  }
+  return copy;
+}
+
+/* Interpreta "metrica op valor [for D] [cooldown D] [clear V]" */
+static int parse_condition(trigger_t *rule, char *error, size_t error_size) {
+  const char *ptr = rule->condition;
+  const char *name = ptr;
+  while (isalnum((unsigned char)*ptr) || *ptr == '_') {
+    ptr++;
+  }
+  char metric[64];
+  snprintf(metric, sizeof(metric), "%.*s", (int)(ptr - name), name);
+  rule->field = metric_field_resolve(metric);
+  if (!rule->field) {
+    snprintf(error, error_size, "unknown metric '%s'", metric);
+    return -1;
+  }
+
+  while (isspace((unsigned char)*ptr)) {
+    ptr++;
+  }
+  if (*ptr != '>' && *ptr != '<') {
+    snprintf(error, error_size, "expected >, >=, < or <= after '%s'",
+             metric);
+    return -1;
+  }
+  rule->above = *ptr++ == '>';
+  rule->inclusive = *ptr == '=';
+  if (rule->inclusive) {
+    ptr++;
+  }
+
+  char *end;
+  rule->threshold = strtod(ptr, &end);
+  if (end == ptr) {
+    snprintf(error, error_size, "expected a number after the operator");
+    return -1;
+  }
+
+  double band = fabs(rule->threshold) * TRIGGER_DEFAULT_HYSTERESIS;
+  rule->clear_level =
+      rule->above ? rule->threshold - band : rule->threshold + band;
+  rule->duration = 0;
+  rule->cooldown = TRIGGER_DEFAULT_COOLDOWN;
+
+  // Opciones: palabra clave seguida de su valor
+  char *options = trim_copy(end, strlen(end));
+  char *saveptr = NULL;
+  int result = 0;
+  for (char *key = strtok_r(options, " \t", &saveptr); key && result == 0;
+       key = strtok_r(NULL, " \t", &saveptr)) {
+    char *value = strtok_r(NULL, " \t", &saveptr);
+    if (!value) {
+      snprintf(error, error_size, "'%s' needs a value", key);
+      result = -1;
+    } else if (strcmp(key, "for") == 0) {
+      result = parse_duration(value, &rule->duration);
+    } else if (strcmp(key, "cooldown") == 0) {
+      result = parse_duration(value, &rule->cooldown);
+    } else if (strcmp(key, "clear") == 0) {
+      rule->clear_level = strtod(value, &end);
+      result = end == value || *end != '\0' ? -1 : 0;
+    } else {
+      snprintf(error, error_size, "unknown option '%s'", key);
+      result = -1;
+    }
+    if (result == -1 && value && error[0] == '\0') {
+      snprintf(error, error_size, "bad value '%s' for '%s'", value, key);
+    }
+  }
+  free(options);
+  if (result == -1) {
+    return -1;
+  }
+
+  if (rule->above ? rule->clear_level > rule->threshold
+                  : rule->clear_level < rule->threshold) {
+    snprintf(error, error_size, "clear must be on the other side of %g",
+             rule->threshold);
+    return -1;
+  }
+  return 0;
+}
+
+int trigger_add(const char *text, char *error, size_t error_size) {
+  error[0] = '\0';
+  if (rule_count == TRIGGER_MAX_RULES) {
+    snprintf(error, error_size, "at most %d rules", TRIGGER_MAX_RULES);
+    return -1;
+  }
+  const char *arrow = strstr(text, "->");
+  if (!arrow) {
+    snprintf(error, error_size, "missing '-> command'");
+    return -1;
+  }
+
+  trigger_t rule;
+  memset(&rule, 0, sizeof(rule));
+  rule.condition = trim_copy(text, arrow - text);
+  rule.action = trim_copy(arrow + 2, strlen(arrow + 2));
+  if (rule.action[0] == '\0') {
+    snprintf(error, error_size, "missing command after '->'");
+  } else if (parse_condition(&rule, error, error_size) == 0) {
+    rule.id = next_trigger_id++;
+    rule.armed = 1;
+    rules[rule_count++] = rule;
+    return rule.id;
+  }
+  free(rule.condition);
+  free(rule.action);
+  return -1;
+}
+
+int trigger_remove(int id) {
+  for (size_t i = 0; i < rule_count; i++) {
+    if (rules[i].id == id) {
+      free(rules[i].condition);
+      free(rules[i].action);
+      memmove(&rules[i], &rules[i + 1],
+              (rule_count - i - 1) * sizeof(trigger_t));
+      rule_count--;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const trigger_t *trigger_find(int id) {
+  for (size_t i = 0; i < rule_count; i++) {
+    if (rules[i].id == id) {
+      return &rules[i];
+    }
+  }
+  return NULL;
+}
+
+void triggers_clear(void) {
+  while (rule_count > 0) {
+    trigger_remove(rules[0].id);
+  }
+}
+
+size_t triggers_count(void) { return rule_count; }
+
+void triggers_print(void) {
+  if (rule_count == 0) {
+    printf("No triggers.\n");
+    return;
+  }
+  for (size_t i = 0; i < rule_count; i++) {
+    const trigger_t *rule = &rules[i];
+    printf("[%d] %s -> %s\n", rule->id, rule->condition, rule->action);
+    printf("    for %g s, cooldown %g s, clears at %g; fired %lu "
+           "times%s\n",
+           rule->duration, rule->cooldown, rule->clear_level, rule->fired,
+           rule->armed ? "" : ", waiting to clear");
+  }
+}
+
+void triggers_evaluate(const metrics_sample_t *sample) {
+  double now = sample->timestamp;
+  for (size_t i = 0; i < rule_count; i++) {
+    trigger_t *rule = &rules[i];
+    double value = metric_field_value(sample, rule->field);
+
+    // Histeresis: despues de disparar hay que volver del otro lado de clear
+    if (!rule->armed) {
+      if (rule->above ? value > rule->clear_level
+                      : value < rule->clear_level) {
+        continue;
+      }
+      rule->armed = 1;
+    }
+
+    int holds;
+    if (rule->above) {
+      holds = rule->inclusive ? value >= rule->threshold
+                              : value > rule->threshold;
+    } else {
+      holds = rule->inclusive ? value <= rule->threshold
+                              : value < rule->threshold;
+    }
+    if (!holds) {
+      rule->since = 0;
+      continue;
+    }
+    if (rule->since == 0) {
+      rule->since = now;
+    }
+    if (now - rule->since < rule->duration ||
+        (rule->fired > 0 && now - rule->last_fired < rule->cooldown)) {
+      continue;
+    }
+
+    rule->pending = 1;
+    rule->pending_value = value;
+    rule->last_fired = now;
+    rule->fired++;
+    rule->armed = 0;
+    rule->since = 0;
+  }
+}
+
+int triggers_pending(void) {
+  int pending = 0;
+  for (size_t i = 0; i < rule_count; i++) {
+    pending += rules[i].pending;
+  }
+  return pending;
+}
+
+/* La accion corre en un hijo con el ejecutor normal de la shell, asi acepta
+ * pipes, redirecciones y comandos internos, y queda como trabajo en segundo
+ * plano como los lanzados con '&' */
+static void launch_action(const trigger_t *rule) {
+  char value[TRIGGER_VALUE_SIZE];
+  snprintf(value, sizeof(value), "%g", rule->pending_value);
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("Shell: fork");
+    return;
+  }
+  if (pid == 0) {
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    setenv("TRIGGER_METRIC", rule->field->name, 1);
+    setenv("TRIGGER_VALUE", value, 1);
+
+    char *command = strdup(rule->action);
+    if (!command) {
+      _exit(EXIT_FAILURE);
+    }
+    // _exit y no exit: vaciar los buffers de stdio heredados moveria el
+    // offset del archivo batch que lee el padre
+    execute_command(command);
+    fflush(stdout);
+    _exit(last_status); // Una accion fallida figura asi en 'jobs'
+  }
+
+  trace_name_track(pid, rule->action);
+  trace_begin_on(pid, "run", NULL);
+  int job_id = add_job(pid, rule->action);
+  if (job_id != -1) {
+    printf("[%d] %d\n", job_id, pid);
+  } else {
+    waitpid(pid, NULL, 0);
+  }
+}
+
+int triggers_run_pending(void) {
+  int launched = 0;
+  for (size_t i = 0; i < rule_count; i++) {
+    trigger_t *rule = &rules[i];
+    if (!rule->pending) {
+      continue;
+    }
+    rule->pending = 0;
+    printf("Trigger %d: %s (%s = %g)\n", rule->id, rule->condition,
+           rule->field->name, rule->pending_value);
+    launch_action(rule);
+    launched++;
+  }
+  return launched;
+}
@@ -1,15 +1,49 @@
 #include "../include/commands.h"
+#include "../include/completion.h"
+#include "../include/configindex.h"
+#include "../include/heredoc.h"
+#include "../include/history_log.h"
+#include "../include/job_usage.h"
+#include "../include/memo.h"
+#include "../include/metrics_archive.h"
+#include "../include/metrics_demand.h"
+#include "../include/metrics_history.h"
+#include "../include/metrics_shm.h"
+#include "../include/monitor_config.h"
+#include "../include/monitor_supervisor.h"
+#include "../include/parse.h"
+#include "../include/pathexp.h"
+#include "../include/path_cache.h"
+#include "../include/proc_file.h"
+#include "../include/searchconfig.h"
+#include "../include/serve.h"
+#include "../include/shell_stats.h"
+#include "../include/shellcore.h"
+#include "../include/trace.h"
+#include "../include/triggers.h"
 #include <assert.h>
+#include <dirent.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #define BUFFER_SIZE 4096
-#define MONITOR_PID_FILE "/tmp/monitor_pid"
 #define MONITOR_PIPE "/tmp/monitor_pipe"
 #define PINK "\033[1;35m"
 #define RESET "\033[0m"
@@ -81,6 +115,46 @@ void test_cmd_quit()
     printf("test_cmd_quit passed successfully!\n");
 }
 
+#define TEST_MONITOR_PROGRAM "/tmp/test_monitoring_project"
+
+static pid_t test_monitor_owner = 0;
+
+static void remove_test_monitor()
+{
+    // Forked children that call exit() run this too
+    if (getpid() == test_monitor_owner)
+    {
+        remove(TEST_MONITOR_PROGRAM);
+    }
+}
+
+/**
+ * @brief Puts a stand-in monitor in place when the real one was not built.
+ *
+ * The stand-in reports readiness on MONITOR_READY_FD, when it is given one,
+ * and then sleeps. It is
+ * written to TEST_MONITOR_PROGRAM and selected through MONITOR_BIN, so the
+ * tests do not depend on the working directory, and removed when they exit.
+ */
+static void install_test_monitor()
+{
+    static int installed = 0;
+    if (installed || access(monitor_program(), X_OK) == 0)
+    {
+        return;
+    }
+    FILE* script = fopen(TEST_MONITOR_PROGRAM, "w");
+    assert(script != NULL);
+    fprintf(script, "#!/bin/sh\nif [ -n \"$%s\" ]; then echo ready >&$%s; fi\nexec sleep 600\n",
+            MONITOR_READY_FD_ENV, MONITOR_READY_FD_ENV);
+    fclose(script);
+    assert(chmod(TEST_MONITOR_PROGRAM, 0755) == 0);
+    assert(setenv(MONITOR_PROGRAM_ENV, TEST_MONITOR_PROGRAM, 1) == 0);
+    installed = 1;
+    test_monitor_owner = getpid();
+    atexit(remove_test_monitor);
+}
+
 /**
  * @brief Test for starting the monitoring process.
  *
@@ -89,7 +163,9 @@ void test_cmd_quit()
  */
 void test_cmd_start_monitor()
 {
-    int result = cmd_start_monitor();
+    install_test_monitor();
+    char* args[] = {"start_monitor", NULL};
+    int result = cmd_start_monitor(args);
     assert(result == 1);
 
     // Check if PID file was created and contains a valid PID
@@ -114,8 +190,11 @@ void test_cmd_start_monitor()
  */
 void test_cmd_stop_monitor()
 {
+    install_test_monitor();
+
     // Start the monitoring process
-    cmd_start_monitor();
+    char* args[] = {"start_monitor", NULL};
+    cmd_start_monitor(args);
 
     // Read the PID from the file
     FILE* pid_file = fopen(MONITOR_PID_FILE, "r");
@@ -146,7 +225,8 @@ void test_cmd_stop_monitor()
  * a piped command (`cat file | grep "Hello"`) to verify the output.
  *
  * It captures the output of the piped command and checks that it
- * contains the expected lines.
+ * contains the expected lines. It then checks that a pipeline whose pipe
+ * cannot be created fails with status 1 instead of exiting the shell.
  */
 void test_piped_commands()
 {
@@ -236,35 +316,2125 @@ void test_piped_commands()
     {
         perror("Failed to delete temporary file");
     }
+
+    // Without descriptors for the pipe the pipeline fails, the shell goes on
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        struct rlimit limit = {64, 64};
+        if (setrlimit(RLIMIT_NOFILE, &limit) == -1)
+        {
+            _exit(2);
+        }
+        int last = -1;
+        int fd;
+        while ((fd = dup(STDERR_FILENO)) != -1)
+        {
+            last = fd;
+        }
+        close(last); // One free descriptor: pipe2 needs two
+        char* failing[] = {"echo lost", "cat"};
+        int result = execute_piped_commands(failing, 2);
+        _exit(result == 1 && last_status == 1 ? 0 : 1);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
 }
 
 /**
- * @brief Main function to run all tests.
+ * @brief Test for here-strings and here-document descriptors.
  *
- * This function calls each test function in sequence,
- * printing a message before each test starts and asserting that all tests pass.
+ * This test parses a command with a here-string and checks that the inline
+ * data is returned as a stdin redirection instead of an argument. It then verifies that
+ * `heredoc_open` serves both a small payload (pipe) and one larger than
+ * HEREDOC_PIPE_MAX (memfd) from the start.
+ */
+void test_heredoc()
+{
+    char command[] = "tr a-z A-Z <<< \"hello world\"";
+    redir_t* redirs = NULL;
+    char** args = parse_command(command, &redirs);
+    assert(args != NULL);
+    assert(strcmp(args[0], "tr") == 0);
+    assert(args[3] == NULL); // The here-string is not an argument
+    assert(redirs != NULL && redirs->kind == REDIR_DATA && redirs->fd == STDIN_FILENO);
+    char* here_data = redirs->data;
+    assert(strcmp(here_data, "hello world\n") == 0);
+
+    char buffer[BUFFER_SIZE];
+    int fd = heredoc_open(here_data, strlen(here_data));
+    assert(fd != -1);
+    ssize_t bytes_read = read(fd, buffer, sizeof(buffer));
+    assert(bytes_read == (ssize_t)strlen(here_data));
+    assert(memcmp(buffer, here_data, bytes_read) == 0);
+    close(fd);
+
+    size_t big_length = HEREDOC_PIPE_MAX * 3;
+    char* big = malloc(big_length);
+    assert(big != NULL);
+    memset(big, 'x', big_length);
+    fd = heredoc_open(big, big_length);
+    assert(fd != -1);
+    size_t total = 0;
+    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        total += bytes_read;
+    }
+    assert(total == big_length);
+    close(fd);
+
+    free(big);
+    redir_free(redirs);
+    for (int i = 0; args[i] != NULL; i++)
+    {
+        free(args[i]);
+    }
+    free(args);
+    printf("test_heredoc passed successfully!\n");
+}
+
+/**
+ * @brief Test for the redirection engine.
  *
- * @return 0 upon successful completion of all tests.
+ * This test runs an external command with `> file 2>&1` and checks that both
+ * stdout and stderr end up in the file, in order. It then appends to the same
+ * file with `>>` from a built-in and verifies that the earlier content is kept
+ * and that the shell's stdout is restored afterwards.
  */
-int main()
+void test_redirections()
 {
-    printf(PINK "\n\n==== Running test: test_cmd_cd ====\n" RESET);
-    test_cmd_cd();
+    const char* temp_filename = "temp_redir_file.txt";
+    char command[] = "sh -c 'echo out; echo err 1>&2' > temp_redir_file.txt 2>&1";
+    int result = execute_single_command(command);
+    assert(result == 1);
 
-    printf(PINK "\n\n==== Running test: test_cmd_echo ====\n" RESET);
-    test_cmd_echo();
+    char append[] = "echo appended >> temp_redir_file.txt";
+    result = execute_single_command(append);
+    assert(result == 1);
 
-    printf(PINK "\n\n==== Running test: test_cmd_quit ====\n" RESET);
-    test_cmd_quit();
+    FILE* file = fopen(temp_filename, "r");
+    assert(file != NULL);
+    char buffer[BUFFER_SIZE];
+    size_t bytes_read = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[bytes_read] = '\0';
+    fclose(file);
+    printf("Redirected content:\n%s", buffer);
+    assert(strcmp(buffer, "out\nerr\nappended \n") == 0);
 
-    printf(PINK "\n\n==== Running test: test_cmd_start_monitor ====\n" RESET);
-    test_cmd_start_monitor();
+    // The shell's stdout must be back on its original descriptor
+    assert(fcntl(STDOUT_FILENO, F_GETFD) != -1);
 
-    printf(PINK "\n\n==== Running test: test_cmd_stop_monitor ====\n" RESET);
-    test_cmd_stop_monitor();
+    unlink(temp_filename);
+    printf("test_redirections passed successfully!\n");
+}
 
-    printf(PINK "\n\n==== Running test: test_piped_commands ====\n" RESET);
-    test_piped_commands();
+/**
+ * @brief Test for process substitution.
+ *
+ * This test runs `cat <(echo one) <(echo two | tr a-z A-Z)` with its output
+ * redirected to a file and checks that both producers, one of them a
+ * pipeline, were read through /dev/fd in argument order.
+ */
+void test_process_substitution()
+{
+    const char* temp_filename = "temp_procsub_file.txt";
+    char command[] = "cat <(echo one) <(echo two | tr a-z A-Z) > temp_procsub_file.txt";
+    int result = execute_single_command(command);
+    assert(result == 1);
+
+    FILE* file = fopen(temp_filename, "r");
+    assert(file != NULL);
+    char buffer[BUFFER_SIZE];
+    size_t bytes_read = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[bytes_read] = '\0';
+    fclose(file);
+    printf("Substituted content:\n%s", buffer);
+    assert(strcmp(buffer, "one\nTWO\n") == 0);
+
+    unlink(temp_filename);
+    printf("test_process_substitution passed successfully!\n");
+}
+
+/**
+ * @brief Test for the persistent searchconfig index.
+ *
+ * This test indexes a small tree with the cache redirected to a temporary
+ * directory, then adds and removes files and checks that the following
+ * queries see the changes without a rebuild. A `--rebuild` query must give
+ * the same answer.
+ */
+void test_searchconfig_index()
+{
+    char root[] = "/tmp/test_index.XXXXXX";
+    assert(mkdtemp(root) != NULL);
+    char path[BUFFER_SIZE];
+    snprintf(path, sizeof(path), "%s/cache", root);
+    assert(mkdir(path, 0700) == 0);
+    setenv("XDG_CACHE_HOME", path, 1);
+
+    snprintf(path, sizeof(path), "%s/tree", root);
+    assert(mkdir(path, 0755) == 0);
+    snprintf(path, sizeof(path), "%s/tree/sub", root);
+    assert(mkdir(path, 0755) == 0);
+    snprintf(path, sizeof(path), "%s/tree/sub/a.config", root);
+    FILE* file = fopen(path, "w");
+    assert(file != NULL);
+    fclose(file);
+
+    char tree[BUFFER_SIZE];
+    snprintf(tree, sizeof(tree), "%s/tree", root);
+    config_matches_t matches;
+    assert(config_index_query(tree, ".config", 0, &matches) == 0);
+    assert(matches.count == 1);
+    assert(strcmp(matches.items[0].path, path) == 0);
+    config_matches_free(&matches);
+
+    // New directory with a match, and the old match removed
+    snprintf(path, sizeof(path), "%s/tree/new", root);
+    assert(mkdir(path, 0755) == 0);
+    snprintf(path, sizeof(path), "%s/tree/new/b.config", root);
+    file = fopen(path, "w");
+    assert(file != NULL);
+    fclose(file);
+    char removed[BUFFER_SIZE];
+    snprintf(removed, sizeof(removed), "%s/tree/sub/a.config", root);
+    assert(unlink(removed) == 0);
+
+    assert(config_index_query(tree, ".config", 0, &matches) == 0);
+    assert(matches.count == 1);
+    assert(strcmp(matches.items[0].path, path) == 0);
+    config_matches_free(&matches);
+
+    assert(config_index_query(tree, ".config", 1, &matches) == 0);
+    assert(matches.count == 1);
+    assert(strcmp(matches.items[0].path, path) == 0);
+    config_matches_free(&matches);
+
+    char command[BUFFER_SIZE];
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    assert(system(command) == 0);
+    unsetenv("XDG_CACHE_HOME");
+    printf("test_searchconfig_index passed successfully!\n");
+}
+
+/**
+ * @brief Test for searchconfig output.
+ *
+ * This test searches a directory with `-e` and checks that only the matching
+ * lines are printed, with their line numbers, and then checks that a search
+ * without a pattern copies the whole file into a redirected stdout.
+ */
+void test_searchconfig_pattern()
+{
+    char root[] = "/tmp/test_pattern.XXXXXX";
+    assert(mkdtemp(root) != NULL);
+    char path[BUFFER_SIZE];
+    snprintf(path, sizeof(path), "%s/app.config", root);
+    FILE* file = fopen(path, "w");
+    assert(file != NULL);
+    fputs("port=80\nhost=local\n# port again\n", file);
+    fclose(file);
+
+    char command[BUFFER_SIZE];
+    snprintf(command, sizeof(command), "searchconfig -e port %s > %s/out.txt", root, root);
+    assert(execute_single_command(command) == 1);
+
+    char out_path[BUFFER_SIZE];
+    snprintf(out_path, sizeof(out_path), "%s/out.txt", root);
+    file = fopen(out_path, "r");
+    assert(file != NULL);
+    char buffer[BUFFER_SIZE];
+    size_t bytes_read = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[bytes_read] = '\0';
+    fclose(file);
+    printf("Pattern output:\n%s", buffer);
+    char expected[BUFFER_SIZE];
+    snprintf(expected, sizeof(expected), "%s:1: port=80\n%s:3: # port again\n", path, path);
+    assert(strstr(buffer, expected) != NULL);
+    assert(strstr(buffer, "host=local") == NULL);
+
+    snprintf(command, sizeof(command), "searchconfig %s > %s/out.txt", root, root);
+    assert(execute_single_command(command) == 1);
+    file = fopen(out_path, "r");
+    assert(file != NULL);
+    bytes_read = fread(buffer, 1, sizeof(buffer) - 1, file);
+    buffer[bytes_read] = '\0';
+    fclose(file);
+    assert(strstr(buffer, "port=80\nhost=local\n# port again\n") != NULL);
+
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    assert(system(command) == 0);
+    printf("test_searchconfig_pattern passed successfully!\n");
+}
+
+/**
+ * @brief Test for the parallel walker behind searchconfig.
+ *
+ * This test builds a small tree with nested directories, a symbolic link to a
+ * matching file and a symbolic link to a directory, and checks that walks
+ * with 1, 2 and 8 threads return the same sorted list: the link to the file
+ * matches and the directory behind the other link is not walked again. It
+ * then checks the fstatat() fallback used when readdir reports DT_UNKNOWN.
+ */
+void test_searchconfig_walk()
+{
+    char root[] = "/tmp/test_walk.XXXXXX";
+    assert(mkdtemp(root) != NULL);
+    const char* dirs[] = {"sub", "sub/deep", "wide", "wide/a", "wide/b", "wide/c"};
+    const char* files[] = {"top.config", "notes.txt", "sub/b.config", "sub/deep/c.config",
+                           "wide/a/1.config", "wide/b/2.config", "wide/c/3.txt"};
+    char path[BUFFER_SIZE];
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        assert(mkdir(path, 0755) == 0);
+    }
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        FILE* file = fopen(path, "w");
+        assert(file != NULL);
+        fclose(file);
+    }
+    snprintf(path, sizeof(path), "%s/link.config", root);
+    assert(symlink("sub/b.config", path) == 0);
+    snprintf(path, sizeof(path), "%s/linkdir.config", root);
+    assert(symlink("sub", path) == 0);
+
+    const char* expected[] = {"link.config", "sub/b.config", "sub/deep/c.config",
+                              "top.config", "wide/a/1.config", "wide/b/2.config"};
+    size_t expected_count = sizeof(expected) / sizeof(expected[0]);
+    int threads[] = {1, 2, 8};
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+    {
+        config_matches_t matches = {0};
+        assert(search_directory_parallel(root, ".config", threads[t], &matches) == 0);
+        printf("%d threads: %zu matches\n", threads[t], matches.count);
+        assert(matches.count == expected_count);
+        for (size_t i = 0; i < matches.count; i++)
+        {
+            snprintf(path, sizeof(path), "%s/%s", root, expected[i]);
+            assert(matches.items[i].error == 0);
+            assert(strcmp(matches.items[i].path, path) == 0);
+        }
+        config_matches_free(&matches);
+    }
+
+    // Sin d_type el tipo sale de fstatat, con los enlaces tratados igual
+    int dir_fd = open(root, O_RDONLY | O_DIRECTORY);
+    assert(dir_fd != -1);
+    assert(config_entry_type(dir_fd, "top.config", DT_UNKNOWN) == DT_REG);
+    assert(config_entry_type(dir_fd, "sub", DT_UNKNOWN) == DT_DIR);
+    assert(config_entry_type(dir_fd, "link.config", DT_UNKNOWN) == DT_REG);
+    assert(config_entry_type(dir_fd, "linkdir.config", DT_UNKNOWN) == DT_UNKNOWN);
+    assert(config_entry_type(dir_fd, "linkdir.config", DT_LNK) == DT_UNKNOWN);
+    assert(config_entry_type(dir_fd, "missing", DT_UNKNOWN) == -1 && errno == ENOENT);
+    close(dir_fd);
+
+    snprintf(path, sizeof(path), "rm -rf %s", root);
+    assert(system(path) == 0);
+    printf("test_searchconfig_walk passed successfully!\n");
+}
+
+#define TEST_SHM_NAME "/shell_test_metrics"
+#define TEST_SHM_SAMPLES 200000
+
+/* Publica muestras cuyos campos valen todos el numero de muestra */
+static void* publish_samples(void* arg)
+{
+    metrics_shm_t* writer = arg;
+    metrics_sample_t sample;
+    for (int i = 1; i <= TEST_SHM_SAMPLES; i++)
+    {
+        double* fields = (double*)&sample;
+        for (size_t f = 0; f < sizeof(sample) / sizeof(double); f++)
+        {
+            fields[f] = i;
+        }
+        metrics_shm_publish(writer, &sample);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Test for the shared-memory metrics ring.
+ *
+ * This test publishes samples from one thread while another keeps reading the
+ * newest one through a separate read-only mapping. Every sample read must be
+ * consistent (all fields from the same write) and never older than the
+ * previous one. Samples that fell off the ring must be reported as gone.
+ */
+void test_metrics_shm()
+{
+    shm_unlink(TEST_SHM_NAME);
+    metrics_shm_t* writer = metrics_shm_create(TEST_SHM_NAME);
+    assert(writer != NULL);
+    metrics_shm_t* reader = metrics_shm_open(TEST_SHM_NAME);
+    assert(reader != NULL);
+
+    metrics_sample_t sample;
+    assert(metrics_shm_read_latest(reader, &sample, NULL) == -1);
+
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, publish_samples, writer) == 0);
+    uint64_t last = 0;
+    int reads = 0;
+    while (last < TEST_SHM_SAMPLES)
+    {
+        uint64_t number;
+        if (metrics_shm_read_latest(reader, &sample, &number) != 0)
+        {
+            continue;
+        }
+        double* fields = (double*)&sample;
+        for (size_t f = 0; f < sizeof(sample) / sizeof(double); f++)
+        {
+            assert(fields[f] == (double)number);
+        }
+        assert(number >= last);
+        last = number;
+        reads++;
+    }
+    pthread_join(thread, NULL);
+    printf("Read %d consistent samples while writing %d\n", reads, TEST_SHM_SAMPLES);
+
+    assert(metrics_shm_head(reader) == TEST_SHM_SAMPLES);
+    assert(metrics_shm_read(reader, TEST_SHM_SAMPLES - METRICS_RING_SLOTS + 1, &sample) == 0);
+    assert(metrics_shm_read(reader, TEST_SHM_SAMPLES - METRICS_RING_SLOTS, &sample) == -1);
+
+    metrics_shm_close(reader);
+    metrics_shm_close(writer);
+    shm_unlink(TEST_SHM_NAME);
+    printf("test_metrics_shm passed successfully!\n");
+}
+
+/**
+ * @brief Test for the binary metric record.
+ *
+ * This test encodes a sample, checks that it decodes back unchanged, that a
+ * record with a different schema hash is rejected, and that the JSON debug
+ * format round-trips too.
+ */
+void test_metric_record()
+{
+    metrics_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.timestamp = 1700000000.25;
+    sample.cpu_usage_percentage = 42.5;
+    sample.context_switches_total = 123456789;
+
+    metric_record_t record;
+    metric_record_encode(&record, &sample, 7);
+    assert((uintptr_t)&record % METRIC_RECORD_ALIGN == 0);
+    assert(record.sequence == 7);
+
+    metrics_sample_t decoded;
+    assert(metric_record_decode(&record, &decoded) == 0);
+    assert(memcmp(&decoded, &sample, sizeof(sample)) == 0);
+
+    record.schema_hash ^= 1;
+    assert(metric_record_decode(&record, &decoded) == -1);
+
+    char* json = metric_sample_to_json(&sample);
+    assert(json != NULL);
+    printf("JSON form: %s\n", json);
+    assert(metric_sample_from_json(json, &decoded) == 0);
+    free(json);
+    assert(decoded.cpu_usage_percentage == 42.5);
+    assert(decoded.context_switches_total == 123456789);
+
+    assert(metric_field_find("memory_usage_percentage") != NULL);
+    assert(metric_field_find("nope") == NULL);
+    printf("test_metric_record passed successfully!\n");
+}
+
+/**
+ * @brief Test for `status_monitor --watch`.
+ *
+ * This test publishes a sample into the monitor's ring and runs
+ * `status_monitor --json --watch 0.05 --count 3` with its output redirected,
+ * checking that exactly three samples were printed and that the command
+ * returned on its own. It then checks that an interval with a unit
+ * (`--watch 2s --count 1`) still watches instead of summarizing history.
+ */
+void test_status_monitor_watch()
+{
+    metrics_shm_t* writer = metrics_shm_create(METRICS_SHM_NAME);
+    assert(writer != NULL);
+    metrics_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.timestamp = time(NULL);
+    sample.cpu_usage_percentage = 33.0;
+    metrics_shm_publish(writer, &sample);
+
+    const char* temp_filename = "temp_watch_file.txt";
+    char command[] = "status_monitor --json --watch 0.05 --count 3 > temp_watch_file.txt";
+    assert(execute_single_command(command) == 1);
+
+    FILE* file = fopen(temp_filename, "r");
+    assert(file != NULL);
+    char line[BUFFER_SIZE];
+    int lines = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        assert(strstr(line, "\"cpu_usage_percentage\":33") != NULL);
+        lines++;
+    }
+    fclose(file);
+    assert(lines == 3);
+
+    // Intervalo con unidad: sigue siendo --watch, no una ventana de historia
+    char duration_command[] = "status_monitor --json --watch 2s --count 1 > temp_watch_file.txt";
+    assert(execute_single_command(duration_command) == 1);
+    file = fopen(temp_filename, "r");
+    assert(file != NULL);
+    lines = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        assert(strstr(line, "\"cpu_usage_percentage\":33") != NULL);
+        lines++;
+    }
+    fclose(file);
+    assert(lines == 1);
+
+    unlink(temp_filename);
+    metrics_shm_close(writer);
+    shm_unlink(METRICS_SHM_NAME);
+    printf("test_status_monitor_watch passed successfully!\n");
+}
+
+/**
+ * @brief Test for the metric history behind `status_monitor --history`.
+ *
+ * This test feeds ten minutes of one-per-second samples with CPU values
+ * 1..600 in scrambled order and disk reads growing 5 per second. It checks
+ * the exact aggregates and p95 at 1 s resolution, an estimate from the 10 s
+ * buckets, the rate computed for the counter, and the command output.
+ */
+void test_metrics_history()
+{
+    metrics_history_reset();
+    double now = time(NULL);
+    metrics_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+    for (int i = 0; i < 600; i++)
+    {
+        sample.timestamp = now - 599 + i;
+        sample.cpu_usage_percentage = (i * 7) % 600 + 1;
+        sample.disk_reads = 1000 + 5 * i;
+        metrics_history_add(&sample);
+    }
+
+    double quantiles[] = {0.5, 0.95};
+    double values[2];
+    metrics_summary_t summary;
+    assert(metrics_history_query("cpu_usage_percentage", 600, quantiles, 2,
+                                 values, &summary) == 0);
+    printf("10m: avg %.2f p50 %.2f p95 %.2f (%zu samples)\n", summary.avg,
+           values[0], values[1], summary.count);
+    assert(summary.count == 600);
+    assert(summary.resolution == 1);
+    assert(summary.min == 1 && summary.max == 600);
+    assert(fabs(summary.avg - 300.5) < 1e-9);
+    assert(fabs(values[0] - 300.5) < 1e-9);
+    assert(fabs(values[1] - 570.5) < 1e-9);
+
+    // Una hora: sale de los buckets de 10 s, ya resumidos por el sketch
+    assert(metrics_history_query("cpu_usage_percentage", 3600, quantiles, 2,
+                                 values, &summary) == 0);
+    printf("1h: p95 %.2f from %.0f s buckets\n", values[1],
+           summary.resolution);
+    assert(summary.resolution == 10);
+    assert(summary.count == 600);
+    assert(fabs(values[1] - 570.5) < 15);
+
+    assert(metrics_history_is_rate("disk_reads"));
+    assert(metrics_history_query("disk_reads", 600, NULL, 0, NULL,
+                                 &summary) == 0);
+    assert(summary.count == 599);
+    assert(fabs(summary.avg - 5) < 1e-9);
+    assert(metrics_history_query("nope", 600, NULL, 0, NULL, &summary) == -1);
+
+    const char* temp_filename = "temp_history_file.txt";
+    char command[] = "status_monitor --history -c 10m --p95 > temp_history_file.txt";
+    assert(execute_single_command(command) == 1);
+    FILE* file = fopen(temp_filename, "r");
+    assert(file != NULL);
+    char line[BUFFER_SIZE];
+    int found = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strstr(line, "CPU Usage (%)") && strstr(line, " p95 "))
+        {
+            found = 1;
+        }
+        assert(strstr(line, "Memory Usage") == NULL);
+    }
+    fclose(file);
+    assert(found);
+
+    unlink(temp_filename);
+    metrics_history_reset();
+    printf("test_metrics_history passed successfully!\n");
+}
+
+/**
+ * @brief Builds the i-th sample written by test_metrics_archive().
+ */
+static void archive_test_sample(int i, metrics_sample_t* sample)
+{
+    memset(sample, 0, sizeof(*sample));
+    // Un segundo con algo de jitter y un hueco largo a la mitad
+    sample->timestamp = 1700000000 + i + (i % 7 == 0 ? 0.013 : 0) + (i >= 1500 ? 500 : 0);
+    sample->cpu_usage_percentage = fmod(i * 0.37, 100);
+    sample->memory_usage_percentage = 42.0;
+    sample->disk_reads = 1000 + i * 3;
+    sample->network_bandwidth_rx = 1e9 + i * 1500.5;
+    sample->running_processes_count = 100 + i % 5;
+    sample->context_switches_total = 123456789 + i * 250;
+}
+
+typedef struct archive_check
+{
+    int next;
+} archive_check_t;
+
+static int archive_check_sample(const metrics_sample_t* sample, void* data)
+{
+    archive_check_t* check = data;
+    metrics_sample_t expected;
+    archive_test_sample(check->next++, &expected);
+    assert(fabs(sample->timestamp - expected.timestamp) < 0.0005);
+    assert(memcmp((const char*)sample + sizeof(double), (const char*)&expected + sizeof(double),
+                  sizeof(expected) - sizeof(double)) == 0);
+    return 0;
+}
+
+/**
+ * @brief Test for the compressed metric archive of `start_monitor --record`.
+ *
+ * This test writes 3000 samples (reopening the archive once), checks they
+ * take a fraction of their raw size, that a torn block at the end is
+ * ignored and cut off, that a scan returns every sample unchanged, and that
+ * a range aggregate matches a brute-force one while decompressing only the
+ * blocks cut by the range. It also runs `replay_monitor` on the file.
+ */
+void test_metrics_archive()
+{
+    const char* path = "temp_archive.bin";
+    unlink(path);
+    metrics_archive_writer_t* writer = metrics_archive_create(path);
+    assert(writer != NULL);
+    metrics_sample_t sample;
+    for (int i = 0; i < 2000; i++)
+    {
+        archive_test_sample(i, &sample);
+        assert(metrics_archive_append(writer, &sample) == 0);
+    }
+    assert(metrics_archive_close(writer) == 0);
+
+    // Un bloque a medio escribir no tiene que tapar a los siguientes
+    int fd = open(path, O_WRONLY | O_APPEND);
+    assert(fd != -1);
+    assert(write(fd, "MBLKtorn", 8) == 8);
+    close(fd);
+
+    writer = metrics_archive_create(path);
+    assert(writer != NULL);
+    for (int i = 2000; i < 3000; i++)
+    {
+        archive_test_sample(i, &sample);
+        assert(metrics_archive_append(writer, &sample) == 0);
+    }
+    assert(metrics_archive_close(writer) == 0);
+
+    struct stat statbuf;
+    assert(stat(path, &statbuf) == 0);
+    printf("3000 samples: %ld bytes (%zu raw)\n", (long)statbuf.st_size, 3000 * sizeof(metrics_sample_t));
+    assert((size_t)statbuf.st_size < 3000 * sizeof(metrics_sample_t) / 3);
+
+    metrics_archive_t archive;
+    assert(metrics_archive_open(path, &archive) == 0);
+    assert(archive.size == (size_t)statbuf.st_size);
+    archive_check_t check = {0};
+    assert(metrics_archive_scan(&archive, -INFINITY, INFINITY, archive_check_sample, &check) == 3000);
+    assert(check.next == 3000);
+
+    double from = 1700000000 + 700.5;
+    double to = 1700000000 + 2300.5;
+    metrics_aggregate_t expected = {0};
+    for (int i = 0; i < 3000; i++)
+    {
+        archive_test_sample(i, &sample);
+        double timestamp = round(sample.timestamp * 1000) / 1000;
+        if (timestamp >= from && timestamp <= to)
+        {
+            if (expected.count == 0 || sample.cpu_usage_percentage < expected.min)
+            {
+                expected.min = sample.cpu_usage_percentage;
+            }
+            if (expected.count == 0 || sample.cpu_usage_percentage > expected.max)
+            {
+                expected.max = sample.cpu_usage_percentage;
+            }
+            expected.sum += sample.cpu_usage_percentage;
+            expected.count++;
+        }
+    }
+    metrics_aggregate_t aggregate;
+    assert(metrics_archive_aggregate(&archive, metric_field_find("cpu_usage_percentage"), from, to, &aggregate) ==
+           0);
+    printf("Range: %zu samples, %zu blocks, %zu decompressed\n", aggregate.count, aggregate.blocks_scanned,
+           aggregate.blocks_decoded);
+    assert(aggregate.count == expected.count);
+    assert(aggregate.min == expected.min && aggregate.max == expected.max);
+    assert(fabs(aggregate.sum - expected.sum) < 1e-6);
+    assert(aggregate.blocks_decoded <= 2);
+    metrics_archive_unmap(&archive);
+
+    const char* temp_filename = "temp_replay_file.txt";
+    char command[] = "replay_monitor temp_archive.bin -f disk_reads > temp_replay_file.txt";
+    assert(execute_single_command(command) == 1);
+    FILE* file = fopen(temp_filename, "r");
+    assert(file != NULL);
+    char line[BUFFER_SIZE];
+    int found = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strstr(line, "disk_reads: avg 5498.50 min 1000.00 max 9997.00"))
+        {
+            found = 1;
+        }
+    }
+    fclose(file);
+    assert(found);
+
+    unlink(temp_filename);
+    unlink(path);
+    printf("test_metrics_archive passed successfully!\n");
+}
+
+/**
+ * @brief Test for the threshold triggers.
+ *
+ * This test registers `mem>90 for 30s cooldown 60s` and feeds it samples one
+ * second apart. It checks that the rule waits for the duration, fires once,
+ * stays disarmed until memory drops below the hysteresis band, and then waits
+ * for the cooldown before firing again. It also checks that the action runs
+ * as a background job, that a failing action shows its exit status in
+ * `jobs`, and that bad rules are rejected.
+ */
+void test_triggers()
+{
+    char error[BUFFER_SIZE];
+    assert(trigger_add("bogus>1 -> echo x", error, sizeof(error)) == -1);
+    assert(trigger_add("mem>90", error, sizeof(error)) == -1);
+    assert(trigger_add("mem=90 -> echo x", error, sizeof(error)) == -1);
+    assert(trigger_add("mem>90 for soon -> echo x", error, sizeof(error)) == -1);
+    assert(trigger_add("mem>90 clear 95 -> echo x", error, sizeof(error)) == -1);
+
+    const char* temp_filename = "temp_trigger_file.txt";
+    unlink(temp_filename);
+    int id = trigger_add("mem>90 for 30s cooldown 60s -> echo fired > temp_trigger_file.txt", error,
+                         sizeof(error));
+    assert(id > 0);
+    const trigger_t* rule = trigger_find(id);
+    assert(rule != NULL && rule->clear_level == 85.5);
+
+    metrics_sample_t sample;
+    memset(&sample, 0, sizeof(sample));
+    double start = 1700000000;
+    for (int t = 0; t <= 40; t++)
+    {
+        sample.timestamp = start + t;
+        sample.memory_usage_percentage = 95;
+        triggers_evaluate(&sample);
+        // Dispara al cumplirse los 30 s, y una sola vez
+        assert(rule->fired == (t >= 30 ? 1u : 0u));
+    }
+    assert(triggers_pending() == 1);
+    assert(triggers_run_pending() == 1);
+    assert(triggers_pending() == 0);
+
+    // Dentro de la banda de histeresis sigue desarmada
+    sample.timestamp = start + 41;
+    sample.memory_usage_percentage = 88;
+    triggers_evaluate(&sample);
+    assert(!rule->armed);
+    sample.timestamp = start + 42;
+    sample.memory_usage_percentage = 80;
+    triggers_evaluate(&sample);
+    assert(rule->armed);
+
+    // Rearmada, pero el cooldown la frena hasta 60 s despues del disparo
+    for (int t = 43; t <= 95; t++)
+    {
+        sample.timestamp = start + t;
+        sample.memory_usage_percentage = 95;
+        triggers_evaluate(&sample);
+        assert(rule->fired == (t >= 90 ? 2u : 1u));
+    }
+    assert(rule->last_fired == start + 90);
+
+    // La accion del primer disparo corre en segundo plano
+    FILE* file = NULL;
+    for (int i = 0; i < 100 && !file; i++)
+    {
+        file = fopen(temp_filename, "r");
+        if (!file)
+        {
+            usleep(20000);
+        }
+    }
+    assert(file != NULL);
+    char line[BUFFER_SIZE] = "";
+    for (int i = 0; i < 100 && !fgets(line, sizeof(line), file); i++)
+    {
+        usleep(20000);
+        clearerr(file);
+    }
+    fclose(file);
+    assert(strncmp(line, "fired", 5) == 0);
+
+    // Una accion que falla figura con su estado de salida en 'jobs'
+    assert(triggers_run_pending() == 1); // El segundo disparo de la regla
+    int failing = trigger_add("mem>90 -> false", error, sizeof(error));
+    assert(failing > 0);
+    sample.timestamp = start + 100;
+    triggers_evaluate(&sample);
+    assert(triggers_run_pending() == 1);
+    for (int i = 0; i < 100; i++)
+    {
+        usleep(20000);
+        sigchld_handler_logic();
+        char jobs_command[] = "jobs > temp_trigger_file.txt";
+        assert(execute_single_command(jobs_command) == 1);
+        file = fopen(temp_filename, "r");
+        assert(file != NULL);
+        line[0] = '\0';
+        int done = 0;
+        while (fgets(line, sizeof(line), file))
+        {
+            if (strstr(line, "false") && !strstr(line, "Running"))
+            {
+                assert(strstr(line, "Exit 1") != NULL);
+                done = 1;
+            }
+        }
+        fclose(file);
+        if (done)
+        {
+            break;
+        }
+        assert(i < 99);
+    }
+    assert(trigger_remove(failing) == 0);
+
+    // La linea llega sin separar, asi que '>' y '->' no son redirecciones
+    char command[] = "trigger add cpu >= 99.5 -> echo busy";
+    assert(execute_command(command) == 1);
+    assert(trigger_remove(id) == 0);
+    assert(trigger_remove(id) == -1);
+    char clear[] = "trigger clear";
+    assert(execute_command(clear) == 1);
+    assert(triggers_pending() == 0);
+
+    unlink(temp_filename);
+    printf("test_triggers passed successfully!\n");
+}
+
+/**
+ * @brief Test for the supervision of the monitor process.
+ *
+ * This test starts the monitor, kills it with SIGKILL and checks that the
+ * supervisor reaps it and starts a new one within milliseconds. It then
+ * writes a PID file pointing at the test itself and checks that
+ * `stop_monitor` does not signal a process that is not the monitor. Last, it
+ * checks that a monitor that never reports readiness counts as started as
+ * soon as it was executed, that one that opts into the handshake with
+ * MONITOR_READY_WAIT is waited for, and that one that cannot be executed
+ * fails at once.
+ */
+void test_monitor_supervisor()
+{
+    install_test_monitor();
+    char* args[] = {"start_monitor", NULL};
+    cmd_start_monitor(args);
+
+    FILE* pid_file = fopen(MONITOR_PID_FILE, "r");
+    assert(pid_file != NULL);
+    pid_t pid;
+    assert(fscanf(pid_file, "%d", &pid) == 1);
+    fclose(pid_file);
+
+    // Crash: the supervisor restarts it after MONITOR_RESTART_MIN_MS
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(kill(pid, SIGKILL) == 0);
+    pid_t restarted = 0;
+    long elapsed_ms = 0;
+    while (elapsed_ms < 2000)
+    {
+        if (monitor_supervise_pending())
+        {
+            monitor_supervise();
+        }
+        pid_file = fopen(MONITOR_PID_FILE, "r");
+        if (pid_file)
+        {
+            if (fscanf(pid_file, "%d", &restarted) != 1)
+            {
+                restarted = 0;
+            }
+            fclose(pid_file);
+        }
+        if (restarted > 0 && restarted != pid)
+        {
+            break;
+        }
+        usleep(5000);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    }
+    printf("Restarted as PID %d after %ld ms\n", restarted, elapsed_ms);
+    assert(restarted > 0 && restarted != pid);
+    assert(elapsed_ms < 1000);
+    assert(kill(pid, 0) == -1);     // The crashed one was reaped
+    assert(kill(restarted, 0) == 0);
+
+    // Its CPU cost is measured from its /proc/<pid>/stat
+    monitor_overhead_t overhead;
+    assert(monitor_overhead(&overhead) == 0);
+    assert(overhead.pid == restarted && overhead.cpu_percent >= 0);
+
+    cmd_stop_monitor();
+    assert(kill(restarted, 0) == -1);
+    assert(!monitor_supervise_pending());
+
+    // A stale PID file must not hit an unrelated process
+    pid_file = fopen(MONITOR_PID_FILE, "w");
+    assert(pid_file != NULL);
+    fprintf(pid_file, "%d\n", getpid());
+    fclose(pid_file);
+    assert(monitor_stop() == -1);
+    assert(access(MONITOR_PID_FILE, F_OK) == -1);
+
+    const char* program = getenv(MONITOR_PROGRAM_ENV);
+    char* saved_program = program ? strdup(program) : NULL;
+    const char* silent_program = "/tmp/test_silent_monitor";
+    const char* temp_filename = "temp_start_monitor.txt";
+    const char* scripts[] = {"#!/bin/sh\nexec sleep 600\n",
+                             "#!/bin/sh\necho ready >&$" MONITOR_READY_FD_ENV "\nexec sleep 600\n"};
+    const char* expected[] = {"Monitoring process started with PID", "(ready in"};
+    for (int i = 0; i < 2; i++)
+    {
+        FILE* script = fopen(silent_program, "w");
+        assert(script != NULL);
+        fputs(scripts[i], script);
+        fclose(script);
+        assert(chmod(silent_program, 0755) == 0);
+        assert(setenv(MONITOR_PROGRAM_ENV, silent_program, 1) == 0);
+        if (i == 1)
+        {
+            assert(setenv(MONITOR_READY_WAIT_ENV, "1", 1) == 0);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        char command[] = "start_monitor > temp_start_monitor.txt";
+        assert(execute_single_command(command) == 1);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+
+        char output[BUFFER_SIZE];
+        FILE* file = fopen(temp_filename, "r");
+        assert(file != NULL);
+        size_t length = fread(output, 1, sizeof(output) - 1, file);
+        output[length] = '\0';
+        fclose(file);
+        printf("%s", output);
+        printf("Started in %ld ms\n", elapsed_ms);
+        assert(strstr(output, expected[i]) != NULL);
+        assert(strstr(output, "not ready") == NULL);
+        assert(elapsed_ms < MONITOR_READY_TIMEOUT_MS / 2);
+        assert(monitor_stop() == 0);
+        unsetenv(MONITOR_READY_WAIT_ENV);
+    }
+    unlink(temp_filename);
+    remove(silent_program);
+
+    // Not executable: reported by the exec pipe, without waiting
+    assert(setenv(MONITOR_PROGRAM_ENV, silent_program, 1) == 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    assert(monitor_start() == -1);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed_ms = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    assert(elapsed_ms < MONITOR_READY_TIMEOUT_MS / 2);
+    assert(access(MONITOR_PID_FILE, F_OK) == -1);
+
+    if (saved_program)
+    {
+        setenv(MONITOR_PROGRAM_ENV, saved_program, 1);
+        free(saved_program);
+    }
+    else
+    {
+        unsetenv(MONITOR_PROGRAM_ENV);
+    }
+
+    printf("test_monitor_supervisor passed successfully!\n");
+}
+
+static volatile int control_server_running = 1;
+static monitor_config_t control_server_config;
+
+// memcmp would also compare the padding after the bitmask
+static int same_config(const monitor_config_t* a, const monitor_config_t* b)
+{
+    return a->interval == b->interval && a->metrics == b->metrics;
+}
+
+/* Monitor de prueba: atiende el socket de control hasta que se le pide parar */
+static void* control_server(void* arg)
+{
+    int listen_fd = *(int*)arg;
+    while (control_server_running)
+    {
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 20) > 0)
+        {
+            monitor_control_serve(listen_fd, &control_server_config);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Test for the monitor configuration and its control socket.
+ *
+ * This test applies `key=value` assignments, saves and reloads the
+ * configuration file, and checks that no temporary file is left behind. It
+ * then runs the serving side of the control socket in a thread, the way the
+ * monitor's sampling loop would, and checks that a configuration sent by the
+ * shell is applied live and read back.
+ */
+void test_monitor_config()
+{
+    const char* path = "temp_monitor_config.json";
+    const char* socket_path = "/tmp/test_monitor_control.sock";
+    char error[256];
+    size_t count;
+    const metric_field_t* fields = metric_fields(&count);
+
+    monitor_config_t config;
+    monitor_config_default(&config);
+    assert(monitor_config_assign(&config, "interval=500ms", error, sizeof(error)) == 0);
+    assert(monitor_config_assign(&config, "metrics=cpu,mem", error, sizeof(error)) == 0);
+    assert(fabs(config.interval - 0.5) < 1e-9);
+    uint32_t expected = 1u << 0; // timestamp
+    expected |= 1u << (metric_field_find("cpu_usage_percentage") - fields);
+    expected |= 1u << (metric_field_find("memory_usage_percentage") - fields);
+    assert(config.metrics == expected);
+
+    // Rejected assignments leave the configuration as it was
+    monitor_config_t before = config;
+    assert(monitor_config_assign(&config, "interval=0s", error, sizeof(error)) == -1);
+    assert(monitor_config_assign(&config, "metrics=cpu,bogus", error, sizeof(error)) == -1);
+    assert(monitor_config_assign(&config, "color=red", error, sizeof(error)) == -1);
+    assert(same_config(&before, &config));
+
+    // Atomic save: the file reloads the same and no temporary is left
+    remove(path);
+    assert(monitor_config_save(path, &config) == 0);
+    monitor_config_t loaded;
+    assert(monitor_config_load(path, &loaded) == 0);
+    assert(same_config(&loaded, &config));
+    char temp[256];
+    snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+    assert(access(temp, F_OK) == -1);
+    remove(path);
+
+    // No monitor listening
+    unlink(socket_path);
+    assert(monitor_control_set(socket_path, &config, error, sizeof(error)) == -1);
+
+    monitor_config_default(&control_server_config);
+    int listen_fd = monitor_control_listen(socket_path);
+    assert(listen_fd != -1);
+    pthread_t server;
+    control_server_running = 1;
+    assert(pthread_create(&server, NULL, control_server, &listen_fd) == 0);
+
+    assert(monitor_control_set(socket_path, &config, error, sizeof(error)) == 0);
+    assert(same_config(&config, &loaded));
+    monitor_config_t live;
+    assert(monitor_control_get(socket_path, &live, error, sizeof(error)) == 0);
+    assert(same_config(&live, &loaded));
+
+    control_server_running = 0;
+    pthread_join(server, NULL);
+    assert(same_config(&control_server_config, &loaded));
+    close(listen_fd);
+    unlink(socket_path);
+
+    printf("test_monitor_config passed successfully!\n");
+}
+
+/**
+ * @brief Test for demand-driven sampling.
+ *
+ * This test drives a pacer tick by tick: without readers the samples get
+ * further apart (after 0, 1, 3, 7 and 15 ticks), with a reader every tick
+ * samples, and once the reader leaves the backoff starts over. It also checks
+ * that a reader's announcement is seen through the shared lease, which only
+ * its owner can open, and that a
+ * /proc file kept open reads the same file again with pread.
+ */
+void test_metrics_demand()
+{
+    metrics_pacer_t pacer;
+    metrics_pacer_init(&pacer);
+    double base = 0.1;
+    int expected_idle[] = {0, 1, 3, 7, 15};
+    size_t next = 0;
+    for (int tick = 0; tick < 20; tick++)
+    {
+        int due = metrics_pacer_due(&pacer, 100 + tick * base, base, 0);
+        int expected = next < 5 && expected_idle[next] == tick;
+        assert(due == expected);
+        next += due;
+    }
+    assert(next == 5);
+    assert(fabs(pacer.idle_interval - base * METRICS_IDLE_MAX_FACTOR) < 1e-9);
+
+    // A reader: every tick samples
+    for (int tick = 20; tick < 25; tick++)
+    {
+        assert(metrics_pacer_due(&pacer, 100 + tick * base, base, 1) == 1);
+    }
+    // The reader left: the backoff starts over from one tick
+    int expected_after[] = {1, 0, 1, 0, 0, 0, 1};
+    for (int tick = 25; tick < 32; tick++)
+    {
+        assert(metrics_pacer_due(&pacer, 100 + tick * base, base, 0) == expected_after[tick - 25]);
+    }
+
+    metrics_demand_touch(1.0);
+    assert(metrics_demand_active());
+    // Only the monitor's user may hold the collector at full rate
+    int demand_fd = shm_open(METRICS_DEMAND_NAME, O_RDONLY, 0);
+    assert(demand_fd != -1);
+    struct stat demand_stat;
+    assert(fstat(demand_fd, &demand_stat) == 0);
+    assert((demand_stat.st_mode & 0777) == 0600);
+    close(demand_fd);
+
+    proc_file_t stat;
+    assert(proc_file_open(&stat, "/proc/self/stat") == 0);
+    char first[1024], second[1024];
+    assert(proc_file_read(&stat, first, sizeof(first)) > 0);
+    assert(proc_file_read(&stat, second, sizeof(second)) > 0);
+    assert(atoi(first) == getpid() && atoi(second) == getpid());
+    proc_file_close(&stat);
+    proc_file_close(&stat);
+    assert(proc_file_read(&stat, first, sizeof(first)) == -1);
+
+    printf("test_metrics_demand passed successfully!\n");
+}
+
+/**
+ * @brief Test for the per-job resource accounting.
+ *
+ * This test samples a busy child through its /proc files, records its end
+ * with the usage from wait4() and checks what `jobs -l` prints before and
+ * after the job is reported. It then checks that `time` reports the CPU and
+ * memory of a timed pipeline on stderr.
+ */
+void test_job_usage()
+{
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        // Gasta CPU hasta que lo maten
+        for (volatile unsigned long i = 0;; i++)
+        {
+        }
+    }
+    int job_id = add_job(pid, "busy loop");
+    assert(job_id > 0);
+
+    char path[BUFFER_SIZE];
+    proc_file_t stat, status;
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    assert(proc_file_open(&stat, path) == 0);
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    assert(proc_file_open(&status, path) == 0);
+    job_usage_t live;
+    memset(&live, 0, sizeof(live));
+    double cpu = 0;
+    for (int i = 0; i < 100 && cpu < 0.05; i++)
+    {
+        usleep(10000);
+        assert(job_usage_sample(&stat, &status, &live) == 0);
+        cpu = live.user + live.sys;
+    }
+    assert(cpu >= 0.05);
+    assert(live.max_rss > 0);
+    assert(live.voluntary_switches + live.involuntary_switches > 0);
+
+    kill(pid, SIGKILL);
+    int wait_status;
+    struct rusage rusage;
+    assert(wait4(pid, &wait_status, 0, &rusage) == pid);
+    // Reaped: the files only give ESRCH now
+    assert(job_usage_sample(&stat, &status, &live) == -1);
+    proc_file_close(&stat);
+    proc_file_close(&status);
+    assert(finish_job(pid, wait_status, &rusage) == 1);
+    assert(finish_job(pid, wait_status, &rusage) == 0);
+
+    // 'jobs -l' prints the final usage once, then forgets the job
+    const char* temp_filename = "temp_jobs_file.txt";
+    char line[BUFFER_SIZE];
+    for (int round = 0; round < 2; round++)
+    {
+        fflush(stdout);
+        int saved = dup(STDOUT_FILENO);
+        int fd = open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        assert(saved != -1 && fd != -1);
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+        print_jobs(1);
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+
+        FILE* file = fopen(temp_filename, "r");
+        assert(file != NULL);
+        int found = 0;
+        while (fgets(line, sizeof(line), file))
+        {
+            if (strstr(line, "busy loop") && strstr(line, "Killed"))
+            {
+                found = 1;
+                assert(fgets(line, sizeof(line), file) != NULL);
+                double real, user, sys;
+                assert(sscanf(line, " %lfs real, %lfs user, %lfs sys", &real, &user, &sys) == 3);
+                assert(real > 0 && user + sys >= 0.05);
+            }
+        }
+        fclose(file);
+        assert(found == (round == 0));
+    }
+
+    // 'time' measures the whole pipeline, children included
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    int fd = open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(saved != -1 && fd != -1);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+    char command[] = "time sh -c 'i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done' | cat";
+    assert(execute_command(command) == 1);
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    FILE* file = fopen(temp_filename, "r");
+    assert(file != NULL);
+    double real = -1, user = -1, sys = -1;
+    long rss = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        sscanf(line, "real %lfs", &real);
+        sscanf(line, "user %lfs", &user);
+        sscanf(line, "sys %lfs", &sys);
+        sscanf(line, "max RSS %ld KiB", &rss);
+    }
+    fclose(file);
+    assert(real > 0 && user + sys > 0 && rss > 0);
+
+    unlink(temp_filename);
+    printf("test_job_usage passed successfully!\n");
+}
+
+#define STATS_THREADS 4
+#define STATS_VALUES 10000
+
+static void* record_stats(void* arg)
+{
+    (void)arg;
+    for (uint64_t value = 1; value <= STATS_VALUES; value++)
+    {
+        shell_stats_record(SHELL_HIST_PIPELINE_STAGES, value);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Test for the shell's own metrics.
+ *
+ * This test records from several threads and checks that no value is lost
+ * and that the quantiles are within the histogram's precision. It then runs
+ * commands and checks the spawn, exec-failure and PATH-cache metrics, and
+ * reads the Prometheus text from the Unix socket.
+ */
+void test_shell_stats()
+{
+    shell_histogram_snapshot_t before, after;
+    shell_stats_snapshot(SHELL_HIST_PIPELINE_STAGES, &before);
+    pthread_t threads[STATS_THREADS];
+    for (int i = 0; i < STATS_THREADS; i++)
+    {
+        assert(pthread_create(&threads[i], NULL, record_stats, NULL) == 0);
+    }
+    for (int i = 0; i < STATS_THREADS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    shell_stats_snapshot(SHELL_HIST_PIPELINE_STAGES, &after);
+    assert(after.count - before.count == STATS_THREADS * STATS_VALUES);
+
+    // Only what the threads recorded: 1..10000, four times
+    shell_histogram_snapshot_t recorded;
+    memset(&recorded, 0, sizeof(recorded));
+    for (size_t i = 0; i < SHELL_STATS_BUCKETS; i++)
+    {
+        recorded.buckets[i] = after.buckets[i] - before.buckets[i];
+    }
+    recorded.count = after.count - before.count;
+    double quantiles[] = {0.5, 0.9, 0.99, 1.0};
+    for (int q = 0; q < 4; q++)
+    {
+        double exact = quantiles[q] * STATS_VALUES;
+        double estimate = shell_stats_quantile(&recorded, quantiles[q]);
+        assert(estimate >= exact && estimate <= exact * (1 + 1.0 / 16) + 1);
+    }
+
+    // Spawns, an exec failure and PATH cache hits
+    uint64_t failures = shell_stats_counter(SHELL_COUNTER_EXEC_FAILURES);
+    uint64_t hits = shell_stats_counter(SHELL_COUNTER_PATH_HITS);
+    shell_histogram_snapshot_t spawns;
+    shell_stats_snapshot(SHELL_HIST_SPAWN, &spawns);
+    char first[] = "true";
+    char second[] = "true";
+    char missing[] = "no_such_command_for_stats 2> /dev/null";
+    assert(execute_command(first) == 1);
+    assert(execute_command(second) == 1);
+    assert(execute_command(missing) == 1);
+    assert(shell_stats_counter(SHELL_COUNTER_EXEC_FAILURES) == failures + 1);
+    assert(shell_stats_counter(SHELL_COUNTER_PATH_HITS) >= hits + 1);
+    assert(path_cache_lookup("no_such_command_for_stats") == NULL);
+    shell_stats_snapshot(SHELL_HIST_SPAWN, &after);
+    assert(after.count == spawns.count + 2);
+
+    // The same text over the Unix socket
+    const char* socket_path = "/tmp/test_shell_stats.sock";
+    assert(shell_stats_listen(socket_path) == 0);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    assert(connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0);
+    const char* request = "GET /metrics HTTP/1.0\r\n\r\n";
+    assert(write(fd, request, strlen(request)) == (ssize_t)strlen(request));
+    char* text = malloc(1 << 16);
+    size_t length = 0;
+    ssize_t count;
+    while ((count = read(fd, text + length, (1 << 16) - 1 - length)) > 0)
+    {
+        length += count;
+    }
+    text[length] = '\0';
+    close(fd);
+    assert(strncmp(text, "HTTP/1.0 200 OK", 15) == 0);
+    assert(strstr(text, "# TYPE shell_spawn_duration_seconds histogram") != NULL);
+    char expected[128];
+    snprintf(expected, sizeof(expected), "shell_exec_failures_total %llu\n", (unsigned long long)(failures + 1));
+    assert(strstr(text, expected) != NULL);
+    free(text);
+    shell_stats_close();
+    assert(access(socket_path, F_OK) == -1);
+
+    printf("test_shell_stats passed successfully!\n");
+}
+
+/**
+ * @brief Test for the Chrome trace of the shell's execution.
+ *
+ * This test traces a pipeline and a command, writes the trace and checks
+ * that it has the parse, fork and wait spans, a named track per child and a
+ * matching end for every begin. It then checks that nothing is recorded
+ * once tracing stops.
+ */
+void test_trace()
+{
+    const char* temp_filename = "temp_trace.json";
+    assert(trace_start(temp_filename) == 0);
+    char pipeline[] = "echo traced | cat > /dev/null";
+    char single[] = "true";
+    assert(execute_command(pipeline) == 1);
+    assert(execute_command(single) == 1);
+    assert(trace_flush() == 0);
+
+    FILE* file = fopen(temp_filename, "r");
+    assert(file != NULL);
+    char line[BUFFER_SIZE];
+    int begins = 0, ends = 0, tracks = 0, parse = 0, fork_spans = 0, waits = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        begins += strstr(line, "\"ph\":\"B\"") != NULL;
+        ends += strstr(line, "\"ph\":\"E\"") != NULL;
+        tracks += strstr(line, "\"process_name\"") != NULL;
+        parse += strstr(line, "\"name\":\"parse\",\"ph\":\"B\"") != NULL;
+        fork_spans += strstr(line, "\"name\":\"fork\",\"ph\":\"B\"") != NULL;
+        waits += strstr(line, "\"name\":\"wait\",\"ph\":\"B\"") != NULL;
+    }
+    fclose(file);
+    assert(begins > 0 && begins == ends);
+    // The shell plus three children
+    assert(tracks == 4);
+    assert(parse == 3 && fork_spans == 3 && waits == 2);
+
+    trace_stop();
+    assert(!trace_enabled);
+    assert(execute_command(single) == 1);
+    assert(trace_flush() == -1);
+
+    unlink(temp_filename);
+    printf("test_trace passed successfully!\n");
+}
+
+typedef struct
+{
+    char output[BUFFER_SIZE];
+    size_t length;
+    int status;
+    int finished;
+} shellcore_result_t;
+
+static void shellcore_output(void* data, int run, int fd, const char* bytes, size_t length)
+{
+    (void)run;
+    shellcore_result_t* result = data;
+    // stderr tambien se junta, para ver el error de un comando inexistente
+    assert(fd == 1 || fd == 2);
+    assert(result->length + length < sizeof(result->output));
+    memcpy(result->output + result->length, bytes, length);
+    result->length += length;
+    result->output[result->length] = '\0';
+}
+
+static void shellcore_exit(void* data, int run, int status)
+{
+    (void)run;
+    shellcore_result_t* result = data;
+    result->status = status;
+    result->finished = 1;
+}
+
+/* Corre line en ctx hasta que termina */
+static void shellcore_run_line(shell_ctx_t* ctx, const char* line, shellcore_result_t* result)
+{
+    static const shell_callbacks_t callbacks = {shellcore_output, shellcore_exit};
+    memset(result, 0, sizeof(*result));
+    assert(shell_run(ctx, line, &callbacks, result) > 0);
+    while (!result->finished)
+    {
+        assert(shell_ctx_poll(ctx, 5000) >= 0);
+    }
+}
+
+static void* shellcore_worker(void* arg)
+{
+    shell_ctx_t* ctx = shell_ctx_create();
+    assert(ctx != NULL);
+    shellcore_result_t result;
+    for (int i = 0; i < 20; i++)
+    {
+        shellcore_run_line(ctx, arg, &result);
+        assert(WIFEXITED(result.status) && WEXITSTATUS(result.status) == 0);
+        assert(strcmp(result.output, "3\n") == 0);
+    }
+    shell_ctx_destroy(ctx);
+    return NULL;
+}
+
+/**
+ * @brief Test the reentrant executor of libshellcore.
+ *
+ * Two threads run pipelines on their own contexts at the same time; then the
+ * output, exit status, error codes and per-context directory are checked.
+ * Built-ins and here-documents are rejected, and a here-document body queued
+ * by the shell is not taken.
+ */
+void test_shellcore()
+{
+    pthread_t threads[2];
+    char* lines[] = {"printf 'a\\nb\\nc\\n' | wc -l", "echo one two three | wc -w"};
+    for (int i = 0; i < 2; i++)
+    {
+        assert(pthread_create(&threads[i], NULL, shellcore_worker, lines[i]) == 0);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    shell_ctx_t* ctx = shell_ctx_create();
+    assert(ctx != NULL);
+    shellcore_result_t result;
+    shellcore_run_line(ctx, "echo hello | tr a-z A-Z", &result);
+    assert(strcmp(result.output, "HELLO\n") == 0);
+
+    shellcore_run_line(ctx, "nonexistent_command_xyz", &result);
+    assert(WIFEXITED(result.status) && WEXITSTATUS(result.status) == 127);
+    assert(strstr(result.output, "nonexistent_command_xyz") != NULL);
+
+    shellcore_run_line(ctx, "sh -c 'exit 3'", &result);
+    assert(WIFEXITED(result.status) && WEXITSTATUS(result.status) == 3);
+
+    // Lo que la libreria no ejecuta se rechaza sin arrancar nada
+    assert(shell_run(ctx, "echo <", NULL, NULL) == SHELL_ERR_SYNTAX);
+    assert(strlen(shell_ctx_error(ctx)) > 0);
+    assert(shell_run(ctx, "cat <(true)", NULL, NULL) == SHELL_ERR_UNSUPPORTED);
+    assert(shell_run(ctx, "sleep 1 &", NULL, NULL) == SHELL_ERR_UNSUPPORTED);
+    assert(shell_run(ctx, "cd /tmp", NULL, NULL) == SHELL_ERR_UNSUPPORTED);
+    assert(shell_run(ctx, "ls | jobs", NULL, NULL) == SHELL_ERR_UNSUPPORTED);
+    for (const builtin_t* builtin = builtins; builtin->name; builtin++)
+    {
+        // echo runs from PATH
+        int expected = strcmp(builtin->name, "echo") == 0 ? 1 : 0;
+        assert((shell_run(ctx, builtin->name, NULL, NULL) > 0) == expected);
+    }
+    while (shell_ctx_poll(ctx, 100) > 0)
+    {
+    }
+
+    // A here-document body queued by the shell is left where it is
+    FILE* body = fmemopen("queued\nEOF\n", 11, "r");
+    assert(body != NULL);
+    assert(heredoc_collect("cat <<EOF", body) == 0);
+    fclose(body);
+    assert(shell_run(ctx, "cat <<EOF", NULL, NULL) == SHELL_ERR_UNSUPPORTED);
+    char* queued = heredoc_next_body();
+    assert(queued != NULL && strcmp(queued, "queued\n") == 0);
+    free(queued);
+    assert(shell_ctx_poll(ctx, 0) == 0);
+
+    char cwd[PATH_MAX];
+    assert(getcwd(cwd, sizeof(cwd)) != NULL);
+    assert(shell_ctx_chdir(ctx, "/tmp") == SHELL_OK);
+    shellcore_run_line(ctx, "pwd", &result);
+    assert(strcmp(result.output, "/tmp\n") == 0);
+    char after[PATH_MAX];
+    assert(getcwd(after, sizeof(after)) != NULL && strcmp(cwd, after) == 0);
+    assert(shell_ctx_chdir(ctx, "/nonexistent_dir_xyz") == SHELL_ERR_SYSTEM);
+
+    // Destruir con una corrida en curso la mata
+    assert(shell_run(ctx, "sleep 30", NULL, NULL) > 0);
+    assert(shell_ctx_poll(ctx, 0) == 1);
+    shell_ctx_destroy(ctx);
+
+    printf("test_shellcore passed successfully!\n");
+}
+
+/* Sends line to the server and returns its status; the output goes to out */
+static int serve_line(int sock, const char* cwd, const char* line, char* const env[], char* out, size_t size)
+{
+    int pipe_fds[2];
+    assert(pipe(pipe_fds) == 0);
+    int null_fd = open("/dev/null", O_RDONLY);
+    int fds[SERVE_FDS] = {null_fd, pipe_fds[1], pipe_fds[1]};
+    assert(serve_send_request(sock, cwd, line, env, fds) == 0);
+    close(null_fd);
+    close(pipe_fds[1]);
+    int status;
+    assert(serve_recv_status(sock, &status) == 0);
+    ssize_t length = read(pipe_fds[0], out, size - 1);
+    out[length > 0 ? length : 0] = '\0';
+    close(pipe_fds[0]);
+    return status;
+}
+
+/**
+ * @brief Test the exit status of command lines and the command server.
+ *
+ * A forked server runs lines with the client's descriptors, directory and
+ * environment; a 'cd' in one request does not change the next.
+ */
+void test_serve()
+{
+    char failing[] = "sh -c 'exit 4'";
+    assert(execute_command(failing) == 1 && last_status == 4);
+    char piped[] = "sh -c 'exit 5' | true";
+    assert(execute_command(piped) == 1 && last_status == 0);
+    char builtin[] = "echo status > /dev/null";
+    assert(execute_command(builtin) == 1 && last_status == 0);
+
+    const char* path = "/tmp/test_serve.sock";
+    pid_t server = fork();
+    if (server == 0)
+    {
+        _exit(serve_run(path));
+    }
+    int sock = -1;
+    for (int i = 0; i < 100 && sock == -1; i++)
+    {
+        usleep(10000);
+        sock = serve_connect(path);
+    }
+    assert(sock != -1);
+
+    char out[BUFFER_SIZE];
+    assert(serve_line(sock, NULL, "echo hello | tr a-z A-Z", NULL, out, sizeof(out)) == 0);
+    assert(strcmp(out, "HELLO\n") == 0);
+    assert(serve_line(sock, NULL, "sh -c 'exit 3'", NULL, out, sizeof(out)) == 3);
+
+    char* env[] = {"SERVE_TEST_VAR=from client", "HOME", NULL};
+    assert(serve_line(sock, "/tmp", "pwd", env, out, sizeof(out)) == 0);
+    assert(strcmp(out, "/tmp\n") == 0);
+    assert(serve_line(sock, NULL, "printenv SERVE_TEST_VAR", env, out, sizeof(out)) == 0);
+    assert(strcmp(out, "from client\n") == 0);
+    assert(serve_line(sock, NULL, "printenv HOME", env, out, sizeof(out)) == 1);
+
+    // Each request runs in its own fork of the server
+    char cwd[PATH_MAX];
+    assert(getcwd(cwd, sizeof(cwd)) != NULL);
+    assert(serve_line(sock, NULL, "cd /\npwd", NULL, out, sizeof(out)) == 0);
+    assert(strcmp(out, "/\n") == 0);
+    assert(serve_line(sock, NULL, "pwd", NULL, out, sizeof(out)) == 0);
+    assert(strncmp(out, cwd, strlen(cwd)) == 0);
+    close(sock);
+
+    // A second server on a live socket is refused
+    assert(serve_run(path) == EXIT_FAILURE);
+
+    kill(server, SIGTERM);
+    int status;
+    assert(waitpid(server, &status, 0) == server);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+    assert(access(path, F_OK) == -1);
+    printf("test_serve passed successfully!\n");
+}
+
+/* Counts the lines of a file, 0 if it does not exist */
+static int count_file_lines(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        return 0;
+    }
+    int lines = 0;
+    int c;
+    while ((c = fgetc(file)) != EOF)
+    {
+        lines += c == '\n';
+    }
+    fclose(file);
+    return lines;
+}
+
+/**
+ * @brief Test for the memo built-in.
+ *
+ * A command that logs each real run is memoized: a repeated call must replay
+ * its output and status without running it, and changing an input file or a
+ * declared variable must run it again. A tiny size limit then evicts the
+ * least recently used entries.
+ */
+void test_memo()
+{
+    char root[] = "/tmp/test_memo.XXXXXX";
+    assert(mkdtemp(root) != NULL);
+    char path[BUFFER_SIZE];
+    snprintf(path, sizeof(path), "%s/cache", root);
+    setenv(MEMO_DIR_ENV, path, 1);
+    char input[BUFFER_SIZE], runs[BUFFER_SIZE], out[BUFFER_SIZE];
+    snprintf(input, sizeof(input), "%s/input.txt", root);
+    snprintf(runs, sizeof(runs), "%s/runs", root);
+    snprintf(out, sizeof(out), "%s/out", root);
+    FILE* file = fopen(input, "w");
+    assert(file != NULL);
+    fprintf(file, "first\n");
+    fclose(file);
+
+    char line[BUFFER_SIZE];
+    snprintf(line, sizeof(line), "memo -i %s -e MEMO_TEST sh -c 'echo run >> %s; cat %s; exit 4' > %s", input, runs, input, out);
+    setenv("MEMO_TEST", "a", 1);
+    uint64_t hits = shell_stats_counter(SHELL_COUNTER_MEMO_HITS);
+    for (int i = 0; i < 3; i++)
+    {
+        char command[BUFFER_SIZE];
+        strcpy(command, line);
+        assert(execute_command(command) == 1);
+        assert(last_status == 4);
+        assert(count_file_lines(runs) == 1);
+        file = fopen(out, "r");
+        assert(file != NULL);
+        char buffer[BUFFER_SIZE];
+        assert(fgets(buffer, sizeof(buffer), file) && strcmp(buffer, "first\n") == 0);
+        fclose(file);
+    }
+    assert(shell_stats_counter(SHELL_COUNTER_MEMO_HITS) == hits + 2);
+
+    // A different input or variable is a different key
+    file = fopen(input, "w");
+    assert(file != NULL);
+    fprintf(file, "second\n");
+    fclose(file);
+    char command[BUFFER_SIZE];
+    strcpy(command, line);
+    assert(execute_command(command) == 1 && count_file_lines(runs) == 2);
+    setenv("MEMO_TEST", "b", 1);
+    strcpy(command, line);
+    assert(execute_command(command) == 1 && count_file_lines(runs) == 3);
+    unsetenv("MEMO_TEST");
+    strcpy(command, line);
+    assert(execute_command(command) == 1 && count_file_lines(runs) == 4);
+
+    size_t entries;
+    uint64_t bytes;
+    assert(memo_usage(&entries, &bytes) == 0 && entries == 4);
+
+    // Room for about two entries: the oldest go, the one just replayed stays
+    snprintf(path, sizeof(path), "%" PRIu64, bytes / 2);
+    setenv(MEMO_MAX_BYTES_ENV, path, 1);
+    setenv("MEMO_TEST", "a", 1);
+    strcpy(command, line);
+    assert(execute_command(command) == 1 && count_file_lines(runs) == 4);
+    strcpy(command, "memo true");
+    assert(execute_command(command) == 1);
+    assert(memo_usage(&entries, &bytes) == 0 && entries <= 3);
+    strcpy(command, line);
+    assert(execute_command(command) == 1 && count_file_lines(runs) == 4);
+
+    assert(memo_clear() >= 1);
+    assert(memo_usage(&entries, &bytes) == 0 && entries == 0);
+
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    assert(system(command) == 0);
+    unsetenv(MEMO_DIR_ENV);
+    unsetenv(MEMO_MAX_BYTES_ENV);
+    unsetenv("MEMO_TEST");
+    printf("test_memo passed successfully!\n");
+}
+
+/**
+ * @brief Test for the shared command history.
+ *
+ * Several processes append to the same file at once and every record must
+ * survive whole. Searches return each distinct command once, newest first,
+ * with its metadata, and see what other processes appended after the index
+ * was built. A small size limit then compacts the file to its newest half.
+ * Last, a record cut short as by a killed writer is dropped, and what is
+ * appended after it stays visible.
+ */
+void test_history_log()
+{
+    char root[] = "/tmp/test_history.XXXXXX";
+    assert(mkdtemp(root) != NULL);
+    char path[BUFFER_SIZE];
+    snprintf(path, sizeof(path), "%s/history", root);
+    assert(history_log_open(path) == 0);
+    assert(history_log_count() == 0);
+
+    // Concurrent writers
+    for (int writer = 0; writer < 4; writer++)
+    {
+        pid_t pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+        {
+            history_log_close();
+            if (history_log_open(path) == -1)
+            {
+                _exit(1);
+            }
+            for (int i = 0; i < 50; i++)
+            {
+                char command[64];
+                snprintf(command, sizeof(command), "make target%d", i % 10);
+                if (history_log_append(command, "/src", writer, i, 1000) == -1)
+                {
+                    _exit(1);
+                }
+            }
+            _exit(0);
+        }
+    }
+    int status;
+    while (wait(&status) > 0)
+    {
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    assert(history_log_count() == 200);
+
+    history_entry_t entries[16];
+    assert(history_log_search("target", entries, 16) == 10);
+    assert(history_log_search("get7", entries, 16) == 1);
+    assert(strcmp(entries[0].command, "make target7") == 0);
+    assert(strcmp(entries[0].cwd, "/src") == 0 && entries[0].duration_ns == 1000);
+    assert(history_log_search("no such command", entries, 16) == 0);
+
+    // Appended after the index exists, by this process and by another one
+    assert(history_log_append("git status", "/home", 3, 0, 5) == 0);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        history_log_close();
+        _exit(history_log_open(path) == 0 && history_log_append("git log", "/tmp", 0, 0, 5) == 0 ? 0 : 1);
+    }
+    assert(waitpid(pid, &status, 0) == pid && WEXITSTATUS(status) == 0);
+    assert(history_log_search("git", entries, 16) == 2);
+    assert(strcmp(entries[0].command, "git log") == 0 && entries[0].pid == pid);
+    assert(strcmp(entries[1].command, "git status") == 0 && entries[1].status == 3);
+    assert(history_log_recent(entries, 3) == 3);
+    assert(strcmp(entries[0].command, "git log") == 0);
+    assert(strcmp(entries[1].command, "git status") == 0);
+
+    // Compaction keeps the newest half and the index follows the new file
+    struct stat st;
+    assert(stat(path, &st) == 0);
+    char limit[32];
+    snprintf(limit, sizeof(limit), "%lld", (long long)st.st_size / 2);
+    setenv(HISTORY_MAX_BYTES_ENV, limit, 1);
+    assert(history_log_append("ls -l", "/", 0, 0, 1) == 0);
+    assert(stat(path, &st) == 0 && st.st_size <= atoll(limit) / 2 + 64);
+    size_t kept = history_log_count();
+    assert(kept > 0 && kept < 100);
+    assert(history_log_recent(entries, 1) == 1 && strcmp(entries[0].command, "ls -l") == 0);
+    assert(history_log_search("git", entries, 16) == 2);
+    assert(history_log_search("ls -l", entries, 16) == 1);
+
+    // A reopened file has the same records
+    history_log_close();
+    assert(history_log_open(path) == 0 && history_log_count() == kept);
+    unsetenv(HISTORY_MAX_BYTES_ENV);
+
+    // A writer killed mid-record: the torn tail is cut before the next append
+    assert(history_log_append("torn command", "/", 0, 0, 1) == 0);
+    history_log_close();
+    assert(stat(path, &st) == 0);
+    assert(truncate(path, st.st_size - 10) == 0);
+    assert(history_log_open(path) == 0 && history_log_count() == kept);
+    assert(history_log_append("after torn", "/", 0, 0, 1) == 0);
+    assert(history_log_count() == kept + 1);
+    history_log_close();
+    assert(history_log_open(path) == 0 && history_log_count() == kept + 1);
+    assert(history_log_recent(entries, 1) == 1 && strcmp(entries[0].command, "after torn") == 0);
+    assert(history_log_search("torn command", entries, 16) == 0);
+    history_log_close();
+
+    char command[BUFFER_SIZE];
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    assert(system(command) == 0);
+    unsetenv(HISTORY_MAX_BYTES_ENV);
+    printf("test_history_log passed successfully!\n");
+}
+
+/**
+ * @brief Counts the matches of a completion and frees them.
+ *
+ * @param line The line, completed at its end.
+ * @param expected If not NULL, the first match must be this one.
+ * @return The number of matches.
+ */
+static size_t count_completions(const char* line, const char* expected)
+{
+    const char* space = strrchr(line, ' ');
+    int start = space ? (int)(space - line) + 1 : 0;
+    char** matches = completion_matches(line, start, (int)strlen(line));
+    size_t count = 0;
+    if (matches)
+    {
+        assert(!expected || strcmp(matches[0], expected) == 0);
+        while (matches[count])
+        {
+            free(matches[count++]);
+        }
+        free(matches);
+    }
+    return count;
+}
+
+/**
+ * @brief Test for tab completion.
+ *
+ * Command names come from the built-ins and from an index of PATH that
+ * notices new executables, options from the built-in registry, and file
+ * names from cached listings that notice new files.
+ */
+void test_completion()
+{
+    char root[] = "/tmp/test_completion.XXXXXX";
+    assert(mkdtemp(root) != NULL);
+    char path[BUFFER_SIZE];
+    const char* files[] = {"bin/alpha", "bin/alpine", "bin/alps.txt", "dir/notes.txt", "dir/.hidden"};
+    snprintf(path, sizeof(path), "%s/bin", root);
+    assert(mkdir(path, 0755) == 0);
+    snprintf(path, sizeof(path), "%s/dir", root);
+    assert(mkdir(path, 0755) == 0);
+    snprintf(path, sizeof(path), "%s/dir/sub", root);
+    assert(mkdir(path, 0755) == 0);
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        FILE* file = fopen(path, "w");
+        assert(file != NULL);
+        fclose(file);
+        assert(chmod(path, strstr(files[i], ".txt") ? 0644 : 0755) == 0);
+    }
+    char* old_path = getenv("PATH") ? strdup(getenv("PATH")) : NULL;
+    snprintf(path, sizeof(path), "%s/bin", root);
+    setenv("PATH", path, 1);
+
+    // Executables only, built-ins included, in command position
+    assert(count_completions("alp", "alpha") == 2);
+    assert(count_completions("ls 2>&1 | alp", "alpha") == 2);
+    assert(count_completions("time alp", "alpha") == 2);
+    assert(count_completions("hist", "history") == 1);
+    snprintf(path, sizeof(path), "%s/bin/alpaca", root);
+    FILE* file = fopen(path, "w");
+    assert(file != NULL);
+    fclose(file);
+    assert(chmod(path, 0755) == 0);
+    assert(count_completions("alp", "alpaca") == 3);
+
+    // Options of a built-in
+    assert(count_completions("status_monitor --h", "--help") == 2);
+    assert(count_completions("history sea", "search") == 1);
+
+    // File names; directories end with '/' and only they follow cd
+    char line[BUFFER_SIZE];
+    snprintf(line, sizeof(line), "cat %s/dir/", root);
+    assert(count_completions(line, NULL) == 2);
+    snprintf(line, sizeof(line), "cat %s/dir/.", root);
+    assert(count_completions(line, NULL) == 1);
+    snprintf(line, sizeof(line), "cd %s/dir/", root);
+    snprintf(path, sizeof(path), "%s/dir/sub/", root);
+    assert(count_completions(line, path) == 1);
+    snprintf(path, sizeof(path), "%s/dir/new.txt", root);
+    file = fopen(path, "w");
+    assert(file != NULL);
+    fclose(file);
+    snprintf(line, sizeof(line), "cat %s/dir/n", root);
+    assert(count_completions(line, path) == 2);
+
+    if (old_path)
+    {
+        setenv("PATH", old_path, 1);
+        free(old_path);
+    }
+    completion_clear();
+    snprintf(line, sizeof(line), "rm -rf %s", root);
+    assert(system(line) == 0);
+    printf("test_completion passed successfully!\n");
+}
+
+/**
+ * @brief Joins the matches of a pattern with spaces and frees them.
+ *
+ * @param pattern The pattern.
+ * @param directory Where it is expanded.
+ * @param joined Receives the matches, or "" when there are none.
+ * @param size Room in joined.
+ * @return The number of matches.
+ */
+static long expand_joined(const char* pattern, const char* directory, char* joined, size_t size)
+{
+    char** matches;
+    long count = pathexp_expand(pattern, directory, &matches);
+    assert(count >= 0);
+    joined[0] = '\0';
+    for (long i = 0; i < count; i++)
+    {
+        snprintf(joined + strlen(joined), size - strlen(joined), "%s%s", i ? " " : "", matches[i]);
+        free(matches[i]);
+    }
+    free(matches);
+    return count;
+}
+
+/**
+ * @brief Test for pathname expansion.
+ *
+ * Checks `*`, `?`, classes, hidden files, `**` and a trailing '/' against a
+ * small tree, the byte order of the results, and that the parser expands
+ * only unquoted words and keeps a pattern that matches nothing.
+ */
+void test_pathexp()
+{
+    char root[] = "/tmp/test_pathexp.XXXXXX";
+    assert(mkdtemp(root) != NULL);
+    const char* dirs[] = {"src", "src/lib", "src/.cache", "docs"};
+    const char* files[] = {"a.c", "b.c", "B.h", "notes.txt", ".hidden.c", "src/main.c", "src/lib/util.c", "src/.cache/old.c", "docs/x1.md", "docs/x2.md", "docs/xa.md"};
+    char path[BUFFER_SIZE];
+    for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, dirs[i]);
+        assert(mkdir(path, 0755) == 0);
+    }
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", root, files[i]);
+        FILE* file = fopen(path, "w");
+        assert(file != NULL);
+        fclose(file);
+    }
+
+    char joined[BUFFER_SIZE];
+    assert(pathexp_has_magic("*.c") && pathexp_has_magic("x[0-9]") && !pathexp_has_magic("[") && !pathexp_has_magic("a-z"));
+    assert(expand_joined("*.c", root, joined, sizeof(joined)) == 2 && strcmp(joined, "a.c b.c") == 0);
+    assert(expand_joined(".*.c", root, joined, sizeof(joined)) == 1 && strcmp(joined, ".hidden.c") == 0);
+    assert(expand_joined("?.*", root, joined, sizeof(joined)) == 3 && strcmp(joined, "B.h a.c b.c") == 0);
+    assert(expand_joined("docs/x[0-9].md", root, joined, sizeof(joined)) == 2 && strcmp(joined, "docs/x1.md docs/x2.md") == 0);
+    assert(expand_joined("docs/x[!0-9].md", root, joined, sizeof(joined)) == 1 && strcmp(joined, "docs/xa.md") == 0);
+    assert(expand_joined("*/", root, joined, sizeof(joined)) == 2 && strcmp(joined, "docs/ src/") == 0);
+    assert(expand_joined("**/*.c", root, joined, sizeof(joined)) == 4 && strcmp(joined, "a.c b.c src/lib/util.c src/main.c") == 0);
+    assert(expand_joined("*.none", root, joined, sizeof(joined)) == 0);
+
+    // Absolute patterns give absolute paths
+    snprintf(path, sizeof(path), "%s/src/*.c", root);
+    assert(expand_joined(path, NULL, joined, sizeof(joined)) == 1);
+    snprintf(path, sizeof(path), "%s/src/main.c", root);
+    assert(strcmp(joined, path) == 0);
+
+    // The parser: unquoted words only, and no match keeps the word
+    char command[BUFFER_SIZE] = "ls *.c '*.c' \"d*\" d* *.none";
+    redir_t* redirs = NULL;
+    const char* error;
+    char** args = parse_command_quiet(command, &redirs, root, &error);
+    assert(args != NULL && error == NULL);
+    const char* expected[] = {"ls", "a.c", "b.c", "*.c", "d*", "docs", "*.none", NULL};
+    for (int i = 0; expected[i] || args[i]; i++)
+    {
+        assert(expected[i] && args[i] && strcmp(args[i], expected[i]) == 0);
+        free(args[i]);
+    }
+    free(args);
+    redir_free(redirs);
+
+    // Through the shell
+    snprintf(command, sizeof(command), "echo %s/docs/x?.md > %s/out", root, root);
+    assert(execute_command(command) == 1);
+    snprintf(path, sizeof(path), "%s/out", root);
+    FILE* file = fopen(path, "r");
+    assert(file != NULL);
+    char line[BUFFER_SIZE];
+    assert(fgets(line, sizeof(line), file) != NULL);
+    fclose(file);
+    snprintf(path, sizeof(path), "%s/docs/x1.md %s/docs/x2.md %s/docs/xa.md", root, root, root);
+    assert(strncmp(line, path, strlen(path)) == 0);
+
+    snprintf(command, sizeof(command), "rm -rf %s", root);
+    assert(system(command) == 0);
+    printf("test_pathexp passed successfully!\n");
+}
+
+/**
+ * @brief Main function to run all tests.
+ *
+ * This function calls each test function in sequence,
+ * printing a message before each test starts and asserting that all tests pass.
+ *
+ * @return 0 upon successful completion of all tests.
+ */
+int main()
+{
+    printf(PINK "\n\n==== Running test: test_cmd_cd ====\n" RESET);
+    test_cmd_cd();
+
+    printf(PINK "\n\n==== Running test: test_cmd_echo ====\n" RESET);
+    test_cmd_echo();
+
+    printf(PINK "\n\n==== Running test: test_cmd_quit ====\n" RESET);
+    test_cmd_quit();
+
+    printf(PINK "\n\n==== Running test: test_cmd_start_monitor ====\n" RESET);
+    test_cmd_start_monitor();
+
+    printf(PINK "\n\n==== Running test: test_cmd_stop_monitor ====\n" RESET);
+    test_cmd_stop_monitor();
+
+    printf(PINK "\n\n==== Running test: test_piped_commands ====\n" RESET);
+    test_piped_commands();
+
+    printf(PINK "\n\n==== Running test: test_heredoc ====\n" RESET);
+    test_heredoc();
+
+    printf(PINK "\n\n==== Running test: test_redirections ====\n" RESET);
+    test_redirections();
+
+    printf(PINK "\n\n==== Running test: test_process_substitution ====\n" RESET);
+    test_process_substitution();
+
+    printf(PINK "\n\n==== Running test: test_searchconfig_index ====\n" RESET);
+    test_searchconfig_index();
+
+    printf(PINK "\n\n==== Running test: test_searchconfig_pattern ====\n" RESET);
+    test_searchconfig_pattern();
+    printf(PINK "\n\n==== Running test: test_searchconfig_walk ====\n" RESET);
+    test_searchconfig_walk();
+
+    printf(PINK "\n\n==== Running test: test_metrics_shm ====\n" RESET);
+    test_metrics_shm();
+
+    printf(PINK "\n\n==== Running test: test_metric_record ====\n" RESET);
+    test_metric_record();
+
+    printf(PINK "\n\n==== Running test: test_status_monitor_watch ====\n" RESET);
+    test_status_monitor_watch();
+
+    printf(PINK "\n\n==== Running test: test_metrics_history ====\n" RESET);
+    test_metrics_history();
+
+    printf(PINK "\n\n==== Running test: test_metrics_archive ====\n" RESET);
+    test_metrics_archive();
+
+    printf(PINK "\n\n==== Running test: test_triggers ====\n" RESET);
+    test_triggers();
+
+    printf(PINK "\n\n==== Running test: test_monitor_supervisor ====\n" RESET);
+    test_monitor_supervisor();
+
+    printf(PINK "\n\n==== Running test: test_monitor_config ====\n" RESET);
+    test_monitor_config();
+
+    printf(PINK "\n\n==== Running test: test_metrics_demand ====\n" RESET);
+    test_metrics_demand();
+
+    printf(PINK "\n\n==== Running test: test_job_usage ====\n" RESET);
+    test_job_usage();
+
+    printf(PINK "\n\n==== Running test: test_shell_stats ====\n" RESET);
+    test_shell_stats();
+
+    printf(PINK "\n\n==== Running test: test_trace ====\n" RESET);
+    test_trace();
+
+    printf(PINK "\n\n==== Running test: test_shellcore ====\n" RESET);
+    test_shellcore();
+
+    printf(PINK "\n\n==== Running test: test_serve ====\n" RESET);
+    test_serve();
+
+    printf(PINK "\n\n==== Running test: test_memo ====\n" RESET);
+    test_memo();
+
+    printf(PINK "\n\n==== Running test: test_history_log ====\n" RESET);
+    test_history_log();
+
+    printf(PINK "\n\n==== Running test: test_completion ====\n" RESET);
+    test_completion();
+
+    printf(PINK "\n\n==== Running test: test_pathexp ====\n" RESET);
+    test_pathexp();
 
     return 0;
 }
@@ -0,0 +1,84 @@
+#define _GNU_SOURCE
+#include "serve.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CLIENT_MAX_ENV 64
+#define CLIENT_LINE_SIZE 8192
+#define CLIENT_FAILURE 255 // Como ssh: no se confunde con el de la linea
+
+/* Corre una linea en un 'shell --serve' con la entrada, la salida y el
+ * directorio de este proceso, y sale con su estado */
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [-C directory] [-e NAME=VALUE | -e NAME]... socket "
+          "command...\n",
+          name);
+  exit(CLIENT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  char *env[CLIENT_MAX_ENV + 1];
+  int env_count = 0;
+  char cwd[PATH_MAX];
+  const char *directory = NULL;
+
+  int option;
+  while ((option = getopt(argc, argv, "+C:e:")) != -1) {
+    switch (option) {
+    case 'C':
+      directory = optarg;
+      break;
+    case 'e':
+      if (env_count == CLIENT_MAX_ENV) {
+        fprintf(stderr, "%s: too many -e\n", argv[0]);
+        return CLIENT_FAILURE;
+      }
+      env[env_count++] = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  env[env_count] = NULL;
+  if (argc - optind < 2) {
+    usage(argv[0]);
+  }
+  if (!directory) {
+    directory = getcwd(cwd, sizeof(cwd)); // NULL: el del servidor
+  }
+
+  // Los argumentos se juntan en una linea, como los ve la shell
+  char line[CLIENT_LINE_SIZE] = "";
+  size_t length = 0;
+  for (int i = optind + 1; i < argc; i++) {
+    int written = snprintf(line + length, sizeof(line) - length, "%s%s",
+                           i > optind + 1 ? " " : "", argv[i]);
+    if (written < 0 || (size_t)written >= sizeof(line) - length) {
+      fprintf(stderr, "%s: command line too long\n", argv[0]);
+      return CLIENT_FAILURE;
+    }
+    length += written;
+  }
+
+  const char *path = argv[optind];
+  int sock = serve_connect(path);
+  if (sock == -1) {
+    fprintf(stderr, "%s: %s: ", argv[0], path);
+    perror(NULL);
+    return CLIENT_FAILURE;
+  }
+  int fds[SERVE_FDS] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+  int status;
+  if (serve_send_request(sock, directory, line, env, fds) == -1 ||
+      serve_recv_status(sock, &status) == -1) {
+    perror(argv[0]);
+    return CLIENT_FAILURE;
+  }
+  close(sock);
+  return status;
+}